@@ -4,16 +4,33 @@
 #define NULL 0
 #endif
 
+/** HeapIndex of a task that was taken from the heap because it is due */
+#define HEAP_INDEX_DUE -2
+
+#if (MTM_USE_HEAP == 1)
 #define TASK_NEW(task)     \
 	do                     \
 	{                      \
 		task = new Task_t; \
 	} while (0)
+#define TASK_DEL(task)       \
+	do                       \
+	{                        \
+		if (!task->Static)   \
+			delete task;     \
+	} while (0)
+#else
+#define TASK_NEW(task) \
+	do                 \
+	{                  \
+		task = NULL;   \
+	} while (0)
 #define TASK_DEL(task) \
 	do                 \
 	{                  \
-		delete task;   \
+		(void)task;    \
 	} while (0)
+#endif
 
 /**
  * @brief initialization task list
@@ -25,10 +42,14 @@ MillisTaskManager::MillisTaskManager(bool priorityEnable)
 	PriorityEnable = priorityEnable;
 	Head = NULL;
 	Tail = NULL;
+	NextID = 0;
+	HeapSize = 0;
+	DueNum = 0;
+	DueLeft = 0;
 }
 
 /**
- * @brief scheduler destructor, release task list memory
+ * @brief scheduler destructor, release task list memory, static task nodes are not freed
  * @param none
  * @retval None
  */
@@ -47,6 +68,7 @@ MillisTaskManager::~MillisTaskManager()
 
 /**
  * @brief Add a task to the task list and set the interval execution time
+ *        The task node is allocated on the heap, fails if MTM_USE_HEAP is 0
  * @param func: task function pointer
  * @param timeMs: cycle time setting (milliseconds)
  * @param state: task switch
@@ -57,20 +79,69 @@ MillisTaskManager::Task_t *MillisTaskManager::Register(TaskFunction_t func, uint
 	Task_t *task = Find(func);
 
 	if (task != NULL)
-	{
-		task->Time = timeMs;
-		task->State = state;
-		task->FirstExecut = true;
-		return task;
-	}
+		return Update(task, timeMs, state);
+
+	if (state && (HeapSize + DueLeft >= MTM_MAX_TASKS))
+		return NULL;
 
 	TASK_NEW(task);
 
 	if (task == NULL)
-	{
 		return NULL;
-	}
 
+	return Insert(task, func, timeMs, state, false);
+}
+
+/**
+ * @brief Add a task with a caller provided node to the task list and set the interval execution time
+ *        The node must stay valid while the task is registered, usually a static variable.
+ *        No heap allocation, the node memory is known at link time.
+ * @param task: task node, the content is initialized here
+ * @param func: task function pointer
+ * @param timeMs: cycle time setting (milliseconds)
+ * @param state: task switch
+ * @retval task node address, the already registered node if the function has been registered before
+ */
+MillisTaskManager::Task_t *MillisTaskManager::Register(Task_t *task, TaskFunction_t func, uint32_t timeMs, bool state)
+{
+	Task_t *found = Find(func);
+
+	if (found != NULL)
+		return Update(found, timeMs, state);
+
+	if ((task == NULL) || (state && (HeapSize + DueLeft >= MTM_MAX_TASKS)))
+		return NULL;
+
+	return Insert(task, func, timeMs, state, true);
+}
+
+/**
+ * @brief change interval and state of a registered task, it executes again like a new task
+ * @param task: task node address
+ * @param timeMs: cycle time setting (milliseconds)
+ * @param state: task switch
+ * @retval task node address
+ */
+MillisTaskManager::Task_t *MillisTaskManager::Update(Task_t *task, uint32_t timeMs, bool state)
+{
+	task->Time = timeMs;
+	task->FirstExecut = true;
+	SetState(task->Function, state);
+	HeapUpdate(task);
+	return task;
+}
+
+/**
+ * @brief initialize a task node and append it to the task list
+ * @param task: task node address
+ * @param func: task function pointer
+ * @param timeMs: cycle time setting (milliseconds)
+ * @param state: task switch
+ * @param isStatic: node memory provided by the caller
+ * @retval task node address
+ */
+MillisTaskManager::Task_t *MillisTaskManager::Insert(Task_t *task, TaskFunction_t func, uint32_t timeMs, bool state, bool isStatic)
+{
 	task->Function = func;
 	task->Time = timeMs;
 	task->State = state;
@@ -78,7 +149,22 @@ MillisTaskManager::Task_t *MillisTaskManager::Register(TaskFunction_t func, uint
 	task->TimePrev = 0;
 	task->TimeCost = 0;
 	task->TimeError = 0;
+	task->ID = NextID++;
+	task->HeapIndex = -1;
+	task->Static = isStatic;
 	task->Next = NULL;
+#if (MTM_USE_HISTOGRAM == 1)
+	for (uint8_t idx = 0; idx < MTM_HIST_BUCKETS; idx++)
+	{
+		task->CostHist[idx] = 0;
+		task->ErrorHist[idx] = 0;
+	}
+#endif
+
+	if (state)
+	{
+		HeapPush(task);
+	}
 
 	if (Head == NULL)
 	{
@@ -150,7 +236,7 @@ MillisTaskManager::Task_t *MillisTaskManager::GetPrev(Task_t *task)
 }
 
 /**
- * @brief logout task (use with caution, thread-unsafe)
+ * @brief logout task (use with caution, thread-unsafe), a static task node can be registered again
  * @param func: task function pointer
  * @retval true: success; false: failure
  */
@@ -160,20 +246,34 @@ bool MillisTaskManager::Logout(TaskFunction_t func)
 	if (task == NULL)
 		return false;
 
+	HeapRemove(task);
+
+	// Due or executing in the running scheduler pass, the node must not be used after delete
+	for (int16_t idx = 0; idx < DueNum; idx++)
+	{
+		if (Due[idx] == task)
+			Due[idx] = NULL;
+	}
+	if (task->HeapIndex == HEAP_INDEX_DUE)
+	{
+		task->HeapIndex = -1;
+		DueLeft--;
+	}
+
 	Task_t *prev = GetPrev(task);
 	Task_t *next = task->Next;
 
-	if (prev == NULL && next != NULL)
+	if (prev == NULL)
 	{
 		Head = next;
 	}
-	else if (prev != NULL && next == NULL)
+	else
 	{
-		prev->Next = NULL;
+		prev->Next = next;
 	}
-	else if (prev != NULL && next != NULL)
+	if (next == NULL)
 	{
-		prev->Next = next;
+		Tail = prev;
 	}
 	TASK_DEL(task);
 	return true;
@@ -191,6 +291,16 @@ bool MillisTaskManager::SetState(TaskFunction_t func, bool state)
 	if (task == NULL)
 		return false;
 
+	// A due task goes back into the heap at the end of its turn in Running, if it is still enabled
+	if (state && (task->HeapIndex == -1))
+	{
+		if (!HeapPush(task))
+			return false;
+	}
+	else if (!state)
+	{
+		HeapRemove(task);
+	}
 	task->State = state;
 	return true;
 }
@@ -208,6 +318,7 @@ bool MillisTaskManager::SetIntervalTime(TaskFunction_t func, uint32_t timeMs)
 		return false;
 
 	task->Time = timeMs;
+	HeapUpdate(task);
 	return true;
 }
 
@@ -224,6 +335,7 @@ bool MillisTaskManager::ReSetTaskTime(TaskFunction_t func, uint32_t timeMs)
 		return false;
 
 	task->TimePrev = timeMs;
+	HeapUpdate(task);
 	return true;
 }
 
@@ -249,6 +361,67 @@ float MillisTaskManager::GetCPU_Usage()
 }
 #endif
 
+/**
+ * @brief get the next node of the task
+ * @param task: task node address, NULL for the head of the list
+ * @retval next task node address, NULL at the end of the list
+ */
+MillisTaskManager::Task_t *MillisTaskManager::GetNext(Task_t *task)
+{
+	if (task == NULL)
+		return Head;
+
+	return task->Next;
+}
+
+#if (MTM_USE_HISTOGRAM == 1)
+/**
+ * @brief log2 histogram bucket of a value
+ * @param value: value
+ * @retval bucket, 0 for value 0, n for values from 2^(n-1) to 2^n - 1
+ */
+uint8_t MillisTaskManager::HistBucket(uint32_t value)
+{
+	uint8_t bucket = 0;
+	while ((value != 0) && (bucket < (MTM_HIST_BUCKETS - 1)))
+	{
+		value >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+/**
+ * @brief add a value to a histogram, the counters saturate
+ * @param hist: histogram with MTM_HIST_BUCKETS counters
+ * @param value: value
+ * @retval None
+ */
+void MillisTaskManager::HistAdd(uint16_t *hist, uint32_t value)
+{
+	uint8_t bucket = HistBucket(value);
+	if (hist[bucket] != 0xFFFF)
+		hist[bucket]++;
+}
+
+/**
+ * @brief clear the histograms of all tasks
+ * @param None
+ * @retval None
+ */
+void MillisTaskManager::ResetHistograms()
+{
+	for (Task_t *now = Head; now != NULL; now = now->Next)
+	{
+		for (uint8_t idx = 0; idx < MTM_HIST_BUCKETS; idx++)
+		{
+			now->CostHist[idx] = 0;
+			now->ErrorHist[idx] = 0;
+		}
+	}
+}
+#endif
+
 /**
  * @brief time difference judgment
  * @param nowTick: current time
@@ -286,52 +459,256 @@ uint32_t MillisTaskManager::GetTimeCost(TaskFunction_t func)
 	return task->TimeCost;
 }
 
+/**
+ * @brief deadline order of two tasks, tasks waiting for the first execution come first
+ *        deadlines are compared with the signed difference, intervals must be below 2^31 ms
+ * @param a: task node address
+ * @param b: task node address
+ * @retval true: task a is due before task b
+ */
+bool MillisTaskManager::HeapLess(Task_t *a, Task_t *b)
+{
+	if (a->FirstExecut != b->FirstExecut)
+	{
+		return a->FirstExecut;
+	}
+	int32_t diff = (int32_t)((a->TimePrev + a->Time) - (b->TimePrev + b->Time));
+	if (a->FirstExecut || (diff == 0))
+	{
+		return a->ID < b->ID;
+	}
+	return diff < 0;
+}
+
+/**
+ * @brief swap two heap entries
+ * @param a: heap index
+ * @param b: heap index
+ * @retval None
+ */
+void MillisTaskManager::HeapSwap(int16_t a, int16_t b)
+{
+	Task_t *task = Heap[a];
+	Heap[a] = Heap[b];
+	Heap[b] = task;
+	Heap[a]->HeapIndex = a;
+	Heap[b]->HeapIndex = b;
+}
+
+/**
+ * @brief move a heap entry up until its parent is due earlier
+ * @param idx: heap index
+ * @retval None
+ */
+void MillisTaskManager::HeapSiftUp(int16_t idx)
+{
+	while (idx > 0)
+	{
+		int16_t parent = (idx - 1) / 2;
+		if (!HeapLess(Heap[idx], Heap[parent]))
+			break;
+		HeapSwap(idx, parent);
+		idx = parent;
+	}
+}
+
+/**
+ * @brief move a heap entry down until its children are due later
+ * @param idx: heap index
+ * @retval None
+ */
+void MillisTaskManager::HeapSiftDown(int16_t idx)
+{
+	while (true)
+	{
+		int16_t first = idx;
+		int16_t left = 2 * idx + 1;
+		int16_t right = left + 1;
+		if ((left < HeapSize) && HeapLess(Heap[left], Heap[first]))
+			first = left;
+		if ((right < HeapSize) && HeapLess(Heap[right], Heap[first]))
+			first = right;
+		if (first == idx)
+			break;
+		HeapSwap(idx, first);
+		idx = first;
+	}
+}
+
+/**
+ * @brief add a task to the deadline heap, nothing changes if the task is in the heap already
+ * @param task: task node address
+ * @retval true: success; false: heap is full
+ */
+bool MillisTaskManager::HeapPush(Task_t *task)
+{
+	// Already scheduled, a task is never in the heap twice
+	if (task->HeapIndex >= 0)
+		return true;
+
+	// Room is kept for the due tasks that go back into the heap
+	if (HeapSize + DueLeft >= MTM_MAX_TASKS)
+		return false;
+
+	task->HeapIndex = HeapSize;
+	Heap[HeapSize++] = task;
+	HeapSiftUp(task->HeapIndex);
+	return true;
+}
+
+/**
+ * @brief remove a task from the deadline heap, a due task taken out by Running is not changed
+ * @param task: task node address
+ * @retval None
+ */
+void MillisTaskManager::HeapRemove(Task_t *task)
+{
+	int16_t idx = task->HeapIndex;
+	if (idx < 0)
+		return;
+
+	task->HeapIndex = -1;
+	HeapSize--;
+	if (idx == HeapSize)
+		return;
+
+	Task_t *moved = Heap[HeapSize];
+	Heap[idx] = moved;
+	moved->HeapIndex = idx;
+	HeapUpdate(moved);
+}
+
+/**
+ * @brief restore the heap order after the deadline of a task changed
+ * @param task: task node address
+ * @retval None
+ */
+void MillisTaskManager::HeapUpdate(Task_t *task)
+{
+	if (task->HeapIndex < 0)
+		return;
+
+	HeapSiftUp(task->HeapIndex);
+	HeapSiftDown(task->HeapIndex);
+}
+
+/**
+ * @brief time until the next task is due
+ * @param tick: provide a system clock variable accurate to milliseconds
+ * @retval time in ms, 0 if a task is due, 0xFFFFFFFF if no task is enabled
+ */
+uint32_t MillisTaskManager::NextDeadline(uint32_t tick)
+{
+	if (HeapSize == 0)
+		return 0xFFFFFFFF;
+
+	Task_t *task = Heap[0];
+	if (task->FirstExecut)
+		return 0;
+
+	uint32_t elapsTime = GetTickElaps(tick, task->TimePrev);
+	if (elapsTime >= task->Time)
+		return 0;
+
+	return task->Time - elapsTime;
+}
+
 /**
  * @brief scheduler (kernel)
+ *        Only the due tasks are taken from the deadline heap, they are executed in registration order.
+ *        With priority enabled only the due task with the highest priority is executed.
+ *        A task can disable, enable or logout itself or other tasks, a due task that was disabled or
+ *        logged out before its turn is not executed.
  * @param tick: provide a system clock variable accurate to milliseconds
  * @retval None
  */
 void MillisTaskManager::Running(uint32_t tick)
 {
-	Task_t *now = Head;
-	while (true)
+	// Take all due tasks from the heap
+	DueNum = 0;
+	while (HeapSize > 0)
 	{
-		if (now == NULL)
-		{
+		Task_t *now = Heap[0];
+		if (!now->FirstExecut && (GetTickElaps(tick, now->TimePrev) < now->Time))
 			break;
+
+		HeapRemove(now);
+		now->HeapIndex = HEAP_INDEX_DUE;
+
+		// Sort by registration order
+		int16_t pos = DueNum++;
+		while ((pos > 0) && (Due[pos - 1]->ID > now->ID))
+		{
+			Due[pos] = Due[pos - 1];
+			pos--;
 		}
+		Due[pos] = now;
+	}
+	DueLeft = DueNum;
+
+	bool executed = false;
+	for (int16_t idx = 0; idx < DueNum; idx++)
+	{
+		Task_t *now = Due[idx];
 
-		if (now->Function != NULL && now->State)
+		// Logged out by a task that was executed before
+		if (now == NULL)
+			continue;
+
+		now->HeapIndex = -1;
+		DueLeft--;
+
+		// Disabled by a task that was executed before
+		if (!now->State)
+			continue;
+
+		if (PriorityEnable && executed)
 		{
-			uint32_t elapsTime = GetTickElaps(tick, now->TimePrev);
-			if ((elapsTime >= now->Time) || (now->FirstExecut == true))
-			{
-				now->FirstExecut = false;
+			// Not executed, back into the heap unchanged
+			HeapPush(now);
+			continue;
+		}
+		executed = true;
 
-				now->TimeError = elapsTime - now->Time;
+		uint32_t elapsTime = GetTickElaps(tick, now->TimePrev);
 
-				now->TimePrev = tick;
+#if (MTM_USE_HISTOGRAM == 1)
+		if (!now->FirstExecut)
+			HistAdd(now->ErrorHist, elapsTime - now->Time);
+#endif
+
+		now->FirstExecut = false;
+
+		now->TimeError = elapsTime - now->Time;
+
+		now->TimePrev = tick;
+
+		HeapPush(now);
+
+		if (now->Function == NULL)
+			continue;
 
 #if (MTM_USE_CPU_USAGE == 1)
-				uint32_t start = micros();
+		uint32_t start = micros();
+
+		now->Function();
 
-				now->Function();
+		uint32_t timeCost = micros() - start;
 
-				uint32_t timeCost = micros() - start;
+		UserFuncLoopUs += timeCost;
 
-				now->TimeCost = timeCost;
+		// Logged out itself
+		if (Due[idx] == NULL)
+			continue;
 
-				UserFuncLoopUs += timeCost;
+		now->TimeCost = timeCost;
+
+#if (MTM_USE_HISTOGRAM == 1)
+		HistAdd(now->CostHist, timeCost);
+#endif
 #else
-				now->Function();
+		now->Function();
 #endif
-				if (PriorityEnable)
-				{
-					break;
-				}
-			}
-		}
-
-		now = now->Next;
 	}
+	DueNum = 0;
 }
@@ -15,6 +15,14 @@
 			Add anti-collision judgment to TaskRegister
 			Add TimeCost task time cost calculation
 			Use singly linked list to manage tasks, add GetTickElaps to handle uint32 overflow, add time error records
+  * @Upgrade 2025.1.5
+			Enabled tasks are kept in a binary heap ordered by deadline, Running only touches due tasks
+			Add NextDeadline() to get the time until the next task is due
+			Fix Logout of the only or the last task in the list
+			Add log2 histograms of the task cost and time error
+			Add Register with a caller provided static task node, no heap allocation
+			MTM_USE_HEAP 0 removes new/delete, only static task nodes can be registered
+			Fix SetState, Register and Logout from a task on another task that is due in the same Running call
   **************************************************** ****************************
   * @attention
   * You need to provide a system clock accurate to the millisecond level, and then call the Running function periodically
@@ -25,6 +33,20 @@
 #define __MILLISTASKMANAGER_H
 
 #define MTM_USE_CPU_USAGE 1
+#define MTM_USE_HISTOGRAM 1
+
+/** 1 = Register(func, ...) allocates the task node with new, 0 = only static task nodes */
+#ifndef MTM_USE_HEAP
+#define MTM_USE_HEAP 1
+#endif
+
+/** Number of log2 histogram buckets, bucket n counts values from 2^(n-1) to 2^n - 1, the last bucket is open ended */
+#define MTM_HIST_BUCKETS 16
+
+/** Max number of enabled tasks in the deadline heap, can be set by the build, e.g. for host benchmarks */
+#ifndef MTM_MAX_TASKS
+#define MTM_MAX_TASKS 16
+#endif
 
 #include "stdint.h"
 
@@ -41,6 +63,13 @@ public:
 		uint32_t TimePrev;		 // The last trigger time of the task.
 		uint32_t TimeCost;		 // Task cost (us) time.
 		uint32_t TimeError;		 // Error time.
+		uint16_t ID;			 // Registration order, smaller ID = higher priority.
+		int16_t HeapIndex;		 // Position in the deadline heap, -1 if not scheduled, -2 while due in Running.
+		bool Static;			 // Node memory provided by the caller, not freed.
+#if (MTM_USE_HISTOGRAM == 1)
+		uint16_t CostHist[MTM_HIST_BUCKETS];  // Task cost (us) histogram.
+		uint16_t ErrorHist[MTM_HIST_BUCKETS]; // Error time (ms) histogram.
+#endif
 		struct Task *Next;		 // next node.
 	};
 	typedef struct Task Task_t;
@@ -49,8 +78,10 @@ public:
 	~MillisTaskManager();
 
 	Task_t *Register(TaskFunction_t func, uint32_t timeMs, bool state = true);
+	Task_t *Register(Task_t *task, TaskFunction_t func, uint32_t timeMs, bool state = true);
 	Task_t *Find(TaskFunction_t func);
 	Task_t *GetPrev(Task_t *task);
+	Task_t *GetNext(Task_t *task);
 	bool Logout(TaskFunction_t func);
 	bool SetState(TaskFunction_t func, bool state);
 	bool SetIntervalTime(TaskFunction_t func, uint32_t timeMs);
@@ -59,13 +90,35 @@ public:
 	uint32_t GetTickElaps(uint32_t nowTick, uint32_t prevTick);
 #if (MTM_USE_CPU_USAGE == 1)
 	float GetCPU_Usage();
+#endif
+#if (MTM_USE_HISTOGRAM == 1)
+	static uint8_t HistBucket(uint32_t value);
+	static void HistAdd(uint16_t *hist, uint32_t value);
+	void ResetHistograms();
 #endif
 	void Running(uint32_t tick);
+	uint32_t NextDeadline(uint32_t tick);
 
 private:
-	Task_t *Head;		 // Task list header.
-	Task_t *Tail;		 // Tail of the task list.
-	bool PriorityEnable; // Priority enable.
+	Task_t *Update(Task_t *task, uint32_t timeMs, bool state);
+	Task_t *Insert(Task_t *task, TaskFunction_t func, uint32_t timeMs, bool state, bool isStatic);
+	bool HeapLess(Task_t *a, Task_t *b);
+	void HeapSwap(int16_t a, int16_t b);
+	void HeapSiftUp(int16_t idx);
+	void HeapSiftDown(int16_t idx);
+	bool HeapPush(Task_t *task);
+	void HeapRemove(Task_t *task);
+	void HeapUpdate(Task_t *task);
+
+	Task_t *Head;				 // Task list header.
+	Task_t *Tail;				 // Tail of the task list.
+	bool PriorityEnable;		 // Priority enable.
+	uint16_t NextID;			 // ID of the next registered task.
+	Task_t *Heap[MTM_MAX_TASKS]; // Enabled tasks, ordered by deadline.
+	int16_t HeapSize;			 // Number of tasks in the heap.
+	Task_t *Due[MTM_MAX_TASKS];	 // Due tasks of the current Running call.
+	int16_t DueNum;				 // Number of due tasks of the current Running call.
+	int16_t DueLeft;			 // Due tasks that are not back in the heap yet.
 };
 
 #endif
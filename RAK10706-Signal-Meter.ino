@@ -49,18 +49,9 @@ bool lorawan_mode = true;
 bool has_oled = false;
 /** Buffer for OLED output */
 char line_str[256];
-/** Flag for display handler */
-uint8_t display_reason;
-
 /** Task Manager for button press */
 MillisTaskManager mtmMain;
 
-/** LoRaWAN packet (used for FieldTester Mode only) */
-WisCayenne g_solution_data(255);
-
-/** Buffer for FieldTester downlink */
-uint8_t field_tester_pckg[32];
-
 /** Flag for GNSS readings active */
 bool gnss_active = false;
 
@@ -88,19 +79,27 @@ uint32_t receiver_node = 0;
 uint32_t sender_node = 0;
 
 /**
- * @brief Send a LoRaWAN packet
+ * @brief Prepare and send the packet of a test cycle
+ *        Called by the test cycle when it starts, tx_active is false if nothing was handed to the stack
  *
- * @param data unused
  */
-void send_packet(void *data)
+void send_test_packet(void)
 {
 	tx_active = true;
 	ready_to_dump = false;
 
+	// Check duty cycle, defer the uplink to the next legal slot
+	if (api.lorawan.nwm.get() && !dc_check())
+	{
+		tx_active = false;
+		ready_to_dump = true;
+		return;
+	}
+
 	if ((g_custom_parameters.test_mode == MODE_FIELDTESTER) || (g_custom_parameters.test_mode == MODE_FIELDTESTER_V2))
 	{
 		// Clear payload
-		g_solution_data.reset();
+		tx_payload_reset();
 
 		if (g_custom_parameters.location_on)
 		{
@@ -130,7 +129,7 @@ void send_packet(void *data)
 						api.lorawan.timereq.set(1);
 					}
 					// Check if packet size fits DR
-					if (!check_dr(g_custom_parameters.custom_packet_len))
+					if (!tx_buffer_check_dr(g_tx_payload))
 					{
 						return;
 					}
@@ -138,7 +137,7 @@ void send_packet(void *data)
 					// Always send confirmed packet to make sure a reply is received
 					MYLOG("GNSS", "Send from send_packet FieldTester poll success fPort %d", fPort);
 					// Serial.println("+EVT:>>>>>>>>");
-					if (!api.lorawan.send(g_solution_data.getSize(), g_solution_data.getBuffer(), fPort, true, 0))
+					if (!tx_send(g_tx_payload, fPort))
 					{
 						MYLOG("APP", "LoRaWAN send returned error");
 						tx_active = false;
@@ -158,14 +157,7 @@ void send_packet(void *data)
 							oled_add_line(line_str);
 						}
 						// If forced TX, send whether we have location or not 143050416, 1206306357
-						if (g_custom_parameters.test_mode == MODE_FIELDTESTER_V2)
-						{
-							g_solution_data.addGNSS_T2(0, 0, (int16_t)packet_num);
-						}
-						else
-						{
-							g_solution_data.addGNSS_T(0, 0, 0, 1, 0);
-						}
+						tx_buffer_add_gnss(g_tx_payload, 0, 0, 0, 1.0, 0);
 
 						// Get gateway time
 						if (sync_time_status == 0)
@@ -175,14 +167,14 @@ void send_packet(void *data)
 						}
 
 						// Check if packet size fits DR
-						if (!check_dr(g_custom_parameters.custom_packet_len))
+						if (!tx_buffer_check_dr(g_tx_payload))
 						{
 							return;
 						}
 
 						MYLOG("GNSS", "Send from send_packet FieldTester forced fPort %d", fPort);
 						// Serial.println("+EVT:>>>>>>>>");
-						if (!api.lorawan.send(g_solution_data.getSize(), g_solution_data.getBuffer(), fPort, true, 0))
+						if (!tx_send(g_tx_payload, fPort))
 						{
 							tx_active = false;
 							MYLOG("GNSS", "LoRaWAN send returned error");
@@ -197,18 +189,8 @@ void send_packet(void *data)
 					}
 					else // Wait for location fix
 					{
-						// Start checking for valid location
-						// Set flag for GNSS active to avoid retrigger */
-						gnss_active = true;
-						g_solution_data.reset();
-						check_gnss_counter = 0;
-						// Max location aquisition time is half of send frequency
-						check_gnss_max_try = g_custom_parameters.send_interval / 2 / 2500;
-						// Reset satellites check values
-						max_sat = 0;
-						max_sat_unchanged = 0;
-						// Start the timer
-						api.system.timer.start(RAK_TIMER_3, 2500, NULL);
+						// The test cycle starts the location acquisition and ends it after its timeout
+						cycle_event(CEV_ACQUIRE);
 					}
 				}
 			}
@@ -247,14 +229,7 @@ void send_packet(void *data)
 				oled_add_line((char *)"Indoor test");
 			}
 			// Location is switched off, send indoor test packet
-			if (g_custom_parameters.test_mode == MODE_FIELDTESTER_V2)
-			{
-				g_solution_data.addGNSS_T2(0, 0, (int16_t)packet_num);
-			}
-			else
-			{
-				g_solution_data.addGNSS_T(0, 0, 0, 1.0, 0);
-			}
+			tx_buffer_add_gnss(g_tx_payload, 0, 0, 0, 1.0, 0);
 
 			// Get gateway time
 			if (sync_time_status == 0)
@@ -264,7 +239,7 @@ void send_packet(void *data)
 			}
 
 			// Check if packet size fits DR
-			if (!check_dr(g_custom_parameters.custom_packet_len))
+			if (!tx_buffer_check_dr(g_tx_payload))
 			{
 				return;
 			}
@@ -272,7 +247,7 @@ void send_packet(void *data)
 			// Always send confirmed packet to make sure a reply is received
 			MYLOG("APP", "Send from send_packet FieldTester location off fPort %d", fPort);
 			// Serial.println("+EVT:>>>>>>>>");
-			if (!api.lorawan.send(g_solution_data.getSize(), g_solution_data.getBuffer(), fPort, true, 0))
+			if (!tx_send(g_tx_payload, fPort))
 			{
 				MYLOG("APP", "LoRaWAN send returned error");
 				tx_active = false;
@@ -290,7 +265,7 @@ void send_packet(void *data)
 			forced_tx = false;
 		}
 
-		g_solution_data.reset();
+		tx_payload_reset();
 
 		if (api.lorawan.nwm.get())
 		{
@@ -318,22 +293,71 @@ void send_packet(void *data)
 					api.lorawan.timereq.set(1);
 				}
 				// Always send confirmed packet to make sure a reply is received
-				if (g_custom_parameters.location_on)
+				if (g_custom_parameters.location_on && (g_custom_parameters.batch_samples > 1) && !dr_sweep_active)
+				{
+					// Collect samples and send them in one packet
+					if (!poll_gnss())
+					{
+						oled_add_line((char *)"No location, sample skipped");
+						tx_active = false;
+						ready_to_dump = true;
+						return;
+					}
+					if (!batch_add_sample(g_last_lat_raw, g_last_long_raw, g_last_altitude, last_rssi, last_snr, link_check_gateways))
+					{
+						sprintf(line_str, "Sample %d of %d", g_batch_count, g_custom_parameters.batch_samples);
+						oled_add_line(line_str);
+						tx_active = false;
+						ready_to_dump = true;
+						return;
+					}
+
+					// Check if packet size fits DR
+					if (!tx_buffer_check_dr(g_batch_payload))
+					{
+						batch_reset();
+						return;
+					}
+					MYLOG("GNSS", "Send batch of %d samples fPort %d", g_batch_count, BATCH_FPORT);
+					if (!tx_send(g_batch_payload, BATCH_FPORT))
+					{
+						tx_active = false;
+						MYLOG("APP", "LoRaWAN send returned error");
+						ready_to_dump = true;
+					}
+					batch_reset();
+					// Increase sent packet number
+					packet_num++;
+				}
+				else if (g_custom_parameters.location_on)
 				{
 					if (!poll_gnss())
 					{
 						g_last_long = 0.0;
 						g_last_lat = 0.0;
-						g_solution_data.addGNSS_T(0, 0, 0, 0, 0);
+						tx_buffer_add_gnss(g_tx_payload, 0, 0, 0, 0, 0);
 					}
 
 					// Check if packet size fits DR
-					if (!check_dr(g_solution_data.getSize()))
+					if (!tx_buffer_check_dr(g_tx_payload))
 					{
 						return;
 					}
 					MYLOG("GNSS", "Send from send_packet LinkCheck location on fPort %d", fPort);
-					if (!api.lorawan.send(g_solution_data.getSize(), g_solution_data.getBuffer(), fPort, true, 0))
+					if (!tx_send(g_tx_payload, fPort))
+					{
+						tx_active = false;
+						MYLOG("APP", "LoRaWAN send returned error");
+						ready_to_dump = true;
+					}
+					// Increase sent packet number
+					packet_num++;
+				}
+				else if (frag_needed())
+				{
+					// Custom packet is too large for the DR, send it in fragments
+					MYLOG("APP", "Send fragment fPort %d", FRAG_FPORT);
+					if (!frag_send())
 					{
 						tx_active = false;
 						MYLOG("APP", "LoRaWAN send returned error");
@@ -345,13 +369,13 @@ void send_packet(void *data)
 				else
 				{
 					// Check if packet size fits DR
-					if (!check_dr(g_custom_parameters.custom_packet_len))
+					if (!tx_buffer_check_dr(tx_custom_payload()))
 					{
 						return;
 					}
 					MYLOG("GNSS", "Send from send_packet LinkCheck location off fPort %d", fPort);
 					// Serial.println("+EVT:>>>>>>>>");
-					if (!api.lorawan.send(g_custom_parameters.custom_packet_len, g_custom_parameters.custom_packet, fPort, true, 0))
+					if (!tx_send(&g_custom_payload, fPort))
 					{
 						tx_active = false;
 						MYLOG("APP", "LoRaWAN send returned error");
@@ -375,6 +399,8 @@ void send_packet(void *data)
 			oled_add_line((char *)"Start sending");
 
 			// Always send with CAD
+			trace_add(TEV_TX_START, 0, g_custom_parameters.custom_packet_len);
+			energy_state(EN_TX, true);
 			api.lora.psend(g_custom_parameters.custom_packet_len, g_custom_parameters.custom_packet, false); //, true);
 			tx_active = true;
 			// Increase sent packet number
@@ -384,9 +410,25 @@ void send_packet(void *data)
 }
 
 /**
- * @brief Display handler
+ * @brief Start a test cycle, the test cycle sends the packet
+ *        While the last test cycle is not finished, the test is skipped
+ *
+ * @param data unused
+ */
+void send_packet(void *data)
+{
+	if (!cycle_event(CEV_START))
+	{
+		MYLOG("APP", "Test cycle in %s, test skipped", cycle_state_names[cycle_get_state()]);
+		forced_tx = false;
+	}
+}
+
+/**
+ * @brief Show the result of an event on the display and write it to the SD card
  *
- * @param reason 1 = RX packet display (only P2P mode)
+ * @param event event with reason and results
+ *        reason 1 = RX packet display (only P2P mode)
  *               2 = TX failed display (only LPW LinkCheck mode)
  *               3 = Join failed (only LPW mode)
  *               4 = Linkcheck result display (only LPW LinkCheck mode)
@@ -395,56 +437,14 @@ void send_packet(void *data)
  *               7 = FieldTester no downlink packet (only FieldTester mode )
  *               8 = P2P TX finished (only P2P mode)
  */
-void handle_display(void *reason)
+static void display_event(app_event_s *event)
 {
-	// Update date and time if synced with LNS
-	if (sync_time_status == 1)
-	{
-		sync_time_status = 2;
-
-		struct tm localtime;
-		SysTime_t UnixEpoch = SysTimeGet();
-		UnixEpoch.Seconds -= 18;												/*removing leap seconds*/
-		UnixEpoch.Seconds += (int32_t)(g_custom_parameters.timezone * 60 * 60); // Make it GMT+8
-		SysTimeLocalTime(UnixEpoch.Seconds, &localtime);
-		MYLOG("APP", "LNS Time %d %d %d %d:%d:%d\n", localtime.tm_year + 1900, localtime.tm_mon + 1,
-			  localtime.tm_mday, localtime.tm_hour,
-			  localtime.tm_min, localtime.tm_sec);
-
-		g_date_time.year = localtime.tm_year + 1900;
-		g_date_time.month = localtime.tm_mon + 1;
-		g_date_time.date = localtime.tm_mday;
-		g_date_time.hour = localtime.tm_hour;
-		g_date_time.minute = localtime.tm_min;
-		g_date_time.second = localtime.tm_sec;
-		if (has_rtc)
-		{
-			MYLOG("APP", "Sync RTC with LoRaWAN");
-			set_rak12002(g_date_time.year, g_date_time.month, g_date_time.date, g_date_time.hour, g_date_time.minute, g_date_time.second);
-			read_rak12002();
-			MYLOG("APP", "After sync: %d %d %d %d:%d:%d\n", g_date_time.year, g_date_time.month,
-				  g_date_time.date, g_date_time.hour,
-				  g_date_time.minute, g_date_time.second);
-		}
-	}
-
-	digitalWrite(LED_BLUE, LOW);
-	digitalWrite(LED_GREEN, LOW);
-	// Get the wakeup reason
-	uint8_t *disp_reason = (uint8_t *)reason;
-
-	// Check if we have a reason
-	if (disp_reason == NULL)
-	{
-		MYLOG("APP", "Bug in code!");
-		return;
-	}
-
-	switch (disp_reason[0])
+	trace_add(TEV_DISPLAY, event->reason, millis() - event->time);
+	switch (event->reason)
 	{
 	case 1: // RX packet display (only P2P mode)
 		prepare_oled_header();
-		// MYLOG("APP", "RX_EVENT %d, disp_reason[0]);
+		// MYLOG("APP", "RX_EVENT %d, event->reason);
 		// RX event display
 		if (has_sd)
 		{
@@ -468,19 +468,19 @@ void handle_display(void *reason)
 			result.lng = g_last_long;
 			result.min_rssi = 0;
 			result.max_rssi = 0;
-			result.rx_rssi = last_rssi;
-			result.rx_snr = last_snr;
+			result.rx_rssi = event->rssi;
+			result.rx_snr = event->snr;
 			result.min_dst = 0;
 			result.max_dst = 0;
 			result.demod = 0;
-			result.lost = packet_lost;
+			result.lost = event->packet_lost;
 			write_sd_entry();
 		}
 		if (has_oled && !g_settings_ui)
 		{
 			sprintf(line_str, "LoRa P2P mode");
 			oled_write_line(0, 0, line_str);
-			sprintf(line_str, "Received packets %d", packet_num);
+			sprintf(line_str, "Received packets %d", event->packet_num);
 			oled_write_line(1, 0, line_str);
 			sprintf(line_str, "F %.3f", (api.lora.pfreq.get() / 1000000.0));
 			oled_write_line(2, 0, line_str);
@@ -528,14 +528,14 @@ void handle_display(void *reason)
 			oled_write_line(3, 64, line_str);
 			sprintf(line_str, "CR 4/%d", api.lora.pcr.get() + 5);
 			oled_write_line(2, 64, line_str);
-			sprintf(line_str, "RSSI %d", last_rssi);
+			sprintf(line_str, "RSSI %d", event->rssi);
 			oled_write_line(4, 0, line_str);
-			sprintf(line_str, "SNR %d", last_snr);
+			sprintf(line_str, "SNR %d", event->snr);
 			oled_write_line(4, 64, line_str);
 			oled_display();
 		}
 		MYLOG("APP", "LPW P2P mode");
-		MYLOG("APP", "Packet # %d RSSI %d SNR %d", packet_num, last_rssi, last_snr);
+		MYLOG("APP", "Packet # %d RSSI %d SNR %d", event->packet_num, event->rssi, event->snr);
 		MYLOG("APP", "F %.3f SF %d BW %d",
 			  (float)api.lora.pfreq.get() / 1000000.0,
 			  api.lora.psf.get(),
@@ -572,7 +572,7 @@ void handle_display(void *reason)
 			result.min_dst = 0;
 			result.max_dst = 0;
 			result.demod = 0;
-			result.lost = packet_lost;
+			result.lost = event->packet_lost;
 			result.tx_dr = api.lorawan.dr.get();
 			write_sd_entry();
 		}
@@ -580,9 +580,9 @@ void handle_display(void *reason)
 		{
 			sprintf(line_str, "LinkCheck Mode");
 			oled_write_line(0, 0, line_str);
-			sprintf(line_str, "TX Error ", tx_fail_status);
+			sprintf(line_str, "TX Error ", event->status);
 			oled_write_line(2, 0, line_str);
-			switch (tx_fail_status)
+			switch (event->status)
 			{
 			case RAK_LORAMAC_STATUS_ERROR:
 				sprintf(line_str, "Service error");
@@ -642,7 +642,7 @@ void handle_display(void *reason)
 		break;
 	case 3: // Join failed(only LPW mode)
 		prepare_oled_header();
-		// MYLOG("APP", "JOIN_ERROR %d\n", disp_reason[0]);
+		// MYLOG("APP", "JOIN_ERROR %d\n", event->reason);
 		if (has_oled && !g_settings_ui)
 		{
 			switch (g_custom_parameters.test_mode)
@@ -657,7 +657,7 @@ void handle_display(void *reason)
 				oled_write_line(0, 0, (char *)"FieldTester V2 mode");
 				break;
 			}
-			sprintf(line_str, "Test interval  %lds", g_custom_parameters.send_interval / 1000);
+			sprintf(line_str, "Test interval  %lds", get_send_period() / 1000);
 			oled_write_line(1, 0, line_str);
 			oled_write_line(2, 0, (char *)" ");
 			sprintf(line_str, "Join failed");
@@ -668,7 +668,7 @@ void handle_display(void *reason)
 		break;
 	case 4: // Linkcheck result display(only LPW LinkCheck mode)
 		prepare_oled_header();
-		// MYLOG("APP", "LINK_CHECK %d\n", disp_reason[0]);
+		// MYLOG("APP", "LINK_CHECK %d\n", event->reason);
 		// LinkCheck result event display
 		if (has_sd)
 		{
@@ -687,51 +687,51 @@ void handle_display(void *reason)
 			result.min = g_date_time.minute;
 			result.sec = g_date_time.second;
 			result.mode = MODE_LINKCHECK;
-			result.gw = link_check_gateways;
+			result.gw = event->gateways;
 			result.lat = g_last_lat;
 			result.lng = g_last_long;
-			result.min_rssi = last_rssi;
-			result.max_rssi = last_rssi;
-			result.rx_rssi = last_rssi;
-			result.rx_snr = last_snr;
+			result.min_rssi = event->rssi;
+			result.max_rssi = event->rssi;
+			result.rx_rssi = event->rssi;
+			result.rx_snr = event->snr;
 			result.min_dst = 0;
 			result.max_dst = 0;
-			result.demod = link_check_demod_margin;
-			result.lost = packet_lost;
+			result.demod = event->demod;
+			result.lost = event->packet_lost;
 			result.tx_dr = api.lorawan.dr.get();
 			write_sd_entry();
 		}
 		if (has_oled && !g_settings_ui)
 		{
-			sprintf(line_str, "LPW LinkCheck %s", link_check_state == 0 ? "OK" : "NOK");
+			sprintf(line_str, "LPW LinkCheck %s", event->link_state == 0 ? "OK" : "NOK");
 			oled_write_line(0, 0, line_str);
 
-			if (link_check_state == 0)
+			if (event->link_state == 0)
 			{
-				sprintf(line_str, "UL Demod Margin  %d", link_check_demod_margin);
+				sprintf(line_str, "UL Demod Margin  %d", event->demod);
 				oled_write_line(1, 0, line_str);
 				sprintf(line_str, "UL DR %d", api.lorawan.dr.get());
 				oled_write_line(2, 0, line_str);
-				sprintf(line_str, "%d GW(s)", link_check_gateways);
+				sprintf(line_str, "%d GW(s)", event->gateways);
 				oled_write_line(2, 64, line_str);
-				sprintf(line_str, "Sent %d", packet_num);
+				sprintf(line_str, "Sent %d", event->packet_num);
 				oled_write_line(3, 0, line_str);
-				sprintf(line_str, "Lost %d", packet_lost);
+				sprintf(line_str, "Lost %d", event->packet_lost);
 				oled_write_line(3, 64, line_str);
-				sprintf(line_str, "DL RSSI %d", last_rssi);
+				sprintf(line_str, "DL RSSI %d", event->rssi);
 				oled_write_line(4, 0, line_str);
-				sprintf(line_str, "DL SNR %d", last_snr);
+				sprintf(line_str, "DL SNR %d", event->snr);
 				oled_write_line(4, 64, line_str);
 			}
 			else
 			{
-				sprintf(line_str, "Sent %d", packet_num);
+				sprintf(line_str, "Sent %d", event->packet_num);
 				oled_write_line(1, 0, line_str);
-				sprintf(line_str, "Lost %d", packet_lost);
+				sprintf(line_str, "Lost %d", event->packet_lost);
 				oled_write_line(1, 64, line_str);
-				sprintf(line_str, "LinkCheck result %d ", link_check_state);
+				sprintf(line_str, "LinkCheck result %d ", event->link_state);
 				oled_write_line(2, 0, line_str);
-				switch (link_check_state)
+				switch (event->link_state)
 				{
 				case RAK_LORAMAC_STATUS_ERROR:
 					sprintf(line_str, "Service error");
@@ -793,13 +793,13 @@ void handle_display(void *reason)
 			}
 			oled_display();
 		}
-		MYLOG("APP", "LinkCheck %s", link_check_state == 0 ? "OK" : "NOK");
-		MYLOG("APP", "Packet # %d RSSI %d SNR %d", packet_num, last_rssi, last_snr);
-		MYLOG("APP", "GW # %d Demod Margin %d", link_check_gateways, link_check_demod_margin);
+		MYLOG("APP", "LinkCheck %s", event->link_state == 0 ? "OK" : "NOK");
+		MYLOG("APP", "Packet # %d RSSI %d SNR %d", event->packet_num, event->rssi, event->snr);
+		MYLOG("APP", "GW # %d Demod Margin %d", event->gateways, event->demod);
 		break;
 	case 5: // Join success(only LPW mode)
 		prepare_oled_header();
-		// MYLOG("APP", "JOIN_SUCCESS %d\n", disp_reason[0]);
+		// MYLOG("APP", "JOIN_SUCCESS %d\n", event->reason);
 		if (has_oled && !g_settings_ui)
 		{
 			switch (g_custom_parameters.test_mode)
@@ -814,7 +814,7 @@ void handle_display(void *reason)
 				oled_write_line(0, 0, (char *)"FieldTester V2 mode");
 				break;
 			}
-			sprintf(line_str, "Test interval  %lds", g_custom_parameters.send_interval / 1000);
+			sprintf(line_str, "Test interval  %lds", get_send_period() / 1000);
 			oled_write_line(1, 0, line_str);
 			oled_write_line(2, 0, (char *)" ");
 			sprintf(line_str, "Device joined network");
@@ -827,18 +827,18 @@ void handle_display(void *reason)
 		prepare_oled_header();
 		if (g_custom_parameters.test_mode == MODE_FIELDTESTER_V2)
 		{
-			uint16_t plr_i = ((uint16_t)field_tester_pckg[0] << 8) + (uint16_t)field_tester_pckg[1];
+			uint16_t plr_i = ((uint16_t)event->data[0] << 8) + (uint16_t)event->data[1];
 			plr = plr_i / 10;
-			int8_t max_rssi = field_tester_pckg[2] - 200;
-			int16_t min_distance = (int16_t)field_tester_pckg[3] * 250;
-			int16_t max_distance = (int16_t)field_tester_pckg[4] * 250;
-			int8_t num_gateways = field_tester_pckg[5] >> 4;
-			int16_t seq_id = (int16_t)field_tester_pckg[5] & 0x0F + (int16_t)field_tester_pckg[6];
-			int8_t max_snr = field_tester_pckg[7];
+			int8_t max_rssi = event->data[2] - 200;
+			int16_t min_distance = (int16_t)event->data[3] * 250;
+			int16_t max_distance = (int16_t)event->data[4] * 250;
+			int8_t num_gateways = event->data[5] >> 4;
+			int16_t seq_id = (int16_t)event->data[5] & 0x0F + (int16_t)event->data[6];
+			int8_t max_snr = event->data[7];
 			uint8_t gw_eui[8] = {0xac, 0x1f, 0x09, 0xff, 0xfe, 0x00, 0x00, 0x00};
-			gw_eui[5] = field_tester_pckg[8];
-			gw_eui[6] = field_tester_pckg[9];
-			gw_eui[7] = field_tester_pckg[10];
+			gw_eui[5] = event->data[8];
+			gw_eui[6] = event->data[9];
+			gw_eui[7] = event->data[10];
 			MYLOG("APP", "+EVT:FieldTester V2 %d gateways", num_gateways);
 			MYLOG("APP", "+EVT:RSSI max %d, SNR max %d", max_rssi, max_snr);
 			MYLOG("APP", "+EVT:Distance min %d max %d", min_distance, max_distance);
@@ -865,8 +865,8 @@ void handle_display(void *reason)
 				result.min_rssi = 0;
 				result.max_rssi = max_rssi;
 				result.max_snr = max_snr;
-				result.rx_rssi = last_rssi;
-				result.rx_snr = last_snr;
+				result.rx_rssi = event->rssi;
+				result.rx_snr = event->snr;
 				result.min_dst = min_distance;
 				result.max_dst = max_distance;
 				result.demod = 0;
@@ -886,7 +886,7 @@ void handle_display(void *reason)
 					oled_write_header((char *)"RAK FieldTest V2");
 				}
 
-				sprintf(line_str, "DL RX SNR: %d RSSI: %d", last_snr, last_rssi);
+				sprintf(line_str, "DL RX SNR: %d RSSI: %d", event->snr, event->rssi);
 				oled_write_line(0, 0, line_str);
 				sprintf(line_str, "UL TX SNR: %d RSSI: %d", max_snr, max_rssi);
 				oled_write_line(1, 0, line_str);
@@ -902,7 +902,7 @@ void handle_display(void *reason)
 					oled_write_line(3, 50, line_str);
 					sprintf(line_str, "%d", max_distance);
 					oled_write_line(3, 80, line_str);
-					sprintf(line_str, "PLR: %.1f   Sent: %d", plr, packet_num);
+					sprintf(line_str, "PLR: %.1f   Sent: %d", plr, event->packet_num);
 					// sprintf(line_str, "L %.6f:%.6f", g_last_lat, g_last_long);
 					oled_write_line(4, 0, line_str);
 				}
@@ -911,7 +911,7 @@ void handle_display(void *reason)
 					sprintf(line_str, "NA");
 					oled_write_line(3, 50, line_str);
 					oled_write_line(3, 80, line_str);
-					sprintf(line_str, "PLR: %.1f   Sent: %d", plr, packet_num);
+					sprintf(line_str, "PLR: %.1f   Sent: %d", plr, event->packet_num);
 					// sprintf(line_str, "Location NA");
 					oled_write_line(4, 0, line_str);
 				}
@@ -920,11 +920,11 @@ void handle_display(void *reason)
 		}
 		else
 		{
-			int16_t min_rssi = field_tester_pckg[1] - 200;
-			int16_t max_rssi = field_tester_pckg[2] - 200;
-			int16_t min_distance = field_tester_pckg[3] * 250;
-			int16_t max_distance = field_tester_pckg[4] * 250;
-			int8_t num_gateways = field_tester_pckg[5];
+			int16_t min_rssi = event->data[1] - 200;
+			int16_t max_rssi = event->data[2] - 200;
+			int16_t min_distance = event->data[3] * 250;
+			int16_t max_distance = event->data[4] * 250;
+			int8_t num_gateways = event->data[5];
 			MYLOG("APP", "+EVT:FieldTester %d gateways", num_gateways);
 			MYLOG("APP", "+EVT:RSSI min %d max %d", min_rssi, max_rssi);
 			MYLOG("APP", "+EVT:Distance min %d max %d", min_distance, max_distance);
@@ -951,12 +951,12 @@ void handle_display(void *reason)
 				result.lng = g_last_long;
 				result.min_rssi = min_rssi;
 				result.max_rssi = max_rssi;
-				result.rx_rssi = last_rssi;
-				result.rx_snr = last_snr;
+				result.rx_rssi = event->rssi;
+				result.rx_snr = event->snr;
 				result.min_dst = min_distance;
 				result.max_dst = max_distance;
 				result.demod = 0;
-				result.lost = packet_lost;
+				result.lost = event->packet_lost;
 				result.tx_dr = api.lorawan.dr.get();
 				write_sd_entry();
 			}
@@ -972,7 +972,7 @@ void handle_display(void *reason)
 					oled_write_header((char *)"RAK FieldTest V2");
 				}
 
-				sprintf(line_str, "DL RX SNR: %d RSSI: %d", last_snr, last_rssi);
+				sprintf(line_str, "DL RX SNR: %d RSSI: %d", event->snr, event->rssi);
 				oled_write_line(0, 0, line_str);
 				sprintf(line_str, "GW(s): %d\n", num_gateways);
 				oled_write_line(1, 0, line_str);
@@ -992,7 +992,7 @@ void handle_display(void *reason)
 					oled_write_line(2, 80, line_str);
 					sprintf(line_str, "%d", max_distance);
 					oled_write_line(3, 80, line_str);
-					sprintf(line_str, "Lost: %d   Sent: %d", packet_lost, packet_num);
+					sprintf(line_str, "Lost: %d   Sent: %d", event->packet_lost, event->packet_num);
 					// sprintf(line_str, "L %.6f:%.6f", g_last_lat, g_last_long);
 					oled_write_line(4, 0, line_str);
 				}
@@ -1001,7 +1001,7 @@ void handle_display(void *reason)
 					sprintf(line_str, "NA");
 					oled_write_line(2, 80, line_str);
 					oled_write_line(3, 80, line_str);
-					sprintf(line_str, "Lost: %d   Sent: %d", packet_lost, packet_num);
+					sprintf(line_str, "Lost: %d   Sent: %d", event->packet_lost, event->packet_num);
 					// sprintf(line_str, "Location NA");
 					oled_write_line(4, 0, line_str);
 				}
@@ -1013,8 +1013,6 @@ void handle_display(void *reason)
 		prepare_oled_header();
 		// MYLOG("APP", "+EVT:FieldTester no downlink");
 
-		api.system.timer.stop(RAK_TIMER_4);
-
 		if (has_sd)
 		{
 			if (has_rtc)
@@ -1042,7 +1040,7 @@ void handle_display(void *reason)
 			result.min_dst = 0;
 			result.max_dst = 0;
 			result.demod = 0;
-			result.lost = packet_lost;
+			result.lost = event->packet_lost;
 			result.tx_dr = api.lorawan.dr.get();
 			write_sd_entry();
 		}
@@ -1059,35 +1057,35 @@ void handle_display(void *reason)
 			}
 			sprintf(line_str, "No Downlink received");
 			oled_write_line(0, 0, line_str);
-			if (has_link_check)
+			if (event->has_link_check)
 			{
 				has_link_check = false;
-				if (link_check_state == 0)
+				if (event->link_state == 0)
 				{
-					sprintf(line_str, "UL Demod Margin  %d", link_check_demod_margin);
+					sprintf(line_str, "UL Demod Margin  %d", event->demod);
 					oled_write_line(1, 0, line_str);
 					sprintf(line_str, "UL DR %d", api.lorawan.dr.get());
 					oled_write_line(2, 0, line_str);
-					sprintf(line_str, "%d GW(s)", link_check_gateways);
+					sprintf(line_str, "%d GW(s)", event->gateways);
 					oled_write_line(2, 64, line_str);
-					sprintf(line_str, "Sent %d", packet_num);
+					sprintf(line_str, "Sent %d", event->packet_num);
 					oled_write_line(3, 0, line_str);
-					sprintf(line_str, "Lost %d", packet_lost);
+					sprintf(line_str, "Lost %d", event->packet_lost);
 					oled_write_line(3, 64, line_str);
-					sprintf(line_str, "DL RSSI %d", last_rssi);
+					sprintf(line_str, "DL RSSI %d", event->rssi);
 					oled_write_line(4, 0, line_str);
-					sprintf(line_str, "DL SNR %d", last_snr);
+					sprintf(line_str, "DL SNR %d", event->snr);
 					oled_write_line(4, 64, line_str);
 				}
 				else
 				{
-					sprintf(line_str, "Sent %d", packet_num);
+					sprintf(line_str, "Sent %d", event->packet_num);
 					oled_write_line(1, 0, line_str);
-					sprintf(line_str, "Lost %d", packet_lost);
+					sprintf(line_str, "Lost %d", event->packet_lost);
 					oled_write_line(1, 64, line_str);
-					sprintf(line_str, "LinkCheck result %d ", link_check_state);
+					sprintf(line_str, "LinkCheck result %d ", event->link_state);
 					oled_write_line(2, 0, line_str);
-					switch (link_check_state)
+					switch (event->link_state)
 					{
 					case RAK_LORAMAC_STATUS_ERROR:
 						sprintf(line_str, "Service error");
@@ -1155,11 +1153,11 @@ void handle_display(void *reason)
 			}
 			if (g_custom_parameters.test_mode == MODE_FIELDTESTER_V2)
 			{
-				sprintf(line_str, "PLR: %.1f   Sent: %d", plr, packet_num);
+				sprintf(line_str, "PLR: %.1f   Sent: %d", plr, event->packet_num);
 			}
 			else
 			{
-				sprintf(line_str, "Lost: %d   Sent: %d", packet_lost, packet_num);
+				sprintf(line_str, "Lost: %d   Sent: %d", event->packet_lost, event->packet_num);
 			}
 			// sprintf(line_str, "L %.6f:%.6f", g_last_lat, g_last_long);
 			oled_write_line(5, 0, line_str);
@@ -1205,7 +1203,7 @@ void handle_display(void *reason)
 		break;
 	case 10: // RX packet display (only Meshtastic mode)
 		prepare_oled_header();
-		// MYLOG("APP", "RX_EVENT %d, disp_reason[0]);
+		// MYLOG("APP", "RX_EVENT %d, event->reason);
 		// RX event display
 		if (has_sd && (g_custom_parameters.mesh_check_node != 0x00))
 		{
@@ -1229,37 +1227,37 @@ void handle_display(void *reason)
 			result.lng = g_last_long;
 			result.min_rssi = 0;
 			result.max_rssi = 0;
-			result.rx_rssi = last_rssi;
-			result.rx_snr = last_snr;
+			result.rx_rssi = event->rssi;
+			result.rx_snr = event->snr;
 			result.min_dst = 0;
 			result.max_dst = 0;
 			result.demod = 0;
-			result.lost = packet_lost;
+			result.lost = event->packet_lost;
 			write_sd_entry();
 		}
 		if (has_oled && !g_settings_ui)
 		{
 			sprintf(line_str, "Meshtastic mode");
 			oled_write_line(0, 0, line_str);
-			sprintf(line_str, "Received packets %d", packet_num);
+			sprintf(line_str, "Received packets %d", event->packet_num);
 			oled_write_line(1, 0, line_str);
 			sprintf(line_str, "Receiver:");
 			oled_write_line(2, 0, line_str);
-			sprintf(line_str, "!%08X", receiver_node);
+			sprintf(line_str, "!%08X", event->receiver_node);
 			oled_write_line(2, 64, line_str);
 			sprintf(line_str, "Sender");
 			oled_write_line(3, 0, line_str);
-			sprintf(line_str, "!%08X", sender_node);
+			sprintf(line_str, "!%08X", event->sender_node);
 			oled_write_line(3, 64, line_str);
-			sprintf(line_str, "RSSI %d", last_rssi);
+			sprintf(line_str, "RSSI %d", event->rssi);
 			oled_write_line(4, 0, line_str);
-			sprintf(line_str, "SNR %d", last_snr);
+			sprintf(line_str, "SNR %d", event->snr);
 			oled_write_line(4, 64, line_str);
 			oled_display();
 		}
 		MYLOG("APP", "Meshtastic mode");
-		MYLOG("APP", "Rcv: %08X Snd: %08X", receiver_node, sender_node);
-		MYLOG("APP", "RSSI: %d SNR %d", last_rssi, last_snr);
+		MYLOG("APP", "Rcv: %08X Snd: %08X", event->receiver_node, event->sender_node);
+		MYLOG("APP", "RSSI: %d SNR %d", event->rssi, event->snr);
 		MYLOG("APP", "F %.3f SF %d BW %d",
 			  (float)api.lora.pfreq.get() / 1000000.0,
 			  api.lora.psf.get(),
@@ -1269,7 +1267,7 @@ void handle_display(void *reason)
 		if (has_oled && !g_settings_ui)
 		{
 			oled_clear();
-			sprintf(line_str, "Unknown Event %d", disp_reason[0]);
+			sprintf(line_str, "Unknown Event %d", event->reason);
 			oled_write_line(0, 0, line_str);
 			oled_display();
 		}
@@ -1280,15 +1278,126 @@ void handle_display(void *reason)
 }
 
 /**
- * @brief Timer callback if no downlink was received
+ * @brief Display handler
+ *        Shows the waiting events in the order they were created
  *
- * 	Shows display with LinkCheck results
+ * @param reason unused
+ */
+void handle_display(void *reason)
+{
+	// Update date and time if synced with LNS
+	if (sync_time_status == 1)
+	{
+		sync_time_status = 2;
+
+		struct tm localtime;
+		SysTime_t UnixEpoch = SysTimeGet();
+		UnixEpoch.Seconds -= 18;												/*removing leap seconds*/
+		UnixEpoch.Seconds += (int32_t)(g_custom_parameters.timezone * 60 * 60); // Make it GMT+8
+		SysTimeLocalTime(UnixEpoch.Seconds, &localtime);
+		MYLOG("APP", "LNS Time %d %d %d %d:%d:%d\n", localtime.tm_year + 1900, localtime.tm_mon + 1,
+			  localtime.tm_mday, localtime.tm_hour,
+			  localtime.tm_min, localtime.tm_sec);
+
+		g_date_time.year = localtime.tm_year + 1900;
+		g_date_time.month = localtime.tm_mon + 1;
+		g_date_time.date = localtime.tm_mday;
+		g_date_time.hour = localtime.tm_hour;
+		g_date_time.minute = localtime.tm_min;
+		g_date_time.second = localtime.tm_sec;
+		if (has_rtc)
+		{
+			MYLOG("APP", "Sync RTC with LoRaWAN");
+			set_rak12002(g_date_time.year, g_date_time.month, g_date_time.date, g_date_time.hour, g_date_time.minute, g_date_time.second);
+			read_rak12002();
+			MYLOG("APP", "After sync: %d %d %d %d:%d:%d\n", g_date_time.year, g_date_time.month,
+				  g_date_time.date, g_date_time.hour,
+				  g_date_time.minute, g_date_time.second);
+		}
+	}
+
+	digitalWrite(LED_BLUE, LOW);
+	digitalWrite(LED_GREEN, LOW);
+
+	app_event_s event;
+	while (evt_pop(&event))
+	{
+		display_event(&event);
+		if (event.cycle_result)
+		{
+			cycle_event(CEV_SHOWN);
+		}
+	}
+}
+
+/**
+ * @brief Queue an event for the display handler
+ *        The event gets a copy of the current results, later callbacks do not change it
+ *        The display of a test cycle result is started by the test cycle
  *
+ * @param reason display reason, see display_event
+ * @param data payload of the event, e.g. FieldTester downlink
+ * @param len size of the payload
+ * @param cycle_result true if the event is the result of the test cycle
  */
-void no_dl_handler(void *disp_reason)
+static void queue_event(uint8_t reason, uint8_t *data, uint8_t len, bool cycle_result)
 {
-	display_reason = 7;
-	api.system.timer.start(RAK_TIMER_1, 250, &display_reason);
+	app_event_s event;
+	event.reason = reason;
+	event.time = millis();
+	event.rssi = last_rssi;
+	event.snr = last_snr;
+	event.has_link_check = has_link_check;
+	event.link_state = link_check_state;
+	event.demod = link_check_demod_margin;
+	event.gateways = link_check_gateways;
+	event.status = tx_fail_status;
+	event.packet_num = packet_num;
+	event.packet_lost = packet_lost;
+	event.receiver_node = receiver_node;
+	event.sender_node = sender_node;
+	event.len = len > EVT_DATA_SIZE ? EVT_DATA_SIZE : len;
+	memset(event.data, 0, EVT_DATA_SIZE);
+	if (data != NULL)
+	{
+		memcpy(event.data, data, event.len);
+	}
+	event.cycle_result = cycle_result;
+	if (!evt_push(&event))
+	{
+		MYLOG("APP", "Event queue full, event %d dropped", reason);
+	}
+	if (!cycle_result)
+	{
+		lat_timer_start(RAK_TIMER_1, 250, NULL);
+	}
+}
+
+/**
+ * @brief Queue an event of a callback for the display handler
+ *        The event is reported to the test cycle, the event that ends the TX and RX stages is flagged as result
+ *
+ * @param reason display reason, see display_event
+ * @param data payload of the event, e.g. FieldTester downlink
+ * @param len size of the payload
+ */
+void post_event(uint8_t reason, uint8_t *data, uint8_t len)
+{
+	uint8_t cycle_ev = cycle_reason_event(reason);
+	bool cycle_result = (cycle_ev != CYCLE_NUM_EVENTS) && cycle_event(cycle_ev) && (cycle_get_state() == CYCLE_LOG);
+	queue_event(reason, data, len, cycle_result);
+}
+
+/**
+ * @brief No downlink was received in FieldTester mode
+ *        Called by the test cycle when the wait for the downlink timed out, shows display with LinkCheck results
+ *
+ */
+void no_dl_handler(void)
+{
+	trace_add(TEV_RX_TIMEOUT);
+	queue_event(7, NULL, 0, true);
+	lat_timer_start(RAK_TIMER_1, 250, NULL);
 }
 
 /**
@@ -1298,15 +1407,14 @@ void no_dl_handler(void *disp_reason)
  */
 void join_cb_lpw(int32_t status)
 {
+	trace_add(TEV_JOIN, status);
 	if (status != 0)
 	{
-		display_reason = 3;
-		api.system.timer.start(RAK_TIMER_1, 250, &display_reason);
+		post_event(3);
 	}
 	else
 	{
-		display_reason = 5;
-		api.system.timer.start(RAK_TIMER_1, 250, &display_reason);
+		post_event(5);
 	}
 	tx_active = false;
 }
@@ -1318,10 +1426,11 @@ void join_cb_lpw(int32_t status)
  */
 void send_cb_p2p(void)
 {
+	trace_add(TEV_TX_DONE);
+	energy_state(EN_TX, false);
 	tx_active = false;
 
-	display_reason = 8;
-	api.system.timer.start(RAK_TIMER_1, 250, &display_reason);
+	post_event(8);
 }
 
 /**
@@ -1331,6 +1440,7 @@ void send_cb_p2p(void)
  */
 void recv_cb_p2p(rui_lora_p2p_recv_t data)
 {
+	trace_add(TEV_RX, data.Rssi, data.Snr);
 	last_rssi = data.Rssi;
 	last_snr = data.Snr;
 	packet_num++;
@@ -1362,14 +1472,12 @@ void recv_cb_p2p(rui_lora_p2p_recv_t data)
 
 		if (fire_display)
 		{
-			display_reason = 10;
-			api.system.timer.start(RAK_TIMER_1, 250, &display_reason);
+			post_event(10);
 		}
 		return;
 	}
 	// Not Meshtastic
-	display_reason = 1;
-	api.system.timer.start(RAK_TIMER_1, 250, &display_reason);
+	post_event(1);
 }
 
 /**
@@ -1379,6 +1487,7 @@ void recv_cb_p2p(rui_lora_p2p_recv_t data)
  */
 void recv_cb_lpw(SERVICE_LORA_RECEIVE_T *data)
 {
+	trace_add(TEV_RX, data->Rssi, data->Snr);
 	last_rssi = data->Rssi;
 	last_snr = data->Snr;
 	last_dr = data->RxDatarate;
@@ -1392,14 +1501,10 @@ void recv_cb_lpw(SERVICE_LORA_RECEIVE_T *data)
 	}
 	if ((g_custom_parameters.test_mode == MODE_FIELDTESTER) || (g_custom_parameters.test_mode == MODE_FIELDTESTER_V2))
 	{
-		// Downlink received, stop no-downlink timer
-		api.system.timer.stop(RAK_TIMER_4);
-
+		// Downlink received, ends the wait for the downlink of the test cycle
 		if ((data->Port == 2) || (data->Port == 3))
 		{
-			display_reason = 6;
-			memcpy(field_tester_pckg, data->Buffer, data->BufferSize);
-			api.system.timer.start(RAK_TIMER_1, 250, &display_reason);
+			post_event(6, data->Buffer, data->BufferSize);
 		}
 		else
 		{
@@ -1416,8 +1521,16 @@ void recv_cb_lpw(SERVICE_LORA_RECEIVE_T *data)
  */
 void send_cb_lpw(int32_t status)
 {
+	trace_add(TEV_TX_DONE, status);
+	// Each attempt of the uplink counts for the duty cycle
+	dc_add_retx(status);
 	if (status != RAK_LORAMAC_STATUS_OK)
 	{
+		if (dr_sweep_active)
+		{
+			sweep_add_result(false, 0, 0, 0, 0);
+		}
+		frag_add_result(false);
 		tx_active = false;
 		MYLOG("APP", "LMC status %d\n", status);
 		tx_fail_status = status;
@@ -1425,20 +1538,17 @@ void send_cb_lpw(int32_t status)
 		if ((g_custom_parameters.test_mode == MODE_FIELDTESTER) || (g_custom_parameters.test_mode == MODE_FIELDTESTER_V2))
 		{
 			packet_lost++;
-			display_reason = 7;
-			api.system.timer.start(RAK_TIMER_1, 250, &display_reason);
+			post_event(7);
 		}
 		else
 		{
 			packet_lost++;
-			display_reason = 2;
-			api.system.timer.start(RAK_TIMER_1, 250, &display_reason);
+			post_event(2);
 		}
 	}
 	else if (tx_active)
 	{
-		display_reason = 8;
-		api.system.timer.start(RAK_TIMER_1, 250, &display_reason);
+		post_event(8);
 	}
 }
 
@@ -1449,6 +1559,12 @@ void send_cb_lpw(int32_t status)
  */
 void linkcheck_cb_lpw(SERVICE_LORA_LINKCHECK_T *data)
 {
+	trace_add(TEV_LINKCHECK, (data->State << 8) | data->NbGateways, data->Rssi);
+	if (dr_sweep_active)
+	{
+		sweep_add_result(data->State == 0, data->Rssi, data->Snr, data->NbGateways, data->DemodMargin);
+	}
+	frag_add_result(data->State == 0);
 	tx_active = false;
 	// MYLOG("APP", "linkcheck_cb_lpw\n");
 	last_snr = data->Snr;
@@ -1463,13 +1579,11 @@ void linkcheck_cb_lpw(SERVICE_LORA_LINKCHECK_T *data)
 	}
 	if ((g_custom_parameters.test_mode == MODE_FIELDTESTER) || (g_custom_parameters.test_mode == MODE_FIELDTESTER_V2))
 	{
-		// start timer, if no downlink from backend server, show linkcheck results instead
-		display_reason = 7;
-		api.system.timer.start(RAK_TIMER_4, 10000, &display_reason);
+		// The test cycle waits for the downlink, if no downlink from backend server, show linkcheck results instead
+		cycle_event(CEV_TX_DONE);
 		return;
 	}
-	display_reason = 4;
-	api.system.timer.start(RAK_TIMER_1, 250, &display_reason);
+	post_event(4);
 }
 
 /**
@@ -1525,6 +1639,8 @@ uint8_t UserBattLevel(void)
  */
 void setup(void)
 {
+	trace_init();
+
 	pinMode(WB_IO2, OUTPUT);
 	pinMode(LED_GREEN, OUTPUT);
 	pinMode(LED_BLUE, OUTPUT);
@@ -1546,7 +1662,7 @@ void setup(void)
 	}
 
 	// Shutdown modules power
-	digitalWrite(WB_IO2, LOW);
+	rail_power(false);
 
 	Serial.begin(115200);
 #ifdef _VARIANT_RAK4630_
@@ -1622,6 +1738,62 @@ void setup(void)
 	{
 		MYLOG("APP", "Failed to initialize Meshtastic ID AT command");
 	}
+	if (!init_batch_at())
+	{
+		MYLOG("APP", "Failed to initialize Batch AT command");
+	}
+	if (!init_duty_cycle_at())
+	{
+		MYLOG("APP", "Failed to initialize Duty Cycle AT command");
+	}
+	if (!init_auto_interval_at())
+	{
+		MYLOG("APP", "Failed to initialize Auto Interval AT command");
+	}
+	if (!init_sweep_at())
+	{
+		MYLOG("APP", "Failed to initialize DR Sweep AT command");
+	}
+	if (!init_size_sweep_at())
+	{
+		MYLOG("APP", "Failed to initialize Size Sweep AT command");
+	}
+	if (!init_fragment_at())
+	{
+		MYLOG("APP", "Failed to initialize Fragment AT command");
+	}
+	if (!init_bench_at())
+	{
+		MYLOG("APP", "Failed to initialize Benchmark AT command");
+	}
+	if (!init_sleep_at())
+	{
+		MYLOG("APP", "Failed to initialize Sleep AT command");
+	}
+	if (!init_latency_at())
+	{
+		MYLOG("APP", "Failed to initialize Latency AT command");
+	}
+	if (!init_cycle_at())
+	{
+		MYLOG("APP", "Failed to initialize Test cycle AT command");
+	}
+	if (!init_jobs_at())
+	{
+		MYLOG("APP", "Failed to initialize Jobs AT command");
+	}
+	if (!init_trace_at())
+	{
+		MYLOG("APP", "Failed to initialize Trace AT command");
+	}
+	if (!init_energy_at())
+	{
+		MYLOG("APP", "Failed to initialize Energy AT command");
+	}
+	if (!init_oled_at())
+	{
+		MYLOG("APP", "Failed to initialize OLED AT command");
+	}
 
 	// Get saved custom settings
 	if (!get_at_setting())
@@ -1662,6 +1834,7 @@ void setup(void)
 	{
 		oled_add_line((char *)"GNSS OK");
 	}
+	energy_update_gnss();
 
 	// Initialize RTC
 	has_rtc = init_rak12002();
@@ -1684,6 +1857,9 @@ void setup(void)
 		oled_add_line((char *)"RTC OK");
 	}
 
+	// Restore the fair use budget, needs the settings and the RTC
+	dc_init_day();
+
 	// Initialize SD card
 	has_sd = init_sd();
 	if (!has_sd)
@@ -1759,32 +1935,29 @@ void setup(void)
 		break;
 	}
 
-	sprintf(line_str, "Test interval  %lds", g_custom_parameters.send_interval / 1000);
+	sprintf(line_str, "Test interval  %lds", get_send_period() / 1000);
 	oled_add_line(line_str);
 
 	// Create timer for periodic sending
-	api.system.timer.create(RAK_TIMER_0, send_packet, RAK_TIMER_PERIODIC);
+	lat_timer_create(RAK_TIMER_0, send_packet, RAK_TIMER_PERIODIC);
 
-	if (g_custom_parameters.send_interval != 0)
+	if (get_send_period() != 0)
 	{
-		api.system.timer.start(RAK_TIMER_0, g_custom_parameters.send_interval, NULL);
+		lat_timer_start(RAK_TIMER_0, get_send_period(), NULL);
 	}
 
 	//  Create timer for display handler
-	api.system.timer.create(RAK_TIMER_1, handle_display, RAK_TIMER_ONESHOT);
+	lat_timer_create(RAK_TIMER_1, handle_display, RAK_TIMER_ONESHOT);
 
 	// Create timer for display saver
-	api.system.timer.create(RAK_TIMER_2, oled_saver, RAK_TIMER_ONESHOT);
+	lat_timer_create(RAK_TIMER_2, oled_saver, RAK_TIMER_ONESHOT);
 	if (g_custom_parameters.display_saver)
 	{
-		api.system.timer.start(RAK_TIMER_2, 60000, NULL);
+		lat_timer_start(RAK_TIMER_2, 60000, NULL);
 	}
 
 	// Create timer for GNSS location acquisition
-	api.system.timer.create(RAK_TIMER_3, gnss_handler, RAK_TIMER_PERIODIC);
-
-	// Create timer for FieldTester mode when no downlink arrives
-	api.system.timer.create(RAK_TIMER_4, no_dl_handler, RAK_TIMER_ONESHOT);
+	lat_timer_create(RAK_TIMER_3, gnss_handler, RAK_TIMER_PERIODIC);
 
 	// If LoRaWAN, start join if required (Removed, because problem in production)
 	// if (lorawan_mode)
@@ -1802,15 +1975,18 @@ void setup(void)
 /**
  * @brief Loop
  *
- * 	Only used to catch button events
+ * 	Only used to catch button events and run background jobs, sleeps until the next event
  */
 void loop(void)
 {
-	// api.system.sleep.all(100);
-	if (pressCount != 0)
+	if (button_busy() || job_busy())
 	{
 		mtmMain.Running(millis());
 	}
+	// Timeouts of the test cycle stages
+	cycle_check();
+	// Sleep until the next task is due or an interrupt or timer wakes up the MCU
+	lp_idle();
 }
 
 /**
@@ -1825,6 +2001,7 @@ void set_linkcheck(void)
 	{
 		// If in LoRa P2P mode, switch of RX
 		api.lora.precv(0);
+		energy_state(EN_RX, false);
 	}
 	// Force LoRaWAN mode (might cause restart)
 	api.lorawan.nwm.set();
@@ -1844,12 +2021,12 @@ void set_linkcheck(void)
 	if (g_custom_parameters.location_on)
 	{
 		// Enable GNSS module
-		digitalWrite(WB_IO2, HIGH);
+		rail_power(true);
 	}
 	else
 	{
 		// Disable GNSS module
-		digitalWrite(WB_IO2, LOW);
+		rail_power(false);
 	}
 	fPort = 2;
 }
@@ -1864,6 +2041,7 @@ void set_p2p(void)
 	lorawan_mode = false;
 
 	api.lora.precv(0);
+	energy_state(EN_RX, false);
 
 	// Force LoRa P2P mode (might cause restart)
 	if (!api.lora.nwm.set())
@@ -1875,15 +2053,16 @@ void set_p2p(void)
 	api.lora.registerPSendCallback(send_cb_p2p);
 	// Enable RX mode
 	api.lora.precv(65533);
+	energy_state(EN_RX, true);
 	if (g_custom_parameters.location_on)
 	{
 		// Enable GNSS module
-		digitalWrite(WB_IO2, HIGH);
+		rail_power(true);
 	}
 	else
 	{
 		// Disable GNSS module
-		digitalWrite(WB_IO2, LOW);
+		rail_power(false);
 	}
 }
 
@@ -1898,6 +2077,7 @@ void set_field_tester(void)
 	{
 		// If in LoRa P2P mode, switch of RX
 		api.lora.precv(0);
+		energy_state(EN_RX, false);
 	}
 	// Force LoRaWAN mode (might cause restart)
 	api.lorawan.nwm.set();
@@ -1916,7 +2096,7 @@ void set_field_tester(void)
 	if (g_custom_parameters.location_on)
 	{
 		// Enable GNSS module
-		digitalWrite(WB_IO2, HIGH);
+		rail_power(true);
 	}
 	fPort = 1;
 }
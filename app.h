@@ -58,33 +58,7 @@
 #define SW_VERSION_1 0
 #define SW_VERSION_2 11
 #endif
-/** Custom flash parameters structure */
-struct custom_param_s
-{
-	uint32_t settings_crc = 0;
-	uint32_t send_interval = 30000;
-	uint8_t valid_flag = 0xAA;
-	uint8_t test_mode = 0;
-	bool display_saver = true;
-	bool location_on = false;
-	uint8_t custom_packet[129] = {0x01, 0x02, 0x03, 0x04};
-	uint16_t custom_packet_len = 4;
-	bool dr_sweep_on = false;
-	int8_t timezone = 8;
-	uint32_t mesh_check_node = 0;
-};
-// Structure size without CRC
-#define custom_params_len sizeof(custom_param_s)
-
-typedef enum test_mode_num
-{
-	MODE_LINKCHECK = 0,
-	MODE_P2P = 1,
-	MODE_FIELDTESTER = 2,
-	MODE_FIELDTESTER_V2 = 3,
-	MODE_MESHTASTIC = 4,
-	INVALID_MODE = 5
-} test_mode_num_t;
+#include "settings.h"
 
 /** Custom flash parameters */
 extern custom_param_s g_custom_parameters;
@@ -108,25 +82,381 @@ void set_linkcheck(void);
 void set_p2p(void);
 void set_field_tester(void);
 void send_packet(void *data);
+void send_test_packet(void);
 uint8_t get_min_dr(uint16_t region, uint16_t payload_size);
-bool check_dr(uint16_t packet_len);
+uint8_t get_max_payload(uint16_t region, uint8_t dr);
+uint8_t get_fopts_len(void);
 extern uint32_t g_send_repeat_time;
 extern bool lorawan_mode;
 extern volatile bool tx_active;
 extern volatile bool forced_tx;
 extern volatile bool dr_sweep_active;
 extern uint8_t sync_time_status;
-extern uint16_t *region_map[];
 extern volatile bool ready_to_dump;
+extern volatile int16_t last_rssi;
+extern volatile int8_t last_snr;
+extern volatile uint8_t link_check_gateways;
 extern volatile int32_t packet_num;
 extern bool g_settings_active;
 extern uint8_t fPort;
 
 // LoRaWAN stuff
 #include "wisblock_cayenne.h"
-extern WisCayenne g_solution_data;
+#include "lorawan_regions.h"
+
+// Uplink TX buffers
+/** Largest application payload of all regions */
+#define TX_BUFFER_SIZE 242
+/** Number of TX buffers in the pool */
+#define TX_BUFFER_NUM 2
+/** Buffers taken from the pool once and never freed, g_tx_payload and g_batch_payload */
+#define TX_BUFFER_FIXED 2
+static_assert(TX_BUFFER_FIXED <= TX_BUFFER_NUM, "TX buffer pool too small for g_tx_payload and g_batch_payload");
+/** Uplink payload buffer */
+struct tx_buffer_s
+{
+	uint8_t *data;
+	uint8_t len;
+	uint8_t min_dr;
+	uint8_t band;  // Region of min_dr
+	uint8_t fopts; // FOpts length of min_dr
+	bool in_use;
+};
+tx_buffer_s *tx_buffer_alloc(void);
+void tx_buffer_free(tx_buffer_s *buffer);
+tx_buffer_s *tx_payload_reset(void);
+tx_buffer_s *tx_custom_payload(void);
+void tx_buffer_set_dr(tx_buffer_s *buffer);
+bool tx_buffer_dr_valid(tx_buffer_s *buffer);
+bool tx_buffer_add_gnss(tx_buffer_s *buffer, int32_t latitude, int32_t longitude, int16_t altitude, float accuracy, int8_t sats);
+bool tx_buffer_check_dr(tx_buffer_s *buffer);
+bool tx_send(tx_buffer_s *buffer, uint8_t port);
+extern tx_buffer_s *g_tx_payload;
+extern tx_buffer_s g_custom_payload;
+
+// Duty cycle
+/** Duty cycle window in ms */
+#define DC_WINDOW_MS 3600000UL
+/** Max number of uplinks in the window */
+#define DC_MAX_RECORDS 64
+uint8_t dc_get_subband(void);
+uint32_t dc_get_toa(uint8_t len);
+int32_t dc_get_budget_left(void);
+uint32_t dc_get_wait(uint8_t len);
+void dc_add_tx(uint8_t len);
+void dc_add_retx(int32_t status);
+uint32_t dc_get_next_wait(void);
+bool dc_check(void);
+bool init_duty_cycle_at(void);
+
+// Auto send interval
+/** Fair use day in ms */
+#define DC_DAY_MS 86400000UL
+/** Shortest send interval in auto interval mode */
+#define AUTO_INTERVAL_MIN 10000UL
+/** Flash offset of the fair use budget, behind the settings */
+#define DC_DAY_FLASH_OFFSET 512
+/** Number of flash writes of the fair use budget per day */
+#define DC_DAY_SAVE_STEPS 16
+/** Oldest valid date for the fair use day, 2024-01-01 */
+#define DC_TIME_VALID 1704067200UL
+uint32_t dc_get_day_used(void);
+uint32_t dc_get_day_left(void);
+bool dc_day_has_date(void);
+void dc_init_day(void);
+uint32_t dc_calc_auto_interval(void);
+uint32_t get_send_period(void);
+void dc_update_auto_interval(void);
+bool init_auto_interval_at(void);
+
+// Fragmented custom packet
+/** fPort for fragments */
+#define FRAG_FPORT 4
+/** Send interval between the fragments of a packet */
+#define FRAG_INTERVAL_MS 15000
+/** Fragment delivery statistics */
+struct frag_stats_s
+{
+	uint16_t sent;
+	uint16_t ok;
+	uint16_t packets;
+	uint16_t complete;
+};
+bool frag_needed(void);
+bool frag_send(void);
+void frag_add_result(bool success);
+bool init_fragment_at(void);
+extern frag_stats_s g_frag_stats;
+
+// DR sweep
+/** Max number of uplinks per DR */
+#define SWEEP_MAX_COUNT 20
+/** Log file for the sweep results */
+#define SWEEP_FILE_NAME "SWEEP.CSV"
+/** Time in ms to wait for the result of a sweep uplink */
+#define SWEEP_RESULT_TIMEOUT 10000
+/** Time in ms the result of a sweep uplink stays on the display */
+#define SWEEP_DISPLAY_TIME 2000
+/** Sweep statistics of one DR */
+struct sweep_stats_s
+{
+	bool used;
+	bool skipped;
+	uint8_t sent;
+	uint8_t ok;
+	uint8_t fail_run;
+	uint16_t gw_sum;
+	int32_t rssi_sum;
+	uint32_t rssi_sq;
+	int32_t snr_sum;
+	uint32_t snr_sq;
+	uint16_t demod_sum;
+};
+/** Calculated sweep results of one DR */
+struct sweep_result_s
+{
+	float success;
+	float gw;
+	float rssi;
+	float rssi_sd;
+	float snr;
+	float snr_sd;
+	float demod;
+};
+void sweep_stats_add(sweep_stats_s *stats, bool success, int16_t rssi, int8_t snr, uint8_t gateways, uint8_t demod);
+void sweep_stats_get(sweep_stats_s *stats, sweep_result_s *res);
+void sweep_add_result(bool success, int16_t rssi, int8_t snr, uint8_t gateways, uint8_t demod);
+bool dr_sweep_start(void);
+void sweep_show_line(uint8_t dr);
+int sweep_format_dr(uint8_t dr, char *line, size_t size, char separator);
+void sweep_save(void);
+bool init_sweep_at(void);
+extern sweep_stats_s g_sweep_stats[];
+
+// Payload size sweep
+/** Max number of payload sizes in a sweep */
+#define SIZE_SWEEP_MAX_STEPS 16
+/** Log file for the payload size sweep results */
+#define SIZE_SWEEP_FILE_NAME "SIZESWP.CSV"
+bool size_sweep_start(uint8_t count, uint8_t step);
+int size_sweep_format(uint8_t idx, char *line, size_t size, char separator);
+void size_sweep_show_line(uint8_t idx);
+void size_sweep_save(void);
+bool init_size_sweep_at(void);
+extern sweep_stats_s g_size_stats[];
+extern uint8_t g_size_len[];
+extern uint8_t g_size_num;
+
+// Benchmarks
+/** Benchmark result */
+struct bench_result_s
+{
+	const char *name;
+	uint32_t iterations;
+	uint32_t ns_op;
+	uint32_t bytes_op;
+};
+uint8_t bench_count(void);
+bool bench_run(uint8_t idx, bench_result_s *res);
+bool init_bench_at(void);
+
+// Tickless idle
+/** Longest sleep of the main loop in ms */
+#define LP_MAX_SLEEP_MS 60000
+/** Sleep statistics */
+struct lp_stats_s
+{
+	uint32_t total_ms;
+	uint32_t sleep_ms;
+	uint32_t sleeps;
+	uint16_t ratio; // in 0.1 %
+};
+void lp_idle(void);
+void lp_get_stats(lp_stats_s *stats);
+void lp_reset_stats(void);
+uint32_t lp_get_sleep_total(void);
+bool init_sleep_at(void);
+
+// Latency histograms
+/** Number of timers with run time and latency measurement, RAK_TIMER_0 to RAK_TIMER_3 */
+#define LAT_NUM_TIMERS 4
+bool lat_timer_create(RAK_TIMER_ID id, RAK_TIMER_HANDLER handler, RAK_TIMER_MODE mode);
+bool lat_timer_start(RAK_TIMER_ID id, uint32_t ms, void *data);
+int lat_format(uint8_t idx, char *line, size_t size);
+void lat_reset(void);
+bool init_latency_at(void);
+
+// Event queue
+/** Max number of waiting events, must be a power of 2 */
+#define EVT_QUEUE_SIZE 8
+/** Max payload size of an event */
+#define EVT_DATA_SIZE 32
+/** Event from the LoRa callbacks with a copy of the results */
+struct app_event_s
+{
+	uint8_t reason; // Display reason, see handle_display
+	uint32_t time;	// millis() when the event was created
+	int16_t rssi;
+	int8_t snr;
+	bool has_link_check;
+	uint8_t link_state;
+	uint8_t demod;
+	uint8_t gateways;
+	int32_t status; // TX fail status
+	int32_t packet_num;
+	int32_t packet_lost;
+	uint32_t receiver_node;
+	uint32_t sender_node;
+	bool cycle_result; // Event is the result of a test cycle
+	uint8_t len;
+	uint8_t data[EVT_DATA_SIZE];
+};
+bool evt_push(app_event_s *event);
+bool evt_pop(app_event_s *event);
+uint16_t evt_pending(void);
+uint32_t evt_get_overflows(void);
+void post_event(uint8_t reason, uint8_t *data = NULL, uint8_t len = 0);
+void no_dl_handler(void);
+
+// Test cycle
+#include "test_cycle.h"
+bool cycle_event(uint8_t event);
+uint8_t cycle_get_state(void);
+uint8_t cycle_reason_event(uint8_t reason);
+uint32_t cycle_next_timeout(void);
+void cycle_check(void);
+int cycle_format(uint8_t idx, char *line, size_t size);
+void cycle_reset(void);
+bool init_cycle_at(void);
+
+// Cooperative jobs
+struct job_s;
+/** Step of a job, returns true when the job is finished */
+typedef bool (*job_step_t)(job_s *job);
+/** Resumable job, the step function continues from state on each call */
+struct job_s
+{
+	const char *name;
+	job_step_t step;
+	uint8_t state;		   // Resume point, starts with 0
+	bool active;		   // Job is running
+	bool failed;		   // Last run ended with an error
+	uint32_t wake;		   // millis() of the next step
+	uint32_t progress;	   // Work done, unit depends on the job
+	uint32_t total;		   // Work known so far, 0 if unknown
+	uint32_t steps;		   // Number of steps
+	uint32_t max_block_us; // Longest step
+	uint32_t started;	   // millis() when the job was started
+	uint32_t duration;	   // Run time of the finished job in ms
+	job_s *next;
+};
+bool job_start(job_s *job);
+void job_sleep(job_s *job, uint32_t ms);
+void job_wake(job_s *job);
+bool job_busy(void);
+int job_format(uint8_t idx, char *line, size_t size);
+bool init_jobs_at(void);
+
+// Event trace
+/** Number of events in the trace ring */
+#define TRACE_SIZE 256
+/** Events per hex line of the dump */
+#define TRACE_PER_LINE 4
+/** Pause after which a sync event with millis() is recorded, below the 71 minutes of the microsecond timestamp */
+#define TRACE_SYNC_MS (30 * 60 * 1000)
+/** Min time between two traces saved to the SD card */
+#define TRACE_SAVE_INTERVAL (60 * 60 * 1000)
+/** Trace file on the SD card */
+#define TRACE_FILE_NAME "trace.txt"
+/** Trace events, arguments in brackets (arg0, arg1) */
+typedef enum trace_event_num
+{
+	TEV_SYNC = 0,		   // Time sync (pause before in s, millis())
+	TEV_BOOT = 1,		   // Start (-, reset reason)
+	TEV_TX_START = 2,	   // Packet handed to the stack (fPort, length), fPort 0 = P2P
+	TEV_TX_ERROR = 3,	   // Stack refused the packet (fPort, -)
+	TEV_TX_DONE = 4,	   // TX finished (status, -)
+	TEV_RX = 5,			   // Packet received (RSSI, SNR)
+	TEV_RX_TIMEOUT = 6,	   // No downlink from the FieldTester backend (-, -)
+	TEV_JOIN = 7,		   // Join result (status, -)
+	TEV_LINKCHECK = 8,	   // LinkCheck result (state << 8 | gateways, RSSI)
+	TEV_GNSS_POLL = 9,	   // GNSS poll (1 = location, satellites)
+	TEV_SD_BEGIN = 10,	   // SD card log entry start (lines written, -)
+	TEV_SD_END = 11,	   // SD card log entry end (1 = OK, lines written)
+	TEV_DISPLAY = 12,	   // Display update (reason, event age ms)
+	TEV_BUTTON = 13,	   // Button edge (buffered edges, pressed)
+	TEV_GESTURE = 14,	   // Button event handled (button status, -)
+	TEV_CYCLE_TIMEOUT = 15, // Test cycle stuck (state, -)
+	TEV_TRACE_SAVED = 16,  // Trace written to SD card (1 = OK, -)
+	TEV_NUM = 17
+} trace_event_num_t;
+/** One trace event, 12 bytes */
+struct trace_event_s
+{
+	uint32_t time_us;
+	uint8_t id;
+	uint8_t reserved;
+	uint16_t arg0;
+	uint32_t arg1;
+};
+void trace_init(void);
+void trace_add(uint8_t id, uint16_t arg0 = 0, uint32_t arg1 = 0);
+void trace_reset(void);
+int trace_format(uint8_t idx, char *line, size_t size);
+void trace_fault(uint8_t reason, uint16_t arg);
+bool init_trace_at(void);
+
+// Energy accounting
+/** States with their own current draw */
+typedef enum energy_state_num
+{
+	EN_BASE = 0,		 // Sleep current of the device, always counted
+	EN_MCU = 1,			 // MCU active, main loop not sleeping
+	EN_OLED = 2,		 // OLED switched on
+	EN_OLED_REFRESH = 3, // OLED buffer transfer
+	EN_RAIL = 4,		 // WB_IO2 rail on (GNSS module and SD card powered)
+	EN_GNSS = 5,		 // GNSS receiver acquiring or tracking
+	EN_SD = 6,			 // SD card write
+	EN_TX = 7,			 // Radio TX
+	EN_RX = 8,			 // Radio continuous RX (LoRa P2P)
+	EN_NUM = 9
+} energy_state_num_t;
+/** Default current draw model in uA */
+#define ENERGY_DEFAULT_UA {40, 3000, 8000, 1500, 1500, 25000, 25000, 110000, 5500}
+void energy_state(uint8_t id, bool on);
+void energy_add(uint8_t id, uint32_t ms);
+void energy_update_gnss(void);
+void rail_power(bool on);
+uint32_t energy_avg_ua(uint8_t id);
+bool energy_set_ua(const char *name, uint32_t ua);
+int energy_format(uint8_t idx, char *line, size_t size);
+void energy_reset(void);
+bool init_energy_at(void);
+
+// Batched uplinks
+/** fPort for batched uplinks */
+#define BATCH_FPORT 3
+/** Max number of samples in one batched uplink */
+#define BATCH_MAX_SAMPLES 32
+bool batch_add_sample(int32_t latitude, int32_t longitude, int16_t altitude, int16_t rssi, int8_t snr, uint8_t gateways);
+void batch_reset(void);
+bool init_batch_at(void);
+extern tx_buffer_s *g_batch_payload;
+extern uint8_t g_batch_count;
 
 // OLED
+/** Display transfer statistics */
+struct oled_stats_s
+{
+	uint32_t bytes;		  // I2C bytes sent to the display
+	uint32_t windows;	  // Transfer windows sent
+	uint32_t full_frames; // Updates sent as full frame
+	uint32_t updates;	  // Display updates
+	uint32_t fields;	  // Text fields drawn
+	uint32_t full_bytes;  // I2C bytes the updates would need with full frames
+	uint32_t bytes_s;	  // I2C bytes per second
+	uint32_t total_ms;
+};
 bool init_oled(void);
 void oled_add_line(char *line);
 void oled_show(void);
@@ -138,6 +468,9 @@ void oled_power(bool on_off);
 void display_show_menu(char *menu[], uint8_t menu_len, uint8_t sel_menu, uint8_t sel_item, bool display_saver = false, bool location_on = false);
 void oled_saver(void *);
 void prepare_oled_header(void);
+void oled_get_stats(oled_stats_s *stats);
+void oled_reset_stats(void);
+bool init_oled_at(void);
 extern custom_param_s g_last_settings;
 extern char line_str[];
 extern char *g_regions_list[];
@@ -164,12 +497,14 @@ typedef enum disp_mode_num
 	S_P2P_CR,
 	S_P2P_PPL,
 	S_P2P_TX,
+	S_ENERGY,
 	S_SUB_NONE = 255
 };
 extern bool g_settings_ui;
 
 // Button
 #include "MillisTaskManager.h"
+#include "gesture.h"
 
 #define BUTTON_INT_PIN WB_IO5
 
@@ -189,12 +524,23 @@ typedef enum
 	BUTTONSTATE_NONE,
 } buttonState_t;
 
+/** Size of the edge buffer, 7 clicks are 14 edges plus bounces */
+#define BUTTON_EDGE_QUEUE_SIZE 32
+/** Size of the queue of recognized gestures */
+#define BUTTON_GESTURE_QUEUE_SIZE 4
+/** Button edge captured by the interrupt */
+struct button_edge_s
+{
+	uint32_t time; // millis() of the edge
+	bool pressed;  // Level after the edge
+};
+
 bool buttonInit(void);
 uint8_t getButtonStatus(void);
 void handle_button(void);
 void buttonIntHandle(void);
+bool button_busy(void);
 extern MillisTaskManager mtmMain;
-extern volatile uint8_t pressCount;
 extern volatile bool display_power;
 
 // ACC
@@ -209,49 +555,45 @@ void read_acc(void);
 bool init_gnss(bool active = false);
 bool poll_gnss(void);
 void gnss_handler(void *);
+uint32_t gnss_start_acquisition(void);
+void gnss_stop_acquisition(void);
+void gnss_send_fix(void);
 extern bool gnss_active;
+extern bool has_gnss;
 extern uint16_t check_gnss_counter;
-extern uint16_t check_gnss_max_try;
 extern uint8_t max_sat;
 extern uint8_t max_sat_unchanged;
 extern volatile float g_last_lat;
 extern volatile float g_last_long;
+extern volatile int32_t g_last_lat_raw;
+extern volatile int32_t g_last_long_raw;
 extern volatile float g_last_accuracy;
 extern volatile uint32_t g_last_altitude;
 extern volatile uint8_t g_last_satellites;
 extern volatile bool has_gnss_location;
+/** 1 = wait 500 ms and write the full GNSS configuration on every init, as before the read-back, to compare the init times */
+#ifndef GNSS_CFG_FORCE
+#define GNSS_CFG_FORCE 0
+#endif
+extern uint32_t gnss_boot_to_poll;
+extern uint32_t gnss_init_duration;
+extern uint8_t gnss_cfg_writes;
 
 // SD Card
-/** Log file info structure */
-struct result_s
-{
-	uint16_t year = 24;
-	uint8_t month = 9;
-	uint8_t day = 27;
-	uint8_t hour = 12;
-	uint8_t min = 0;
-	uint8_t sec = 0;
-	uint8_t mode = 0;
-	uint8_t gw = 0;
-	float lat = 14.421536;
-	float lng = 121.006819;
-	int8_t min_rssi = 0;
-	int8_t max_rssi = 0;
-	int8_t max_snr = 0;
-	int8_t rx_rssi = 0;
-	int8_t rx_snr = 0;
-	int16_t min_dst = 0;
-	int16_t max_dst = 0;
-	int16_t demod = 0;
-	int16_t lost = 0;
-	int8_t tx_dr = 0;
-};
+/** Max wait for the end of the test cycle before the log files are dumped */
+#define SD_JOB_WAIT_TX 10000
+/** Bytes sent per step of the log file dump */
+#define SD_DUMP_CHUNK 16
+#include "log_format.h"
 bool init_sd(void);
 bool create_sd_file(void);
 void write_sd_entry(void);
-void dump_all_sd_files(void);
+bool sd_dump_start(void);
 void dump_sd_file(const char *path);
-void clear_sd_file(void);
+bool sd_erase_start(void);
+bool sd_busy(void);
+bool write_sd_table(const char *path, const char *header, const char *table);
+bool write_sd_lines(const char *path, int (*format)(uint8_t idx, char *line, size_t size));
 extern volatile result_s result;
 extern volatile char file_name[];
 extern bool has_sd;
@@ -0,0 +1,57 @@
+/**
+ * @file bench.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Micro benchmarks of the hot code paths
+ *        Each benchmark runs a kernel of bench_kernels.h in a loop and measures the time with micros()
+ * @version 0.1
+ * @date 2025-01-04
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "app.h"
+#include "bench_kernels.h"
+
+static_assert(sizeof(bench_buffer) == TX_BUFFER_SIZE, "Benchmark buffer must have the size of the uplink buffer");
+
+/**
+ * @brief Get the number of benchmarks
+ *
+ * @return uint8_t number of benchmarks
+ */
+uint8_t bench_count(void)
+{
+	return BENCH_NUM;
+}
+
+/**
+ * @brief Run one benchmark
+ *
+ * @param idx benchmark index
+ * @param res result
+ * @return true benchmark was run
+ * @return false invalid index
+ */
+bool bench_run(uint8_t idx, bench_result_s *res)
+{
+	if (idx >= BENCH_NUM)
+	{
+		return false;
+	}
+	bench_setup();
+
+	const bench_kernel_s *kernel = &bench_kernels[idx];
+	uint32_t bytes = 0;
+	uint32_t start = micros();
+	for (uint32_t iter = 0; iter < kernel->iterations; iter++)
+	{
+		bytes += kernel->run(iter);
+	}
+	uint32_t time_us = micros() - start;
+
+	res->name = kernel->name;
+	res->iterations = kernel->iterations;
+	res->ns_op = (uint32_t)((uint64_t)time_us * 1000 / kernel->iterations);
+	res->bytes_op = bytes / kernel->iterations;
+	return true;
+}
@@ -0,0 +1,325 @@
+/**
+ * @file bench_kernels.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Benchmark kernels of the hot code paths, shared by ATC+BENCH and the host benchmarks
+ *        No Arduino dependencies, the settings CRC comes from <utilities.h> of RUI3 or of the host shim.
+ *        The kernels and their order are the same on both sides, so the JSON results can be compared.
+ *        Include it in one translation unit only.
+ * @version 0.1
+ * @date 2025-01-20
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef BENCH_KERNELS_H
+#define BENCH_KERNELS_H
+
+#include <stdint.h>
+#include <utilities.h>
+#include "settings.h"
+#include "log_format.h"
+#include "payload_codec.h"
+#include "lorawan_regions.h"
+#include "MillisTaskManager.h"
+
+/** Multiplier of the iteration counts, the host runs more iterations than the device */
+#ifndef BENCH_ITER_SCALE
+#define BENCH_ITER_SCALE 1
+#endif
+
+/** Benchmark kernel */
+struct bench_kernel_s
+{
+	const char *name;
+	uint32_t iterations;
+	uint32_t (*run)(uint32_t iter); // Returns the bytes processed
+};
+
+/** Result sink, keeps the compiler from removing the kernels */
+static volatile uint32_t bench_sink = 0;
+
+/** Buffer for the encoders and the CSV line, size of the uplink buffer */
+static uint8_t bench_buffer[242];
+
+/** Settings for the CRC kernel */
+static custom_param_s bench_settings;
+
+/** Log file entry for the CSV kernel */
+static result_s bench_result;
+
+/** Payloads for the decoders */
+static uint8_t bench_ft_v1_payload[ft_v1_codec::size];
+static uint8_t bench_ft_v2_payload[ft_v2_codec::size];
+static uint8_t bench_delta_payload[batch_delta_codec::size];
+
+/** Task manager with dummy tasks */
+static MillisTaskManager bench_mtm;
+
+/** Static task nodes of the dummy tasks */
+static MillisTaskManager::Task_t bench_nodes[8];
+
+/** Intervals of the dummy tasks */
+static const uint32_t bench_intervals[] = {1, 2, 5, 10, 20, 50, 100, 1000};
+
+/** Flag if the dummy tasks and the decoder payloads are ready */
+static bool bench_ready = false;
+
+/**
+ * @brief Dummy task for the task manager benchmark
+ *
+ * @tparam N task number, each task needs its own function
+ */
+template <int N>
+void bench_task(void)
+{
+	bench_sink += N;
+}
+
+/**
+ * @brief Settings CRC as used by get_at_setting and save_at_setting
+ *
+ * @param iter loop counter
+ * @return uint32_t bytes processed
+ */
+static uint32_t bench_crc32(uint32_t iter)
+{
+	bench_settings.send_interval = iter;
+	uint8_t *p_data = (uint8_t *)&bench_settings.send_interval;
+	bench_sink += Crc32(p_data, custom_params_len - (sizeof(uint32_t)));
+	return custom_params_len - (sizeof(uint32_t));
+}
+
+/**
+ * @brief Minimum DR lookup for changing payload sizes
+ *
+ * @param iter loop counter
+ * @return uint32_t bytes processed
+ */
+static uint32_t bench_min_dr(uint32_t iter)
+{
+	uint8_t region = iter % LPW_NUM_REGIONS;
+	bench_sink += lpw_min_dr(region, iter % 243, lpw_regions[region].dwell_default, 2);
+	return 0;
+}
+
+/**
+ * @brief Max payload lookup for changing DR
+ *
+ * @param iter loop counter
+ * @return uint32_t bytes processed
+ */
+static uint32_t bench_max_payload(uint32_t iter)
+{
+	uint8_t region = iter % LPW_NUM_REGIONS;
+	bench_sink += lpw_max_payload(region, iter % LPW_NUM_DR, lpw_regions[region].dwell_default, 2);
+	return 0;
+}
+
+/**
+ * @brief Time on air calculation for changing payload sizes
+ *
+ * @param iter loop counter
+ * @return uint32_t bytes processed
+ */
+static uint32_t bench_toa(uint32_t iter)
+{
+	bench_sink += lpw_toa_us(iter % LPW_NUM_REGIONS, iter % 6, iter % 243, 1);
+	return 0;
+}
+
+/**
+ * @brief FieldTester V1 location encoder
+ *
+ * @param iter loop counter
+ * @return uint32_t bytes processed
+ */
+static uint32_t bench_ft_v1_encode(uint32_t iter)
+{
+	int32_t values[5] = {144213536 + (int32_t)iter, 1210068190 - (int32_t)iter, 52, 120, 12};
+	bench_sink += ft_v1_codec::encode(bench_buffer, values);
+	return ft_v1_codec::size;
+}
+
+/**
+ * @brief FieldTester V1 location decoder, as used by the host tools
+ *
+ * @param iter loop counter
+ * @return uint32_t bytes processed
+ */
+static uint32_t bench_ft_v1_decode(uint32_t iter)
+{
+	int32_t values[5];
+	bench_ft_v1_payload[9] = iter;
+	ft_v1_codec::decode(bench_ft_v1_payload, ft_v1_codec::size, values);
+	bench_sink += values[FT_LAT] + values[FT_SATS];
+	return ft_v1_codec::size;
+}
+
+/**
+ * @brief FieldTester V2 location encoder
+ *
+ * @param iter loop counter
+ * @return uint32_t bytes processed
+ */
+static uint32_t bench_ft_v2_encode(uint32_t iter)
+{
+	int32_t values[4] = {144213536 + (int32_t)iter, 1210068190 - (int32_t)iter, (int32_t)(iter & 0xFFFF), 0};
+	bench_sink += ft_v2_codec::encode(bench_buffer, values);
+	return ft_v2_codec::size;
+}
+
+/**
+ * @brief FieldTester V2 location decoder
+ *
+ * @param iter loop counter
+ * @return uint32_t bytes processed
+ */
+static uint32_t bench_ft_v2_decode(uint32_t iter)
+{
+	int32_t values[4];
+	bench_ft_v2_payload[9] = iter;
+	bench_sink += ft_v2_codec::decode(bench_ft_v2_payload, ft_v2_codec::size, values);
+	bench_sink += values[FT_LNG] + values[FT_V2_SEQ];
+	return ft_v2_codec::size;
+}
+
+/**
+ * @brief Batched uplink delta encoder
+ *
+ * @param iter loop counter
+ * @return uint32_t bytes processed
+ */
+static uint32_t bench_batch_delta_encode(uint32_t iter)
+{
+	int32_t values[4] = {(int32_t)(iter % 2000) - 1000, 1000 - (int32_t)(iter % 2000), 3, 60};
+	bench_sink += batch_delta_codec::encode(bench_buffer, values);
+	return batch_delta_codec::size;
+}
+
+/**
+ * @brief Batched uplink delta decoder
+ *
+ * @param iter loop counter
+ * @return uint32_t bytes processed
+ */
+static uint32_t bench_batch_delta_decode(uint32_t iter)
+{
+	int32_t values[4];
+	bench_delta_payload[6] = iter;
+	batch_delta_codec::decode(bench_delta_payload, batch_delta_codec::size, values);
+	bench_sink += values[BATCH_LAT] + values[BATCH_TIME];
+	return batch_delta_codec::size;
+}
+
+/**
+ * @brief Location uplink as built by tx_buffer_add_gnss, FieldTester V1 or V2 encoder and the minimum DR of the payload
+ *        This encoder path replaced the Cayenne LPP encoder of WisBlock_Cayenne for the location uplinks
+ *
+ * @param iter loop counter
+ * @return uint32_t bytes processed
+ */
+static uint32_t bench_uplink_gnss(uint32_t iter)
+{
+	int32_t values[5] = {144213536 + (int32_t)iter, 1210068190 - (int32_t)iter, 52, 120, 12};
+	uint8_t len;
+	if (iter & 1)
+	{
+		values[FT_V2_SEQ] = (uint16_t)iter;
+		len = ft_v2_codec::encode(bench_buffer, values);
+	}
+	else
+	{
+		len = ft_v1_codec::encode(bench_buffer, values);
+	}
+	uint8_t region = iter % LPW_NUM_REGIONS;
+	bench_sink += lpw_min_dr(region, len, lpw_regions[region].dwell_default, 2);
+	return len;
+}
+
+/**
+ * @brief CSV line of the SD card log as written by write_sd_entry, all test modes with and without location
+ *
+ * @param iter loop counter
+ * @return uint32_t bytes processed
+ */
+static uint32_t bench_sd_csv(uint32_t iter)
+{
+	bench_result.sec = iter % 60;
+	bench_result.lost = iter;
+	int len = log_format_entry((char *)bench_buffer, sizeof(bench_buffer), bench_result, iter % 4, (iter & 4) != 0);
+	bench_sink += len;
+	return len;
+}
+
+/**
+ * @brief Task manager scheduler pass over 8 tasks
+ *
+ * @param iter loop counter
+ * @return uint32_t bytes processed
+ */
+static uint32_t bench_mtm_running(uint32_t iter)
+{
+	bench_mtm.Running(iter);
+	return 0;
+}
+
+/**
+ * @brief Task manager next deadline query over 8 tasks
+ *
+ * @param iter loop counter
+ * @return uint32_t bytes processed
+ */
+static uint32_t bench_mtm_deadline(uint32_t iter)
+{
+	bench_sink += bench_mtm.NextDeadline(iter);
+	return 0;
+}
+
+/** Benchmark kernels */
+static const bench_kernel_s bench_kernels[] = {
+	{"crc32_settings", 1000 * BENCH_ITER_SCALE, bench_crc32},
+	{"lpw_min_dr", 10000 * BENCH_ITER_SCALE, bench_min_dr},
+	{"lpw_max_payload", 10000 * BENCH_ITER_SCALE, bench_max_payload},
+	{"lpw_toa_us", 10000 * BENCH_ITER_SCALE, bench_toa},
+	{"ft_v1_encode", 10000 * BENCH_ITER_SCALE, bench_ft_v1_encode},
+	{"ft_v1_decode", 10000 * BENCH_ITER_SCALE, bench_ft_v1_decode},
+	{"ft_v2_encode", 10000 * BENCH_ITER_SCALE, bench_ft_v2_encode},
+	{"ft_v2_decode", 10000 * BENCH_ITER_SCALE, bench_ft_v2_decode},
+	{"batch_delta_encode", 10000 * BENCH_ITER_SCALE, bench_batch_delta_encode},
+	{"batch_delta_decode", 10000 * BENCH_ITER_SCALE, bench_batch_delta_decode},
+	{"uplink_gnss", 10000 * BENCH_ITER_SCALE, bench_uplink_gnss},
+	{"sd_csv_format", 1000 * BENCH_ITER_SCALE, bench_sd_csv},
+	{"mtm_running_8", 10000 * BENCH_ITER_SCALE, bench_mtm_running},
+	{"mtm_next_deadline_8", 10000 * BENCH_ITER_SCALE, bench_mtm_deadline},
+};
+
+/** Number of benchmark kernels */
+#define BENCH_NUM (sizeof(bench_kernels) / sizeof(bench_kernel_s))
+
+/**
+ * @brief Register the dummy tasks and encode the decoder payloads, only once
+ *
+ */
+static void bench_setup(void)
+{
+	if (bench_ready)
+	{
+		return;
+	}
+	bench_mtm.Register(&bench_nodes[0], bench_task<0>, bench_intervals[0]);
+	bench_mtm.Register(&bench_nodes[1], bench_task<1>, bench_intervals[1]);
+	bench_mtm.Register(&bench_nodes[2], bench_task<2>, bench_intervals[2]);
+	bench_mtm.Register(&bench_nodes[3], bench_task<3>, bench_intervals[3]);
+	bench_mtm.Register(&bench_nodes[4], bench_task<4>, bench_intervals[4]);
+	bench_mtm.Register(&bench_nodes[5], bench_task<5>, bench_intervals[5]);
+	bench_mtm.Register(&bench_nodes[6], bench_task<6>, bench_intervals[6]);
+	bench_mtm.Register(&bench_nodes[7], bench_task<7>, bench_intervals[7]);
+	int32_t ft_values[5] = {144213536, 1210068190, 52, 120, 12};
+	ft_v1_codec::encode(bench_ft_v1_payload, ft_values);
+	ft_v2_codec::encode(bench_ft_v2_payload, ft_values);
+	int32_t delta_values[4] = {-1000, 1000, 3, 60};
+	batch_delta_codec::encode(bench_delta_payload, delta_values);
+	bench_ready = true;
+}
+
+#endif // BENCH_KERNELS_H
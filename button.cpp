@@ -11,14 +11,33 @@
 #include "app.h"
 #include "udrv_dfu.h"
 
-/** Button press time value */
-volatile static time_t pressTime = 0;
+/** Edges captured by the interrupt, single producer (interrupt), single consumer (button task) */
+static button_edge_s button_edges[BUTTON_EDGE_QUEUE_SIZE];
+/** Write index of the edge buffer, only changed by the interrupt */
+static volatile uint16_t edge_head = 0;
+/** Read index of the edge buffer, only changed by the button task */
+static volatile uint16_t edge_tail = 0;
+/** Number of edges dropped because the buffer was full */
+static volatile uint32_t edge_overflows = 0;
+/** Number of dropped edges already handled by the button task */
+static uint32_t edge_overflows_seen = 0;
 
-/** Number of clicks counter */
-volatile uint8_t pressCount = 0;
+/** Gesture recognizer, fed with the buffered edges */
+static gesture_sm_s button_sm;
 
-/** Timestamp for first button press event */
-static time_t firstPressTime = 0;
+/** Recognized gestures waiting to be handled */
+static uint8_t button_queue[BUTTON_GESTURE_QUEUE_SIZE];
+/** Write index of the gesture queue */
+static uint16_t queue_head = 0;
+/** Read index of the gesture queue */
+static uint16_t queue_tail = 0;
+
+/** Button states of the recognized gestures */
+static const uint8_t button_gestures[GESTURE_NUM] = {BUTTONSTATE_NONE, SINGLE_CLICK, DOUBLE_CLICK, TRIPPLE_CLICK, QUAD_CLICK,
+													  FIVE_CLICK, SIX_CLICK, SEVEN_CLICK, LONG_PRESS};
+
+/** Static task node of the button handler */
+static MillisTaskManager::Task_t button_task;
 
 /** Flag if UI is active or not */
 bool g_settings_ui = false;
@@ -90,7 +109,7 @@ char *p_bw_menu[] = {"125", "250", "500", "62.5", "41.67", "31.25", "20.83", "15
 
 /**
  * @brief Initialize button handler
- *     Register interrupt handler
+ *     Register interrupt handler for both edges
  *     Register with millis task manager
  *
  * @return true
@@ -98,146 +117,125 @@ char *p_bw_menu[] = {"125", "250", "500", "62.5", "41.67", "31.25", "20.83", "15
  */
 bool buttonInit(void)
 {
+	gesture_init(&button_sm);
 	pinMode(BUTTON_INT_PIN, INPUT_PULLUP);
-	attachInterrupt(BUTTON_INT_PIN, buttonIntHandle, FALLING);
+	attachInterrupt(BUTTON_INT_PIN, buttonIntHandle, CHANGE);
+	// A press ends the sleep of the main loop, while a gesture is pending the sleep is bounded by the button task
+	api.system.sleep.setup(RUI_WAKEUP_FALLING_EDGE, BUTTON_INT_PIN);
 
-	mtmMain.Register(handle_button, 100); // Process button data every 100ms.
+	mtmMain.Register(&button_task, handle_button, 100); // Process button data every 100ms.
 
 	return true;
 }
 
 /**
  * @brief Button interrupt handler
+ *     Only buffers the edge with its time stamp, the gesture is recognized in the button task
+ *     Edges are not lost while the main loop is blocked, e.g. while settings are saved
  *
  */
 void buttonIntHandle(void)
 {
-	pressTime = millis();
-	if ((millis() - firstPressTime) > 200) // for button debounce.
+	uint16_t head = edge_head;
+	bool pressed = digitalRead(BUTTON_INT_PIN) == LOW;
+	if ((uint16_t)(head - edge_tail) >= BUTTON_EDGE_QUEUE_SIZE)
 	{
-		firstPressTime = millis();
-		pressCount += 1;
+		edge_overflows++;
+		return;
 	}
-	MYLOG("BTN", "pressCount = %d", pressCount);
+	button_edges[head % BUTTON_EDGE_QUEUE_SIZE].time = millis();
+	button_edges[head % BUTTON_EDGE_QUEUE_SIZE].pressed = pressed;
+	// Edge must be complete before the button task sees the new index
+	__sync_synchronize();
+	edge_head = head + 1;
+	trace_add(TEV_BUTTON, (uint16_t)(edge_head - edge_tail), pressed);
 }
 
 /**
- * @brief Button Status handler
+ * @brief Add a recognized gesture to the gesture queue
+ *     If the queue is full, the gesture is dropped
  *
- * @return uint8_t button status, number of clicks or long press detection
+ * @param gesture gesture_num_t, GESTURE_NONE is ignored
  */
-uint8_t getButtonStatus(void)
+static void button_queue_gesture(uint8_t gesture)
 {
-	uint8_t lowCount = 0;
-	if (((millis() - pressTime) > 3000) && (digitalRead(BUTTON_INT_PIN) == LOW) && (pressCount >= 1))
+	if (gesture == GESTURE_NONE)
 	{
-		return LONG_PRESS;
+		return;
 	}
-
-	if (((millis() - pressTime) >= 400) && (pressCount == 1) && (digitalRead(BUTTON_INT_PIN) == HIGH))
+	MYLOG("BTN", "Gesture %s", gesture_names[gesture]);
+	if ((uint16_t)(queue_head - queue_tail) >= BUTTON_GESTURE_QUEUE_SIZE)
 	{
-		uint8_t highCount = 0;
-		for (uint8_t i; i < 200; i++)
-		{
-			if (digitalRead(BUTTON_INT_PIN) == HIGH)
-				highCount++;
-			delay(1);
-		}
-		if (highCount > 198) // Have no option but to.
-		{
-			return SINGLE_CLICK;
-		}
+		MYLOG("BTN", "Gesture queue full");
+		return;
 	}
+	button_queue[queue_head % BUTTON_GESTURE_QUEUE_SIZE] = gesture;
+	queue_head++;
+}
 
-	if (((millis() - pressTime) >= 400) && (pressCount == 2) && (digitalRead(BUTTON_INT_PIN) == HIGH))
+/**
+ * @brief Feed the buffered edges into the gesture recognizer
+ *     The edges are handled with their own time stamps, a gesture that ended while the
+ *     main loop was blocked is recognized before the edges of the next gesture
+ *
+ */
+static void button_decode(void)
+{
+	while (edge_tail != edge_head)
 	{
-		uint8_t highCount = 0;
-		for (uint8_t i; i < 200; i++)
-		{
-			if (digitalRead(BUTTON_INT_PIN) == HIGH)
-				highCount++;
-			delay(1);
-		}
-		if (highCount > 198) // Have no option but to.
-		{
-			return DOUBLE_CLICK;
-		}
-	}
+		__sync_synchronize();
+		button_edge_s edge = button_edges[edge_tail % BUTTON_EDGE_QUEUE_SIZE];
+		// Slot must be copied before the interrupt can reuse it
+		__sync_synchronize();
+		edge_tail = edge_tail + 1;
 
-	if (((millis() - pressTime) >= 600) && (pressCount == 3))
-	{
-		uint8_t highCount = 0;
-		for (uint8_t i; i < 200; i++)
-		{
-			if (digitalRead(BUTTON_INT_PIN) == HIGH)
-				highCount++;
-			delay(1);
-		}
-		if (highCount > 198) // Have no option but to.
-		{
-			return TRIPPLE_CLICK;
-		}
+		button_queue_gesture(gesture_timeout(&button_sm, edge.time));
+		button_queue_gesture(gesture_edge(&button_sm, edge.pressed, edge.time));
 	}
 
-	if (((millis() - pressTime) >= 800) && (pressCount == 4))
+	// Edges were lost, the click count of the pending gesture is not reliable
+	if (edge_overflows != edge_overflows_seen)
 	{
-		uint8_t highCount = 0;
-		for (uint8_t i; i < 200; i++)
-		{
-			if (digitalRead(BUTTON_INT_PIN) == HIGH)
-				highCount++;
-			delay(1);
-		}
-		if (highCount > 198) // Have no option but to.
-		{
-			return QUAD_CLICK;
-		}
+		edge_overflows_seen = edge_overflows;
+		MYLOG("BTN", "Edge buffer overflow");
+		gesture_init(&button_sm);
 	}
 
-	if (((millis() - pressTime) >= 1200) && (pressCount == 5))
+	// The level is only valid if no new edge arrived after reading it
+	bool pressed = digitalRead(BUTTON_INT_PIN) == LOW;
+	if (edge_tail == edge_head)
 	{
-		uint8_t highCount = 0;
-		for (uint8_t i; i < 200; i++)
-		{
-			if (digitalRead(BUTTON_INT_PIN) == HIGH)
-				highCount++;
-			delay(1);
-		}
-		if (highCount > 198) // Have no option but to.
-		{
-			return FIVE_CLICK;
-		}
+		button_queue_gesture(gesture_poll(&button_sm, pressed, millis()));
 	}
+}
 
-	if (((millis() - pressTime) >= 1400) && (pressCount == 6))
-	{
-		uint8_t highCount = 0;
-		for (uint8_t i; i < 200; i++)
-		{
-			if (digitalRead(BUTTON_INT_PIN) == HIGH)
-				highCount++;
-			delay(1);
-		}
-		if (highCount > 198) // Have no option but to.
-		{
-			return SIX_CLICK;
-		}
-	}
-	if (((millis() - pressTime) >= 1600) && (pressCount == 7))
+/**
+ * @brief Button Status handler
+ *     Decodes the buffered edges and returns the oldest recognized gesture, never waits for the button
+ *
+ * @return uint8_t button status, number of clicks or long press detection
+ */
+uint8_t getButtonStatus(void)
+{
+	button_decode();
+	if (queue_tail == queue_head)
 	{
-		uint8_t highCount = 0;
-		for (uint8_t i; i < 200; i++)
-		{
-			if (digitalRead(BUTTON_INT_PIN) == HIGH)
-				highCount++;
-			delay(1);
-		}
-		if (highCount > 198) // Have no option but to.
-		{
-			return SEVEN_CLICK;
-		}
+		return BUTTONSTATE_NONE;
 	}
-	return BUTTONSTATE_NONE;
+	uint8_t gesture = button_queue[queue_tail % BUTTON_GESTURE_QUEUE_SIZE];
+	queue_tail++;
+	return button_gestures[gesture];
+}
+
+/**
+ * @brief Check if the button needs the button task
+ *
+ * @return true edges buffered, gesture in progress or gestures waiting
+ * @return false button idle
+ */
+bool button_busy(void)
+{
+	return (edge_tail != edge_head) || gesture_pending(&button_sm) || (queue_tail != queue_head);
 }
 
 /**
@@ -264,12 +262,14 @@ void save_n_reboot(void)
 		if ((g_custom_parameters.test_mode == MODE_P2P) || (g_custom_parameters.test_mode == MODE_MESHTASTIC))
 		{
 			api.lora.precv(0);
+			energy_state(EN_RX, false);
 			api.lorawan.join(0, 0, 10, 50);
 			api.lora.nwm.set();
 		}
 		else
 		{
 			api.lora.precv(0);
+			energy_state(EN_RX, false);
 			api.lorawan.join(1, 1, 10, 50);
 			api.lorawan.nwm.set();
 		}
@@ -352,6 +352,7 @@ void save_n_reboot(void)
 		}
 		// enable receive again
 		api.lora.precv(65533);
+		energy_state(EN_RX, true);
 	}
 	oled_clear();
 
@@ -373,39 +374,47 @@ void save_n_reboot(void)
 		oled_add_line((char *)"FieldTester V2 mode");
 		break;
 	}
-	sprintf(line_str, "Test interval  %lds", g_custom_parameters.send_interval / 1000);
+	if (g_custom_parameters.auto_interval)
+	{
+		sprintf(line_str, "Test interval  auto %lds", get_send_period() / 1000);
+	}
+	else
+	{
+		sprintf(line_str, "Test interval  %lds", g_custom_parameters.send_interval / 1000);
+	}
 	oled_add_line(line_str);
 
-	if (g_custom_parameters.send_interval != 0)
+	if (get_send_period() != 0)
 	{
-		api.system.timer.start(RAK_TIMER_0, g_custom_parameters.send_interval, NULL);
+		lat_timer_start(RAK_TIMER_0, get_send_period(), NULL);
 	}
 
 	if (g_custom_parameters.display_saver)
 	{
-		api.system.timer.start(RAK_TIMER_2, 60000, NULL);
+		lat_timer_start(RAK_TIMER_2, 60000, NULL);
 	}
 }
 
 /**
- * @brief Handle button events
+ * @brief Handle one button event
  *     Switch UI display depending on number clicks
  *     Enable/Disable UI display depending on number of clicks
  *     Force Reboot or Bootloader mode, depending on number of clicks
  *     Switch display on/off with long press event
  *
+ * @param status button status, number of clicks or long press
  */
-void handle_button(void)
+static void button_event(uint8_t status)
 {
 	uint8_t selected_item = 0;
 	// char line_str[32];
 
-	switch (getButtonStatus())
+	trace_add(TEV_GESTURE, status);
+
+	switch (status)
 	{
 	case LONG_PRESS:
 	{
-		pressCount = 0;
-		pressTime = 0;
 		MYLOG("BTN", "LongPress");
 		if (display_power)
 		{
@@ -420,8 +429,6 @@ void handle_button(void)
 	}
 	case SEVEN_CLICK:
 	{
-		pressCount = 0;
-		pressTime = 0;
 		// MYLOG("BTN", "Seven Clicks");
 		if (g_settings_ui)
 		{
@@ -436,8 +443,6 @@ void handle_button(void)
 	}
 	case SIX_CLICK:
 	{
-		pressCount = 0;
-		pressTime = 0;
 		// MYLOG("BTN", "Six Clicks");
 		if (g_settings_ui)
 		{
@@ -461,8 +466,6 @@ void handle_button(void)
 	}
 	case FIVE_CLICK:
 	{
-		pressCount = 0;
-		pressTime = 0;
 		// MYLOG("BTN", "Fice Clicks");
 		if (g_settings_ui)
 		{
@@ -504,8 +507,6 @@ void handle_button(void)
 	}
 	case QUAD_CLICK:
 	{
-		pressCount = 0;
-		pressTime = 0;
 		// MYLOG("BTN", "Four Clicks");
 		if (g_settings_ui)
 		{
@@ -517,6 +518,7 @@ void handle_button(void)
 				display_show_menu(mode_menu, mode_menu_len, sel_menu, selected_item, g_last_settings.display_saver, g_last_settings.location_on);
 				break;
 			case T_INFO_MENU: // NA
+			case S_ENERGY: // NA
 				sel_menu = T_TOP_MENU;
 				display_show_menu(top_menu, top_menu_len, sel_menu, 255, g_last_settings.display_saver, g_last_settings.location_on);
 				break;
@@ -583,52 +585,13 @@ void handle_button(void)
 				if ((g_custom_parameters.test_mode != MODE_P2P) && (g_custom_parameters.test_mode != MODE_MESHTASTIC))
 				{
 					// Sweep through all DR (only LoRaWAN)
-					if (!tx_active)
+					if (!tx_active && !dr_sweep_active)
 					{
-						dr_sweep_active = true;
 						if (!display_power)
 						{
 							oled_power(true);
 						}
-						MYLOG("BTN", "DR sweep triggered");
-						api.system.timer.stop(RAK_TIMER_0);
-
-						uint16_t *region_ps = region_map[api.lorawan.band.get()];
-						uint16_t origin_dr = api.lorawan.dr.get();
-						for (int idx = 0; idx < 16; idx++)
-						{
-							if (region_ps[idx] != 0)
-							{
-								MYLOG("BTN", "DR sweep DR%d", idx);
-								api.lorawan.dr.set(idx);
-								delay(100);
-								send_packet(NULL);
-
-								// Wait for TX finished
-								time_t start_wait = millis();
-								while (tx_active)
-								{
-									delay(1000);
-									if ((millis() - start_wait) > 10000)
-									{
-										// Timeout on tx_active
-										MYLOG("BTN", "tx_active timeout");
-										break;
-									}
-								}
-								// Some time for display
-								delay(2000);
-							}
-						}
-
-						// Restore data rate
-						api.lorawan.dr.set(origin_dr);
-
-						if (g_custom_parameters.send_interval != 0)
-						{
-							api.system.timer.start(RAK_TIMER_0, g_custom_parameters.send_interval, NULL);
-						}
-						dr_sweep_active = false;
+						dr_sweep_start();
 					}
 				}
 			}
@@ -637,8 +600,6 @@ void handle_button(void)
 	}
 	case TRIPPLE_CLICK:
 	{
-		pressCount = 0;
-		pressTime = 0;
 		// MYLOG("BTN", "Tripple Click");
 		if (g_settings_ui)
 		{
@@ -649,6 +610,7 @@ void handle_button(void)
 				display_show_menu(settings_menu, settings_menu_len, sel_menu, 255, g_last_settings.display_saver, g_last_settings.location_on);
 				break;
 			case T_INFO_MENU: // NA
+			case S_ENERGY: // NA
 				sel_menu = T_TOP_MENU;
 				display_show_menu(top_menu, top_menu_len, sel_menu, 255, g_last_settings.display_saver, g_last_settings.location_on);
 				break;
@@ -821,7 +783,7 @@ void handle_button(void)
 		{
 			if (api.lorawan.nwm.get() == 1)
 			{
-				if (!tx_active)
+				if (!tx_active && !dr_sweep_active && !sd_busy())
 				{
 					if (!display_power)
 					{
@@ -831,15 +793,15 @@ void handle_button(void)
 					api.system.timer.stop(RAK_TIMER_0);
 					forced_tx = true;
 					send_packet(NULL);
-					if (g_custom_parameters.send_interval != 0)
+					if (get_send_period() != 0)
 					{
-						api.system.timer.start(RAK_TIMER_0, g_custom_parameters.send_interval, NULL);
+						lat_timer_start(RAK_TIMER_0, get_send_period(), NULL);
 					}
 				}
 			}
 			else
 			{
-				if (!tx_active)
+				if (!tx_active && !sd_busy())
 				{
 					if (!display_power)
 					{
@@ -849,9 +811,9 @@ void handle_button(void)
 					api.system.timer.stop(RAK_TIMER_0);
 					forced_tx = true;
 					send_packet(NULL);
-					if (g_custom_parameters.send_interval != 0)
+					if (get_send_period() != 0)
 					{
-						api.system.timer.start(RAK_TIMER_0, g_custom_parameters.send_interval, NULL);
+						lat_timer_start(RAK_TIMER_0, get_send_period(), NULL);
 					}
 				}
 			}
@@ -860,8 +822,6 @@ void handle_button(void)
 	}
 	case DOUBLE_CLICK:
 	{
-		pressCount = 0;
-		pressTime = 0;
 		// MYLOG("BTN", "Double Click");
 		if (!g_settings_ui)
 		{
@@ -892,6 +852,7 @@ void handle_button(void)
 			{
 				MYLOG("BTN", "Get LoRaWAN settings");
 				api.lora.precv(0);
+				energy_state(EN_RX, false);
 				ui_p2p_freq = api.lora.pfreq.get();
 				ui_p2p_sf = api.lora.psf.get();
 				ui_p2p_bw = api.lora.pbw.get();
@@ -910,9 +871,13 @@ void handle_button(void)
 				sel_menu = T_INFO_MENU;
 				display_show_menu(back_menu, back_menu_len, sel_menu, 255, g_last_settings.display_saver, g_last_settings.location_on);
 				break;
-			case T_INFO_MENU: // NA
-				sel_menu = T_TOP_MENU;
-				display_show_menu(top_menu, top_menu_len, sel_menu, 255, g_last_settings.display_saver, g_last_settings.location_on);
+			case T_INFO_MENU:
+				sel_menu = S_ENERGY;
+				display_show_menu(back_menu, back_menu_len, sel_menu, 255, g_last_settings.display_saver, g_last_settings.location_on);
+				break;
+			case S_ENERGY:
+				// Refresh the estimation
+				display_show_menu(back_menu, back_menu_len, sel_menu, 255, g_last_settings.display_saver, g_last_settings.location_on);
 				break;
 			case T_SETT_MENU:
 				sel_menu = S_SEND_INT;
@@ -1051,8 +1016,6 @@ void handle_button(void)
 	}
 	case SINGLE_CLICK:
 	{
-		pressCount = 0;
-		pressTime = 0;
 		// MYLOG("BTN", "Single Click");
 		if (g_settings_ui)
 		{
@@ -1071,6 +1034,10 @@ void handle_button(void)
 				sel_menu = T_TOP_MENU;
 				display_show_menu(top_menu, top_menu_len, sel_menu, 255, g_last_settings.display_saver, g_last_settings.location_on);
 				break;
+			case S_ENERGY:
+				sel_menu = T_INFO_MENU;
+				display_show_menu(back_menu, back_menu_len, sel_menu, 255, g_last_settings.display_saver, g_last_settings.location_on);
+				break;
 			case S_LPW_BAND:
 			case S_LPW_ADR:
 			case S_LPW_DR:
@@ -1102,4 +1069,18 @@ void handle_button(void)
 	default:
 		break;
 	}
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Handle button events, task of the task manager
+ *     All gestures recognized since the last call are handled in order
+ *
+ */
+void handle_button(void)
+{
+	uint8_t status;
+	while ((status = getButtonStatus()) != BUTTONSTATE_NONE)
+	{
+		button_event(status);
+	}
+}
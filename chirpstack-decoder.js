@@ -4,52 +4,194 @@
 // Decoding function depends on fPort
 //  - fPort == 1 ==> Decode FieldTester payload
 //  - fPort == 2 ==> Decode Linkcheck payload (returns an ASCII string of the payload)
+//  - fPort == 3 ==> Decode batched Linkcheck payload (returns an array of points)
+//  - fPort == 4 ==> Decode fragment of a Linkcheck payload (returns the fragment, use reassembleFragments() to rebuild the packet)
 // The function must return an object, e.g. {"temperature": 22.5}
+// Field table of the FieldTester payload, must match ft_v1_fields in payload_codec.h
+//  type: 0 = unsigned, 1 = magnitude with separate sign bit
+//  value = raw * scale + offset, same units as the firmware, the decoded value is value / divisor
+//  The tables are checked against payload_codec.h by test/check_decoder.js (make test in the test folder)
+var ftV1Fields = [
+	{ name: "latitude", type: 1, bitPos: 2, bits: 23, signBit: 1, offset: 53, scale: 108, divisor: 10000000 },
+	{ name: "longitude", type: 1, bitPos: 25, bits: 23, signBit: 0, offset: 107, scale: 215, divisor: 10000000 },
+	{ name: "altitude", type: 0, bitPos: 48, bits: 16, signBit: 0, offset: -1000, scale: 1, divisor: 1 },
+	{ name: "hdop", type: 0, bitPos: 64, bits: 8, signBit: 0, offset: 0, scale: 10, divisor: 100 },
+	{ name: "sats", type: 0, bitPos: 72, bits: 8, signBit: 0, offset: 0, scale: 1, divisor: 1 }
+];
+
+// Field tables of the batched payload, must match batch_head_fields, batch_key_fields and batch_delta_fields in payload_codec.h
+var batchHeadFields = [
+	{ name: "count", type: 0, bitPos: 0, bits: 8, signBit: 0, offset: 0, scale: 1, divisor: 1 },
+	{ name: "age", type: 0, bitPos: 8, bits: 16, signBit: 0, offset: 0, scale: 1, divisor: 1 },
+	{ name: "rssi", type: 0, bitPos: 24, bits: 8, signBit: 0, offset: -200, scale: 1, divisor: 1 },
+	{ name: "snr", type: 0, bitPos: 32, bits: 8, signBit: 0, offset: -128, scale: 1, divisor: 1 },
+	{ name: "gateways", type: 0, bitPos: 40, bits: 8, signBit: 0, offset: 0, scale: 1, divisor: 1 }
+];
+var batchKeyFields = [
+	{ name: "latitude", type: 0, bitPos: 0, bits: 32, signBit: 0, offset: -900000000, scale: 1, divisor: 1 },
+	{ name: "longitude", type: 0, bitPos: 32, bits: 32, signBit: 0, offset: -1800000000, scale: 1, divisor: 1 },
+	{ name: "altitude", type: 0, bitPos: 64, bits: 16, signBit: 0, offset: -1000, scale: 1, divisor: 1 }
+];
+var batchDeltaFields = [
+	{ name: "latitude", type: 0, bitPos: 0, bits: 16, signBit: 0, offset: -3276800, scale: 100, divisor: 1 },
+	{ name: "longitude", type: 0, bitPos: 16, bits: 16, signBit: 0, offset: -3276800, scale: 100, divisor: 1 },
+	{ name: "altitude", type: 0, bitPos: 32, bits: 8, signBit: 0, offset: -128, scale: 1, divisor: 1 },
+	{ name: "time", type: 0, bitPos: 40, bits: 16, signBit: 0, offset: 0, scale: 1, divisor: 1 }
+];
+
+// Field table of the fragment header, must match frag_head_fields in payload_codec.h
+var fragHeadFields = [
+	{ name: "id", type: 0, bitPos: 0, bits: 8, signBit: 0, offset: 0, scale: 1, divisor: 1 },
+	{ name: "total", type: 0, bitPos: 8, bits: 8, signBit: 0, offset: 0, scale: 1, divisor: 1 },
+	{ name: "offset", type: 0, bitPos: 16, bits: 8, signBit: 0, offset: 0, scale: 1, divisor: 1 }
+];
+
+// Read bits MSB first, same as codec_get_bits() in payload_codec.h
+function getBits(bytes, bitPos, bits) {
+	var raw = 0;
+	for (var idx = 0; idx < bits; idx++) {
+		var pos = bitPos + idx;
+		raw = raw * 2 + ((bytes[pos >> 3] >> (7 - (pos & 0x07))) & 0x01);
+	}
+	return raw;
+}
+
+// Decode a payload with a field table, same as codec_format::decode() in payload_codec.h
+function decodeFields(fields, bytes) {
+	var values = {};
+	for (var idx = 0; idx < fields.length; idx++) {
+		var field = fields[idx];
+		var value = getBits(bytes, field.bitPos, field.bits) * field.scale + field.offset;
+		if ((field.type === 1) && getBits(bytes, field.signBit, 1)) {
+			value = -value;
+		}
+		values[field.name] = value / field.divisor;
+	}
+	return values;
+}
+
+// Expand a batched payload into points, keyframe first, then position and time changes
+// age is the number of seconds the sample was taken before the uplink
+// RSSI, SNR and number of gateways are the LinkCheck result before the uplink, once per packet
+function decodeBatch(bytes) {
+	var head = decodeFields(batchHeadFields, bytes);
+	var key = decodeFields(batchKeyFields, bytes.slice(6, 16));
+	var points = [];
+	var lat = key.latitude;
+	var lng = key.longitude;
+	var alt = key.altitude;
+	var time = 0;
+	for (var idx = 0; idx < head.count; idx++) {
+		if (idx > 0) {
+			var pos = 16 + (idx - 1) * 7;
+			if (bytes.length < pos + 7) {
+				break;
+			}
+			var sample = decodeFields(batchDeltaFields, bytes.slice(pos, pos + 7));
+			lat += sample.latitude;
+			lng += sample.longitude;
+			alt += sample.altitude;
+			time += sample.time;
+		}
+		points.push({
+			latitude: lat / 10000000,
+			longitude: lng / 10000000,
+			altitude: alt,
+			time: time
+		});
+	}
+	// Time of the last sample is the age in the header
+	for (idx = 0; idx < points.length; idx++) {
+		points[idx].age = head.age + time - points[idx].time;
+		delete points[idx].time;
+	}
+	return { rssi: head.rssi, snr: head.snr, gateways: head.gateways, points: points };
+}
+
+// Convert bytes to a hex string
+function toHex(bytes) {
+	return Array.from(bytes, function (byte) {
+		return ('0' + (byte & 0xFF).toString(16)).slice(-2);
+	}).join('');
+}
+
+// Rebuild packets from decoded fragments (fPort 4), the fragments can be in any order
+// The decoder is stateless, the integration has to collect the fragments and call this function
+// Returns the complete packets as hex strings and the ids of incomplete packets
+function reassembleFragments(fragments) {
+	var packets = {};
+	for (var idx = 0; idx < fragments.length; idx++) {
+		var frag = fragments[idx];
+		var packet = packets[frag.id];
+		if (!packet || (packet.total !== frag.total)) {
+			packet = { total: frag.total, bytes: new Array(frag.total), received: 0 };
+			packets[frag.id] = packet;
+		}
+		for (var pos = 0; pos < frag.data.length / 2; pos++) {
+			var byteIdx = frag.offset + pos;
+			if ((byteIdx < packet.total) && (packet.bytes[byteIdx] === undefined)) {
+				packet.bytes[byteIdx] = parseInt(frag.data.substr(pos * 2, 2), 16);
+				packet.received++;
+			}
+		}
+	}
+	var result = { complete: [], incomplete: [] };
+	for (var id in packets) {
+		if (packets[id].received === packets[id].total) {
+			result.complete.push({ id: Number(id), payload: toHex(packets[id].bytes) });
+		} else {
+			result.incomplete.push(Number(id));
+		}
+	}
+	return result;
+}
+
 function Decode(fPort, bytes, variables) {
 	var decoded = {};
 	// avoid sending Downlink ACK to integration (Cargo)
 	if (fPort === 1) {
-		var lonSign = (bytes[0] >> 7) & 0x01 ? -1 : 1;
-		var latSign = (bytes[0] >> 6) & 0x01 ? -1 : 1;
-
-		var encLat = ((bytes[0] & 0x3f) << 17) +
-			(bytes[1] << 9) +
-			(bytes[2] << 1) +
-			(bytes[3] >> 7);
-
-		var encLon = ((bytes[3] & 0x7f) << 16) +
-			(bytes[4] << 8) +
-			bytes[5];
-
-		var hdop = bytes[8] / 10;
-		var sats = bytes[9];
+		var fields = decodeFields(ftV1Fields, bytes);
+		var hdop = fields.hdop;
+		var sats = fields.sats;
 
 		var maxHdop = 2;
 		var minSats = 5;
 
 		if ((hdop < maxHdop) && (sats >= minSats)) {
 			// Send only acceptable quality of position to mappers
-			decoded.latitude = latSign * (encLat * 108 + 53) / 10000000;
-			decoded.longitude = lonSign * (encLon * 215 + 107) / 10000000;
-			decoded.altitude = ((bytes[6] << 8) + bytes[7]) - 1000;
+			decoded.latitude = fields.latitude;
+			decoded.longitude = fields.longitude;
+			decoded.altitude = fields.altitude;
 			decoded.accuracy = (hdop * 5 + 5) / 10
 			decoded.hdop = hdop;
 			decoded.sats = sats;
 		} else {
 			decoded.error = "Need more GPS precision (hdop must be <" + maxHdop +
 				" & sats must be >= " + minSats + ") current hdop: " + hdop + " & sats:" + sats;
-			decoded.latitude = latSign * (encLat * 108 + 53) / 10000000;
-			decoded.longitude = lonSign * (encLon * 215 + 107) / 10000000;
-			decoded.altitude = ((bytes[6] << 8) + bytes[7]) - 1000;
+			decoded.latitude = fields.latitude;
+			decoded.longitude = fields.longitude;
+			decoded.altitude = fields.altitude;
 			decoded.accuracy = (hdop * 5 + 5) / 10
 			decoded.hdop = hdop;
 			decoded.sats = sats;
 		}
 		return decoded;
 	} else if (fPort === 2) {
-		decoded.payload = Array.from(bytes, function (byte) {
-			return ('0' + (byte & 0xFF).toString(16)).slice(-2);
-		}).join('')
+		decoded.payload = toHex(bytes);
+		return decoded;
+	} else if (fPort === 3) {
+		if (bytes.length < 16) {
+			decoded.error = "Batched payload too short";
+			return decoded;
+		}
+		return decodeBatch(bytes);
+	} else if (fPort === 4) {
+		if (bytes.length < 4) {
+			decoded.error = "Fragment too short";
+			return decoded;
+		}
+		decoded = decodeFields(fragHeadFields, bytes);
+		decoded.data = toHex(bytes.slice(3));
 		return decoded;
 	}
 	return null;
@@ -61,6 +61,20 @@ int product_info_handler(SERIAL_PORT port, char *cmd, stParam *param);
 int avail_modules_handler(SERIAL_PORT port, char *cmd, stParam *param);
 int settings_handler(SERIAL_PORT port, char *cmd, stParam *param);
 int mesh_node_handler(SERIAL_PORT port, char *cmd, stParam *param);
+int batch_handler(SERIAL_PORT port, char *cmd, stParam *param);
+int duty_cycle_handler(SERIAL_PORT port, char *cmd, stParam *param);
+int auto_interval_handler(SERIAL_PORT port, char *cmd, stParam *param);
+int sweep_handler(SERIAL_PORT port, char *cmd, stParam *param);
+int size_sweep_handler(SERIAL_PORT port, char *cmd, stParam *param);
+int fragment_handler(SERIAL_PORT port, char *cmd, stParam *param);
+int bench_handler(SERIAL_PORT port, char *cmd, stParam *param);
+int sleep_handler(SERIAL_PORT port, char *cmd, stParam *param);
+int latency_handler(SERIAL_PORT port, char *cmd, stParam *param);
+int cycle_handler(SERIAL_PORT port, char *cmd, stParam *param);
+int jobs_handler(SERIAL_PORT port, char *cmd, stParam *param);
+int trace_handler(SERIAL_PORT port, char *cmd, stParam *param);
+int energy_handler(SERIAL_PORT port, char *cmd, stParam *param);
+int oled_handler(SERIAL_PORT port, char *cmd, stParam *param);
 
 /**
  * @brief Add send interval AT command
@@ -118,10 +132,10 @@ int interval_send_handler(SERIAL_PORT port, char *cmd, stParam *param)
 		MYLOG("AT_CMD", "New interval %ld", g_custom_parameters.send_interval);
 		// Stop the timer
 		api.system.timer.stop(RAK_TIMER_0);
-		if (g_custom_parameters.send_interval != 0)
+		if (get_send_period() != 0)
 		{
 			// Restart the timer
-			api.system.timer.start(RAK_TIMER_0, g_custom_parameters.send_interval, NULL);
+			lat_timer_start(RAK_TIMER_0, get_send_period(), NULL);
 		}
 		MYLOG("AT_CMD", "Timer restarted with %ld", g_custom_parameters.send_interval);
 		// Save custom settings
@@ -340,23 +354,11 @@ int dump_logs_handler(SERIAL_PORT port, char *cmd, stParam *param)
 		oled_add_line((char *)"Do not power off");
 		oled_display();
 
-		time_t start_wait = millis();
-		while (!ready_to_dump)
+		// Dump runs as job after the current test cycle, the device reboots when finished
+		if (!sd_dump_start())
 		{
-			delay(1000);
-			if ((millis() - start_wait) > 10000)
-			{
-				MYLOG("ATC", "Timeout waiting for TX finished");
-				return AT_BUSY_ERROR;
-			}
+			return AT_BUSY_ERROR;
 		}
-		dump_all_sd_files();
-		AT_PRINTF("\r\n");
-		oled_clear();
-		oled_write_header("REBOOT", false);
-		oled_display();
-		// reboot
-		api.system.reboot();
 	}
 	else if (param->argc == 1 && !strcmp(param->argv[0], "e"))
 	{
@@ -370,21 +372,11 @@ int dump_logs_handler(SERIAL_PORT port, char *cmd, stParam *param)
 		oled_add_line((char *)"Do not power off");
 		oled_display();
 
-		time_t start_wait = millis();
-		while (!ready_to_dump)
+		// Erase runs as job after the current test cycle, the device reboots when finished
+		if (!sd_erase_start())
 		{
-			delay(1000);
-			if ((millis() - start_wait) > 20000)
-			{
-				MYLOG("ATC", "Timeout waiting for TX finished");
-				return AT_BUSY_ERROR;
-			}
+			return AT_BUSY_ERROR;
 		}
-
-		clear_sd_file();
-
-		// reboot
-		api.system.reboot();
 	}
 
 	// else if (param->argc == 1)
@@ -686,15 +678,16 @@ int settings_handler(SERIAL_PORT port, char *cmd, stParam *param)
 			g_settings_active = false;
 			// Stop the timer
 			api.system.timer.stop(RAK_TIMER_0);
-			if (g_custom_parameters.send_interval != 0)
+			if (get_send_period() != 0)
 			{
 				// Restart the timer
-				api.system.timer.start(RAK_TIMER_0, g_custom_parameters.send_interval, NULL);
+				lat_timer_start(RAK_TIMER_0, get_send_period(), NULL);
 			}
 
 			if ((g_custom_parameters.test_mode == MODE_P2P) || (g_custom_parameters.test_mode == MODE_MESHTASTIC))
 			{
 				api.lora.precv(65533);
+				energy_state(EN_RX, true);
 			}
 			return AT_OK;
 		}
@@ -707,6 +700,7 @@ int settings_handler(SERIAL_PORT port, char *cmd, stParam *param)
 			if ((g_custom_parameters.test_mode == MODE_P2P) || (g_custom_parameters.test_mode == MODE_MESHTASTIC))
 			{
 				api.lora.precv(0);
+				energy_state(EN_RX, false);
 			}
 			return AT_OK;
 		}
@@ -754,27 +748,21 @@ int mesh_node_handler(SERIAL_PORT port, char *cmd, stParam *param)
 }
 
 /**
- * @brief Add custom Status AT command
+ * @brief Add batched uplink AT command
  *
- * @return true AT command were added
- * @return false AT command couldn't be added
+ * @return true if success
+ * @return false if failed
  */
-bool init_status_at(void)
+bool init_batch_at(void)
 {
-	return api.system.atMode.add((char *)"STATUS",
-								 (char *)"Get device information",
-								 (char *)"STATUS", status_handler,
-								 RAK_ATCMD_PERM_READ);
+	return api.system.atMode.add((char *)"BATCH",
+								 (char *)"Set/Get number of samples per uplink in LinkCheck mode with location. 1 = off, 2 to 32 = batched",
+								 (char *)"BATCH", batch_handler,
+								 RAK_ATCMD_PERM_WRITE | RAK_ATCMD_PERM_READ);
 }
 
-/** Regions as text array */
-char *g_regions_list[] = {"EU433", "CN470", "RU864", "IN865", "EU868", "US915", "AU915", "KR920", "AS923", "AS923-2", "AS923-3", "AS923-4", "LA915"};
-/** Network modes as text array*/
-char *nwm_list[] = {"P2P", "LoRaWAN", "FSK"};
-/** Available test modes as text array */
-char *test_mode_list[] = {"LinkCheck", "LoRa P2P", "FieldTester"};
 /**
- * @brief Print device status over Serial
+ * @brief Handler for batched uplink AT command
  *
  * @param port Serial port used
  * @param cmd char array with the received AT command
@@ -783,93 +771,35 @@ char *test_mode_list[] = {"LinkCheck", "LoRa P2P", "FieldTester"};
  * 			AT_OK AT command & parameters valid
  * 			AT_PARAM_ERROR command or parameters invalid
  */
-int status_handler(SERIAL_PORT port, char *cmd, stParam *param)
+int batch_handler(SERIAL_PORT port, char *cmd, stParam *param)
 {
-	String value_str = "";
-	int nw_mode = 0;
-	int region_set = 0;
-	uint8_t key_eui[16] = {0}; // efadff29c77b4829acf71e1a6e76f713
-
-	if ((param->argc == 1 && !strcmp(param->argv[0], "?")) || (param->argc == 0))
+	if (param->argc == 1 && !strcmp(param->argv[0], "?"))
 	{
-		AT_PRINTF("Device Status:");
-		AT_PRINTF("Test Mode: %s", test_mode_list[g_custom_parameters.test_mode]);
-		value_str = api.system.hwModel.get();
-		value_str.toUpperCase();
-		AT_PRINTF("Module: %s", value_str.c_str());
-		AT_PRINTF("Version: %s", api.system.firmwareVer.get().c_str());
-		AT_PRINTF("Send time: %d s", g_custom_parameters.send_interval / 1000);
-		/// \todo
-		nw_mode = api.lorawan.nwm.get();
-		AT_PRINTF("Network mode %s", nwm_list[nw_mode]);
-		if (nw_mode == 1)
+		AT_PRINTF("%s=%d", cmd, g_custom_parameters.batch_samples);
+	}
+	else if (param->argc == 1)
+	{
+		for (int i = 0; i < strlen(param->argv[0]); i++)
 		{
-			AT_PRINTF("Network %s", api.lorawan.njs.get() ? "joined" : "not joined");
-			region_set = api.lorawan.band.get();
-			AT_PRINTF("Region: %d", region_set);
-			AT_PRINTF("Region: %s", g_regions_list[region_set]);
-			if (api.lorawan.njm.get())
-			{
-				AT_PRINTF("OTAA mode");
-				api.lorawan.deui.get(key_eui, 8);
-				AT_PRINTF("DevEUI=%02X%02X%02X%02X%02X%02X%02X%02X",
-						  key_eui[0], key_eui[1], key_eui[2], key_eui[3],
-						  key_eui[4], key_eui[5], key_eui[6], key_eui[7]);
-				api.lorawan.appeui.get(key_eui, 8);
-				AT_PRINTF("AppEUI=%02X%02X%02X%02X%02X%02X%02X%02X",
-						  key_eui[0], key_eui[1], key_eui[2], key_eui[3],
-						  key_eui[4], key_eui[5], key_eui[6], key_eui[7]);
-				api.lorawan.appkey.get(key_eui, 16);
-				AT_PRINTF("AppKey=%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X",
-						  key_eui[0], key_eui[1], key_eui[2], key_eui[3],
-						  key_eui[4], key_eui[5], key_eui[6], key_eui[7],
-						  key_eui[8], key_eui[9], key_eui[10], key_eui[11],
-						  key_eui[12], key_eui[13], key_eui[14], key_eui[15]);
-			}
-			else
+			if (!isdigit(*(param->argv[0] + i)))
 			{
-				AT_PRINTF("ABP mode");
-				api.lorawan.appskey.get(key_eui, 16);
-				AT_PRINTF("AppsKey=%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X",
-						  key_eui[0], key_eui[1], key_eui[2], key_eui[3],
-						  key_eui[4], key_eui[5], key_eui[6], key_eui[7],
-						  key_eui[8], key_eui[9], key_eui[10], key_eui[11],
-						  key_eui[12], key_eui[13], key_eui[14], key_eui[15]);
-				api.lorawan.nwkskey.get(key_eui, 16);
-				AT_PRINTF("NwksKey=%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X",
-						  key_eui[0], key_eui[1], key_eui[2], key_eui[3],
-						  key_eui[4], key_eui[5], key_eui[6], key_eui[7],
-						  key_eui[8], key_eui[9], key_eui[10], key_eui[11],
-						  key_eui[12], key_eui[13], key_eui[14], key_eui[15]);
-				api.lorawan.daddr.get(key_eui, 4);
-				AT_PRINTF("DevAddr=%02X%02X%02X%02X",
-						  key_eui[0], key_eui[1], key_eui[2], key_eui[3]);
+				return AT_PARAM_ERROR;
 			}
 		}
-		else if (nw_mode == 0)
-		{
-			AT_PRINTF("Frequency = %d", api.lora.pfreq.get());
-			AT_PRINTF("SF = %d", api.lora.psf.get());
-			AT_PRINTF("BW = %d", api.lora.pbw.get());
-			AT_PRINTF("CR = %d", api.lora.pcr.get());
-			AT_PRINTF("Preamble length = %d", api.lora.ppl.get());
-			AT_PRINTF("TX power = %d", api.lora.ptp.get());
-		}
-		else
+
+		uint32_t new_samples = strtoul(param->argv[0], NULL, 10);
+		if ((new_samples < 1) || (new_samples > BATCH_MAX_SAMPLES))
 		{
-			AT_PRINTF("Frequency = %d", api.lora.pfreq.get());
-			AT_PRINTF("Bitrate = %d", api.lora.pbr.get());
-			AT_PRINTF("Deviaton = %d", api.lora.pfdev.get());
+			return AT_PARAM_ERROR;
 		}
-		AT_PRINTF("Custom settings");
-		AT_PRINTF("Testmode = %d", g_custom_parameters.test_mode);
-		AT_PRINTF("Display saver %s", g_custom_parameters.display_saver ? "On" : "off");
-		atcmd_printf("Custom Packet = ");
-		for (uint8_t i = 0; i < g_custom_parameters.custom_packet_len; i++)
+
+		if (new_samples != g_custom_parameters.batch_samples)
 		{
-			atcmd_printf("%02X", g_custom_parameters.custom_packet[i]);
+			g_custom_parameters.batch_samples = new_samples;
+			save_at_setting();
+			// Start with a new batch
+			batch_reset();
 		}
-		atcmd_printf("\r\n");
 	}
 	else
 	{
@@ -879,21 +809,23 @@ int status_handler(SERIAL_PORT port, char *cmd, stParam *param)
 }
 
 /**
- * @brief Add send interval AT command
+ * @brief Add duty cycle AT command
  *
  * @return true if success
  * @return false if failed
  */
-bool init_app_ver_at(void)
+bool init_duty_cycle_at(void)
 {
-	return api.system.atMode.add((char *)"APPVER",
-								 (char *)"Get application version",
-								 (char *)"APPVER", app_ver_handler,
+	return api.system.atMode.add((char *)"DC",
+								 (char *)"Get duty cycle status. Format: <time on air ms>:<budget left ms>:<next TX ms>",
+								 (char *)"DC", duty_cycle_handler,
 								 RAK_ATCMD_PERM_READ);
 }
 
 /**
- * @brief Handler for send interval AT command
+ * @brief Handler for duty cycle AT command
+ *        Time on air is calculated for the custom packet with the current DR
+ *        Budget left is -1 if the region has no duty cycle limit
  *
  * @param port Serial port used
  * @param cmd char array with the received AT command
@@ -902,93 +834,969 @@ bool init_app_ver_at(void)
  * 			AT_OK AT command & parameters valid
  * 			AT_PARAM_ERROR command or parameters invalid
  */
-int app_ver_handler(SERIAL_PORT port, char *cmd, stParam *param)
+int duty_cycle_handler(SERIAL_PORT port, char *cmd, stParam *param)
 {
-	if (param->argc == 1 && !strcmp(param->argv[0], "?"))
+	if ((param->argc == 1 && !strcmp(param->argv[0], "?")) || (param->argc == 0))
 	{
-		AT_PRINTF("%s=Signal Meter V%d.%d.%d", cmd, SW_VERSION_0, SW_VERSION_1, SW_VERSION_2);
+		AT_PRINTF("%s=%ld:%ld:%ld", cmd, dc_get_toa(g_custom_parameters.custom_packet_len), dc_get_budget_left(),
+				  dc_get_wait(g_custom_parameters.custom_packet_len));
 		return AT_OK;
 	}
-	return AT_ERROR;
+	return AT_PARAM_ERROR;
 }
 
-bool init_product_info_at(void)
+/**
+ * @brief Add auto send interval AT command
+ *
+ * @return true if success
+ * @return false if failed
+ */
+bool init_auto_interval_at(void)
 {
-	/*****************************************************************/
-	/* Add when device is available in WisToolBox                    */
-	/*****************************************************************/
-
-	// Change HW model to RAK10706
-	// api.system.hwModel.set("RAK10706");
-	api.system.hwModel.set("RAK4630");
-
-	return api.system.atMode.add((char *)"PRD_INFO",
-								 (char *)"Get device Information of RAK10706",
-								 (char *)"PRD_INFO", product_info_handler,
-								 RAK_ATCMD_PERM_READ);
+	return api.system.atMode.add((char *)"AUTOINT",
+								 (char *)"Set/Get auto send interval. Format: <0 = off, 1 = on>:<fair use time on air per day in seconds, 0 = no limit>",
+								 (char *)"AUTOINT", auto_interval_handler,
+								 RAK_ATCMD_PERM_WRITE | RAK_ATCMD_PERM_READ);
 }
 
-int product_info_handler(SERIAL_PORT port, char *cmd, stParam *param)
+/**
+ * @brief Handler for auto send interval AT command
+ *        Query returns <on/off>:<fair use s>:<current interval s>:<time on air used today ms>:<s until the budget reset>:<DATE or BOOT>
+ *        DATE: the fair use day follows the local date, BOOT: no date known, the day is counted from boot
+ *
+ * @param port Serial port used
+ * @param cmd char array with the received AT command
+ * @param param char array with the received AT command parameters
+ * @return int result of command parsing
+ * 			AT_OK AT command & parameters valid
+ * 			AT_PARAM_ERROR command or parameters invalid
+ */
+int auto_interval_handler(SERIAL_PORT port, char *cmd, stParam *param)
 {
-	prd_info_requested = true;
-	return AT_COMMAND_NOT_FOUND;
+	if (param->argc == 1 && !strcmp(param->argv[0], "?"))
+	{
+		AT_PRINTF("%s=%d:%d:%ld:%ld:%ld:%s", cmd, g_custom_parameters.auto_interval ? 1 : 0, g_custom_parameters.fair_use_s,
+				  get_send_period() / 1000, dc_get_day_used(), dc_get_day_left() / 1000, dc_day_has_date() ? "DATE" : "BOOT");
+	}
+	else if ((param->argc == 1) || (param->argc == 2))
+	{
+		for (int j = 0; j < param->argc; j++)
+		{
+			for (int i = 0; i < strlen(param->argv[j]); i++)
+			{
+				if (!isdigit(*(param->argv[j] + i)))
+				{
+					return AT_PARAM_ERROR;
+				}
+			}
+		}
+		uint32_t new_auto = strtoul(param->argv[0], NULL, 10);
+		uint32_t new_fair_use = g_custom_parameters.fair_use_s;
+		if (param->argc == 2)
+		{
+			new_fair_use = strtoul(param->argv[1], NULL, 10);
+		}
+		if ((new_auto > 1) || (new_fair_use > 65535))
+		{
+			return AT_PARAM_ERROR;
+		}
 
-	/*****************************************************************/
-	/* Add when device is available in WisToolBox                    */
-	/*****************************************************************/
+		g_custom_parameters.auto_interval = new_auto == 1;
+		g_custom_parameters.fair_use_s = new_fair_use;
+		save_at_setting();
 
-	// Return
-	uint8_t key_eui[16] = {0};
-	if (param->argc == 1 && !strcmp(param->argv[0], "?"))
+		// Restart the timer with the new interval
+		dc_update_auto_interval();
+		api.system.timer.stop(RAK_TIMER_0);
+		if (get_send_period() != 0)
+		{
+			lat_timer_start(RAK_TIMER_0, get_send_period(), NULL);
+		}
+	}
+	else
 	{
-		api.lorawan.deui.get(key_eui, 8);
-		AT_PRINTF("%s=VC:V%d.%d.%d:%02X%02X%02X%02X%02X%02X%02X%02X:RAK10706:%02X%02X%02X%02X%02X%02X%02X%02X", cmd, SW_VERSION_0, SW_VERSION_1, SW_VERSION_2,
-				  key_eui[0], key_eui[1], key_eui[2], key_eui[3],
-				  key_eui[4], key_eui[5], key_eui[6], key_eui[7],
-				  key_eui[0], key_eui[1], key_eui[2], key_eui[3],
-				  key_eui[4], key_eui[5], key_eui[6], key_eui[7]);
-		return AT_OK;
+		return AT_PARAM_ERROR;
 	}
-	return AT_ERROR;
+	return AT_OK;
 }
+
 /**
- * @brief Get setting from flash
+ * @brief Add DR sweep AT command
  *
- * @return false read from flash failed or invalid settings type
+ * @return true if success
+ * @return false if failed
  */
-bool get_at_setting(void)
+bool init_sweep_at(void)
 {
-	bool found_problem = false;
-
-	MYLOG("AT_CMD", "Size of custom parameters %d", sizeof(custom_param_s));
-
-	// // For testing, erase all flash settings
-	// uint8_t erase_flash[255] = {0xff};
-	// memset(erase_flash, 0xff, 255);
-	// bool wr_result = api.system.flash.set(0, erase_flash, sizeof(custom_param_s));
-	// if (!wr_result)
-	// {
-	// 	// First write attempt failed
-	// 	MYLOG("AT_CMD", "Failed to erase custom parameters from Flash");
-	// 	// Retry
-	// 	wr_result = api.system.flash.set(0, erase_flash, sizeof(custom_param_s));
-	// }
-	// if (wr_result)
-	// {
-	// 	MYLOG("AT_CMD", "Erased custom parameters from Flash");
-	// }
+	return api.system.atMode.add((char *)"SWEEP",
+								 (char *)"Set/Get DR sweep settings and results. Format: <uplinks per DR>:<stop after failures, 0 = never>",
+								 (char *)"SWEEP", sweep_handler,
+								 RAK_ATCMD_PERM_WRITE | RAK_ATCMD_PERM_READ);
+}
 
-	uint8_t *flash_value = (uint8_t *)&temp_params.settings_crc;
-	if (!api.system.flash.get(0, flash_value, sizeof(custom_param_s)))
+/**
+ * @brief Handler for DR sweep AT command
+ *        Query returns the settings and one line per DR of the last sweep
+ *        <DR>:<sent>:<ok>:<success %>:<gateways>:<RSSI>:<RSSI spread>:<SNR>:<SNR spread>:<demod margin>
+ *
+ * @param port Serial port used
+ * @param cmd char array with the received AT command
+ * @param param char array with the received AT command parameters
+ * @return int result of command parsing
+ * 			AT_OK AT command & parameters valid
+ * 			AT_PARAM_ERROR command or parameters invalid
+ */
+int sweep_handler(SERIAL_PORT port, char *cmd, stParam *param)
+{
+	if (param->argc == 1 && !strcmp(param->argv[0], "?"))
 	{
-		MYLOG("AT_CMD", "Failed to read custom parameters from Flash");
-		return false;
+		AT_PRINTF("%s=%d:%d", cmd, g_custom_parameters.sweep_count, g_custom_parameters.sweep_fail_stop);
+		for (uint8_t dr = 0; dr < LPW_NUM_DR; dr++)
+		{
+			if (!g_sweep_stats[dr].used)
+			{
+				continue;
+			}
+			if (g_sweep_stats[dr].skipped)
+			{
+				AT_PRINTF("%d:skipped", dr);
+			}
+			else
+			{
+				sweep_format_dr(dr, line_str, 256, ':');
+				AT_PRINTF("%s", line_str);
+			}
+		}
 	}
-	MYLOG("AT_CMD", "Got CRC: %08X", temp_params.settings_crc);
-
-	uint32_t crc_expected = 0x00;
-	// Check validity flag
-	if (temp_params.valid_flag == 0xaa)
+	else if (param->argc == 2)
+	{
+		for (int j = 0; j < param->argc; j++)
+		{
+			for (int i = 0; i < strlen(param->argv[j]); i++)
+			{
+				if (!isdigit(*(param->argv[j] + i)))
+				{
+					return AT_PARAM_ERROR;
+				}
+			}
+		}
+		uint32_t new_count = strtoul(param->argv[0], NULL, 10);
+		uint32_t new_fail_stop = strtoul(param->argv[1], NULL, 10);
+		if ((new_count < 1) || (new_count > SWEEP_MAX_COUNT) || (new_fail_stop > SWEEP_MAX_COUNT))
+		{
+			return AT_PARAM_ERROR;
+		}
+
+		g_custom_parameters.sweep_count = new_count;
+		g_custom_parameters.sweep_fail_stop = new_fail_stop;
+		save_at_setting();
+	}
+	else
+	{
+		return AT_PARAM_ERROR;
+	}
+	return AT_OK;
+}
+
+/**
+ * @brief Add payload size sweep AT command
+ *
+ * @return true if success
+ * @return false if failed
+ */
+bool init_size_sweep_at(void)
+{
+	return api.system.atMode.add((char *)"SIZESWEEP",
+								 (char *)"Start payload size sweep at the current DR or get the PER table. Format: <uplinks per size>:<size step in bytes>",
+								 (char *)"SIZESWEEP", size_sweep_handler,
+								 RAK_ATCMD_PERM_WRITE | RAK_ATCMD_PERM_READ);
+}
+
+/**
+ * @brief Handler for payload size sweep AT command
+ *        Query returns one line per payload size of the last sweep
+ *        <size>:<sent>:<lost>:<PER %>:<RSSI>:<SNR>
+ *
+ * @param port Serial port used
+ * @param cmd char array with the received AT command
+ * @param param char array with the received AT command parameters
+ * @return int result of command parsing
+ * 			AT_OK AT command & parameters valid
+ * 			AT_PARAM_ERROR command or parameters invalid
+ * 			AT_ERROR not in LoRaWAN mode or not joined
+ * 			AT_BUSY_ERROR a sweep, an uplink or an SD card job is active
+ */
+int size_sweep_handler(SERIAL_PORT port, char *cmd, stParam *param)
+{
+	if (param->argc == 1 && !strcmp(param->argv[0], "?"))
+	{
+		AT_PRINTF("%s=%d", cmd, g_size_num);
+		for (uint8_t idx = 0; idx < g_size_num; idx++)
+		{
+			size_sweep_format(idx, line_str, 256, ':');
+			AT_PRINTF("%s", line_str);
+		}
+	}
+	else if (param->argc == 2)
+	{
+		for (int j = 0; j < param->argc; j++)
+		{
+			for (int i = 0; i < strlen(param->argv[j]); i++)
+			{
+				if (!isdigit(*(param->argv[j] + i)))
+				{
+					return AT_PARAM_ERROR;
+				}
+			}
+		}
+		uint32_t new_count = strtoul(param->argv[0], NULL, 10);
+		uint32_t new_step = strtoul(param->argv[1], NULL, 10);
+		if ((new_count < 1) || (new_count > SWEEP_MAX_COUNT) || (new_step < 1) || (new_step > TX_BUFFER_SIZE))
+		{
+			return AT_PARAM_ERROR;
+		}
+		// PER needs the LinkCheck answers, only in LoRaWAN mode
+		if (!api.lorawan.nwm.get() || !api.lorawan.njs.get())
+		{
+			return AT_ERROR;
+		}
+		if (tx_active || dr_sweep_active)
+		{
+			return AT_BUSY_ERROR;
+		}
+		if (!size_sweep_start(new_count, new_step))
+		{
+			return AT_BUSY_ERROR;
+		}
+	}
+	else
+	{
+		return AT_PARAM_ERROR;
+	}
+	return AT_OK;
+}
+
+/**
+ * @brief Add fragmentation AT command
+ *
+ * @return true if success
+ * @return false if failed
+ */
+bool init_fragment_at(void)
+{
+	return api.system.atMode.add((char *)"FRAG",
+								 (char *)"Set/Get fragmentation of custom packets that are too large for the DR. 0 = off, 1 = on",
+								 (char *)"FRAG", fragment_handler,
+								 RAK_ATCMD_PERM_WRITE | RAK_ATCMD_PERM_READ);
+}
+
+/**
+ * @brief Handler for fragmentation AT command
+ *        Query returns <on/off>:<fragments sent>:<fragments delivered>:<packets>:<packets complete>
+ *
+ * @param port Serial port used
+ * @param cmd char array with the received AT command
+ * @param param char array with the received AT command parameters
+ * @return int result of command parsing
+ * 			AT_OK AT command & parameters valid
+ * 			AT_PARAM_ERROR command or parameters invalid
+ */
+int fragment_handler(SERIAL_PORT port, char *cmd, stParam *param)
+{
+	if (param->argc == 1 && !strcmp(param->argv[0], "?"))
+	{
+		AT_PRINTF("%s=%d:%d:%d:%d:%d", cmd, g_custom_parameters.fragment_on ? 1 : 0,
+				  g_frag_stats.sent, g_frag_stats.ok, g_frag_stats.packets, g_frag_stats.complete);
+	}
+	else if (param->argc == 1)
+	{
+		if ((strlen(param->argv[0]) != 1) || ((param->argv[0][0] != '0') && (param->argv[0][0] != '1')))
+		{
+			return AT_PARAM_ERROR;
+		}
+		bool new_fragment = param->argv[0][0] == '1';
+		if (new_fragment != g_custom_parameters.fragment_on)
+		{
+			g_custom_parameters.fragment_on = new_fragment;
+			save_at_setting();
+		}
+		// Start new statistics
+		memset(&g_frag_stats, 0, sizeof(frag_stats_s));
+	}
+	else
+	{
+		return AT_PARAM_ERROR;
+	}
+	return AT_OK;
+}
+
+/**
+ * @brief Add benchmark AT command
+ *
+ * @return true if success
+ * @return false if failed
+ */
+bool init_bench_at(void)
+{
+	return api.system.atMode.add((char *)"BENCH",
+								 (char *)"Run the micro benchmarks, result in JSON format",
+								 (char *)"BENCH", bench_handler,
+								 RAK_ATCMD_PERM_READ);
+}
+
+/**
+ * @brief Handler for benchmark AT command
+ *        Output is one JSON object, one benchmark per line
+ *        {"bench":1,"fw":"<version>","results":[
+ *        {"name":"<kernel>","iter":<iterations>,"ns_op":<ns per call>,"bytes_op":<bytes per call>},
+ *        ]}
+ *
+ * @param port Serial port used
+ * @param cmd char array with the received AT command
+ * @param param char array with the received AT command parameters
+ * @return int result of command parsing
+ * 			AT_OK AT command & parameters valid
+ * 			AT_PARAM_ERROR command or parameters invalid
+ * 			AT_BUSY_ERROR uplink or sweep active
+ */
+int bench_handler(SERIAL_PORT port, char *cmd, stParam *param)
+{
+	if (param->argc == 1 && !strcmp(param->argv[0], "?"))
+	{
+		if (tx_active || dr_sweep_active)
+		{
+			return AT_BUSY_ERROR;
+		}
+		AT_PRINTF("{\"bench\":1,\"fw\":\"%d.%d.%d\",\"results\":[", SW_VERSION_0, SW_VERSION_1, SW_VERSION_2);
+		bench_result_s res;
+		for (uint8_t idx = 0; idx < bench_count(); idx++)
+		{
+			bench_run(idx, &res);
+			AT_PRINTF("{\"name\":\"%s\",\"iter\":%ld,\"ns_op\":%ld,\"bytes_op\":%ld}%s", res.name, res.iterations, res.ns_op, res.bytes_op,
+					  idx < (bench_count() - 1) ? "," : "");
+		}
+		AT_PRINTF("]}");
+	}
+	else
+	{
+		return AT_PARAM_ERROR;
+	}
+	return AT_OK;
+}
+
+/**
+ * @brief Add sleep statistics AT command
+ *
+ * @return true if success
+ * @return false if failed
+ */
+bool init_sleep_at(void)
+{
+	return api.system.atMode.add((char *)"SLEEP",
+								 (char *)"Get or reset the sleep statistics, <sleep ratio %>:<sleep s>:<total s>:<sleeps>",
+								 (char *)"SLEEP", sleep_handler,
+								 RAK_ATCMD_PERM_WRITE | RAK_ATCMD_PERM_READ);
+}
+
+/**
+ * @brief Handler for sleep statistics AT command
+ *        Counts only the sleep of the main loop in lp_idle(), not the sleep of the RUI3 low power mode
+ *
+ * @param port Serial port used
+ * @param cmd char array with the received AT command
+ * @param param char array with the received AT command parameters
+ * @return int result of command parsing
+ * 			AT_OK AT command & parameters valid
+ * 			AT_PARAM_ERROR command or parameters invalid
+ */
+int sleep_handler(SERIAL_PORT port, char *cmd, stParam *param)
+{
+	if (param->argc == 1 && !strcmp(param->argv[0], "?"))
+	{
+		lp_stats_s stats;
+		lp_get_stats(&stats);
+		AT_PRINTF("%s=%d.%d:%ld:%ld:%ld", cmd, stats.ratio / 10, stats.ratio % 10,
+				  stats.sleep_ms / 1000, stats.total_ms / 1000, stats.sleeps);
+	}
+	else if (param->argc == 1 && !strcmp(param->argv[0], "0"))
+	{
+		lp_reset_stats();
+	}
+	else
+	{
+		return AT_PARAM_ERROR;
+	}
+	return AT_OK;
+}
+
+/**
+ * @brief Add latency histogram AT command
+ *
+ * @return true if success
+ * @return false if failed
+ */
+bool init_latency_at(void)
+{
+	return api.system.atMode.add((char *)"LATENCY",
+								 (char *)"Get or reset the run time (us) and delay (ms) histograms of timers and tasks",
+								 (char *)"LATENCY", latency_handler,
+								 RAK_ATCMD_PERM_WRITE | RAK_ATCMD_PERM_READ);
+}
+
+/**
+ * @brief Handler for latency histogram AT command
+ *        One line per histogram <name>:<run|late>:<count 0>,<count 1>,<count 2-3>,<count 4-7>,...
+ *
+ * @param port Serial port used
+ * @param cmd char array with the received AT command
+ * @param param char array with the received AT command parameters
+ * @return int result of command parsing
+ * 			AT_OK AT command & parameters valid
+ * 			AT_PARAM_ERROR command or parameters invalid
+ */
+int latency_handler(SERIAL_PORT port, char *cmd, stParam *param)
+{
+	if (param->argc == 1 && !strcmp(param->argv[0], "?"))
+	{
+		char hist_str[128];
+		int len;
+		for (uint8_t idx = 0; (len = lat_format(idx, hist_str, sizeof(hist_str))) >= 0; idx++)
+		{
+			if (len != 0)
+			{
+				AT_PRINTF("%s", hist_str);
+			}
+		}
+	}
+	else if (param->argc == 1 && !strcmp(param->argv[0], "0"))
+	{
+		lat_reset();
+	}
+	else
+	{
+		return AT_PARAM_ERROR;
+	}
+	return AT_OK;
+}
+
+/**
+ * @brief Add test cycle statistics AT command
+ *
+ * @return true if success
+ * @return false if failed
+ */
+bool init_cycle_at(void)
+{
+	return api.system.atMode.add((char *)"CYCLE",
+								 (char *)"Get or reset the time spent in each stage of the test cycle",
+								 (char *)"CYCLE", cycle_handler,
+								 RAK_ATCMD_PERM_WRITE | RAK_ATCMD_PERM_READ);
+}
+
+/**
+ * @brief Handler for test cycle statistics AT command
+ *        One line per stage <stage>:<entries>:<time s>:<average ms>:<timeouts>
+ *        Last line <mode>:<current stage>:<ignored events>
+ *
+ * @param port Serial port used
+ * @param cmd char array with the received AT command
+ * @param param char array with the received AT command parameters
+ * @return int result of command parsing
+ * 			AT_OK AT command & parameters valid
+ * 			AT_PARAM_ERROR command or parameters invalid
+ */
+int cycle_handler(SERIAL_PORT port, char *cmd, stParam *param)
+{
+	if (param->argc == 1 && !strcmp(param->argv[0], "?"))
+	{
+		char stats_str[64];
+		for (uint8_t idx = 0; cycle_format(idx, stats_str, sizeof(stats_str)) >= 0; idx++)
+		{
+			AT_PRINTF("%s", stats_str);
+		}
+	}
+	else if (param->argc == 1 && !strcmp(param->argv[0], "0"))
+	{
+		cycle_reset();
+	}
+	else
+	{
+		return AT_PARAM_ERROR;
+	}
+	return AT_OK;
+}
+
+/**
+ * @brief Add custom job status AT command
+ *
+ * @return true AT command was added
+ * @return false AT command couldn't be added
+ */
+bool init_jobs_at(void)
+{
+	return api.system.atMode.add((char *)"JOBS",
+								 (char *)"Get progress and longest blocking step of the background jobs",
+								 (char *)"JOBS", jobs_handler,
+								 RAK_ATCMD_PERM_READ);
+}
+
+/**
+ * @brief Handler for job status AT command
+ *        One line per job <name>:<running|idle|failed>:<progress>:<total>:<steps>:<max block us>:<run time ms>
+ *
+ * @param port Serial port used
+ * @param cmd char array with the received AT command
+ * @param param char array with the received AT command parameters
+ * @return int result of command parsing
+ * 			AT_OK AT command & parameters valid
+ * 			AT_PARAM_ERROR command or parameters invalid
+ */
+int jobs_handler(SERIAL_PORT port, char *cmd, stParam *param)
+{
+	if ((param->argc == 1) && !strcmp(param->argv[0], "?"))
+	{
+		char job_str[80];
+		AT_PRINTF("%s=%s", cmd, job_busy() ? "busy" : "idle");
+		for (uint8_t idx = 0; job_format(idx, job_str, sizeof(job_str)) >= 0; idx++)
+		{
+			AT_PRINTF("%s", job_str);
+		}
+	}
+	else
+	{
+		return AT_PARAM_ERROR;
+	}
+	return AT_OK;
+}
+
+/**
+ * @brief Add custom event trace AT command
+ *
+ * @return true AT command was added
+ * @return false AT command couldn't be added
+ */
+bool init_trace_at(void)
+{
+	return api.system.atMode.add((char *)"TRACE",
+								 (char *)"Dump the event trace as hex lines, 0 to clear, 1 to save it to the SD card",
+								 (char *)"TRACE", trace_handler,
+								 RAK_ATCMD_PERM_WRITE | RAK_ATCMD_PERM_READ);
+}
+
+/**
+ * @brief Handler for event trace AT command
+ *        First line TRACE:<recorded events>:<events in the dump>:<millis>:<micros>:<millis of the last event>
+ *        then the events as hex lines
+ *        Decode with trace_decoder.py
+ *
+ * @param port Serial port used
+ * @param cmd char array with the received AT command
+ * @param param char array with the received AT command parameters
+ * @return int result of command parsing
+ * 			AT_OK AT command & parameters valid
+ * 			AT_PARAM_ERROR command or parameters invalid
+ * 			AT_ERROR trace could not be saved
+ * 			AT_BUSY_ERROR SD card dump or erase is running
+ */
+int trace_handler(SERIAL_PORT port, char *cmd, stParam *param)
+{
+	if ((param->argc == 1) && !strcmp(param->argv[0], "?"))
+	{
+		char trace_str[TRACE_PER_LINE * 2 * sizeof(trace_event_s) + 1];
+		for (uint8_t idx = 0; trace_format(idx, trace_str, sizeof(trace_str)) >= 0; idx++)
+		{
+			AT_PRINTF("%s", trace_str);
+		}
+	}
+	else if ((param->argc == 1) && !strcmp(param->argv[0], "0"))
+	{
+		trace_reset();
+	}
+	else if ((param->argc == 1) && !strcmp(param->argv[0], "1"))
+	{
+		if (sd_busy())
+		{
+			return AT_BUSY_ERROR;
+		}
+		if (!has_sd || !write_sd_lines(TRACE_FILE_NAME, trace_format))
+		{
+			return AT_ERROR;
+		}
+	}
+	else
+	{
+		return AT_PARAM_ERROR;
+	}
+	return AT_OK;
+}
+
+/**
+ * @brief Add custom energy accounting AT command
+ *
+ * @return true AT command was added
+ * @return false AT command couldn't be added
+ */
+bool init_energy_at(void)
+{
+	return api.system.atMode.add((char *)"ENERGY",
+								 (char *)"Get the estimated mAh per hour of each subsystem, 0 to restart, <state>:<uA> to change the current model",
+								 (char *)"ENERGY", energy_handler,
+								 RAK_ATCMD_PERM_WRITE | RAK_ATCMD_PERM_READ);
+}
+
+/**
+ * @brief Handler for energy accounting AT command
+ *        One line per state <state>:<active time s>:<model uA>:<mAh per hour>
+ *        Last line total:<time s>:<mAh per hour>
+ *
+ * @param port Serial port used
+ * @param cmd char array with the received AT command
+ * @param param char array with the received AT command parameters
+ * @return int result of command parsing
+ * 			AT_OK AT command & parameters valid
+ * 			AT_PARAM_ERROR command or parameters invalid
+ */
+int energy_handler(SERIAL_PORT port, char *cmd, stParam *param)
+{
+	if ((param->argc == 1) && !strcmp(param->argv[0], "?"))
+	{
+		char energy_str[64];
+		for (uint8_t idx = 0; energy_format(idx, energy_str, sizeof(energy_str)) >= 0; idx++)
+		{
+			AT_PRINTF("%s", energy_str);
+		}
+	}
+	else if ((param->argc == 1) && !strcmp(param->argv[0], "0"))
+	{
+		energy_reset();
+	}
+	else if (param->argc == 2)
+	{
+		for (int i = 0; i < strlen(param->argv[1]); i++)
+		{
+			if (!isdigit(*(param->argv[1] + i)))
+			{
+				return AT_PARAM_ERROR;
+			}
+		}
+		if (!energy_set_ua(param->argv[0], strtoul(param->argv[1], NULL, 10)))
+		{
+			return AT_PARAM_ERROR;
+		}
+	}
+	else
+	{
+		return AT_PARAM_ERROR;
+	}
+	return AT_OK;
+}
+
+/**
+ * @brief Add display statistics AT command
+ *
+ * @return true if success
+ * @return false if failed
+ */
+bool init_oled_at(void)
+{
+	return api.system.atMode.add((char *)"OLED",
+								 (char *)"Get or reset the display statistics, <bytes/s>:<bytes>:<full frame bytes>:<updates>:<fields drawn>:<total s>:<windows>:<full frames>",
+								 (char *)"OLED", oled_handler,
+								 RAK_ATCMD_PERM_WRITE | RAK_ATCMD_PERM_READ);
+}
+
+/**
+ * @brief Handler for display statistics AT command
+ *
+ * @param port Serial port used
+ * @param cmd char array with the received AT command
+ * @param param char array with the received AT command parameters
+ * @return int result of command parsing
+ * 			AT_OK AT command & parameters valid
+ * 			AT_PARAM_ERROR command or parameters invalid
+ */
+int oled_handler(SERIAL_PORT port, char *cmd, stParam *param)
+{
+	if (param->argc == 1 && !strcmp(param->argv[0], "?"))
+	{
+		oled_stats_s stats;
+		oled_get_stats(&stats);
+		AT_PRINTF("%s=%ld:%ld:%ld:%ld:%ld:%ld:%ld:%ld", cmd, stats.bytes_s, stats.bytes, stats.full_bytes,
+				  stats.updates, stats.fields, stats.total_ms / 1000, stats.windows, stats.full_frames);
+	}
+	else if (param->argc == 1 && !strcmp(param->argv[0], "0"))
+	{
+		oled_reset_stats();
+	}
+	else
+	{
+		return AT_PARAM_ERROR;
+	}
+	return AT_OK;
+}
+
+/**
+ * @brief Add custom Status AT command
+ *
+ * @return true AT command were added
+ * @return false AT command couldn't be added
+ */
+bool init_status_at(void)
+{
+	return api.system.atMode.add((char *)"STATUS",
+								 (char *)"Get device information",
+								 (char *)"STATUS", status_handler,
+								 RAK_ATCMD_PERM_READ);
+}
+
+/** Regions as text array */
+char *g_regions_list[] = {"EU433", "CN470", "RU864", "IN865", "EU868", "US915", "AU915", "KR920", "AS923", "AS923-2", "AS923-3", "AS923-4", "LA915"};
+/** Network modes as text array*/
+char *nwm_list[] = {"P2P", "LoRaWAN", "FSK"};
+/** Available test modes as text array */
+char *test_mode_list[] = {"LinkCheck", "LoRa P2P", "FieldTester"};
+/**
+ * @brief Print device status over Serial
+ *
+ * @param port Serial port used
+ * @param cmd char array with the received AT command
+ * @param param char array with the received AT command parameters
+ * @return int result of command parsing
+ * 			AT_OK AT command & parameters valid
+ * 			AT_PARAM_ERROR command or parameters invalid
+ */
+int status_handler(SERIAL_PORT port, char *cmd, stParam *param)
+{
+	String value_str = "";
+	int nw_mode = 0;
+	int region_set = 0;
+	uint8_t key_eui[16] = {0}; // efadff29c77b4829acf71e1a6e76f713
+
+	if ((param->argc == 1 && !strcmp(param->argv[0], "?")) || (param->argc == 0))
+	{
+		AT_PRINTF("Device Status:");
+		AT_PRINTF("Test Mode: %s", test_mode_list[g_custom_parameters.test_mode]);
+		value_str = api.system.hwModel.get();
+		value_str.toUpperCase();
+		AT_PRINTF("Module: %s", value_str.c_str());
+		AT_PRINTF("Version: %s", api.system.firmwareVer.get().c_str());
+		AT_PRINTF("Send time: %d s", g_custom_parameters.send_interval / 1000);
+		if (g_custom_parameters.auto_interval)
+		{
+			AT_PRINTF("Auto send interval: %ld s, fair use %d s/day", get_send_period() / 1000, g_custom_parameters.fair_use_s);
+			AT_PRINTF("Fair use used: %ld ms, reset in %ld s", dc_get_day_used(), dc_get_day_left() / 1000);
+		}
+		lp_stats_s sleep_stats;
+		lp_get_stats(&sleep_stats);
+		AT_PRINTF("Sleep ratio: %d.%d %%", sleep_stats.ratio / 10, sleep_stats.ratio % 10);
+		AT_PRINTF("Events dropped: %ld", evt_get_overflows());
+		/// \todo
+		nw_mode = api.lorawan.nwm.get();
+		AT_PRINTF("Network mode %s", nwm_list[nw_mode]);
+		if (nw_mode == 1)
+		{
+			AT_PRINTF("Network %s", api.lorawan.njs.get() ? "joined" : "not joined");
+			region_set = api.lorawan.band.get();
+			AT_PRINTF("Region: %d", region_set);
+			AT_PRINTF("Region: %s", g_regions_list[region_set]);
+			AT_PRINTF("DR%d: SF%d BW %d kHz, max payload %d bytes, max EIRP %d dBm",
+					  api.lorawan.dr.get(), lpw_sf(region_set, api.lorawan.dr.get()), lpw_bw(region_set, api.lorawan.dr.get()),
+					  get_max_payload(region_set, api.lorawan.dr.get()), lpw_tx_power_dbm(region_set, 0));
+			uint8_t subband = dc_get_subband();
+			if (subband != LPW_SUBBAND_NONE)
+			{
+				// RUI3 does not report the channel of an uplink, the first channel of the region selects the sub-band
+				AT_PRINTF("Duty cycle sub-band %ld-%ld kHz, 1/%d, all uplinks are booked to it",
+						  lpw_subbands[subband].min_freq / 1000, lpw_subbands[subband].max_freq / 1000, lpw_subbands[subband].dc_divisor);
+			}
+			if (api.lorawan.njm.get())
+			{
+				AT_PRINTF("OTAA mode");
+				api.lorawan.deui.get(key_eui, 8);
+				AT_PRINTF("DevEUI=%02X%02X%02X%02X%02X%02X%02X%02X",
+						  key_eui[0], key_eui[1], key_eui[2], key_eui[3],
+						  key_eui[4], key_eui[5], key_eui[6], key_eui[7]);
+				api.lorawan.appeui.get(key_eui, 8);
+				AT_PRINTF("AppEUI=%02X%02X%02X%02X%02X%02X%02X%02X",
+						  key_eui[0], key_eui[1], key_eui[2], key_eui[3],
+						  key_eui[4], key_eui[5], key_eui[6], key_eui[7]);
+				api.lorawan.appkey.get(key_eui, 16);
+				AT_PRINTF("AppKey=%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X",
+						  key_eui[0], key_eui[1], key_eui[2], key_eui[3],
+						  key_eui[4], key_eui[5], key_eui[6], key_eui[7],
+						  key_eui[8], key_eui[9], key_eui[10], key_eui[11],
+						  key_eui[12], key_eui[13], key_eui[14], key_eui[15]);
+			}
+			else
+			{
+				AT_PRINTF("ABP mode");
+				api.lorawan.appskey.get(key_eui, 16);
+				AT_PRINTF("AppsKey=%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X",
+						  key_eui[0], key_eui[1], key_eui[2], key_eui[3],
+						  key_eui[4], key_eui[5], key_eui[6], key_eui[7],
+						  key_eui[8], key_eui[9], key_eui[10], key_eui[11],
+						  key_eui[12], key_eui[13], key_eui[14], key_eui[15]);
+				api.lorawan.nwkskey.get(key_eui, 16);
+				AT_PRINTF("NwksKey=%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X",
+						  key_eui[0], key_eui[1], key_eui[2], key_eui[3],
+						  key_eui[4], key_eui[5], key_eui[6], key_eui[7],
+						  key_eui[8], key_eui[9], key_eui[10], key_eui[11],
+						  key_eui[12], key_eui[13], key_eui[14], key_eui[15]);
+				api.lorawan.daddr.get(key_eui, 4);
+				AT_PRINTF("DevAddr=%02X%02X%02X%02X",
+						  key_eui[0], key_eui[1], key_eui[2], key_eui[3]);
+			}
+		}
+		else if (nw_mode == 0)
+		{
+			AT_PRINTF("Frequency = %d", api.lora.pfreq.get());
+			AT_PRINTF("SF = %d", api.lora.psf.get());
+			AT_PRINTF("BW = %d", api.lora.pbw.get());
+			AT_PRINTF("CR = %d", api.lora.pcr.get());
+			AT_PRINTF("Preamble length = %d", api.lora.ppl.get());
+			AT_PRINTF("TX power = %d", api.lora.ptp.get());
+		}
+		else
+		{
+			AT_PRINTF("Frequency = %d", api.lora.pfreq.get());
+			AT_PRINTF("Bitrate = %d", api.lora.pbr.get());
+			AT_PRINTF("Deviaton = %d", api.lora.pfdev.get());
+		}
+		AT_PRINTF("Custom settings");
+		AT_PRINTF("Testmode = %d", g_custom_parameters.test_mode);
+		AT_PRINTF("Display saver %s", g_custom_parameters.display_saver ? "On" : "off");
+		AT_PRINTF("Batched uplinks %d samples", g_custom_parameters.batch_samples);
+		if (dc_get_budget_left() >= 0)
+		{
+			AT_PRINTF("Duty cycle budget left %ld ms", dc_get_budget_left());
+		}
+		AT_PRINTF("GNSS init %ld ms, %d config messages, first poll after %ld ms%s", gnss_init_duration, gnss_cfg_writes, gnss_boot_to_poll,
+				  GNSS_CFG_FORCE ? ", full config" : "");
+		atcmd_printf("Custom Packet = ");
+		for (uint8_t i = 0; i < g_custom_parameters.custom_packet_len; i++)
+		{
+			atcmd_printf("%02X", g_custom_parameters.custom_packet[i]);
+		}
+		atcmd_printf("\r\n");
+	}
+	else
+	{
+		return AT_PARAM_ERROR;
+	}
+	return AT_OK;
+}
+
+/**
+ * @brief Add send interval AT command
+ *
+ * @return true if success
+ * @return false if failed
+ */
+bool init_app_ver_at(void)
+{
+	return api.system.atMode.add((char *)"APPVER",
+								 (char *)"Get application version",
+								 (char *)"APPVER", app_ver_handler,
+								 RAK_ATCMD_PERM_READ);
+}
+
+/**
+ * @brief Handler for send interval AT command
+ *
+ * @param port Serial port used
+ * @param cmd char array with the received AT command
+ * @param param char array with the received AT command parameters
+ * @return int result of command parsing
+ * 			AT_OK AT command & parameters valid
+ * 			AT_PARAM_ERROR command or parameters invalid
+ */
+int app_ver_handler(SERIAL_PORT port, char *cmd, stParam *param)
+{
+	if (param->argc == 1 && !strcmp(param->argv[0], "?"))
+	{
+		AT_PRINTF("%s=Signal Meter V%d.%d.%d", cmd, SW_VERSION_0, SW_VERSION_1, SW_VERSION_2);
+		return AT_OK;
+	}
+	return AT_ERROR;
+}
+
+bool init_product_info_at(void)
+{
+	/*****************************************************************/
+	/* Add when device is available in WisToolBox                    */
+	/*****************************************************************/
+
+	// Change HW model to RAK10706
+	// api.system.hwModel.set("RAK10706");
+	api.system.hwModel.set("RAK4630");
+
+	return api.system.atMode.add((char *)"PRD_INFO",
+								 (char *)"Get device Information of RAK10706",
+								 (char *)"PRD_INFO", product_info_handler,
+								 RAK_ATCMD_PERM_READ);
+}
+
+int product_info_handler(SERIAL_PORT port, char *cmd, stParam *param)
+{
+	prd_info_requested = true;
+	return AT_COMMAND_NOT_FOUND;
+
+	/*****************************************************************/
+	/* Add when device is available in WisToolBox                    */
+	/*****************************************************************/
+
+	// Return
+	uint8_t key_eui[16] = {0};
+	if (param->argc == 1 && !strcmp(param->argv[0], "?"))
+	{
+		api.lorawan.deui.get(key_eui, 8);
+		AT_PRINTF("%s=VC:V%d.%d.%d:%02X%02X%02X%02X%02X%02X%02X%02X:RAK10706:%02X%02X%02X%02X%02X%02X%02X%02X", cmd, SW_VERSION_0, SW_VERSION_1, SW_VERSION_2,
+				  key_eui[0], key_eui[1], key_eui[2], key_eui[3],
+				  key_eui[4], key_eui[5], key_eui[6], key_eui[7],
+				  key_eui[0], key_eui[1], key_eui[2], key_eui[3],
+				  key_eui[4], key_eui[5], key_eui[6], key_eui[7]);
+		return AT_OK;
+	}
+	return AT_ERROR;
+}
+/**
+ * @brief Get setting from flash
+ *
+ * @return false read from flash failed or invalid settings type
+ */
+bool get_at_setting(void)
+{
+	bool found_problem = false;
+
+	MYLOG("AT_CMD", "Size of custom parameters %d", sizeof(custom_param_s));
+
+	// // For testing, erase all flash settings
+	// uint8_t erase_flash[255] = {0xff};
+	// memset(erase_flash, 0xff, 255);
+	// bool wr_result = api.system.flash.set(0, erase_flash, sizeof(custom_param_s));
+	// if (!wr_result)
+	// {
+	// 	// First write attempt failed
+	// 	MYLOG("AT_CMD", "Failed to erase custom parameters from Flash");
+	// 	// Retry
+	// 	wr_result = api.system.flash.set(0, erase_flash, sizeof(custom_param_s));
+	// }
+	// if (wr_result)
+	// {
+	// 	MYLOG("AT_CMD", "Erased custom parameters from Flash");
+	// }
+
+	uint8_t *flash_value = (uint8_t *)&temp_params.settings_crc;
+	if (!api.system.flash.get(0, flash_value, sizeof(custom_param_s)))
+	{
+		MYLOG("AT_CMD", "Failed to read custom parameters from Flash");
+		return false;
+	}
+	MYLOG("AT_CMD", "Got CRC: %08X", temp_params.settings_crc);
+
+	uint32_t crc_expected = 0x00;
+	// Check validity flag
+	if (temp_params.valid_flag == 0xaa)
 	{
 		// Check CRC
 		MYLOG("AT_CMD", "Create CRC");
@@ -1014,6 +1822,12 @@ bool get_at_setting(void)
 		g_custom_parameters.custom_packet_len = 4;
 		g_custom_parameters.timezone = 8;
 		g_custom_parameters.mesh_check_node = 0;
+		g_custom_parameters.batch_samples = 1;
+		g_custom_parameters.auto_interval = false;
+		g_custom_parameters.fair_use_s = 30;
+		g_custom_parameters.sweep_count = 1;
+		g_custom_parameters.sweep_fail_stop = 3;
+		g_custom_parameters.fragment_on = false;
 		save_at_setting();
 		return false;
 	}
@@ -1079,6 +1893,54 @@ bool get_at_setting(void)
 	// cannot check mesh node id
 	g_custom_parameters.mesh_check_node = temp_params.mesh_check_node;
 
+	if ((temp_params.batch_samples < 1) || (temp_params.batch_samples > BATCH_MAX_SAMPLES))
+	{
+		MYLOG("AT_CMD", "Invalid batch size found %d", temp_params.batch_samples);
+		g_custom_parameters.batch_samples = 1;
+		found_problem = true;
+	}
+	else
+	{
+		g_custom_parameters.batch_samples = temp_params.batch_samples;
+	}
+
+	if (temp_params.auto_interval > 1)
+	{
+		MYLOG("AT_CMD", "Invalid auto interval found %d %d", temp_params.auto_interval, temp_params.fair_use_s);
+		g_custom_parameters.auto_interval = false;
+		g_custom_parameters.fair_use_s = 30;
+		found_problem = true;
+	}
+	else
+	{
+		g_custom_parameters.auto_interval = temp_params.auto_interval;
+		g_custom_parameters.fair_use_s = temp_params.fair_use_s;
+	}
+
+	if ((temp_params.sweep_count < 1) || (temp_params.sweep_count > SWEEP_MAX_COUNT) || (temp_params.sweep_fail_stop > SWEEP_MAX_COUNT))
+	{
+		MYLOG("AT_CMD", "Invalid sweep settings found %d %d", temp_params.sweep_count, temp_params.sweep_fail_stop);
+		g_custom_parameters.sweep_count = 1;
+		g_custom_parameters.sweep_fail_stop = 3;
+		found_problem = true;
+	}
+	else
+	{
+		g_custom_parameters.sweep_count = temp_params.sweep_count;
+		g_custom_parameters.sweep_fail_stop = temp_params.sweep_fail_stop;
+	}
+
+	if (temp_params.fragment_on > 1)
+	{
+		MYLOG("AT_CMD", "Invalid fragment flag found %d", temp_params.fragment_on);
+		g_custom_parameters.fragment_on = false;
+		found_problem = true;
+	}
+	else
+	{
+		g_custom_parameters.fragment_on = temp_params.fragment_on;
+	}
+
 	if (found_problem)
 	{
 		save_at_setting();
@@ -0,0 +1,672 @@
+/**
+ * @file dr_sweep.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief DR and payload size sweep engine
+ *        Sends a configurable number of uplinks per DR or payload size and collects the LinkCheck results in a matrix
+ * @version 0.1
+ * @date 2025-01-02
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "app.h"
+
+/** Results of the last DR sweep, one entry per DR */
+sweep_stats_s g_sweep_stats[LPW_NUM_DR];
+
+/** Results of the last payload size sweep, one entry per size */
+sweep_stats_s g_size_stats[SIZE_SWEEP_MAX_STEPS];
+
+/** Payload size of each entry of the payload size sweep */
+uint8_t g_size_len[SIZE_SWEEP_MAX_STEPS];
+
+/** Number of entries of the payload size sweep */
+uint8_t g_size_num = 0;
+
+/** Statistics entry waiting for the result of an uplink */
+static sweep_stats_s *volatile sweep_pending = NULL;
+
+/** Buffer for the SD card table */
+static char sweep_table[1024];
+
+/** Job of the running sweep */
+static job_s sweep_job = {"sweep"};
+
+/**
+ * @brief Add a result to a statistics entry
+ *
+ * @param stats statistics entry
+ * @param success true if the LinkCheck answer was received
+ * @param rssi RSSI of the LinkCheck answer
+ * @param snr SNR of the LinkCheck answer
+ * @param gateways number of gateways
+ * @param demod demodulation margin
+ */
+void sweep_stats_add(sweep_stats_s *stats, bool success, int16_t rssi, int8_t snr, uint8_t gateways, uint8_t demod)
+{
+	stats->sent++;
+	if (!success)
+	{
+		stats->fail_run++;
+		return;
+	}
+	stats->fail_run = 0;
+	stats->ok++;
+	stats->gw_sum += gateways;
+	stats->rssi_sum += rssi;
+	stats->rssi_sq += rssi * rssi;
+	stats->snr_sum += snr;
+	stats->snr_sq += snr * snr;
+	stats->demod_sum += demod;
+}
+
+/**
+ * @brief Calculate mean values and spread of a statistics entry
+ *
+ * @param stats statistics entry
+ * @param res calculated values, all 0 if no uplink was successful
+ */
+void sweep_stats_get(sweep_stats_s *stats, sweep_result_s *res)
+{
+	memset(res, 0, sizeof(sweep_result_s));
+	if (stats->sent != 0)
+	{
+		res->success = 100.0 * stats->ok / stats->sent;
+	}
+	if (stats->ok == 0)
+	{
+		return;
+	}
+	res->gw = (float)stats->gw_sum / stats->ok;
+	res->rssi = (float)stats->rssi_sum / stats->ok;
+	res->snr = (float)stats->snr_sum / stats->ok;
+	res->demod = (float)stats->demod_sum / stats->ok;
+	float var = (float)stats->rssi_sq / stats->ok - res->rssi * res->rssi;
+	res->rssi_sd = var > 0.0 ? sqrtf(var) : 0.0;
+	var = (float)stats->snr_sq / stats->ok - res->snr * res->snr;
+	res->snr_sd = var > 0.0 ? sqrtf(var) : 0.0;
+}
+
+/**
+ * @brief Add the result of an uplink to the sweep statistics
+ *        Called from the LoRaWAN callbacks, only the first result of an uplink is counted.
+ *        The sweep job continues right away instead of waiting for its timeout.
+ *
+ * @param success true if the LinkCheck answer was received
+ * @param rssi RSSI of the LinkCheck answer
+ * @param snr SNR of the LinkCheck answer
+ * @param gateways number of gateways
+ * @param demod demodulation margin
+ */
+void sweep_add_result(bool success, int16_t rssi, int8_t snr, uint8_t gateways, uint8_t demod)
+{
+	if (sweep_pending == NULL)
+	{
+		return;
+	}
+	sweep_stats_add(sweep_pending, success, rssi, snr, gateways, demod);
+	sweep_pending = NULL;
+	job_wake(&sweep_job);
+}
+
+/**
+ * @brief Wait for the duty cycle before the next uplink of a sweep
+ *
+ * @param buffer payload to send, NULL to send the packet of the test mode
+ * @return uint32_t time in ms until the uplink is allowed, 0 if it can be sent now
+ */
+static uint32_t sweep_dc_wait(tx_buffer_s *buffer)
+{
+	uint32_t wait = buffer == NULL ? dc_get_next_wait() : dc_get_wait(buffer->len);
+	if (wait != 0)
+	{
+		sprintf(line_str, "Duty cycle wait %lds", (wait + 999) / 1000);
+		oled_add_line(line_str);
+	}
+	return wait;
+}
+
+/**
+ * @brief Send one uplink of a sweep, the result is added by sweep_add_result
+ *
+ * @param stats statistics entry for the result
+ * @param buffer payload to send, NULL to send the packet of the test mode
+ */
+static void sweep_send_start(sweep_stats_s *stats, tx_buffer_s *buffer)
+{
+	sweep_pending = stats;
+	if (buffer == NULL)
+	{
+		send_packet(NULL);
+	}
+	else
+	{
+		tx_active = true;
+		if (!tx_send(buffer, fPort))
+		{
+			MYLOG("SWEEP", "LoRaWAN send returned error");
+			tx_active = false;
+			sweep_add_result(false, 0, 0, 0, 0);
+		}
+		packet_num++;
+	}
+}
+
+/**
+ * @brief Count a missing result as failed uplink
+ *
+ */
+static void sweep_send_timeout(void)
+{
+	if (sweep_pending != NULL)
+	{
+		// No answer is a failed uplink
+		MYLOG("SWEEP", "Result timeout");
+		sweep_add_result(false, 0, 0, 0, 0);
+	}
+}
+
+/** Data rate of the running DR sweep */
+static uint8_t sweep_dr = 0;
+
+/** Uplinks sent at the current DR */
+static uint8_t sweep_sent = 0;
+
+/** Higher DR are skipped after a DR failed */
+static bool sweep_skip_rest = false;
+
+/** Data rate before the sweep */
+static uint16_t sweep_origin_dr = 0;
+
+/** Next line of the result display */
+static uint8_t sweep_show_idx = 0;
+
+/** States of the DR sweep job */
+enum dr_sweep_state_num
+{
+	DRS_START = 0, // Reset the results
+	DRS_DR,		   // Set the next DR
+	DRS_SEND,	   // Send an uplink when the duty cycle allows it
+	DRS_WAIT,	   // Result received or timeout
+	DRS_SHOW,	   // Show one line of the results
+	DRS_DONE	   // Save the results and restart the send timer
+};
+
+/**
+ * @brief One step of the DR sweep
+ *        Each DR is tested with sweep_count uplinks. A DR is stopped after sweep_fail_stop
+ *        consecutive failures, all higher DR are skipped then, because they have less link budget.
+ *        The job sleeps while it waits for the duty cycle, the result of an uplink and the display.
+ *
+ * @param job sweep job
+ * @return true sweep finished
+ * @return false more steps needed
+ */
+static bool dr_sweep_step(job_s *job)
+{
+	uint8_t region = api.lorawan.band.get();
+	switch (job->state)
+	{
+	case DRS_START:
+		MYLOG("SWEEP", "DR sweep triggered");
+		api.system.timer.stop(RAK_TIMER_0);
+		memset(g_sweep_stats, 0, sizeof(g_sweep_stats));
+		sweep_origin_dr = api.lorawan.dr.get();
+		sweep_dr = lpw_regions[region].min_ul_dr;
+		sweep_skip_rest = false;
+		job->total = 0;
+		for (uint8_t dr = lpw_regions[region].min_ul_dr; dr <= lpw_regions[region].max_ul_dr; dr++)
+		{
+			if (get_max_payload(region, dr) != 0)
+			{
+				job->total += g_custom_parameters.sweep_count;
+			}
+		}
+		job->state = DRS_DR;
+		return false;
+	case DRS_DR:
+		for (; sweep_dr <= lpw_regions[region].max_ul_dr; sweep_dr++)
+		{
+			// Only uplink datarates that are available in the region
+			if (get_max_payload(region, sweep_dr) == 0)
+			{
+				continue;
+			}
+			sweep_stats_s *stats = &g_sweep_stats[sweep_dr];
+			stats->used = true;
+			if (sweep_skip_rest)
+			{
+				stats->skipped = true;
+				continue;
+			}
+			MYLOG("SWEEP", "DR sweep DR%d", sweep_dr);
+			api.lorawan.dr.set(sweep_dr);
+			sweep_sent = 0;
+			job_sleep(job, 100);
+			job->state = DRS_SEND;
+			return false;
+		}
+
+		// Restore data rate
+		api.lorawan.dr.set(sweep_origin_dr);
+		dc_update_auto_interval();
+		sweep_show_idx = 0;
+		if (has_oled && !g_settings_ui)
+		{
+			prepare_oled_header();
+			oled_add_line((char *)"DR sweep result");
+		}
+		job->state = DRS_SHOW;
+		return false;
+	case DRS_SEND:
+	{
+		// Wait for the end of the last test cycle, it ends at the latest with its stage timeout
+		if (cycle_get_state() != CYCLE_IDLE)
+		{
+			job_sleep(job, 100);
+			return false;
+		}
+		// Wait for the duty cycle instead of deferring the uplink
+		uint32_t wait = sweep_dc_wait(NULL);
+		if (wait != 0)
+		{
+			job_sleep(job, wait);
+			return false;
+		}
+		// Woken up by the result, the timeout is the fallback
+		job_sleep(job, SWEEP_RESULT_TIMEOUT);
+		job->state = DRS_WAIT;
+		sweep_send_start(&g_sweep_stats[sweep_dr], NULL);
+		return false;
+	}
+	case DRS_WAIT:
+	{
+		sweep_send_timeout();
+		sweep_stats_s *stats = &g_sweep_stats[sweep_dr];
+		sweep_sent++;
+		job->progress++;
+		// Some time for display
+		job_sleep(job, SWEEP_DISPLAY_TIME);
+		if ((g_custom_parameters.sweep_fail_stop != 0) && (stats->fail_run >= g_custom_parameters.sweep_fail_stop))
+		{
+			MYLOG("SWEEP", "DR%d stopped after %d failures", sweep_dr, stats->fail_run);
+			sweep_skip_rest = true;
+		}
+		if (sweep_skip_rest || (sweep_sent >= g_custom_parameters.sweep_count))
+		{
+			sweep_dr++;
+			job->state = DRS_DR;
+		}
+		else
+		{
+			job->state = DRS_SEND;
+		}
+		return false;
+	}
+	case DRS_SHOW:
+		for (; sweep_show_idx < LPW_NUM_DR; sweep_show_idx++)
+		{
+			if (g_sweep_stats[sweep_show_idx].used)
+			{
+				break;
+			}
+		}
+		if ((sweep_show_idx >= LPW_NUM_DR) || !has_oled || g_settings_ui)
+		{
+			job->state = DRS_DONE;
+			return false;
+		}
+		sweep_show_line(sweep_show_idx);
+		sweep_show_idx++;
+		// Some time to read the line
+		job_sleep(job, 1000);
+		return false;
+	default:
+		sweep_save();
+		if (get_send_period() != 0)
+		{
+			lat_timer_start(RAK_TIMER_0, get_send_period(), NULL);
+		}
+		dr_sweep_active = false;
+		return true;
+	}
+}
+
+/**
+ * @brief Start a sweep through all uplink DR of the region
+ *        The sweep runs as job, the loop is not blocked while it waits for results
+ *
+ * @return true sweep started
+ * @return false region unknown, a sweep or an SD card job is running
+ */
+bool dr_sweep_start(void)
+{
+	if (dr_sweep_active || sd_busy() || (api.lorawan.band.get() >= LPW_NUM_REGIONS))
+	{
+		return false;
+	}
+	dr_sweep_active = true;
+	sweep_job.step = dr_sweep_step;
+	if (!job_start(&sweep_job))
+	{
+		dr_sweep_active = false;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Show one DR of the sweep matrix on the OLED
+ *        Success, mean RSSI/SNR and gateways
+ *
+ * @param dr datarate
+ */
+void sweep_show_line(uint8_t dr)
+{
+	if (g_sweep_stats[dr].skipped)
+	{
+		sprintf(line_str, "DR%d skipped", dr);
+	}
+	else
+	{
+		sweep_result_s res;
+		sweep_stats_get(&g_sweep_stats[dr], &res);
+		sprintf(line_str, "DR%d %d/%d %.0f/%.0f %.1fGW", dr, g_sweep_stats[dr].ok, g_sweep_stats[dr].sent, res.rssi, res.snr, res.gw);
+	}
+	oled_add_line(line_str);
+}
+
+/**
+ * @brief Format one DR of the sweep matrix
+ *        <DR>;<sent>;<ok>;<success %>;<gateways>;<RSSI>;<RSSI spread>;<SNR>;<SNR spread>;<demod margin>
+ *
+ * @param dr datarate
+ * @param line output buffer
+ * @param size size of the output buffer
+ * @param separator field separator
+ * @return int number of characters written
+ */
+int sweep_format_dr(uint8_t dr, char *line, size_t size, char separator)
+{
+	sweep_result_s res;
+	sweep_stats_get(&g_sweep_stats[dr], &res);
+	return snprintf(line, size, "%d%c%d%c%d%c%.0f%c%.1f%c%.1f%c%.1f%c%.1f%c%.1f%c%.1f",
+					dr, separator, g_sweep_stats[dr].sent, separator, g_sweep_stats[dr].ok, separator, res.success, separator,
+					res.gw, separator, res.rssi, separator, res.rssi_sd, separator, res.snr, separator, res.snr_sd, separator, res.demod);
+}
+
+/**
+ * @brief Append the sweep matrix to the sweep log file on the SD card
+ *
+ */
+void sweep_save(void)
+{
+	if (!has_sd)
+	{
+		return;
+	}
+	if (has_rtc)
+	{
+		read_rak12002();
+	}
+	else
+	{
+		get_mcu_time();
+	}
+	int len = 0;
+	for (uint8_t dr = 0; dr < LPW_NUM_DR; dr++)
+	{
+		if (!g_sweep_stats[dr].used || g_sweep_stats[dr].skipped)
+		{
+			continue;
+		}
+		if (len > (int)sizeof(sweep_table) - 128)
+		{
+			break;
+		}
+		len += snprintf(&sweep_table[len], sizeof(sweep_table) - len, "%04d-%02d-%02d %02d:%02d:%02d;%d;",
+						g_date_time.year, g_date_time.month, g_date_time.date, g_date_time.hour, g_date_time.minute, g_date_time.second,
+						api.lorawan.band.get());
+		len += sweep_format_dr(dr, &sweep_table[len], sizeof(sweep_table) - len, ';');
+		len += snprintf(&sweep_table[len], sizeof(sweep_table) - len, "\r\n");
+	}
+	write_sd_table(SWEEP_FILE_NAME, "\"time\";\"Band\";\"DR\";\"Sent\";\"OK\";\"Success\";\"Gw\";\"RSSI\";\"RSSI SD\";\"SNR\";\"SNR SD\";\"Demod\"", sweep_table);
+}
+
+/** Uplinks per size of the running payload size sweep */
+static uint8_t size_count = 0;
+
+/** Size step of the running payload size sweep */
+static uint8_t size_step = 0;
+
+/** Max payload size of the running payload size sweep */
+static uint8_t size_max_len = 0;
+
+/** Payload of the running payload size sweep */
+static tx_buffer_s *size_buffer = NULL;
+
+/** States of the payload size sweep job */
+enum size_sweep_state_num
+{
+	SZS_START = 0, // Reset the results
+	SZS_SIZE,	   // Prepare the payload of the next size
+	SZS_SEND,	   // Send an uplink when the duty cycle allows it
+	SZS_WAIT,	   // Result received or timeout
+	SZS_SHOW,	   // Show one line of the PER table
+	SZS_DONE	   // Save the PER table and restart the send timer
+};
+
+/**
+ * @brief One step of the payload size sweep
+ *        Sizes go in steps from the step size up to the max payload of the DR.
+ *        The payload is the custom packet, repeated to fill the size.
+ *        The job sleeps while it waits for the duty cycle, the result of an uplink and the display.
+ *
+ * @param job sweep job
+ * @return true sweep finished
+ * @return false more steps needed
+ */
+static bool size_sweep_step(job_s *job)
+{
+	switch (job->state)
+	{
+	case SZS_START:
+		MYLOG("SWEEP", "Size sweep DR%d up to %d bytes in %d byte steps", api.lorawan.dr.get(), size_max_len, size_step);
+		api.system.timer.stop(RAK_TIMER_0);
+		if (!display_power)
+		{
+			oled_power(true);
+		}
+		memset(g_size_stats, 0, sizeof(g_size_stats));
+		g_size_num = 0;
+		job->total = ((size_max_len + size_step - 1) / size_step) * size_count;
+		size_buffer = tx_payload_reset();
+		job->state = SZS_SIZE;
+		return false;
+	case SZS_SIZE:
+	{
+		uint16_t len = g_size_num == 0 ? size_step : g_size_len[g_size_num - 1] + size_step;
+		// Last step is the max payload
+		if (len > size_max_len)
+		{
+			len = size_max_len;
+		}
+		if ((g_size_num >= SIZE_SWEEP_MAX_STEPS) || ((g_size_num != 0) && (g_size_len[g_size_num - 1] == size_max_len)))
+		{
+			tx_payload_reset();
+			sweep_show_idx = 0;
+			if (has_oled && !g_settings_ui)
+			{
+				prepare_oled_header();
+				sprintf(line_str, "PER at DR%d", api.lorawan.dr.get());
+				oled_add_line(line_str);
+			}
+			job->state = SZS_SHOW;
+			return false;
+		}
+		g_size_len[g_size_num] = len;
+		g_size_stats[g_size_num].used = true;
+		g_size_num++;
+
+		// Fill the payload with the custom packet
+		for (uint16_t idx = 0; idx < len; idx++)
+		{
+			size_buffer->data[idx] = g_custom_parameters.custom_packet_len != 0 ? g_custom_parameters.custom_packet[idx % g_custom_parameters.custom_packet_len] : idx;
+		}
+		size_buffer->len = len;
+
+		if (has_oled && !g_settings_ui)
+		{
+			prepare_oled_header();
+			sprintf(line_str, "Size sweep %d bytes", len);
+			oled_add_line(line_str);
+		}
+		sweep_sent = 0;
+		job->state = SZS_SEND;
+		return false;
+	}
+	case SZS_SEND:
+	{
+		// Wait for the duty cycle instead of deferring the uplink
+		uint32_t wait = sweep_dc_wait(size_buffer);
+		if (wait != 0)
+		{
+			job_sleep(job, wait);
+			return false;
+		}
+		// Woken up by the result, the timeout is the fallback
+		job_sleep(job, SWEEP_RESULT_TIMEOUT);
+		job->state = SZS_WAIT;
+		sweep_send_start(&g_size_stats[g_size_num - 1], size_buffer);
+		return false;
+	}
+	case SZS_WAIT:
+		sweep_send_timeout();
+		sweep_sent++;
+		job->progress++;
+		// Some time for display
+		job_sleep(job, SWEEP_DISPLAY_TIME);
+		job->state = sweep_sent >= size_count ? SZS_SIZE : SZS_SEND;
+		return false;
+	case SZS_SHOW:
+		if ((sweep_show_idx >= g_size_num) || !has_oled || g_settings_ui)
+		{
+			job->state = SZS_DONE;
+			return false;
+		}
+		size_sweep_show_line(sweep_show_idx);
+		sweep_show_idx++;
+		// Some time to read the line
+		job_sleep(job, 1000);
+		return false;
+	default:
+		size_sweep_save();
+		if (get_send_period() != 0)
+		{
+			lat_timer_start(RAK_TIMER_0, get_send_period(), NULL);
+		}
+		dr_sweep_active = false;
+		return true;
+	}
+}
+
+/**
+ * @brief Start a sweep through payload sizes at the current DR
+ *        The step is increased if the sizes do not fit into SIZE_SWEEP_MAX_STEPS.
+ *        The sweep runs as job, the loop is not blocked while it waits for results
+ *
+ * @param count uplinks per payload size
+ * @param step payload size step in bytes
+ * @return true sweep started
+ * @return false invalid parameters, a sweep or an SD card job is running
+ */
+bool size_sweep_start(uint8_t count, uint8_t step)
+{
+	uint8_t max_len = get_max_payload(api.lorawan.band.get(), api.lorawan.dr.get());
+	if (dr_sweep_active || sd_busy() || (max_len == 0) || (count == 0) || (step == 0))
+	{
+		return false;
+	}
+	if (((max_len + step - 1) / step) > SIZE_SWEEP_MAX_STEPS)
+	{
+		step = (max_len + SIZE_SWEEP_MAX_STEPS - 1) / SIZE_SWEEP_MAX_STEPS;
+	}
+	size_count = count;
+	size_step = step;
+	size_max_len = max_len;
+
+	dr_sweep_active = true;
+	sweep_job.step = size_sweep_step;
+	if (!job_start(&sweep_job))
+	{
+		dr_sweep_active = false;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Format one size of the payload size sweep
+ *        <size>;<sent>;<lost>;<PER %>;<RSSI>;<SNR>
+ *
+ * @param idx entry of the payload size sweep
+ * @param line output buffer
+ * @param size size of the output buffer
+ * @param separator field separator
+ * @return int number of characters written
+ */
+int size_sweep_format(uint8_t idx, char *line, size_t size, char separator)
+{
+	sweep_result_s res;
+	sweep_stats_get(&g_size_stats[idx], &res);
+	return snprintf(line, size, "%d%c%d%c%d%c%.0f%c%.1f%c%.1f",
+					g_size_len[idx], separator, g_size_stats[idx].sent, separator, g_size_stats[idx].sent - g_size_stats[idx].ok, separator,
+					100.0 - res.success, separator, res.rssi, separator, res.snr);
+}
+
+/**
+ * @brief Show one size of the PER table on the OLED
+ *
+ * @param idx entry of the payload size sweep
+ */
+void size_sweep_show_line(uint8_t idx)
+{
+	sweep_result_s res;
+	sweep_stats_get(&g_size_stats[idx], &res);
+	sprintf(line_str, "%3dB PER %.0f%% %.0f/%.0f", g_size_len[idx], 100.0 - res.success, res.rssi, res.snr);
+	oled_add_line(line_str);
+}
+
+/**
+ * @brief Append the PER table to the size sweep log file on the SD card
+ *
+ */
+void size_sweep_save(void)
+{
+	if (!has_sd)
+	{
+		return;
+	}
+	if (has_rtc)
+	{
+		read_rak12002();
+	}
+	else
+	{
+		get_mcu_time();
+	}
+	int len = 0;
+	for (uint8_t idx = 0; idx < g_size_num; idx++)
+	{
+		if (len > (int)sizeof(sweep_table) - 96)
+		{
+			break;
+		}
+		len += snprintf(&sweep_table[len], sizeof(sweep_table) - len, "%04d-%02d-%02d %02d:%02d:%02d;%d;%d;",
+						g_date_time.year, g_date_time.month, g_date_time.date, g_date_time.hour, g_date_time.minute, g_date_time.second,
+						api.lorawan.band.get(), api.lorawan.dr.get());
+		len += size_sweep_format(idx, &sweep_table[len], sizeof(sweep_table) - len, ';');
+		len += snprintf(&sweep_table[len], sizeof(sweep_table) - len, "\r\n");
+	}
+	write_sd_table(SIZE_SWEEP_FILE_NAME, "\"time\";\"Band\";\"DR\";\"Size\";\"Sent\";\"Lost\";\"PER\";\"RSSI\";\"SNR\"", sweep_table);
+}
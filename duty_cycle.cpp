@@ -0,0 +1,556 @@
+/**
+ * @file duty_cycle.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Duty cycle accounting per sub-band
+ *        Tracks the time on air of the uplinks in a sliding one hour window
+ *        and the off time after each uplink as the LoRaWAN stack does
+ * @version 0.1
+ * @date 2024-12-30
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "app.h"
+#include <utilities.h>
+
+static_assert(sizeof(custom_param_s) <= DC_DAY_FLASH_OFFSET, "Settings overlap the fair use budget in flash");
+
+/** Uplink record */
+struct dc_record_s
+{
+	uint32_t start;	 // millis() at TX start
+	uint32_t toa;	 // Time on air in ms
+	uint8_t subband; // Sub-band index in lpw_subbands
+};
+
+/** Uplink records, ring buffer */
+static dc_record_s dc_records[DC_MAX_RECORDS];
+
+/** Index of the oldest record */
+static uint8_t dc_first = 0;
+
+/** Number of records */
+static uint8_t dc_num = 0;
+
+/** End of the off time per sub-band */
+static uint32_t dc_off_until[LPW_NUM_SUBBANDS];
+
+/** Flag if an off time is active per sub-band */
+static bool dc_off_active[LPW_NUM_SUBBANDS];
+
+/** Payload size of the last uplink, used to estimate the next uplink */
+static uint8_t dc_last_len = 0;
+
+/** Flag if the send timer was shifted to the next legal slot */
+static bool dc_timer_shifted = false;
+
+/** Start of the current fair use day, used while no date is known */
+static uint32_t dc_day_start = 0;
+
+/** Time on air used in the current fair use day in ms */
+static uint32_t dc_day_used = 0;
+
+/** Local calendar day (days since 1970) of the fair use budget, 0 if the day is counted from boot */
+static uint32_t dc_day_number = 0;
+
+/** Time on air of the last save to flash in ms */
+static uint32_t dc_day_saved = 0;
+
+/** Fair use budget saved in flash */
+struct dc_day_flash_s
+{
+	uint32_t crc = 0;
+	uint32_t day = 0;
+	uint32_t used = 0;
+};
+
+/** Send interval calculated in auto interval mode */
+static uint32_t dc_auto_period = 0;
+
+/**
+ * @brief Get the sub-band of the uplinks
+ *        The stack selects the channel, the default channels are used for the accounting
+ *
+ * @return uint8_t sub-band index or LPW_SUBBAND_NONE
+ */
+uint8_t dc_get_subband(void)
+{
+	uint8_t region = api.lorawan.band.get();
+	if (region >= LPW_NUM_REGIONS)
+	{
+		return LPW_SUBBAND_NONE;
+	}
+	return lpw_subband(region, lpw_regions[region].channels[0]);
+}
+
+/**
+ * @brief Time on air of an uplink with the current DR
+ *
+ * @param len application payload size
+ * @return uint32_t time on air in ms
+ */
+uint32_t dc_get_toa(uint8_t len)
+{
+	return (lpw_toa_us(api.lorawan.band.get(), api.lorawan.dr.get(), len, get_fopts_len()) + 999) / 1000;
+}
+
+/**
+ * @brief Remove records that are older than the window
+ *
+ */
+static void dc_expire(void)
+{
+	uint32_t now = millis();
+	while ((dc_num != 0) && ((now - dc_records[dc_first].start) >= DC_WINDOW_MS))
+	{
+		dc_first = (dc_first + 1) % DC_MAX_RECORDS;
+		dc_num--;
+	}
+}
+
+/**
+ * @brief Time on air used in the window
+ *
+ * @param subband sub-band index
+ * @return uint32_t used time on air in ms
+ */
+static uint32_t dc_get_used(uint8_t subband)
+{
+	uint32_t used = 0;
+	for (uint8_t idx = 0; idx < dc_num; idx++)
+	{
+		dc_record_s *record = &dc_records[(dc_first + idx) % DC_MAX_RECORDS];
+		if (record->subband == subband)
+		{
+			used += record->toa;
+		}
+	}
+	return used;
+}
+
+/**
+ * @brief Time on air budget left in the window for the sub-band of the uplinks
+ *
+ * @return int32_t budget in ms, -1 if there is no duty cycle limit
+ */
+int32_t dc_get_budget_left(void)
+{
+	uint8_t subband = dc_get_subband();
+	if (subband == LPW_SUBBAND_NONE)
+	{
+		return -1;
+	}
+	dc_expire();
+	uint32_t budget = DC_WINDOW_MS / lpw_subbands[subband].dc_divisor;
+	uint32_t used = dc_get_used(subband);
+	return used >= budget ? 0 : budget - used;
+}
+
+/**
+ * @brief Time until an uplink with this payload size is allowed
+ *
+ * @param len application payload size
+ * @return uint32_t wait time in ms, 0 if the uplink can be sent now
+ */
+uint32_t dc_get_wait(uint8_t len)
+{
+	uint8_t subband = dc_get_subband();
+	if (subband == LPW_SUBBAND_NONE)
+	{
+		return 0;
+	}
+	dc_expire();
+	uint32_t now = millis();
+	uint32_t wait = 0;
+
+	// Off time after the last uplink
+	if (dc_off_active[subband])
+	{
+		if ((int32_t)(dc_off_until[subband] - now) > 0)
+		{
+			wait = dc_off_until[subband] - now;
+		}
+		else
+		{
+			dc_off_active[subband] = false;
+		}
+	}
+
+	// Sliding window, wait until enough old uplinks leave the window
+	uint32_t toa = dc_get_toa(len);
+	uint32_t budget = DC_WINDOW_MS / lpw_subbands[subband].dc_divisor;
+	uint32_t used = dc_get_used(subband);
+	for (uint8_t idx = 0; (idx < dc_num) && ((used + toa) > budget); idx++)
+	{
+		dc_record_s *record = &dc_records[(dc_first + idx) % DC_MAX_RECORDS];
+		if (record->subband == subband)
+		{
+			used -= record->toa;
+			uint32_t expire = record->start + DC_WINDOW_MS - now;
+			if (expire > wait)
+			{
+				wait = expire;
+			}
+		}
+	}
+	return wait;
+}
+
+/**
+ * @brief Local time from the LoRaWAN time sync or the RTC
+ *
+ * @return uint32_t local time in seconds since 1970, 0 if no valid time is known
+ */
+static uint32_t dc_local_time(void)
+{
+	uint32_t now = 0;
+	if (sync_time_status != 0)
+	{
+		SysTime_t UnixEpoch = SysTimeGet();
+		now = UnixEpoch.Seconds - 18 + (int32_t)(g_custom_parameters.timezone * 60 * 60);
+	}
+	else if (has_rtc)
+	{
+		// RTC runs in local time
+		now = get_unixtime_rak12002();
+	}
+	return now >= DC_TIME_VALID ? now : 0;
+}
+
+/**
+ * @brief Save the fair use budget with its day to flash
+ *
+ */
+static void dc_save_day(void)
+{
+	dc_day_flash_s record;
+	record.day = dc_day_number;
+	record.used = dc_day_used;
+	record.crc = Crc32((uint8_t *)&record.day, sizeof(dc_day_flash_s) - sizeof(uint32_t));
+	if (!api.system.flash.set(DC_DAY_FLASH_OFFSET, (uint8_t *)&record, sizeof(dc_day_flash_s)))
+	{
+		MYLOG("DC", "Saving the fair use budget failed");
+		return;
+	}
+	dc_day_saved = dc_day_used;
+}
+
+/**
+ * @brief Save the fair use budget if it grew by a save step since the last save
+ *        Limits the flash writes to DC_DAY_SAVE_STEPS per day, a reboot loses less than one step
+ *
+ */
+static void dc_check_save_day(void)
+{
+	if (g_custom_parameters.fair_use_s == 0)
+	{
+		return;
+	}
+	uint32_t step = (uint32_t)g_custom_parameters.fair_use_s * 1000 / DC_DAY_SAVE_STEPS;
+	if ((dc_day_used - dc_day_saved) >= step)
+	{
+		dc_save_day();
+	}
+}
+
+/**
+ * @brief Start a new fair use day
+ *        With a known date at local midnight, without a date 24 hours after the start of the day
+ *
+ */
+static void dc_expire_day(void)
+{
+	uint32_t day = dc_local_time() / 86400;
+	if (day != 0)
+	{
+		if (dc_day_number == 0)
+		{
+			// Date became known, the budget used so far belongs to this day
+			dc_day_number = day;
+			dc_save_day();
+		}
+		else if (day != dc_day_number)
+		{
+			dc_day_number = day;
+			dc_day_used = 0;
+			dc_save_day();
+		}
+		return;
+	}
+	uint32_t now = millis();
+	if ((now - dc_day_start) >= DC_DAY_MS)
+	{
+		dc_day_start = now;
+		dc_day_used = 0;
+		dc_save_day();
+	}
+}
+
+/**
+ * @brief Time left until the fair use budget is reset
+ *
+ * @return uint32_t time in ms
+ */
+uint32_t dc_get_day_left(void)
+{
+	dc_expire_day();
+	uint32_t now = dc_local_time();
+	if (now != 0)
+	{
+		return (86400 - (now % 86400)) * 1000;
+	}
+	return DC_DAY_MS - (millis() - dc_day_start);
+}
+
+/**
+ * @brief Check if the fair use day follows the calendar
+ *
+ * @return true the budget is reset at local midnight
+ * @return false no date known, the budget is reset 24 hours after boot
+ */
+bool dc_day_has_date(void)
+{
+	return dc_local_time() != 0;
+}
+
+/**
+ * @brief Restore the fair use budget after a reboot
+ *        The budget of the same day is restored. If no date is known the saved budget is kept,
+ *        a reboot never grants a fresh budget. Call after the settings and the RTC are initialized.
+ *
+ */
+void dc_init_day(void)
+{
+	dc_day_flash_s record;
+	dc_day_start = millis();
+	if (!api.system.flash.get(DC_DAY_FLASH_OFFSET, (uint8_t *)&record, sizeof(dc_day_flash_s)))
+	{
+		MYLOG("DC", "Reading the fair use budget failed");
+		return;
+	}
+	if (record.crc != Crc32((uint8_t *)&record.day, sizeof(dc_day_flash_s) - sizeof(uint32_t)))
+	{
+		MYLOG("DC", "No fair use budget saved");
+		return;
+	}
+	uint32_t day = dc_local_time() / 86400;
+	if ((day != 0) && (record.day != 0) && (record.day != day))
+	{
+		MYLOG("DC", "Fair use budget of day %ld expired", record.day);
+		return;
+	}
+	dc_day_number = record.day;
+	dc_day_used = record.used;
+	dc_day_saved = record.used;
+	MYLOG("DC", "Fair use budget restored, %ld ms used", dc_day_used);
+}
+
+/**
+ * @brief Time on air used today for the fair use policy
+ *
+ * @return uint32_t used time on air in ms
+ */
+uint32_t dc_get_day_used(void)
+{
+	dc_expire_day();
+	return dc_day_used;
+}
+
+/**
+ * @brief Calculate the shortest legal send interval
+ *        Limited by the duty cycle of the sub-band and by the fair use budget,
+ *        the remaining fair use budget is spread over the rest of the day
+ *
+ * @return uint32_t send interval in ms
+ */
+uint32_t dc_calc_auto_interval(void)
+{
+	uint8_t len = dc_last_len != 0 ? dc_last_len : g_custom_parameters.custom_packet_len;
+	uint32_t toa = dc_get_toa(len);
+	uint32_t period = AUTO_INTERVAL_MIN;
+
+	// Duty cycle
+	uint8_t subband = dc_get_subband();
+	if ((subband != LPW_SUBBAND_NONE) && ((toa * lpw_subbands[subband].dc_divisor) > period))
+	{
+		period = toa * lpw_subbands[subband].dc_divisor;
+	}
+
+	// Fair use
+	if (g_custom_parameters.fair_use_s != 0)
+	{
+		uint32_t day_left = dc_get_day_left();
+		uint32_t budget = (uint32_t)g_custom_parameters.fair_use_s * 1000;
+		uint32_t fair_period = day_left;
+		if ((dc_day_used + toa) < budget)
+		{
+			fair_period = (uint32_t)((uint64_t)day_left * toa / (budget - dc_day_used));
+		}
+		if (fair_period > period)
+		{
+			period = fair_period;
+		}
+	}
+
+	// Full seconds
+	return (period + 999) / 1000 * 1000;
+}
+
+/**
+ * @brief Get the period of the send timer
+ *
+ * @return uint32_t send interval in ms, calculated interval in auto interval mode
+ */
+uint32_t get_send_period(void)
+{
+	if (!g_custom_parameters.auto_interval || !api.lorawan.nwm.get())
+	{
+		return g_custom_parameters.send_interval;
+	}
+	if (dc_auto_period == 0)
+	{
+		dc_auto_period = dc_calc_auto_interval();
+	}
+	return dc_auto_period;
+}
+
+/**
+ * @brief Recalculate the send interval in auto interval mode and restart the send timer if it changed
+ *        Called after each uplink, DR changes by ADR or DR sweep are applied with the next uplink
+ *
+ */
+void dc_update_auto_interval(void)
+{
+	if (!g_custom_parameters.auto_interval || !api.lorawan.nwm.get())
+	{
+		dc_auto_period = 0;
+		return;
+	}
+	uint32_t period = dc_calc_auto_interval();
+	if (period != dc_auto_period)
+	{
+		MYLOG("DC", "Auto interval %ld ms", period);
+		dc_auto_period = period;
+		if (!dc_timer_shifted && !dr_sweep_active)
+		{
+			api.system.timer.stop(RAK_TIMER_0);
+			lat_timer_start(RAK_TIMER_0, dc_auto_period, NULL);
+		}
+	}
+}
+
+/**
+ * @brief Record an uplink
+ *
+ * @param len application payload size
+ */
+void dc_add_tx(uint8_t len)
+{
+	dc_last_len = len;
+	energy_add(EN_TX, dc_get_toa(len));
+	dc_expire_day();
+	dc_day_used += dc_get_toa(len);
+	dc_check_save_day();
+	uint8_t subband = dc_get_subband();
+	if (subband == LPW_SUBBAND_NONE)
+	{
+		return;
+	}
+	dc_expire();
+	if (dc_num == DC_MAX_RECORDS)
+	{
+		// Drop the oldest record
+		dc_first = (dc_first + 1) % DC_MAX_RECORDS;
+		dc_num--;
+	}
+	dc_record_s *record = &dc_records[(dc_first + dc_num) % DC_MAX_RECORDS];
+	record->start = millis();
+	record->toa = dc_get_toa(len);
+	record->subband = subband;
+	dc_num++;
+
+	dc_off_until[subband] = record->start + record->toa * lpw_subbands[subband].dc_divisor;
+	dc_off_active[subband] = true;
+	MYLOG("DC", "TX %d bytes, %ld ms on air, next TX after %ld ms", len, record->toa, record->toa * lpw_subbands[subband].dc_divisor);
+}
+
+/**
+ * @brief Record the retransmissions of the last uplink, called from the send callback
+ *        The uplinks are confirmed, api.lorawan.send with retry 0 uses the AT+RETY setting.
+ *        Without ACK the stack sent the uplink 1 + AT+RETY times, the first attempt was recorded by dc_add_tx.
+ *        The stack does not report retransmissions before a received ACK, such an uplink is recorded once.
+ *        Only the RX2 timeout means that all attempts were sent without ACK, other errors (busy, duty cycle,
+ *        not joined, parameters) sent one frame or none and add nothing.
+ *
+ * @param status status of the send callback
+ */
+void dc_add_retx(int32_t status)
+{
+	if (status != RAK_LORAMAC_STATUS_RX2_TIMEOUT)
+	{
+		return;
+	}
+	uint8_t retries = api.lorawan.rety.get();
+	if (retries == 0)
+	{
+		return;
+	}
+	MYLOG("DC", "No ACK, %d retransmissions", retries);
+	for (uint8_t idx = 0; idx < retries; idx++)
+	{
+		dc_add_tx(dc_last_len);
+	}
+	dc_update_auto_interval();
+}
+
+/**
+ * @brief Time until the next uplink is allowed
+ *        The size of the last uplink is used as estimate
+ *
+ * @return uint32_t wait time in ms, 0 if the uplink can be sent now
+ */
+uint32_t dc_get_next_wait(void)
+{
+	return dc_get_wait(dc_last_len);
+}
+
+/**
+ * @brief Check the duty cycle before an uplink
+ *        If the uplink is not allowed, the send timer is moved to the next legal slot
+ *
+ * @return true uplink is allowed
+ * @return false uplink is deferred
+ */
+bool dc_check(void)
+{
+	// Back to the normal send interval after a deferred uplink
+	if (dc_timer_shifted)
+	{
+		dc_timer_shifted = false;
+		api.system.timer.stop(RAK_TIMER_0);
+		if (!dr_sweep_active && (get_send_period() != 0))
+		{
+			lat_timer_start(RAK_TIMER_0, get_send_period(), NULL);
+		}
+	}
+
+	uint32_t wait = dc_get_next_wait();
+	if (wait == 0)
+	{
+		return true;
+	}
+
+	MYLOG("DC", "Duty cycle limit, wait %ld ms", wait);
+	api.system.timer.stop(RAK_TIMER_0);
+	lat_timer_start(RAK_TIMER_0, wait, NULL);
+	dc_timer_shifted = true;
+
+	if (has_oled && !g_settings_ui)
+	{
+		prepare_oled_header();
+		oled_add_line((char *)"Duty cycle limit");
+		sprintf(line_str, "Next TX in %ld s", (wait + 999) / 1000);
+		oled_add_line(line_str);
+	}
+	return false;
+}
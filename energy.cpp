@@ -0,0 +1,206 @@
+/**
+ * @file energy.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Time and energy accounting of the subsystems
+ *        Each subsystem reports its active periods, together with the current draw model of each state
+ *        the average current (= mAh per hour) of each subsystem is estimated
+ * @version 0.1
+ * @date 2025-01-13
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "app.h"
+
+/** Names of the states */
+static const char *const energy_names[EN_NUM] = {"base", "mcu", "oled", "oled_refresh", "rail", "gnss", "sd", "tx", "rx"};
+
+/** Current draw model in uA, can be changed with ATC+ENERGY */
+static uint32_t energy_ua[EN_NUM] = ENERGY_DEFAULT_UA;
+
+/** Accumulated active time of each state in ms */
+static uint32_t energy_on_ms[EN_NUM];
+
+/** millis() when the state became active */
+static uint32_t energy_since[EN_NUM];
+
+/** Flag if the state is active */
+static bool energy_on[EN_NUM];
+
+/** Start of the statistics */
+static uint32_t energy_start = 0;
+
+/** Sleep time of the main loop at the start of the statistics */
+static uint32_t energy_sleep_start = 0;
+
+/** Flag if the WB_IO2 rail is switched on */
+static bool rail_on = false;
+
+/**
+ * @brief Start or end an active period of a subsystem
+ *
+ * @param id energy_state_num_t
+ * @param on true = active, false = inactive
+ */
+void energy_state(uint8_t id, bool on)
+{
+	if (on == energy_on[id])
+	{
+		return;
+	}
+	uint32_t now = millis();
+	if (on)
+	{
+		energy_since[id] = now;
+	}
+	else
+	{
+		energy_on_ms[id] += now - energy_since[id];
+	}
+	energy_on[id] = on;
+}
+
+/**
+ * @brief Add an active period that is known afterwards, e.g. the time on air of an uplink
+ *
+ * @param id energy_state_num_t
+ * @param ms active time in ms
+ */
+void energy_add(uint8_t id, uint32_t ms)
+{
+	energy_on_ms[id] += ms;
+}
+
+/**
+ * @brief Update the GNSS state, the receiver draws current while the rail is on
+ *        and a location is acquired or the location is kept active
+ *
+ */
+void energy_update_gnss(void)
+{
+	energy_state(EN_GNSS, has_gnss && rail_on && (gnss_active || g_custom_parameters.location_on));
+}
+
+/**
+ * @brief Switch the WB_IO2 rail that powers the GNSS module and the SD card
+ *
+ * @param on true = power on, false = power off
+ */
+void rail_power(bool on)
+{
+	digitalWrite(WB_IO2, on ? HIGH : LOW);
+	rail_on = on;
+	energy_state(EN_RAIL, on);
+	energy_update_gnss();
+}
+
+/**
+ * @brief Get the active time of a state since the start of the statistics
+ *
+ * @param id energy_state_num_t
+ * @return uint32_t active time in ms
+ */
+static uint32_t energy_get_ms(uint8_t id)
+{
+	uint32_t now = millis();
+	switch (id)
+	{
+	case EN_BASE:
+		return now - energy_start;
+	case EN_MCU:
+	{
+		// MCU is active when the main loop does not sleep
+		uint32_t sleep_ms = lp_get_sleep_total() - energy_sleep_start;
+		uint32_t total = now - energy_start;
+		return sleep_ms > total ? 0 : total - sleep_ms;
+	}
+	default:
+		return energy_on_ms[id] + (energy_on[id] ? now - energy_since[id] : 0);
+	}
+}
+
+/**
+ * @brief Get the estimated average current of a state
+ *
+ * @param id energy_state_num_t, EN_NUM for the sum of all states
+ * @return uint32_t average current in uA, the same as uAh per hour
+ */
+uint32_t energy_avg_ua(uint8_t id)
+{
+	uint32_t total = millis() - energy_start;
+	if (total == 0)
+	{
+		return 0;
+	}
+	if (id == EN_NUM)
+	{
+		uint32_t sum = 0;
+		for (uint8_t state = 0; state < EN_NUM; state++)
+		{
+			sum += energy_avg_ua(state);
+		}
+		return sum;
+	}
+	return (uint32_t)((uint64_t)energy_ua[id] * energy_get_ms(id) / total);
+}
+
+/**
+ * @brief Change the current draw model of a state
+ *
+ * @param name name of the state
+ * @param ua current draw in uA
+ * @return true model changed
+ * @return false unknown state
+ */
+bool energy_set_ua(const char *name, uint32_t ua)
+{
+	for (uint8_t id = 0; id < EN_NUM; id++)
+	{
+		if (strcmp(name, energy_names[id]) == 0)
+		{
+			energy_ua[id] = ua;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Format the accounting of one state
+ *        Format <state>:<active time s>:<model uA>:<mAh per hour>
+ *        The last line is total:<time s>:<mAh per hour>
+ *
+ * @param idx line index
+ * @param line output buffer
+ * @param size size of the output buffer
+ * @return int length of the line, -1 after the last line
+ */
+int energy_format(uint8_t idx, char *line, size_t size)
+{
+	if (idx < EN_NUM)
+	{
+		return snprintf(line, size, "%s:%ld:%ld:%.3f", energy_names[idx], energy_get_ms(idx) / 1000, energy_ua[idx],
+						energy_avg_ua(idx) / 1000.0);
+	}
+	if (idx == EN_NUM)
+	{
+		return snprintf(line, size, "total:%ld:%.3f", (millis() - energy_start) / 1000, energy_avg_ua(EN_NUM) / 1000.0);
+	}
+	return -1;
+}
+
+/**
+ * @brief Start new statistics, active states stay active
+ *
+ */
+void energy_reset(void)
+{
+	uint32_t now = millis();
+	energy_start = now;
+	energy_sleep_start = lp_get_sleep_total();
+	for (uint8_t id = 0; id < EN_NUM; id++)
+	{
+		energy_on_ms[id] = 0;
+		energy_since[id] = now;
+	}
+}
@@ -0,0 +1,90 @@
+/**
+ * @file event_queue.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Event queue from the LoRa callbacks into the display handler
+ *        Single producer (LoRa and timer callbacks), single consumer (display handler)
+ *        Each event has its own copy of the results, events are not overwritten while waiting
+ * @version 0.1
+ * @date 2025-01-08
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "app.h"
+
+/** Event storage */
+static app_event_s evt_queue[EVT_QUEUE_SIZE];
+
+/** Write index, only changed by the producer */
+static volatile uint16_t evt_head = 0;
+
+/** Read index, only changed by the consumer */
+static volatile uint16_t evt_tail = 0;
+
+/** Number of events dropped because the queue was full */
+static volatile uint32_t evt_overflows = 0;
+
+/**
+ * @brief Add an event to the queue
+ *        If the queue is full, the new event is dropped and counted
+ *
+ * @param event event to copy into the queue
+ * @return true event queued
+ * @return false queue full
+ */
+bool evt_push(app_event_s *event)
+{
+	uint16_t head = evt_head;
+	if ((uint16_t)(head - evt_tail) >= EVT_QUEUE_SIZE)
+	{
+		evt_overflows++;
+		return false;
+	}
+	memcpy(&evt_queue[head % EVT_QUEUE_SIZE], event, sizeof(app_event_s));
+	// Event must be complete before the consumer sees the new index
+	__sync_synchronize();
+	evt_head = head + 1;
+	return true;
+}
+
+/**
+ * @brief Get the oldest event from the queue
+ *
+ * @param event buffer for the event
+ * @return true event copied into the buffer
+ * @return false queue empty
+ */
+bool evt_pop(app_event_s *event)
+{
+	uint16_t tail = evt_tail;
+	if (tail == evt_head)
+	{
+		return false;
+	}
+	__sync_synchronize();
+	memcpy(event, &evt_queue[tail % EVT_QUEUE_SIZE], sizeof(app_event_s));
+	// Slot must be copied before the producer can reuse it
+	__sync_synchronize();
+	evt_tail = tail + 1;
+	return true;
+}
+
+/**
+ * @brief Get the number of events that are waiting
+ *
+ * @return uint16_t number of events
+ */
+uint16_t evt_pending(void)
+{
+	return (uint16_t)(evt_head - evt_tail);
+}
+
+/**
+ * @brief Get the number of dropped events
+ *
+ * @return uint32_t number of events dropped since the start
+ */
+uint32_t evt_get_overflows(void)
+{
+	return evt_overflows;
+}
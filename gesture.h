@@ -0,0 +1,267 @@
+/**
+ * @file gesture.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Table driven button gesture recognizer
+ *        Recognizes 1 to 7 clicks and long presses only from the time stamps of the button edges,
+ *        the gesture is reported when its timeout expires, nothing waits for the button.
+ *        No Arduino dependencies, the time is passed in, the recognizer can be run on a host.
+ * @version 0.1
+ * @date 2025-01-14
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef GESTURE_H
+#define GESTURE_H
+
+#include <stdint.h>
+
+/** Recognized gestures */
+typedef enum gesture_num
+{
+	GESTURE_NONE = 0,
+	GESTURE_CLICK_1 = 1, // GESTURE_CLICK_1 + n - 1 = n clicks
+	GESTURE_CLICK_7 = 7,
+	GESTURE_LONG = 8,
+	GESTURE_NUM = 9
+} gesture_num_t;
+
+/** States of the recognizer */
+typedef enum gesture_state_num
+{
+	GST_IDLE = 0, // Button released, no gesture pending
+	GST_DOWN = 1, // Button pressed
+	GST_UP = 2,	  // Button released, waiting for the next click
+	GST_HELD = 3, // Long press reported, waiting for the release
+	GST_NUM_STATES = 4
+} gesture_state_num_t;
+
+/** Events of the recognizer */
+typedef enum gesture_event_num
+{
+	GEV_PRESS = 0,	 // Falling edge
+	GEV_RELEASE = 1, // Rising edge
+	GEV_TIMEOUT = 2, // Deadline of the state expired
+	GESTURE_NUM_EVENTS = 3
+} gesture_event_num_t;
+
+/** Actions of a transition */
+typedef enum gesture_action_num
+{
+	GACT_NONE = 0,	  // Ignore the event
+	GACT_PRESS = 1,	  // Count the click
+	GACT_RELEASE = 2, // Remember the release time
+	GACT_CLICKS = 3,  // Report the number of clicks
+	GACT_LONG = 4	  // Report a long press
+} gesture_action_num_t;
+
+/** One transition */
+struct gesture_transition_s
+{
+	uint8_t state;	// gesture_state_num_t
+	uint8_t event;	// gesture_event_num_t
+	uint8_t next;	// gesture_state_num_t
+	uint8_t action; // gesture_action_num_t
+};
+
+/** Recognizer state */
+struct gesture_sm_s
+{
+	uint8_t state;
+	uint8_t count;		 // Clicks of the pending gesture
+	uint32_t press_ms;	 // Time of the last press
+	uint32_t release_ms; // Time of the last release
+	uint32_t edge_ms;	 // Time of the last accepted edge, for debouncing
+	uint32_t bounces;	 // Edges dropped by the debouncing
+	uint32_t dropped;	 // Gestures with too many clicks
+};
+
+/** Edges closer than this to the previous edge are contact bounces */
+#define GESTURE_DEBOUNCE_MS 30
+/** Button pressed this long is a long press */
+#define GESTURE_LONG_MS 3000
+/** Button released this long ends the click sequence */
+#define GESTURE_SETTLE_MS 200
+/** Minimum time from the last press to the report of n clicks, the same timing as the old polling */
+#define GESTURE_CLICK_MS {400, 400, 600, 800, 1200, 1400, 1600}
+/** Maximum number of clicks */
+#define GESTURE_MAX_CLICKS 7
+
+static const uint16_t gesture_click_ms[GESTURE_MAX_CLICKS] = GESTURE_CLICK_MS;
+
+/** Transition table, events without entry are ignored */
+static const gesture_transition_s gesture_transitions[] = {
+	{GST_IDLE, GEV_PRESS, GST_DOWN, GACT_PRESS},
+	{GST_DOWN, GEV_RELEASE, GST_UP, GACT_RELEASE},
+	{GST_DOWN, GEV_TIMEOUT, GST_HELD, GACT_LONG},
+	{GST_UP, GEV_PRESS, GST_DOWN, GACT_PRESS},
+	{GST_UP, GEV_TIMEOUT, GST_IDLE, GACT_CLICKS},
+	{GST_HELD, GEV_RELEASE, GST_IDLE, GACT_NONE},
+};
+
+/** Names of the gestures */
+static const char *const gesture_names[GESTURE_NUM] = {"none", "1x", "2x", "3x", "4x", "5x", "6x", "7x", "long"};
+
+/**
+ * @brief Start the recognizer in idle state
+ *
+ * @param sm recognizer
+ */
+static inline void gesture_init(gesture_sm_s *sm)
+{
+	sm->state = GST_IDLE;
+	sm->count = 0;
+	sm->press_ms = 0;
+	sm->release_ms = 0;
+	sm->edge_ms = 0;
+	sm->bounces = 0;
+	sm->dropped = 0;
+}
+
+/**
+ * @brief Get the time when the timeout of the current state expires
+ *
+ * @param sm recognizer
+ * @return uint32_t deadline in ms, only valid in GST_DOWN and GST_UP
+ */
+static inline uint32_t gesture_deadline(const gesture_sm_s *sm)
+{
+	if (sm->state == GST_DOWN)
+	{
+		return sm->press_ms + GESTURE_LONG_MS;
+	}
+	uint8_t idx = sm->count > GESTURE_MAX_CLICKS ? GESTURE_MAX_CLICKS - 1 : sm->count - 1;
+	uint32_t click_end = sm->press_ms + gesture_click_ms[idx];
+	uint32_t settle_end = sm->release_ms + GESTURE_SETTLE_MS;
+	return (int32_t)(click_end - settle_end) > 0 ? click_end : settle_end;
+}
+
+/**
+ * @brief Check if a gesture is in progress
+ *
+ * @param sm recognizer
+ * @return true button pressed or click sequence not finished
+ * @return false idle
+ */
+static inline bool gesture_pending(const gesture_sm_s *sm)
+{
+	return sm->state != GST_IDLE;
+}
+
+/**
+ * @brief Handle one event
+ *
+ * @param sm recognizer
+ * @param event gesture_event_num_t
+ * @param now time of the event in ms
+ * @return uint8_t recognized gesture_num_t, GESTURE_NONE if none
+ */
+static inline uint8_t gesture_event(gesture_sm_s *sm, uint8_t event, uint32_t now)
+{
+	for (uint8_t idx = 0; idx < sizeof(gesture_transitions) / sizeof(gesture_transition_s); idx++)
+	{
+		const gesture_transition_s *tr = &gesture_transitions[idx];
+		if ((tr->state != sm->state) || (tr->event != event))
+		{
+			continue;
+		}
+		uint8_t gesture = GESTURE_NONE;
+		switch (tr->action)
+		{
+		case GACT_PRESS:
+			if (sm->state == GST_IDLE)
+			{
+				sm->count = 0;
+			}
+			// Saturates one above the maximum, such a sequence is dropped
+			if (sm->count <= GESTURE_MAX_CLICKS)
+			{
+				sm->count++;
+			}
+			sm->press_ms = now;
+			break;
+		case GACT_RELEASE:
+			sm->release_ms = now;
+			break;
+		case GACT_CLICKS:
+			if (sm->count > GESTURE_MAX_CLICKS)
+			{
+				sm->dropped++;
+			}
+			else
+			{
+				gesture = GESTURE_CLICK_1 + sm->count - 1;
+			}
+			break;
+		case GACT_LONG:
+			gesture = GESTURE_LONG;
+			break;
+		}
+		sm->state = tr->next;
+		if (sm->state == GST_IDLE)
+		{
+			sm->count = 0;
+		}
+		return gesture;
+	}
+	return GESTURE_NONE;
+}
+
+/**
+ * @brief Handle a button edge, called from the interrupt with the level after the edge
+ *
+ * @param sm recognizer
+ * @param pressed true = button pressed, false = button released
+ * @param now time of the edge in ms
+ * @return uint8_t recognized gesture_num_t, GESTURE_NONE if none
+ */
+static inline uint8_t gesture_edge(gesture_sm_s *sm, bool pressed, uint32_t now)
+{
+	if ((now - sm->edge_ms) < GESTURE_DEBOUNCE_MS)
+	{
+		sm->bounces++;
+		return GESTURE_NONE;
+	}
+	sm->edge_ms = now;
+	return gesture_event(sm, pressed ? GEV_PRESS : GEV_RELEASE, now);
+}
+
+/**
+ * @brief Check only the timeout of the current state
+ *        Used for edges that were buffered, a gesture can end before the next buffered edge
+ *
+ * @param sm recognizer
+ * @param now time in ms
+ * @return uint8_t recognized gesture_num_t, GESTURE_NONE if none
+ */
+static inline uint8_t gesture_timeout(gesture_sm_s *sm, uint32_t now)
+{
+	if (((sm->state == GST_DOWN) || (sm->state == GST_UP)) && ((int32_t)(now - gesture_deadline(sm)) >= 0))
+	{
+		return gesture_event(sm, GEV_TIMEOUT, now);
+	}
+	return GESTURE_NONE;
+}
+
+/**
+ * @brief Check the timeout of the current state, called periodically
+ *        The level of the button catches edges that were dropped as bounces
+ *
+ * @param sm recognizer
+ * @param pressed current level, true = button pressed
+ * @param now current time in ms
+ * @return uint8_t recognized gesture_num_t, GESTURE_NONE if none
+ */
+static inline uint8_t gesture_poll(gesture_sm_s *sm, bool pressed, uint32_t now)
+{
+	// Level does not match the state, the last edge was taken as a bounce
+	if (((now - sm->edge_ms) >= GESTURE_DEBOUNCE_MS) &&
+		((pressed && (sm->state == GST_UP)) || (!pressed && ((sm->state == GST_DOWN) || (sm->state == GST_HELD)))))
+	{
+		sm->edge_ms = now;
+		gesture_event(sm, pressed ? GEV_PRESS : GEV_RELEASE, now);
+	}
+	return gesture_timeout(sm, now);
+}
+
+#endif // GESTURE_H
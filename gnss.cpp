@@ -42,6 +42,10 @@ uint8_t satellites = 0;
 volatile float g_last_lat = 0.0;
 /** Last longitude for global use */
 volatile float g_last_long = 0.0;
+/** Last latitude in 1/10000000 degree */
+volatile int32_t g_last_lat_raw = 0;
+/** Last longitude in 1/10000000 degree */
+volatile int32_t g_last_long_raw = 0;
 /** Last accuracy for global use */
 volatile float g_last_accuracy = 0.0;
 /** Last altitude for global use */
@@ -51,14 +55,221 @@ volatile uint8_t g_last_satellites = 0;
 
 /** Counter for GNSS readings */
 uint16_t check_gnss_counter = 0;
-/** Max number of GNSS readings before giving up */
-uint16_t check_gnss_max_try = 0;
+/** Time between two GNSS readings during the location acquisition */
+#define GNSS_POLL_MS 2500
 
 /** Max number of satellites seen */
 uint8_t max_sat = 0;
 /** Number of checks with unchanged number of satellites seen */
 uint8_t max_sat_unchanged = 0;
 
+/** Hash of the receiver configuration applied last, 0 = unknown */
+static uint32_t gnss_cfg_hash = 0;
+
+/** millis() when init_gnss() was first called */
+static uint32_t gnss_boot_time = 0;
+/** Time from first init_gnss() call until first poll_gnss() call */
+uint32_t gnss_boot_to_poll = 0;
+/** Duration of the last init_gnss() call */
+uint32_t gnss_init_duration = 0;
+/** Number of configuration messages sent to the receiver by the last init_gnss() */
+uint8_t gnss_cfg_writes = 0;
+
+/** GNSS constellations that are enabled when the module is active */
+static const uint8_t gnss_ids[] = {SFE_UBLOX_GNSS_ID_GPS, SFE_UBLOX_GNSS_ID_GALILEO, SFE_UBLOX_GNSS_ID_GLONASS,
+								   SFE_UBLOX_GNSS_ID_SBAS, SFE_UBLOX_GNSS_ID_BEIDOU, SFE_UBLOX_GNSS_ID_IMES,
+								   SFE_UBLOX_GNSS_ID_QZSS};
+
+/** Desired receiver configuration */
+struct gnss_cfg_s
+{
+	uint8_t gnss_mask;		// Bit n set = constellation with gnssId n enabled
+	uint8_t auto_pvt;		// 0 = off, 1 = on, 0xFF = leave as it is
+	uint16_t meas_rate;		// Measurement rate in ms
+};
+
+/** Payload buffer for UBX-CFG polls and writes */
+static uint8_t gnss_cfg_payload[MAX_PAYLOAD_SIZE];
+/** Custom UBX packet used for polls and writes */
+static ubxPacket gnss_cfg_packet = {0, 0, 0, 0, 0, gnss_cfg_payload, 0, 0, SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED, SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED};
+
+/**
+ * @brief FNV-1a hash over the desired configuration
+ *
+ * @param cfg configuration to hash
+ * @return uint32_t hash, never 0
+ */
+static uint32_t gnss_cfg_get_hash(gnss_cfg_s *cfg)
+{
+	uint8_t *data = (uint8_t *)cfg;
+	uint32_t hash = 2166136261UL;
+	for (uint8_t idx = 0; idx < sizeof(gnss_cfg_s); idx++)
+	{
+		hash ^= data[idx];
+		hash *= 16777619UL;
+	}
+	return hash == 0 ? 1 : hash;
+}
+
+/**
+ * @brief Poll a UBX-CFG message into gnss_cfg_packet
+ *
+ * @param id UBX-CFG message ID
+ * @param len length of the poll payload (already in gnss_cfg_payload)
+ * @return true poll answered
+ * @return false no answer
+ */
+static bool gnss_cfg_poll(uint8_t id, uint16_t len)
+{
+	gnss_cfg_packet.cls = UBX_CLASS_CFG;
+	gnss_cfg_packet.id = id;
+	gnss_cfg_packet.len = len;
+	gnss_cfg_packet.startingSpot = 0;
+	return my_gnss.sendCommand(&gnss_cfg_packet) == SFE_UBLOX_STATUS_DATA_RECEIVED;
+}
+
+/**
+ * @brief Send gnss_cfg_packet back to the receiver
+ *
+ * @return true receiver acknowledged
+ * @return false write failed
+ */
+static bool gnss_cfg_write(void)
+{
+	gnss_cfg_writes++;
+	return my_gnss.sendCommand(&gnss_cfg_packet) == SFE_UBLOX_STATUS_DATA_SENT;
+}
+
+/**
+ * @brief Bring the receiver configuration in line with the desired configuration
+ *        Reads the current settings back from the receiver and only writes what differs.
+ *        All constellations are changed with a single UBX-CFG-GNSS message.
+ *        Flash is only written if a setting was changed.
+ *        The hash is only stored if every read-back and write succeeded, otherwise the next init checks again.
+ *        With GNSS_CFG_FORCE all settings are written and saved on every init, to compare the init times.
+ *
+ * @param cfg desired configuration
+ */
+static void gnss_apply_config(gnss_cfg_s *cfg)
+{
+	uint32_t new_hash = gnss_cfg_get_hash(cfg);
+	if ((new_hash == gnss_cfg_hash) && !GNSS_CFG_FORCE)
+	{
+		MYLOG("GNSS", "Configuration unchanged, skip");
+		return;
+	}
+
+	bool changed = false;
+	bool verified = true;
+
+	// Constellations, read-modify-write of a single UBX-CFG-GNSS
+	if (gnss_cfg_poll(UBX_CFG_GNSS, 0))
+	{
+		bool gnss_changed = GNSS_CFG_FORCE;
+		uint8_t num_blocks = gnss_cfg_payload[3];
+		for (uint8_t block = 0; block < num_blocks; block++)
+		{
+			uint8_t *block_data = &gnss_cfg_payload[4 + (block * 8)];
+			if (block_data[0] > 7)
+			{
+				continue;
+			}
+			bool enable = (cfg->gnss_mask & (1 << block_data[0])) != 0;
+			if (((block_data[4] & 0x01) != 0) != enable)
+			{
+				block_data[4] = enable ? (block_data[4] | 0x01) : (block_data[4] & 0xFE);
+				gnss_changed = true;
+			}
+		}
+		if (gnss_changed)
+		{
+			MYLOG("GNSS", "Update constellations");
+			verified = gnss_cfg_write() && verified;
+			changed = true;
+		}
+	}
+	else
+	{
+		MYLOG("GNSS", "Read constellations failed");
+		verified = false;
+	}
+
+	// Measurement rate
+	if (GNSS_CFG_FORCE || (my_gnss.getMeasurementRate() != cfg->meas_rate))
+	{
+		MYLOG("GNSS", "Update measurement rate");
+		gnss_cfg_writes++;
+		verified = my_gnss.setMeasurementRate(cfg->meas_rate) && verified;
+		changed = true;
+	}
+
+	// NAV-PVT output rate on I2C
+	if (cfg->auto_pvt != 0xFF)
+	{
+		gnss_cfg_payload[0] = UBX_CLASS_NAV;
+		gnss_cfg_payload[1] = UBX_NAV_PVT;
+		bool has_auto_pvt = false;
+		bool pvt_known = gnss_cfg_poll(UBX_CFG_MSG, 2);
+		if (pvt_known)
+		{
+			has_auto_pvt = gnss_cfg_payload[2 + COM_PORT_I2C] != 0;
+		}
+		if (GNSS_CFG_FORCE || !pvt_known || (has_auto_pvt != (cfg->auto_pvt == 1)))
+		{
+			MYLOG("GNSS", "Update auto PVT");
+			gnss_cfg_writes++;
+			// Tell the GNSS to "send" each solution and the lib not to update stale data implicitly
+			verified = my_gnss.setAutoPVT(cfg->auto_pvt == 1, false) && verified;
+			changed = true;
+		}
+		else
+		{
+			// Receiver has it already, only tell the library
+			my_gnss.assumeAutoPVT(cfg->auto_pvt == 1, false);
+		}
+	}
+
+	if (changed)
+	{
+		gnss_cfg_writes++;
+		// Save the current settings to flash and BBR
+		verified = my_gnss.saveConfiguration() && verified;
+	}
+	else
+	{
+		MYLOG("GNSS", "Receiver has the configuration already");
+	}
+
+	if (verified)
+	{
+		gnss_cfg_hash = new_hash;
+	}
+	else
+	{
+		MYLOG("GNSS", "Configuration not verified, check again on next init");
+		gnss_cfg_hash = 0;
+	}
+}
+
+/**
+ * @brief Wait until the receiver answers on I2C after power up
+ *
+ * @param timeout max wait time in ms
+ */
+static void gnss_wait_ready(uint32_t timeout)
+{
+	uint32_t start = millis();
+	while ((millis() - start) < timeout)
+	{
+		Wire.beginTransmission(0x42);
+		if (Wire.endTransmission() == 0)
+		{
+			return;
+		}
+		delay(10);
+	}
+}
+
 /**
  * @brief Initialize GNSS module
  *
@@ -68,11 +279,43 @@ uint8_t max_sat_unchanged = 0;
  */
 bool init_gnss(bool active)
 {
+	uint32_t init_start = millis();
+	if (gnss_boot_time == 0)
+	{
+		gnss_boot_time = init_start;
+	}
+	gnss_cfg_writes = 0;
+
 	// Power on the GNSS module
-	digitalWrite(WB_IO2, HIGH);
+	rail_power(true);
 
 	// Give the module some time to power up
-	delay(500);
+	if (GNSS_CFG_FORCE)
+	{
+		delay(500);
+	}
+	else
+	{
+		gnss_wait_ready(500);
+	}
+
+	// Configuration we want to have in the receiver
+	gnss_cfg_s gnss_cfg;
+	gnss_cfg.gnss_mask = 0;
+	for (uint8_t idx = 0; idx < sizeof(gnss_ids); idx++)
+	{
+		gnss_cfg.gnss_mask |= (1 << gnss_ids[idx]);
+	}
+	if (g_custom_parameters.location_on)
+	{
+		gnss_cfg.meas_rate = 200; // Produce five solutions per second
+		gnss_cfg.auto_pvt = 1;
+	}
+	else
+	{
+		gnss_cfg.meas_rate = 500;
+		gnss_cfg.auto_pvt = 0xFF;
+	}
 
 	if (g_gnss_option == NO_GNSS_INIT)
 	{
@@ -88,25 +331,7 @@ bool init_gnss(bool active)
 
 		if (active)
 		{
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_GPS);
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_GALILEO);
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_GLONASS);
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_SBAS);
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_BEIDOU);
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_IMES);
-			my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_QZSS);
-
-			if (g_custom_parameters.location_on)
-			{
-				my_gnss.setNavigationFrequency(5); // Produce two solutions per second
-				my_gnss.setAutoPVT(true, false);   // Tell the GNSS to "send" each solution and the lib not to update stale data implicitly
-			}
-			else
-			{
-				my_gnss.setMeasurementRate(500);
-			}
-
-			my_gnss.saveConfiguration(); // Save the current settings to flash and BBR
+			gnss_apply_config(&gnss_cfg);
 		}
 		else
 		{
@@ -119,13 +344,13 @@ bool init_gnss(bool active)
 		{
 			if (!g_custom_parameters.location_on)
 			{
-				digitalWrite(WB_IO2, LOW);
+				rail_power(false);
 			}
 		}
 		else
 		{
 			// Power down module
-			digitalWrite(WB_IO2, LOW);
+			rail_power(false);
 		}
 	}
 	else
@@ -139,26 +364,11 @@ bool init_gnss(bool active)
 
 		my_gnss.setI2COutput(COM_TYPE_UBX); // Set the I2C port to output UBX only (turn off NMEA noise)
 
-		my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_GPS);
-		my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_GALILEO);
-		my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_GLONASS);
-		my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_SBAS);
-		my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_BEIDOU);
-		my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_IMES);
-		my_gnss.enableGNSS(true, SFE_UBLOX_GNSS_ID_QZSS);
-
-		if (g_custom_parameters.location_on)
-		{
-			my_gnss.setNavigationFrequency(5); // Produce two solutions per second
-			my_gnss.setAutoPVT(true, false);   // Tell the GNSS to "send" each solution and the lib not to update stale data implicitly
-		}
-		else
-		{
-			my_gnss.setMeasurementRate(500);
-		}
-		my_gnss.saveConfiguration(); // Save the current settings to flash and BBR
+		gnss_apply_config(&gnss_cfg);
 	}
 
+	gnss_init_duration = millis() - init_start;
+	MYLOG("GNSS", "Init took %ld ms with %d config messages", gnss_init_duration, gnss_cfg_writes);
 	return true;
 }
 
@@ -170,6 +380,12 @@ bool init_gnss(bool active)
  */
 bool poll_gnss(void)
 {
+	if ((gnss_boot_to_poll == 0) && (gnss_boot_time != 0))
+	{
+		gnss_boot_to_poll = millis() - gnss_boot_time;
+		MYLOG("GNSS", "Boot to first poll %ld ms", gnss_boot_to_poll);
+	}
+
 	has_gnss_location = false;
 
 	latitude = 0;
@@ -284,17 +500,12 @@ bool poll_gnss(void)
 			return false;
 		}
 
-		if (g_custom_parameters.test_mode == MODE_FIELDTESTER_V2)
-		{
-			g_solution_data.addGNSS_T2(latitude, longitude, (int16_t)packet_num);
-		}
-		else
-		{
-			g_solution_data.addGNSS_T(latitude, longitude, altitude / 1000, accuracy, satellites);
-		}
+		tx_buffer_add_gnss(g_tx_payload, latitude, longitude, altitude / 1000, accuracy, satellites);
 
 		g_last_lat = latitude / 10000000.0;
 		g_last_long = longitude / 10000000.0;
+		g_last_lat_raw = latitude;
+		g_last_long_raw = longitude;
 		g_last_accuracy = accuracy;
 		g_last_altitude = altitude / 1000;
 		g_last_satellites = satellites;
@@ -313,19 +524,14 @@ bool poll_gnss(void)
 		accuracy = 1;
 		satellites = 5;
 
-		if (g_custom_parameters.test_mode == MODE_FIELDTESTER_V2)
-		{
-			g_solution_data.addGNSS_T2(latitude, longitude, (int16_t)packet_num);
-		}
-		else
-		{
-			g_solution_data.addGNSS_T(latitude, longitude, altitude, accuracy, satellites);
-		}
+		tx_buffer_add_gnss(g_tx_payload, latitude, longitude, altitude / 1000, accuracy, satellites);
 
 		has_gnss_location = true;
 
 		g_last_lat = latitude / 10000000.0;
 		g_last_long = longitude / 10000000.0;
+		g_last_lat_raw = latitude;
+		g_last_long_raw = longitude;
 		g_last_accuracy = accuracy;
 		g_last_altitude = altitude / 1000;
 		g_last_satellites = satellites;
@@ -334,6 +540,8 @@ bool poll_gnss(void)
 #else
 		g_last_lat = 0;
 		g_last_long = 0;
+		g_last_lat_raw = 0;
+		g_last_long_raw = 0;
 		g_last_accuracy = 1;
 		g_last_altitude = 0;
 		g_last_satellites = 0;
@@ -345,26 +553,114 @@ bool poll_gnss(void)
 	return false;
 }
 
+/**
+ * @brief Start the location acquisition of a FieldTester test cycle
+ *        Called by the test cycle, the acquisition ends with a location or with the timeout of the test cycle
+ *
+ * @return uint32_t max acquisition time in ms, 1/2 of the send interval
+ */
+uint32_t gnss_start_acquisition(void)
+{
+	// Set flag for GNSS active to avoid retrigger
+	gnss_active = true;
+	energy_update_gnss();
+	tx_payload_reset();
+	check_gnss_counter = 0;
+	// Reset satellites check values
+	max_sat = 0;
+	max_sat_unchanged = 0;
+	// Start the timer
+	lat_timer_start(RAK_TIMER_3, GNSS_POLL_MS, NULL);
+	// Max location aquisition time is half of send frequency, at least one reading
+	uint32_t max_time = get_send_period() / 2;
+	return max_time < GNSS_POLL_MS ? GNSS_POLL_MS : max_time;
+}
+
+/**
+ * @brief End the location acquisition without location
+ *        Called by the test cycle when the acquisition time is over, FieldTester does not send data
+ *
+ */
+void gnss_stop_acquisition(void)
+{
+	// Keep GNSS active until we get a valid location!
+	api.system.timer.stop(RAK_TIMER_3);
+	gnss_active = false;
+	energy_update_gnss();
+	tx_active = false;
+
+	MYLOG("GNSS", "Location timeout");
+	if (has_oled && !g_settings_ui)
+	{
+		sprintf(line_str, "No valid location found");
+		oled_add_line(line_str);
+	}
+}
+
+/**
+ * @brief Send the FieldTester packet with the location found
+ *        Called by the test cycle after the location was found, tx_active is false if nothing was sent
+ *
+ */
+void gnss_send_fix(void)
+{
+	// Get gateway time
+	if (sync_time_status == 0)
+	{
+		MYLOG("APP", "Request time");
+		api.lorawan.timereq.set(1);
+	}
+	// Check if packet size fits DR
+	if (!tx_buffer_check_dr(g_tx_payload))
+	{
+		tx_active = false;
+		return;
+	}
+	// Always send confirmed packet to make sure a reply is received
+	MYLOG("GNSS", "Send from GNSS gnss_send_fix fPort %d", fPort);
+	if (!tx_send(g_tx_payload, fPort))
+	{
+		tx_active = false;
+		MYLOG("GNSS", "LoRaWAN send returned error");
+	}
+	else
+	{
+		tx_active = true;
+	}
+	// Increase sent packet number
+	packet_num++;
+}
+
 /**
  * @brief GNSS location aqcuisition
- * Called every 2.5 seconds by timer 1
- * Gives up after 1/2 of send frequency
- * or when location was aquired
+ * Called every 2.5 seconds by timer 3
+ * Reports the location to the test cycle, the test cycle ends the acquisition after 1/2 of send frequency
  *
  */
 void gnss_handler(void *)
 {
+	// The test cycle ended or changed the test mode
+	if (cycle_get_state() != CYCLE_ACQUIRE)
+	{
+		api.system.timer.stop(RAK_TIMER_3);
+		gnss_active = false;
+		energy_update_gnss();
+		return;
+	}
 	digitalWrite(LED_GREEN, HIGH);
 	bool finished_poll = false;
-	if (poll_gnss())
+	bool has_location = poll_gnss();
+	trace_add(TEV_GNSS_POLL, has_location, satellites);
+	if (has_location)
 	{
 		// Keep GNSS active if forced in setup ==> Leads to faster battery drainage!
 		if (!g_custom_parameters.location_on)
 		{
 			// Power down the module
-			digitalWrite(WB_IO2, LOW);
+			rail_power(false);
 		}
 		gnss_active = false;
+		energy_update_gnss();
 		delay(100);
 		MYLOG("GNSS", "Got location");
 		api.system.timer.stop(RAK_TIMER_3);
@@ -378,54 +674,8 @@ void gnss_handler(void *)
 			oled_add_line(line_str);
 		}
 		finished_poll = true;
-		// Get gateway time
-		if (sync_time_status == 0)
-		{
-			MYLOG("APP", "Request time");
-			api.lorawan.timereq.set(1);
-		}
-		// Check if packet size fits DR
-		if (check_dr(g_solution_data.getSize()))
-		{
-			// Always send confirmed packet to make sure a reply is received
-			MYLOG("GNSS", "Send from GNSS gnss_handler fPort %d", fPort);
-			// Serial.println("+EVT:>>>>>>>>");
-			if (!api.lorawan.send(g_solution_data.getSize(), g_solution_data.getBuffer(), fPort, true, 0))
-			{
-				tx_active = false;
-				MYLOG("GNSS", "LoRaWAN send returned error");
-			}
-			else
-			{
-				tx_active = true;
-			}
-			// Increase sent packet number
-			packet_num++;
-		}
-		else
-		{
-			tx_active = false;
-		}
-	}
-	else
-	{
-		if (check_gnss_counter >= check_gnss_max_try)
-		{
-			// Keep GNSS active until we get a valid location!
-			delay(100);
-			gnss_active = false;
-			tx_active = false;
-
-			MYLOG("GNSS", "Location timeout");
-			api.system.timer.stop(RAK_TIMER_3);
-			// If no location found, FieldTester does not send data
-			if (has_oled && !g_settings_ui)
-			{
-				sprintf(line_str, "No valid location found");
-				oled_add_line(line_str);
-			}
-			finished_poll = true;
-		}
+		// The test cycle sends the packet
+		cycle_event(CEV_FIX);
 	}
 	if (has_oled && !finished_poll && !g_settings_ui)
 	{
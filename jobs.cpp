@@ -0,0 +1,190 @@
+/**
+ * @file jobs.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Cooperative resumable jobs
+ *        Long operations are split into short steps, the job runner task of the task manager
+ *        runs one step per job and returns to the main loop in between.
+ *        Each job reports its progress and the longest time one step blocked the main loop.
+ * @version 0.1
+ * @date 2025-01-11
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "app.h"
+
+/** List of all jobs that were started once */
+static job_s *job_list = NULL;
+
+/** Static task node of the job runner */
+static MillisTaskManager::Task_t job_runner_task;
+
+/**
+ * @brief Job runner, task of the task manager
+ *        Runs one step of each job that is due, then sets the task interval to the next wake up time
+ *
+ */
+static void job_runner(void)
+{
+	uint32_t wait = LP_MAX_SLEEP_MS;
+	for (job_s *job = job_list; job != NULL; job = job->next)
+	{
+		if (!job->active)
+		{
+			continue;
+		}
+		if ((int32_t)(job->wake - millis()) > 0)
+		{
+			uint32_t left = job->wake - millis();
+			if (left < wait)
+			{
+				wait = left;
+			}
+			continue;
+		}
+
+		// Run the next step right away unless the step sleeps
+		job->wake = millis();
+		uint32_t start = micros();
+		bool finished = job->step(job);
+		uint32_t block_us = micros() - start;
+		job->steps++;
+		if (block_us > job->max_block_us)
+		{
+			job->max_block_us = block_us;
+		}
+		if (finished)
+		{
+			job->active = false;
+			job->duration = millis() - job->started;
+			MYLOG("JOB", "%s finished after %ld ms, %ld steps, max block %ld us", job->name, job->duration, job->steps, job->max_block_us);
+			continue;
+		}
+		uint32_t left = (int32_t)(job->wake - millis()) > 0 ? job->wake - millis() : 0;
+		if (left < wait)
+		{
+			wait = left;
+		}
+	}
+
+	if (!job_busy())
+	{
+		mtmMain.SetState(job_runner, false);
+		return;
+	}
+	mtmMain.SetIntervalTime(job_runner, wait);
+}
+
+/**
+ * @brief Start a job, a running job starts again from the first step
+ *        The job is added to the job list on the first start
+ *
+ * @param job job with name and step function
+ * @return true job started
+ * @return false job runner could not be scheduled
+ */
+bool job_start(job_s *job)
+{
+	bool listed = false;
+	for (job_s *now = job_list; now != NULL; now = now->next)
+	{
+		if (now == job)
+		{
+			listed = true;
+			break;
+		}
+	}
+	if (!listed)
+	{
+		job->next = job_list;
+		job_list = job;
+	}
+
+	job->state = 0;
+	job->progress = 0;
+	job->total = 0;
+	job->steps = 0;
+	job->max_block_us = 0;
+	job->duration = 0;
+	job->failed = false;
+	job->started = millis();
+	job->wake = job->started;
+	job->active = true;
+
+	// First step in the next loop
+	if (mtmMain.Register(&job_runner_task, job_runner, 0) == NULL)
+	{
+		job->active = false;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Let the job sleep before the next step, called from the step function
+ *
+ * @param job job
+ * @param ms time until the next step in ms
+ */
+void job_sleep(job_s *job, uint32_t ms)
+{
+	job->wake = millis() + ms;
+}
+
+/**
+ * @brief Run the next step of a sleeping job right away, e.g. when the event it waits for happened
+ *
+ * @param job job
+ */
+void job_wake(job_s *job)
+{
+	if (!job->active)
+	{
+		return;
+	}
+	job->wake = millis();
+	mtmMain.Register(&job_runner_task, job_runner, 0);
+}
+
+/**
+ * @brief Check if any job is running
+ *
+ * @return true at least one job is running
+ * @return false no job is running
+ */
+bool job_busy(void)
+{
+	for (job_s *job = job_list; job != NULL; job = job->next)
+	{
+		if (job->active)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Format the status of one job
+ *        Format <name>:<running|idle|failed>:<progress>:<total>:<steps>:<max block us>:<run time ms>
+ *
+ * @param idx line index
+ * @param line output buffer
+ * @param size size of the output buffer
+ * @return int length of the line, -1 after the last job
+ */
+int job_format(uint8_t idx, char *line, size_t size)
+{
+	job_s *job = job_list;
+	for (uint8_t num = 0; (job != NULL) && (num < idx); num++)
+	{
+		job = job->next;
+	}
+	if (job == NULL)
+	{
+		return -1;
+	}
+	return snprintf(line, size, "%s:%s:%ld:%ld:%ld:%ld:%ld", job->name, job->active ? "running" : (job->failed ? "failed" : "idle"),
+					job->progress, job->total, job->steps, job->max_block_us,
+					job->active ? millis() - job->started : job->duration);
+}
@@ -0,0 +1,181 @@
+/**
+ * @file latency.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Run time and latency histograms of the RAK timer callbacks and the task manager tasks
+ *        The timer callbacks are called through a wrapper that measures the run time
+ *        and the delay against the time the timer was started for
+ * @version 0.1
+ * @date 2025-01-07
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "app.h"
+
+/** Timer state and histograms */
+struct lat_timer_s
+{
+	RAK_TIMER_HANDLER handler;
+	RAK_TIMER_MODE mode;
+	bool armed;
+	uint32_t due;
+	uint32_t period;
+	uint16_t cost_hist[MTM_HIST_BUCKETS]; // Run time in us
+	uint16_t late_hist[MTM_HIST_BUCKETS]; // Delay in ms
+};
+
+/** Timers, index is the timer ID */
+static lat_timer_s lat_timers[LAT_NUM_TIMERS];
+
+/** Names of the timer callbacks, index is the timer ID */
+static const char *lat_timer_names[LAT_NUM_TIMERS] = {"send_packet", "handle_display", "oled_saver", "gnss_handler"};
+
+/**
+ * @brief Timer callback wrapper
+ *
+ * @tparam ID timer ID, each timer needs its own function
+ * @param data timer data
+ */
+template <int ID>
+static void lat_timer_cb(void *data)
+{
+	lat_timer_s *timer = &lat_timers[ID];
+	uint32_t now = millis();
+	if (timer->armed)
+	{
+		int32_t late = (int32_t)(now - timer->due);
+		MillisTaskManager::HistAdd(timer->late_hist, late > 0 ? late : 0);
+		if (timer->mode == RAK_TIMER_PERIODIC)
+		{
+			// Periodic timers reload from the expiry
+			timer->due += timer->period;
+			if ((int32_t)(now - timer->due) > 0)
+			{
+				timer->due = now + timer->period;
+			}
+		}
+		else
+		{
+			timer->armed = false;
+		}
+	}
+
+	uint32_t start = micros();
+	timer->handler(data);
+	MillisTaskManager::HistAdd(timer->cost_hist, micros() - start);
+}
+
+/** Callback wrappers, index is the timer ID */
+static const RAK_TIMER_HANDLER lat_timer_cbs[LAT_NUM_TIMERS] = {lat_timer_cb<0>, lat_timer_cb<1>, lat_timer_cb<2>, lat_timer_cb<3>};
+
+/**
+ * @brief Create a timer with run time and latency measurement
+ *
+ * @param id timer ID
+ * @param handler timer callback
+ * @param mode RAK_TIMER_ONESHOT or RAK_TIMER_PERIODIC
+ * @return true timer created
+ * @return false timer could not be created
+ */
+bool lat_timer_create(RAK_TIMER_ID id, RAK_TIMER_HANDLER handler, RAK_TIMER_MODE mode)
+{
+	if (id >= LAT_NUM_TIMERS)
+	{
+		return api.system.timer.create(id, handler, mode);
+	}
+	lat_timers[id].handler = handler;
+	lat_timers[id].mode = mode;
+	lat_timers[id].armed = false;
+	return api.system.timer.create(id, lat_timer_cbs[id], mode);
+}
+
+/**
+ * @brief Start a timer and remember when it is due
+ *
+ * @param id timer ID
+ * @param ms timer period in ms
+ * @param data data for the timer callback
+ * @return true timer started
+ * @return false timer could not be started
+ */
+bool lat_timer_start(RAK_TIMER_ID id, uint32_t ms, void *data)
+{
+	if (id < LAT_NUM_TIMERS)
+	{
+		lat_timers[id].due = millis() + ms;
+		lat_timers[id].period = ms;
+		lat_timers[id].armed = true;
+	}
+	return api.system.timer.start(id, ms, data);
+}
+
+/**
+ * @brief Format a histogram as comma separated list
+ *
+ * @param hist histogram with MTM_HIST_BUCKETS counters
+ * @param line output buffer
+ * @param size size of the output buffer
+ * @param len length of the text already in the buffer
+ * @return int length of the text in the buffer
+ */
+static int lat_format_hist(uint16_t *hist, char *line, size_t size, int len)
+{
+	for (uint8_t idx = 0; (idx < MTM_HIST_BUCKETS) && (len < (int)size); idx++)
+	{
+		len += snprintf(&line[len], size - len, idx == 0 ? "%d" : ",%d", hist[idx]);
+	}
+	return len;
+}
+
+/**
+ * @brief Format one histogram of the timer callbacks or the task manager tasks
+ *        Format <name>:<run|late>:<bucket counts>
+ *        Bucket n counts values from 2^(n-1) to 2^n - 1, run time in us, delay in ms
+ *        Even lines are the run time, odd lines the delay, timers first, then the tasks
+ *
+ * @param idx histogram line
+ * @param line output buffer
+ * @param size size of the output buffer
+ * @return int length of the line, 0 if the timer is not used, -1 after the last line
+ */
+int lat_format(uint8_t idx, char *line, size_t size)
+{
+	bool late = (idx % 2) != 0;
+	uint8_t entry = idx / 2;
+	if (entry < LAT_NUM_TIMERS)
+	{
+		lat_timer_s *timer = &lat_timers[entry];
+		if (timer->handler == NULL)
+		{
+			return 0;
+		}
+		int len = snprintf(line, size, "%s:%s:", lat_timer_names[entry], late ? "late" : "run");
+		return lat_format_hist(late ? timer->late_hist : timer->cost_hist, line, size, len);
+	}
+
+	MillisTaskManager::Task_t *task = mtmMain.GetNext(NULL);
+	for (entry -= LAT_NUM_TIMERS; (entry != 0) && (task != NULL); entry--)
+	{
+		task = mtmMain.GetNext(task);
+	}
+	if (task == NULL)
+	{
+		return -1;
+	}
+	int len = snprintf(line, size, "task%d:%s:", task->ID, late ? "late" : "run");
+	return lat_format_hist(late ? task->ErrorHist : task->CostHist, line, size, len);
+}
+
+/**
+ * @brief Clear all histograms
+ *
+ */
+void lat_reset(void)
+{
+	for (uint8_t idx = 0; idx < LAT_NUM_TIMERS; idx++)
+	{
+		memset(lat_timers[idx].cost_hist, 0, sizeof(lat_timers[idx].cost_hist));
+		memset(lat_timers[idx].late_hist, 0, sizeof(lat_timers[idx].late_hist));
+	}
+	mtmMain.ResetHistograms();
+}
@@ -0,0 +1,118 @@
+/**
+ * @file log_format.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Log file entry and the CSV line format of the SD card log
+ *        No Arduino dependencies, the host benchmarks format the same lines.
+ * @version 0.1
+ * @date 2025-01-20
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef LOG_FORMAT_H
+#define LOG_FORMAT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "settings.h"
+
+/** Log file info structure */
+struct result_s
+{
+	uint16_t year = 24;
+	uint8_t month = 9;
+	uint8_t day = 27;
+	uint8_t hour = 12;
+	uint8_t min = 0;
+	uint8_t sec = 0;
+	uint8_t mode = 0;
+	uint8_t gw = 0;
+	float lat = 14.421536;
+	float lng = 121.006819;
+	int8_t min_rssi = 0;
+	int8_t max_rssi = 0;
+	int8_t max_snr = 0;
+	int8_t rx_rssi = 0;
+	int8_t rx_snr = 0;
+	int16_t min_dst = 0;
+	int16_t max_dst = 0;
+	int16_t demod = 0;
+	int16_t lost = 0;
+	int8_t tx_dr = 0;
+};
+
+/**
+ * @brief Format a log file entry as CSV line, the columns depend on the test mode
+ *
+ * @param line output buffer
+ * @param size size of the output buffer
+ * @param res log file entry
+ * @param test_mode test mode, see test_mode_num_t
+ * @param location_on true if the location is logged in LinkCheck and P2P mode
+ * @return int length of the line as returned by snprintf
+ */
+static inline int log_format_entry(char *line, size_t size, const volatile result_s &res, uint8_t test_mode, bool location_on)
+{
+	if (test_mode == MODE_LINKCHECK)
+	{
+		if (location_on)
+		{
+			// "time";"Mode";"Gw";"Lat";"Lng";"RX RSSI";"RX SNR";"Demod";"TX DR";"Lost"
+			return snprintf(line, size, "%04d-%02d-%02d %02d:%02d:%02d;%d;%d;%.6f;%.6f;%d;%d;%d;%d;%d",
+							res.year, res.month, res.day, res.hour, res.min, res.sec,
+							res.mode, res.gw,
+							res.lat, res.lng,
+							res.rx_rssi,
+							res.rx_snr,
+							res.demod, res.tx_dr, res.lost);
+		}
+		// "time";"Mode";"Gw";"RX RSSI";"RX SNR";"Demod";"TX DR";"Lost"
+		return snprintf(line, size, "%04d-%02d-%02d %02d:%02d:%02d;%d;%d;%d;%d;%d;%d;%d",
+						res.year, res.month, res.day, res.hour, res.min, res.sec,
+						res.mode, res.gw,
+						res.rx_rssi,
+						res.rx_snr,
+						res.demod, res.tx_dr, res.lost);
+	}
+	if (test_mode == MODE_FIELDTESTER)
+	{
+		// "time";"Mode";"Gw";"Lat";"Lng";"min RSSI";"max RSSI";"RX RSSI";"RX SNR";"min Dist";"max Dist";"TX DR";"Lost"
+		return snprintf(line, size, "%04d-%02d-%02d %02d:%02d:%02d;%d;%d;%.6f;%.6f;%d;%d;%d;%d;%d;%d;%d;%d",
+						res.year, res.month, res.day, res.hour, res.min, res.sec,
+						res.mode, res.gw,
+						res.lat, res.lng,
+						res.min_rssi, res.max_rssi, res.rx_rssi,
+						res.rx_snr,
+						res.min_dst, res.max_dst, res.tx_dr, res.lost);
+	}
+	if (test_mode == MODE_FIELDTESTER_V2)
+	{
+		// "time";"Mode";"Gw";"Lat";"Lng";"max RSSI";"max SNR";"RX RSSI";"RX SNR";"min Dist";"max Dist";"TX DR";"PLR"
+		return snprintf(line, size, "%04d-%02d-%02d %02d:%02d:%02d;%d;%d;%.6f;%.6f;%d;%d;%d;%d;%d;%d;%d;%.1f",
+						res.year, res.month, res.day, res.hour, res.min, res.sec,
+						res.mode, res.gw,
+						res.lat, res.lng,
+						res.max_rssi, res.max_snr, res.rx_rssi,
+						res.rx_snr,
+						res.min_dst, res.max_dst, res.tx_dr, (float)res.lost / 10.0f);
+	}
+	// LoRa P2P
+	if (location_on)
+	{
+		// "time";"Mode";"Lat";"Lng";"RX RSSI";"RX SNR"
+		return snprintf(line, size, "%04d-%02d-%02d %02d:%02d:%02d;%d;%.6f;%.6f;%d;%d",
+						res.year, res.month, res.day, res.hour, res.min, res.sec,
+						res.mode,
+						res.lat, res.lng,
+						res.rx_rssi,
+						res.rx_snr);
+	}
+	// "time";"Mode";"RX RSSI";"RX SNR"
+	return snprintf(line, size, "%04d-%02d-%02d %02d:%02d:%02d;%d;%d;%d",
+					res.year, res.month, res.day, res.hour, res.min, res.sec,
+					res.mode,
+					res.rx_rssi,
+					res.rx_snr);
+}
+
+#endif // LOG_FORMAT_H
@@ -0,0 +1,431 @@
+/**
+ * @file lorawan_regions.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief LoRaWAN regional parameters (RP002-1.0.x) for all regions supported by RUI3
+ *        Table index is the RUI3 band number (AT+BAND)
+ *        No Arduino dependencies, all lookups are constexpr and can be used in host tools.
+ * @version 0.1
+ * @date 2024-12-30
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef LORAWAN_REGIONS_H
+#define LORAWAN_REGIONS_H
+
+#include <stdint.h>
+
+/** RUI3 band numbers */
+typedef enum lpw_region_num
+{
+	LPW_EU433 = 0,
+	LPW_CN470 = 1,
+	LPW_RU864 = 2,
+	LPW_IN865 = 3,
+	LPW_EU868 = 4,
+	LPW_US915 = 5,
+	LPW_AU915 = 6,
+	LPW_KR920 = 7,
+	LPW_AS923_1 = 8,
+	LPW_AS923_2 = 9,
+	LPW_AS923_3 = 10,
+	LPW_AS923_4 = 11,
+	LPW_LA915 = 12,
+	LPW_NUM_REGIONS = 13
+} lpw_region_num_t;
+
+/** Number of datarates per region */
+#define LPW_NUM_DR 16
+/** Returned if no datarate can carry the payload */
+#define LPW_DR_NONE 16
+/** Spreading factor value used for FSK datarates */
+#define LPW_SF_FSK 0xFF
+/** Max application payload that is repeater compatible */
+#define LPW_REPEATER_MAX_PAYLOAD 222
+/** Number of default channels in the table */
+#define LPW_NUM_DEF_CHANNELS 3
+
+/** Parameters of one datarate, sf = 0 means not available (RFU or not supported by RUI3) */
+struct lpw_dr_s
+{
+	uint8_t sf;				   // Spreading factor or LPW_SF_FSK
+	uint16_t bw;			   // Bandwidth in kHz (0 for FSK)
+	uint8_t max_payload;	   // Max application payload (N) without dwell time limit
+	uint8_t max_payload_dwell; // Max application payload (N) with 400 ms dwell time limit
+};
+
+/** Parameters of one region */
+struct lpw_region_s
+{
+	lpw_dr_s dr[LPW_NUM_DR];					 // Datarates, uplink and downlink
+	uint8_t min_ul_dr;							 // Lowest uplink datarate
+	uint8_t max_ul_dr;							 // Highest uplink datarate
+	uint8_t max_eirp;							 // Max EIRP in dBm (TX power 0)
+	uint8_t tx_power_steps;						 // Number of TX power settings, each step is 2 dB lower
+	bool dwell_default;							 // Uplink dwell time limit active after join
+	uint32_t channels[LPW_NUM_DEF_CHANNELS];	 // Default channels in Hz (0 = unused)
+};
+
+/** Datarates of EU868, EU433 and RU864 */
+#define LPW_DR_EU                                                                                    \
+	{                                                                                                \
+		{12, 125, 51, 51}, {11, 125, 51, 51}, {10, 125, 51, 51}, {9, 125, 115, 115},                 \
+			{8, 125, 242, 242}, {7, 125, 242, 242}, {7, 250, 242, 242}, {LPW_SF_FSK, 0, 242, 242},   \
+			{0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0},                                  \
+			{0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0},                                  \
+	}
+
+/** Datarates of IN865 (DR6 is RFU) */
+#define LPW_DR_IN                                                                                  \
+	{                                                                                              \
+		{12, 125, 51, 51}, {11, 125, 51, 51}, {10, 125, 51, 51}, {9, 125, 115, 115},               \
+			{8, 125, 242, 242}, {7, 125, 242, 242}, {0, 0, 0, 0}, {LPW_SF_FSK, 0, 242, 242},       \
+			{0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0},                                \
+			{0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0},                                \
+	}
+
+/** Datarates of CN470 and KR920 */
+#define LPW_DR_CN_KR                                                                  \
+	{                                                                                 \
+		{12, 125, 51, 51}, {11, 125, 51, 51}, {10, 125, 51, 51}, {9, 125, 115, 115},  \
+			{8, 125, 242, 242}, {7, 125, 242, 242}, {0, 0, 0, 0}, {0, 0, 0, 0},       \
+			{0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0},                   \
+			{0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0},                   \
+	}
+
+/** Datarates of US915 (DR8 to DR13 are downlink only) */
+#define LPW_DR_US                                                                         \
+	{                                                                                     \
+		{10, 125, 11, 11}, {9, 125, 53, 53}, {8, 125, 125, 125}, {7, 125, 242, 242},      \
+			{8, 500, 242, 242}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0},                 \
+			{12, 500, 53, 53}, {11, 500, 129, 129}, {10, 500, 242, 242}, {9, 500, 242, 242}, \
+			{8, 500, 242, 242}, {7, 500, 242, 242}, {0, 0, 0, 0}, {0, 0, 0, 0},           \
+	}
+
+/** Datarates of AU915 and LA915 (DR8 to DR13 are downlink only) */
+#define LPW_DR_AU                                                                         \
+	{                                                                                     \
+		{12, 125, 51, 0}, {11, 125, 51, 0}, {10, 125, 51, 11}, {9, 125, 115, 53},         \
+			{8, 125, 242, 125}, {7, 125, 242, 242}, {8, 500, 242, 242}, {0, 0, 0, 0},     \
+			{12, 500, 53, 53}, {11, 500, 129, 129}, {10, 500, 242, 242}, {9, 500, 242, 242}, \
+			{8, 500, 242, 242}, {7, 500, 242, 242}, {0, 0, 0, 0}, {0, 0, 0, 0},           \
+	}
+
+/** Datarates of AS923-1 to AS923-4 */
+#define LPW_DR_AS                                                                            \
+	{                                                                                        \
+		{12, 125, 51, 0}, {11, 125, 51, 0}, {10, 125, 51, 11}, {9, 125, 115, 53},            \
+			{8, 125, 242, 125}, {7, 125, 242, 242}, {7, 250, 242, 242}, {LPW_SF_FSK, 0, 242, 242}, \
+			{0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0},                              \
+			{0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0},                              \
+	}
+
+/** Regional parameters, indexed by RUI3 band number */
+static constexpr lpw_region_s lpw_regions[LPW_NUM_REGIONS] = {
+	{LPW_DR_EU, 0, 7, 12, 6, false, {433175000UL, 433375000UL, 433575000UL}},	 // EU433
+	{LPW_DR_CN_KR, 0, 5, 19, 8, false, {470300000UL, 470500000UL, 470700000UL}}, // CN470
+	{LPW_DR_EU, 0, 7, 16, 8, false, {868900000UL, 869100000UL, 0}},				 // RU864
+	{LPW_DR_IN, 0, 7, 30, 11, false, {865062500UL, 865402500UL, 865985000UL}},	 // IN865
+	{LPW_DR_EU, 0, 7, 16, 8, false, {868100000UL, 868300000UL, 868500000UL}},	 // EU868
+	{LPW_DR_US, 0, 4, 30, 15, false, {902300000UL, 902500000UL, 902700000UL}},	 // US915
+	{LPW_DR_AU, 0, 6, 30, 15, false, {915200000UL, 915400000UL, 915600000UL}},	 // AU915
+	{LPW_DR_CN_KR, 0, 5, 14, 8, false, {922100000UL, 922300000UL, 922500000UL}}, // KR920
+	{LPW_DR_AS, 0, 7, 16, 8, true, {923200000UL, 923400000UL, 0}},				 // AS923-1
+	{LPW_DR_AS, 0, 7, 16, 8, true, {921400000UL, 921600000UL, 0}},				 // AS923-2
+	{LPW_DR_AS, 0, 7, 16, 8, true, {916600000UL, 916800000UL, 0}},				 // AS923-3
+	{LPW_DR_AS, 0, 7, 16, 8, true, {917300000UL, 917500000UL, 0}},				 // AS923-4
+	{LPW_DR_AU, 0, 6, 30, 15, false, {915200000UL, 915400000UL, 915600000UL}},	 // LA915, same plan as AU915
+};
+
+/** Returned for invalid region or datarate */
+static constexpr lpw_dr_s lpw_dr_invalid = {0, 0, 0, 0};
+
+/**
+ * @brief Get the parameters of a datarate
+ *
+ * @param region RUI3 band number
+ * @param dr datarate
+ * @return const lpw_dr_s& datarate parameters, all 0 if region or datarate is invalid
+ */
+constexpr const lpw_dr_s &lpw_dr(uint8_t region, uint8_t dr)
+{
+	return ((region < LPW_NUM_REGIONS) && (dr < LPW_NUM_DR)) ? lpw_regions[region].dr[dr] : lpw_dr_invalid;
+}
+
+/**
+ * @brief Get the spreading factor of a datarate
+ *
+ * @param region RUI3 band number
+ * @param dr datarate
+ * @return uint8_t spreading factor, LPW_SF_FSK for FSK, 0 if not available
+ */
+constexpr uint8_t lpw_sf(uint8_t region, uint8_t dr)
+{
+	return lpw_dr(region, dr).sf;
+}
+
+/**
+ * @brief Get the bandwidth of a datarate
+ *
+ * @param region RUI3 band number
+ * @param dr datarate
+ * @return uint16_t bandwidth in kHz, 0 for FSK or if not available
+ */
+constexpr uint16_t lpw_bw(uint8_t region, uint8_t dr)
+{
+	return lpw_dr(region, dr).bw;
+}
+
+/**
+ * @brief Limit payload size to repeater compatible size
+ *
+ * @param size max payload size
+ * @param repeater true if repeater compatible size is required
+ * @return uint8_t limited size
+ */
+constexpr uint8_t lpw_limit_repeater(uint8_t size, bool repeater)
+{
+	return (repeater && (size > LPW_REPEATER_MAX_PAYLOAD)) ? LPW_REPEATER_MAX_PAYLOAD : size;
+}
+
+/**
+ * @brief Get the max application payload of a datarate
+ *
+ * @param region RUI3 band number
+ * @param dr datarate
+ * @param dwell true if 400 ms dwell time limit is active
+ * @param fopts number of bytes used for MAC commands in FOpts
+ * @param repeater true if repeater compatible size is required
+ * @return uint8_t max payload size, 0 if datarate is not available
+ */
+constexpr uint8_t lpw_max_payload(uint8_t region, uint8_t dr, bool dwell, uint8_t fopts = 0, bool repeater = false)
+{
+	return lpw_limit_repeater(dwell ? lpw_dr(region, dr).max_payload_dwell : lpw_dr(region, dr).max_payload, repeater) > fopts
+			   ? lpw_limit_repeater(dwell ? lpw_dr(region, dr).max_payload_dwell : lpw_dr(region, dr).max_payload, repeater) - fopts
+			   : 0;
+}
+
+/**
+ * @brief Get the lowest uplink datarate that can carry the payload
+ *        Searches at most LPW_NUM_DR entries
+ *
+ * @param region RUI3 band number
+ * @param len payload size
+ * @param dwell true if 400 ms dwell time limit is active
+ * @param fopts number of bytes used for MAC commands in FOpts
+ * @param repeater true if repeater compatible size is required
+ * @param dr first datarate to check (used for the search)
+ * @return uint8_t datarate or LPW_DR_NONE if no datarate can carry the payload
+ */
+constexpr uint8_t lpw_min_dr(uint8_t region, uint16_t len, bool dwell, uint8_t fopts = 0, bool repeater = false, uint8_t dr = 0)
+{
+	return ((region >= LPW_NUM_REGIONS) || (dr > lpw_regions[region].max_ul_dr))
+			   ? LPW_DR_NONE
+			   : (((dr >= lpw_regions[region].min_ul_dr) && (lpw_max_payload(region, dr, dwell, fopts, repeater) != 0) &&
+				   (len <= lpw_max_payload(region, dr, dwell, fopts, repeater)))
+					  ? dr
+					  : lpw_min_dr(region, len, dwell, fopts, repeater, dr + 1));
+}
+
+/**
+ * @brief Get the TX power for a TX power setting
+ *
+ * @param region RUI3 band number
+ * @param tx_power TX power setting (0 = max EIRP)
+ * @return int8_t EIRP in dBm, -128 if the setting is not available
+ */
+constexpr int8_t lpw_tx_power_dbm(uint8_t region, uint8_t tx_power)
+{
+	return ((region < LPW_NUM_REGIONS) && (tx_power < lpw_regions[region].tx_power_steps))
+			   ? (int8_t)(lpw_regions[region].max_eirp - 2 * tx_power)
+			   : -128;
+}
+
+/**
+ * @brief Check the entries of one region, starting at a datarate
+ *
+ * @param region RUI3 band number
+ * @param dr first datarate to check
+ * @return true all entries are consistent
+ */
+constexpr bool lpw_check_dr(uint8_t region, uint8_t dr)
+{
+	return (dr >= LPW_NUM_DR) ||
+		   (((lpw_sf(region, dr) == 0) == (lpw_dr(region, dr).max_payload == 0)) &&
+			((lpw_sf(region, dr) == 0) || (lpw_sf(region, dr) == LPW_SF_FSK) || ((lpw_sf(region, dr) >= 7) && (lpw_sf(region, dr) <= 12))) &&
+			((lpw_bw(region, dr) == 0) || (lpw_bw(region, dr) == 125) || (lpw_bw(region, dr) == 250) || (lpw_bw(region, dr) == 500)) &&
+			(lpw_dr(region, dr).max_payload_dwell <= lpw_dr(region, dr).max_payload) &&
+			lpw_check_dr(region, dr + 1));
+}
+
+/**
+ * @brief Check all regions, starting at a region
+ *
+ * @param region first region to check
+ * @return true all regions are consistent
+ */
+constexpr bool lpw_check_regions(uint8_t region)
+{
+	return (region >= LPW_NUM_REGIONS) ||
+		   ((lpw_regions[region].min_ul_dr <= lpw_regions[region].max_ul_dr) &&
+			(lpw_regions[region].max_ul_dr < LPW_NUM_DR) &&
+			(lpw_regions[region].tx_power_steps != 0) &&
+			(lpw_regions[region].channels[0] != 0) &&
+			(lpw_min_dr(region, 1, false) == lpw_regions[region].min_ul_dr) &&
+			lpw_check_dr(region, 0) &&
+			lpw_check_regions(region + 1));
+}
+
+/** Duty cycle sub-band */
+struct lpw_subband_s
+{
+	uint8_t region;		 // RUI3 band number
+	uint32_t min_freq;	 // Lowest frequency in Hz
+	uint32_t max_freq;	 // Highest frequency in Hz
+	uint16_t dc_divisor; // Duty cycle as 1/dc_divisor (100 = 1 %)
+};
+
+/** Duty cycle sub-bands, regions without entry have no duty cycle limit */
+static constexpr lpw_subband_s lpw_subbands[] = {
+	{LPW_EU433, 433050000UL, 434790000UL, 100}, // 1 %
+	{LPW_RU864, 864000000UL, 870000000UL, 100}, // 1 %
+	{LPW_EU868, 863000000UL, 865000000UL, 1000}, // 0.1 %
+	{LPW_EU868, 865000000UL, 868000000UL, 100},	 // 1 %
+	{LPW_EU868, 868000000UL, 868600000UL, 100},	 // 1 %
+	{LPW_EU868, 868700000UL, 869200000UL, 1000}, // 0.1 %
+	{LPW_EU868, 869400000UL, 869650000UL, 10},	 // 10 %
+	{LPW_EU868, 869700000UL, 870000000UL, 100},	 // 1 %
+};
+/** Number of duty cycle sub-bands */
+#define LPW_NUM_SUBBANDS (sizeof(lpw_subbands) / sizeof(lpw_subband_s))
+/** Returned if a frequency has no duty cycle limit */
+#define LPW_SUBBAND_NONE 0xFF
+
+/**
+ * @brief Find the duty cycle sub-band of a frequency
+ *
+ * @param region RUI3 band number
+ * @param freq frequency in Hz
+ * @param idx first sub-band to check (used for the search)
+ * @return uint8_t sub-band index or LPW_SUBBAND_NONE
+ */
+constexpr uint8_t lpw_subband(uint8_t region, uint32_t freq, uint8_t idx = 0)
+{
+	return (idx >= LPW_NUM_SUBBANDS)
+			   ? LPW_SUBBAND_NONE
+			   : (((lpw_subbands[idx].region == region) && (freq >= lpw_subbands[idx].min_freq) && (freq < lpw_subbands[idx].max_freq))
+					  ? idx
+					  : lpw_subband(region, freq, idx + 1));
+}
+
+/** LoRaWAN overhead in bytes without FOpts (MHDR, DevAddr, FCtrl, FCnt, FPort, MIC) */
+#define LPW_PHY_OVERHEAD 13
+
+/**
+ * @brief Duration of one LoRa symbol
+ *
+ * @param sf spreading factor
+ * @param bw bandwidth in kHz
+ * @return uint32_t symbol time in us
+ */
+constexpr uint32_t lora_symbol_us(uint8_t sf, uint16_t bw)
+{
+	return ((uint32_t)1 << sf) * 1000UL / bw;
+}
+
+/**
+ * @brief Rounded up division for the symbol count, negative values give 0
+ */
+constexpr uint32_t lora_ceil_div(int32_t num, int32_t den)
+{
+	return num <= 0 ? 0 : (uint32_t)((num + den - 1) / den);
+}
+
+/**
+ * @brief Number of payload symbols (Semtech AN1200.13)
+ *
+ * @param sf spreading factor
+ * @param bw bandwidth in kHz
+ * @param cr coding rate 1 = 4/5 to 4 = 4/8
+ * @param explicit_header true if explicit header is used
+ * @param crc true if payload CRC is used
+ * @param len PHY payload size
+ * @return uint32_t number of symbols
+ */
+constexpr uint32_t lora_payload_symbols(uint8_t sf, uint16_t bw, uint8_t cr, bool explicit_header, bool crc, uint16_t len)
+{
+	return 8 + lora_ceil_div(8 * (int32_t)len - 4 * sf + 28 + (crc ? 16 : 0) - (explicit_header ? 0 : 20),
+							 4 * (sf - (lora_symbol_us(sf, bw) > 16000 ? 2 : 0))) *
+				   (cr + 4);
+}
+
+/**
+ * @brief LoRa time on air
+ *
+ * @param sf spreading factor
+ * @param bw bandwidth in kHz
+ * @param cr coding rate 1 = 4/5 to 4 = 4/8
+ * @param preamble preamble length in symbols
+ * @param explicit_header true if explicit header is used
+ * @param crc true if payload CRC is used
+ * @param len PHY payload size
+ * @return uint32_t time on air in us
+ */
+constexpr uint32_t lora_toa_us(uint8_t sf, uint16_t bw, uint8_t cr, uint16_t preamble, bool explicit_header, bool crc, uint16_t len)
+{
+	return ((uint32_t)preamble * 4 + 17) * lora_symbol_us(sf, bw) / 4 +
+		   lora_payload_symbols(sf, bw, cr, explicit_header, crc, len) * lora_symbol_us(sf, bw);
+}
+
+/**
+ * @brief FSK time on air at 50 kbps, 5 bytes preamble, 3 bytes sync word, length byte and CRC
+ *
+ * @param len PHY payload size
+ * @return uint32_t time on air in us
+ */
+constexpr uint32_t fsk_toa_us(uint16_t len)
+{
+	return (5 + 3 + 1 + (uint32_t)len + 2) * 160;
+}
+
+/**
+ * @brief Time on air of a LoRaWAN uplink (CR 4/5, 8 symbols preamble, explicit header, CRC)
+ *
+ * @param region RUI3 band number
+ * @param dr datarate
+ * @param len application payload size
+ * @param fopts number of bytes used for MAC commands in FOpts
+ * @return uint32_t time on air in us, 0 if datarate is not available
+ */
+constexpr uint32_t lpw_toa_us(uint8_t region, uint8_t dr, uint16_t len, uint8_t fopts = 0)
+{
+	return (lpw_sf(region, dr) == 0)
+			   ? 0
+			   : ((lpw_sf(region, dr) == LPW_SF_FSK)
+					  ? fsk_toa_us(len + LPW_PHY_OVERHEAD + fopts)
+					  : lora_toa_us(lpw_sf(region, dr), lpw_bw(region, dr), 1, 8, true, true, len + LPW_PHY_OVERHEAD + fopts));
+}
+
+// Table checks, evaluated by the compiler
+static_assert(lpw_check_regions(0), "Inconsistent regional parameters");
+static_assert(lpw_min_dr(LPW_EU868, 51, false) == 0, "EU868 51 bytes fit DR0");
+static_assert(lpw_min_dr(LPW_EU868, 52, false) == 3, "EU868 52 bytes need DR3");
+static_assert(lpw_min_dr(LPW_EU868, 51, false, 1) == 3, "EU868 51 bytes + LinkCheckReq need DR3");
+static_assert(lpw_min_dr(LPW_EU868, 243, false) == LPW_DR_NONE, "EU868 max payload is 242");
+static_assert(lpw_min_dr(LPW_US915, 12, false) == 1, "US915 12 bytes need DR1");
+static_assert(lpw_min_dr(LPW_US915, 243, false) == LPW_DR_NONE, "US915 downlink DRs are not used");
+static_assert(lpw_min_dr(LPW_AS923_1, 1, true) == 2, "AS923 with dwell time starts at DR2");
+static_assert(lpw_min_dr(LPW_AU915, 12, true) == 3, "AU915 with dwell time 12 bytes need DR3");
+static_assert(lpw_max_payload(LPW_AU915, 2, true) == 11, "AU915 DR2 with dwell time");
+static_assert(lpw_max_payload(LPW_EU868, 5, false, 0, true) == LPW_REPEATER_MAX_PAYLOAD, "Repeater compatible size");
+static_assert(lpw_max_payload(LPW_IN865, 6, false) == 0, "IN865 DR6 is RFU");
+static_assert((lpw_sf(LPW_US915, 4) == 8) && (lpw_bw(LPW_US915, 4) == 500), "US915 DR4 is SF8 500 kHz");
+static_assert(lpw_tx_power_dbm(LPW_EU868, 7) == 2, "EU868 TX power 7 is 2 dBm");
+static_assert(lpw_tx_power_dbm(LPW_EU868, 8) == -128, "EU868 has 8 TX power steps");
+static_assert(lpw_toa_us(LPW_EU868, 5, 10) == 61696, "EU868 DR5 10 bytes is 61.7 ms");
+static_assert(lpw_toa_us(LPW_EU868, 0, 10) == 1482752, "EU868 DR0 10 bytes is 1482.8 ms");
+static_assert(lpw_toa_us(LPW_US915, 0, 11) == 370688, "US915 DR0 11 bytes is 370.7 ms");
+static_assert(lpw_subband(LPW_EU868, 868100000UL) == 4, "EU868 default channels are in the 1 % band");
+static_assert(lpw_subband(LPW_US915, 902300000UL) == LPW_SUBBAND_NONE, "US915 has no duty cycle");
+
+#endif
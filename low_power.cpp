@@ -0,0 +1,110 @@
+/**
+ * @file low_power.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Tickless idle of the main loop
+ *        The loop sleeps until the next task of the task manager is due,
+ *        RAK timers and interrupts (button, ACC, radio, UART) wake it up earlier
+ * @version 0.1
+ * @date 2025-01-06
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "app.h"
+
+/** Start of the statistics */
+static uint32_t lp_stats_start = 0;
+
+/** Time spent in sleep in ms */
+static uint32_t lp_sleep_ms = 0;
+
+/** Number of sleep periods */
+static uint32_t lp_sleeps = 0;
+
+/** Time spent in sleep since the start in ms, not reset */
+static uint32_t lp_sleep_total = 0;
+
+/**
+ * @brief Sleep until the next event
+ *        Only the MCU sleeps, the radio keeps receiving in P2P and LoRaWAN class C
+ *        Only this sleep is counted in the statistics, the sleep of the low power mode of RUI3 outside of it is not
+ *
+ */
+void lp_idle(void)
+{
+	uint32_t wait = LP_MAX_SLEEP_MS;
+
+	// Button handling and background jobs run in the task manager
+	bool busy = button_busy();
+	if (busy || job_busy())
+	{
+		wait = mtmMain.NextDeadline(millis());
+		if (wait == 0)
+		{
+			return;
+		}
+		if (wait > LP_MAX_SLEEP_MS)
+		{
+			wait = LP_MAX_SLEEP_MS;
+		}
+	}
+
+	// Wake up for the timeout of the test cycle stage
+	uint32_t cycle_wait = cycle_next_timeout();
+	if (cycle_wait == 0)
+	{
+		return;
+	}
+	if (cycle_wait < wait)
+	{
+		wait = cycle_wait;
+	}
+
+	// A button edge after the check above would wait for the end of the sleep
+	if (!busy && button_busy())
+	{
+		return;
+	}
+
+	uint32_t start = millis();
+	api.system.sleep.cpu(wait);
+	uint32_t slept = millis() - start;
+	lp_sleep_ms += slept;
+	lp_sleep_total += slept;
+	lp_sleeps++;
+}
+
+/**
+ * @brief Get the sleep statistics
+ *
+ * @param stats statistics
+ */
+void lp_get_stats(lp_stats_s *stats)
+{
+	stats->total_ms = millis() - lp_stats_start;
+	stats->sleep_ms = lp_sleep_ms;
+	stats->sleeps = lp_sleeps;
+	// Sleep ratio in 0.1 %
+	stats->ratio = stats->total_ms == 0 ? 0 : (uint16_t)((uint64_t)lp_sleep_ms * 1000 / stats->total_ms);
+}
+
+/**
+ * @brief Start new sleep statistics
+ *
+ */
+void lp_reset_stats(void)
+{
+	lp_stats_start = millis();
+	lp_sleep_ms = 0;
+	lp_sleeps = 0;
+}
+
+/**
+ * @brief Get the time spent in sleep since the start, not changed by lp_reset_stats
+ *
+ * @return uint32_t sleep time in ms
+ */
+uint32_t lp_get_sleep_total(void)
+{
+	return lp_sleep_total;
+}
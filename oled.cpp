@@ -2,6 +2,8 @@
  * @file oled.cpp
  * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
  * @brief Initialization and usage of RAK1921 OLED
+ *        Retained mode, each screen is a set of text fields. Only fields with changed text are drawn again.
+ *        A shadow copy of the panel content is compared with the frame buffer, only the changed spans are sent to the SSD1306.
  * @version 0.2
  * @date 2024-11-18
  *
@@ -14,18 +16,94 @@
 // Forward declaration
 void oled_show(void);
 
+/** I2C address of the display */
+#define OLED_ADDRESS 0x3c
 /** Width of the display in pixel */
 #define OLED_WIDTH 128
 /** Height of the display in pixel */
 #define OLED_HEIGHT 64
+/** Number of 8 pixel pages of the display */
+#define OLED_PAGES (OLED_HEIGHT / 8)
 /** Height of the status bar in pixel */
 #define STATUS_BAR_HEIGHT 11
 /** Height of a single line */
 #define LINE_HEIGHT 10
+/** Height of the font including the descenders, text reaches into the next line */
+#define FONT_HEIGHT 13
 
 /** Number of message lines */
 #define NUM_OF_LINES (OLED_HEIGHT - STATUS_BAR_HEIGHT) / LINE_HEIGHT
 
+/** Max number of text fields on one screen */
+#define OLED_MAX_FIELDS 16
+/** Max text length of a field */
+#define OLED_FIELD_LEN 32
+/** Data bytes per I2C transfer */
+#define OLED_I2C_CHUNK 16
+/** SSD1306 commands for the transfer window */
+#define OLED_CMD_COLUMNADDR 0x21
+#define OLED_CMD_PAGEADDR 0x22
+/** I2C bytes of a full frame, 6 commands, 1024 data bytes with one control byte per chunk */
+#define OLED_FRAME_BYTES (6 * 2 + (OLED_WIDTH * OLED_PAGES) + (OLED_WIDTH * OLED_PAGES) / OLED_I2C_CHUNK)
+/** I2C bytes to set up a transfer window, 6 commands with one control byte each */
+#define OLED_WINDOW_BYTES (6 * 2)
+/** Unchanged bytes between two changed spans of a page that are sent instead of starting a new window */
+#define OLED_SPAN_GAP (OLED_WINDOW_BYTES + 1)
+/** Max number of windows of one update, more changed spans are sent as full frame */
+#define OLED_MAX_SPANS 24
+
+/** Text field of the retained layout */
+struct oled_field_s
+{
+	int16_t x;					// Left edge in pixel
+	int16_t y;					// Top edge in pixel
+	uint16_t width;				// Width of the text in pixel
+	char text[OLED_FIELD_LEN]; // Text of the field
+};
+
+/** Changed span of one page */
+struct oled_span_s
+{
+	uint8_t page;
+	uint8_t col0;
+	uint8_t col1;
+};
+
+/** Rectangle that was cleared for a changed field */
+struct oled_rect_s
+{
+	int16_t x;
+	int16_t y;
+	int16_t w;
+	int16_t h;
+};
+
+/** Fields shown on the display */
+static oled_field_s shown_fields[OLED_MAX_FIELDS];
+/** Number of fields shown on the display */
+static uint8_t shown_num = 0;
+
+/** Fields of the next display update */
+static oled_field_s next_fields[OLED_MAX_FIELDS];
+/** Number of fields of the next display update */
+static uint8_t next_num = 0;
+
+/** Flag if the divider line below the status bar is shown */
+static bool divider_on = false;
+
+/** Copy of the content of the panel */
+static uint8_t panel_shadow[OLED_WIDTH * OLED_PAGES];
+
+/** First changed column of each page, OLED_WIDTH if the page did not change */
+static uint8_t page_min[OLED_PAGES];
+/** Last changed column of each page */
+static uint8_t page_max[OLED_PAGES];
+
+/** Display statistics */
+static oled_stats_s oled_stats;
+/** Start of the statistics */
+static uint32_t oled_stats_start = 0;
+
 /** Line buffer for messages */
 char disp_buffer[NUM_OF_LINES + 1][32] = {0};
 
@@ -33,7 +111,7 @@ char disp_buffer[NUM_OF_LINES + 1][32] = {0};
 uint8_t current_line = 0;
 
 /** Display class using Wire */
-SSD1306Wire display(0x3c, PIN_WIRE_SDA, PIN_WIRE_SCL, GEOMETRY_128_64, &Wire);
+SSD1306Wire display(OLED_ADDRESS, PIN_WIRE_SDA, PIN_WIRE_SCL, GEOMETRY_128_64, &Wire);
 
 /** Flag if display is on or off */
 volatile bool display_power = true;
@@ -69,6 +147,7 @@ bool init_oled(void)
 	display.displayOff();
 	display.clear();
 	display.displayOn();
+	energy_state(EN_OLED, true);
 	display.setBrightness(200);
 #ifdef _RAK19026_
 	display.flipScreenVertically();
@@ -76,10 +155,277 @@ bool init_oled(void)
 	display.setContrast(100, 241, 64);
 	display.setFont(ArialMT_Plain_10);
 	display.display();
+	memcpy(panel_shadow, display.buffer, sizeof(panel_shadow));
+
+	// Display is empty, nothing to update
+	shown_num = 0;
+	next_num = 0;
+	for (uint8_t page = 0; page < OLED_PAGES; page++)
+	{
+		page_min[page] = OLED_WIDTH;
+		page_max[page] = 0;
+	}
+	oled_reset_stats();
 
 	return true;
 }
 
+/**
+ * @brief Set the text of a field of the next update, a field is identified by its position
+ *
+ * @param x left edge in pixel
+ * @param y top edge in pixel
+ * @param text text of the field
+ */
+static void oled_set_field(int16_t x, int16_t y, const char *text)
+{
+	oled_field_s *field = NULL;
+	for (uint8_t idx = 0; idx < next_num; idx++)
+	{
+		if ((next_fields[idx].x == x) && (next_fields[idx].y == y))
+		{
+			field = &next_fields[idx];
+			break;
+		}
+	}
+	if (field == NULL)
+	{
+		if (next_num == OLED_MAX_FIELDS)
+		{
+			MYLOG("DISP", "Too many fields");
+			return;
+		}
+		field = &next_fields[next_num++];
+		field->x = x;
+		field->y = y;
+	}
+	snprintf(field->text, OLED_FIELD_LEN, "%s", text);
+}
+
+/**
+ * @brief Remove the fields of the next update in a range of rows
+ *
+ * @param y_min first row
+ * @param y_max last row
+ */
+static void oled_remove_fields(int16_t y_min, int16_t y_max)
+{
+	uint8_t num = 0;
+	for (uint8_t idx = 0; idx < next_num; idx++)
+	{
+		if ((next_fields[idx].y < y_min) || (next_fields[idx].y > y_max))
+		{
+			next_fields[num++] = next_fields[idx];
+		}
+	}
+	next_num = num;
+}
+
+/**
+ * @brief Find a field by its position
+ *
+ * @param fields list of fields
+ * @param num number of fields in the list
+ * @param x left edge in pixel
+ * @param y top edge in pixel
+ * @return oled_field_s* found field or NULL
+ */
+static oled_field_s *oled_find_field(oled_field_s *fields, uint8_t num, int16_t x, int16_t y)
+{
+	for (uint8_t idx = 0; idx < num; idx++)
+	{
+		if ((fields[idx].x == x) && (fields[idx].y == y))
+		{
+			return &fields[idx];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Clear a rectangle in the frame buffer and mark the touched pages and columns
+ *
+ * @param rect rectangle, clipped to the display
+ */
+static void oled_clear_rect(oled_rect_s *rect)
+{
+	int16_t x0 = rect->x < 0 ? 0 : rect->x;
+	int16_t x1 = rect->x + rect->w > OLED_WIDTH ? OLED_WIDTH - 1 : rect->x + rect->w - 1;
+	int16_t y0 = rect->y < 0 ? 0 : rect->y;
+	int16_t y1 = rect->y + rect->h > OLED_HEIGHT ? OLED_HEIGHT - 1 : rect->y + rect->h - 1;
+	if ((x1 < x0) || (y1 < y0))
+	{
+		return;
+	}
+	display.setColor(BLACK);
+	display.fillRect(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+	for (int16_t page = y0 / 8; page <= y1 / 8; page++)
+	{
+		if (x0 < page_min[page])
+		{
+			page_min[page] = x0;
+		}
+		if (x1 > page_max[page])
+		{
+			page_max[page] = x1;
+		}
+	}
+}
+
+/**
+ * @brief Check if a rectangle overlaps with the area of a text
+ *
+ * @param rect rectangle
+ * @param x left edge of the text
+ * @param y top edge of the text
+ * @param w width of the text
+ * @param h height of the text
+ * @return true areas overlap
+ * @return false areas are separate
+ */
+static bool oled_overlaps(oled_rect_s *rect, int16_t x, int16_t y, int16_t w, int16_t h)
+{
+	return (x < rect->x + rect->w) && (rect->x < x + w) && (y < rect->y + rect->h) && (rect->y < y + h);
+}
+
+/**
+ * @brief Send a window of the frame buffer to the display and update the shadow copy
+ *        The SSD1306 moves to the next column after each data byte and to the next page at the end of the window
+ *
+ * @param col0 first column
+ * @param col1 last column
+ * @param page0 first page
+ * @param page1 last page
+ */
+static void oled_send_window(uint8_t col0, uint8_t col1, uint8_t page0, uint8_t page1)
+{
+	uint8_t window[6] = {OLED_CMD_COLUMNADDR, col0, col1, OLED_CMD_PAGEADDR, page0, page1};
+	for (uint8_t idx = 0; idx < sizeof(window); idx++)
+	{
+		Wire.beginTransmission(OLED_ADDRESS);
+		Wire.write(0x80);
+		Wire.write(window[idx]);
+		Wire.endTransmission();
+	}
+	oled_stats.bytes += OLED_WINDOW_BYTES;
+
+	uint8_t chunk = 0;
+	for (uint16_t page = page0; page <= page1; page++)
+	{
+		for (uint16_t col = col0; col <= col1; col++)
+		{
+			uint16_t pos = col + page * OLED_WIDTH;
+			if (chunk == 0)
+			{
+				Wire.beginTransmission(OLED_ADDRESS);
+				Wire.write(0x40);
+				oled_stats.bytes++;
+			}
+			Wire.write(display.buffer[pos]);
+			panel_shadow[pos] = display.buffer[pos];
+			oled_stats.bytes++;
+			chunk++;
+			if (chunk == OLED_I2C_CHUNK)
+			{
+				Wire.endTransmission();
+				chunk = 0;
+			}
+		}
+	}
+	if (chunk != 0)
+	{
+		Wire.endTransmission();
+	}
+	oled_stats.windows++;
+}
+
+/**
+ * @brief Send the changes to the display
+ *        The touched pages and columns are compared with the shadow copy of the panel, each changed span
+ *        is sent in its own window. Spans with a small gap are merged, a new window costs more than the gap.
+ *        If the windows would cost more than a full frame, the full frame is sent.
+ *
+ */
+static void oled_flush(void)
+{
+	oled_span_s spans[OLED_MAX_SPANS];
+	uint8_t num_spans = 0;
+	uint32_t cost = 0;
+	bool full_frame = false;
+
+	for (uint8_t page = 0; (page < OLED_PAGES) && !full_frame; page++)
+	{
+		int16_t start = -1;
+		int16_t last = -1;
+		for (int16_t col = page_min[page]; col <= page_max[page]; col++)
+		{
+			uint16_t pos = col + page * OLED_WIDTH;
+			if (display.buffer[pos] == panel_shadow[pos])
+			{
+				continue;
+			}
+			if ((start >= 0) && (col - last - 1 > OLED_SPAN_GAP))
+			{
+				if (num_spans == OLED_MAX_SPANS)
+				{
+					full_frame = true;
+					break;
+				}
+				spans[num_spans++] = {page, (uint8_t)start, (uint8_t)last};
+				cost += OLED_WINDOW_BYTES + (last - start + 1) + (last - start + OLED_I2C_CHUNK) / OLED_I2C_CHUNK;
+				start = -1;
+			}
+			if (start < 0)
+			{
+				start = col;
+			}
+			last = col;
+		}
+		if ((start >= 0) && !full_frame)
+		{
+			if (num_spans == OLED_MAX_SPANS)
+			{
+				full_frame = true;
+				break;
+			}
+			spans[num_spans++] = {page, (uint8_t)start, (uint8_t)last};
+			cost += OLED_WINDOW_BYTES + (last - start + 1) + (last - start + OLED_I2C_CHUNK) / OLED_I2C_CHUNK;
+		}
+		page_min[page] = OLED_WIDTH;
+		page_max[page] = 0;
+	}
+
+	if (full_frame || (cost >= OLED_FRAME_BYTES))
+	{
+		for (uint8_t page = 0; page < OLED_PAGES; page++)
+		{
+			page_min[page] = OLED_WIDTH;
+			page_max[page] = 0;
+		}
+	}
+
+	oled_stats.updates++;
+	if (num_spans == 0)
+	{
+		return;
+	}
+
+	energy_state(EN_OLED_REFRESH, true);
+	if (full_frame || (cost >= OLED_FRAME_BYTES))
+	{
+		oled_send_window(0, OLED_WIDTH - 1, 0, OLED_PAGES - 1);
+		oled_stats.full_frames++;
+	}
+	else
+	{
+		for (uint8_t idx = 0; idx < num_spans; idx++)
+		{
+			oled_send_window(spans[idx].col0, spans[idx].col1, spans[idx].page, spans[idx].page);
+		}
+	}
+	energy_state(EN_OLED_REFRESH, false);
+}
+
 /**
  * @brief Write the top line of the display
  */
@@ -90,28 +436,24 @@ void oled_write_header(char *header_line, bool show_error)
 
 	display.setFont(ArialMT_Plain_10);
 
-	// clear the status bar
-	display.setColor(BLACK);
-	display.fillRect(0, 0, OLED_WIDTH, STATUS_BAR_HEIGHT);
-
-	display.setColor(WHITE);
-	display.setTextAlignment(TEXT_ALIGN_LEFT);
+	// replace the fields of the status bar
+	oled_remove_fields(0, STATUS_BAR_HEIGHT - 1);
 
 	if (sd_card_error && has_sd && show_error)
 	{
 		MYLOG("DISP", "SD card error! %d %d", sd_card_error, has_sd);
-		display.drawString(0, 0, (char *)"SD CARD ERROR");
+		oled_set_field(0, 0, (char *)"SD CARD ERROR");
 	}
 	else
 	{
 		if (g_custom_parameters.location_on)
 		{
 			sprintf(oled_line, "%s %s", has_gnss_location ? "O" : "X", header_line);
-			display.drawString(0, 0, oled_line);
+			oled_set_field(0, 0, oled_line);
 		}
 		else
 		{
-			display.drawString(0, 0, header_line);
+			oled_set_field(0, 0, header_line);
 		}
 	}
 #ifdef _VARIANT_RAK4630_
@@ -129,13 +471,13 @@ void oled_write_header(char *header_line, bool show_error)
 		bat = bat / 10.0;
 
 		len = sprintf(oled_line, "%.2fV", bat);
-		display.drawString(127 - (display.getStringWidth(oled_line, len)), 0, oled_line);
+		oled_set_field(127 - (display.getStringWidth(oled_line, len)), 0, oled_line);
 		break;
 	}
 	case 3: // VBUS voltage above valid threshold and USBREG output settling time elapsed (same information as USBPWRRDY event)
 	{
 		len = sprintf(oled_line, "%s", "USB");
-		display.drawString(127 - (display.getStringWidth(oled_line, len)), 0, oled_line);
+		oled_set_field(127 - (display.getStringWidth(oled_line, len)), 0, oled_line);
 		break;
 	}
 	default:
@@ -151,12 +493,19 @@ void oled_write_header(char *header_line, bool show_error)
 	bat = bat / 10.0;
 
 	len = sprintf(oled_line, "%.2fV", bat);
-	display.drawString(127 - (display.getStringWidth(oled_line, len)), 0, oled_line);
+	oled_set_field(127 - (display.getStringWidth(oled_line, len)), 0, oled_line);
 #endif
 
 	// draw divider line
-	display.drawLine(0, 11, 127, 11);
-	display.display();
+	if (!divider_on)
+	{
+		divider_on = true;
+		oled_rect_s divider = {0, STATUS_BAR_HEIGHT, OLED_WIDTH, 1};
+		oled_clear_rect(&divider);
+		display.setColor(WHITE);
+		display.drawLine(0, STATUS_BAR_HEIGHT, OLED_WIDTH - 1, STATUS_BAR_HEIGHT);
+	}
+	oled_display();
 }
 
 /**
@@ -191,28 +540,22 @@ void oled_add_line(char *line)
  */
 void oled_show(void)
 {
-	display.setColor(BLACK);
-	display.fillRect(0, STATUS_BAR_HEIGHT + 1, OLED_WIDTH, OLED_HEIGHT);
-
-	display.setFont(ArialMT_Plain_10);
-	display.setColor(WHITE);
-	display.setTextAlignment(TEXT_ALIGN_LEFT);
+	oled_remove_fields(STATUS_BAR_HEIGHT + 1, OLED_HEIGHT);
 	for (int line = 0; line < current_line; line++)
 	{
-		display.drawString(0, (line * LINE_HEIGHT) + STATUS_BAR_HEIGHT + 1, disp_buffer[line]);
+		oled_set_field(0, (line * LINE_HEIGHT) + STATUS_BAR_HEIGHT + 1, disp_buffer[line]);
 	}
-	display.display();
+	oled_display();
 }
 
 /**
  * @brief Clear the display
+ *        Only the fields of the next update are removed, the display changes with oled_display()
  *
  */
 void oled_clear(void)
 {
-	display.setColor(BLACK);
-	display.fillRect(0, STATUS_BAR_HEIGHT + 1, OLED_WIDTH, OLED_HEIGHT);
-	display.setColor(WHITE);
+	oled_remove_fields(STATUS_BAR_HEIGHT + 1, OLED_HEIGHT);
 	current_line = 0;
 }
 
@@ -225,16 +568,108 @@ void oled_clear(void)
  */
 void oled_write_line(int16_t line, int16_t y_pos, String text)
 {
-	display.drawString(y_pos, (line * LINE_HEIGHT) + STATUS_BAR_HEIGHT + 1, text);
+	oled_set_field(y_pos, (line * LINE_HEIGHT) + STATUS_BAR_HEIGHT + 1, text.c_str());
 }
 
 /**
  * @brief Display the buffer
+ *        Fields with changed text are cleared and drawn again, together with the unchanged fields
+ *        that overlap the cleared area. Only the changed spans of the frame buffer are sent to the display.
  *
  */
 void oled_display(void)
 {
-	display.display();
+	oled_rect_s rects[OLED_MAX_FIELDS * 2];
+	uint8_t num_rects = 0;
+
+	display.setFont(ArialMT_Plain_10);
+	for (uint8_t idx = 0; idx < next_num; idx++)
+	{
+		next_fields[idx].width = display.getStringWidth(next_fields[idx].text, strlen(next_fields[idx].text));
+	}
+
+	// Fields that were removed or changed
+	for (uint8_t idx = 0; idx < shown_num; idx++)
+	{
+		oled_field_s *old_field = &shown_fields[idx];
+		oled_field_s *new_field = oled_find_field(next_fields, next_num, old_field->x, old_field->y);
+		if (((new_field == NULL) || (strcmp(new_field->text, old_field->text) != 0)) && (old_field->width != 0))
+		{
+			rects[num_rects++] = {old_field->x, old_field->y, (int16_t)old_field->width, FONT_HEIGHT};
+		}
+	}
+	// Fields that were added or changed
+	for (uint8_t idx = 0; idx < next_num; idx++)
+	{
+		oled_field_s *new_field = &next_fields[idx];
+		oled_field_s *old_field = oled_find_field(shown_fields, shown_num, new_field->x, new_field->y);
+		if (((old_field == NULL) || (strcmp(new_field->text, old_field->text) != 0)) && (new_field->width != 0))
+		{
+			rects[num_rects++] = {new_field->x, new_field->y, (int16_t)new_field->width, FONT_HEIGHT};
+		}
+	}
+
+	for (uint8_t idx = 0; idx < num_rects; idx++)
+	{
+		oled_clear_rect(&rects[idx]);
+	}
+
+	// Draw all fields that overlap with a cleared area, the text of the line above reaches into the next line
+	display.setColor(WHITE);
+	display.setTextAlignment(TEXT_ALIGN_LEFT);
+	for (uint8_t idx = 0; idx < next_num; idx++)
+	{
+		oled_field_s *field = &next_fields[idx];
+		for (uint8_t rect = 0; rect < num_rects; rect++)
+		{
+			if (oled_overlaps(&rects[rect], field->x, field->y, field->width, FONT_HEIGHT))
+			{
+				display.drawString(field->x, field->y, field->text);
+				oled_stats.fields++;
+				break;
+			}
+		}
+	}
+	if (divider_on)
+	{
+		for (uint8_t rect = 0; rect < num_rects; rect++)
+		{
+			if (oled_overlaps(&rects[rect], 0, STATUS_BAR_HEIGHT, OLED_WIDTH, 1))
+			{
+				display.drawLine(0, STATUS_BAR_HEIGHT, OLED_WIDTH - 1, STATUS_BAR_HEIGHT);
+				break;
+			}
+		}
+	}
+
+	memcpy(shown_fields, next_fields, next_num * sizeof(oled_field_s));
+	shown_num = next_num;
+
+	oled_flush();
+}
+
+/**
+ * @brief Get the display statistics
+ *
+ * @param stats statistics
+ */
+void oled_get_stats(oled_stats_s *stats)
+{
+	memcpy(stats, &oled_stats, sizeof(oled_stats_s));
+	stats->total_ms = millis() - oled_stats_start;
+	stats->full_bytes = oled_stats.updates * OLED_FRAME_BYTES;
+	// Bytes per second of the I2C transfers
+	stats->bytes_s = stats->total_ms == 0 ? 0 : (uint32_t)((uint64_t)oled_stats.bytes * 1000 / stats->total_ms);
+}
+
+/**
+ * @brief Reset the display statistics
+ *
+ */
+void oled_reset_stats(void)
+{
+	memset(&oled_stats, 0, sizeof(oled_stats_s));
+	oled_stats_start = millis();
 }
 
 /**
@@ -257,16 +692,18 @@ void oled_power(bool on_off)
 	{
 		display.displayOn();
 		display_power = true;
+		energy_state(EN_OLED, true);
 		// Restart display saver timer if enabled
 		if (g_custom_parameters.display_saver)
 		{
-			api.system.timer.start(RAK_TIMER_2, 60000, NULL);
+			lat_timer_start(RAK_TIMER_2, 60000, NULL);
 		}
 	}
 	else
 	{
 		display.displayOff();
 		display_power = false;
+		energy_state(EN_OLED, false);
 	}
 }
 
@@ -317,6 +754,29 @@ void display_show_menu(char *menu[], uint8_t menu_len, uint8_t sel_menu, uint8_t
 		oled_write_line(3, 64, line_str);
 		sprintf(line_str, "Location %s", location_on ? "on" : "off");
 		oled_write_line(4, 0, line_str);
+		oled_write_line(4, 64, (char *)"(2) Power");
+	}
+	// Handle estimated power consumption, average mA = mAh per hour
+	else if (sel_menu == S_ENERGY)
+	{
+		oled_write_line(0, 0, (char *)"(1) Back");
+		sprintf(line_str, "%.2f mAh/h", energy_avg_ua(EN_NUM) / 1000.0);
+		oled_write_line(0, 64, line_str);
+		sprintf(line_str, "MCU %.2f", (energy_avg_ua(EN_BASE) + energy_avg_ua(EN_MCU)) / 1000.0);
+		oled_write_line(1, 0, line_str);
+		sprintf(line_str, "OLED %.2f", (energy_avg_ua(EN_OLED) + energy_avg_ua(EN_OLED_REFRESH)) / 1000.0);
+		oled_write_line(1, 64, line_str);
+		sprintf(line_str, "GNSS %.2f", energy_avg_ua(EN_GNSS) / 1000.0);
+		oled_write_line(2, 0, line_str);
+		sprintf(line_str, "Rail %.2f", energy_avg_ua(EN_RAIL) / 1000.0);
+		oled_write_line(2, 64, line_str);
+		sprintf(line_str, "SD %.2f", energy_avg_ua(EN_SD) / 1000.0);
+		oled_write_line(3, 0, line_str);
+		sprintf(line_str, "TX %.2f", energy_avg_ua(EN_TX) / 1000.0);
+		oled_write_line(3, 64, line_str);
+		sprintf(line_str, "RX %.2f", energy_avg_ua(EN_RX) / 1000.0);
+		oled_write_line(4, 0, line_str);
+		oled_write_line(4, 64, (char *)"(2) Update");
 	}
 	// Handle send interval menu
 	else if (sel_menu == S_SEND_INT)
@@ -0,0 +1,322 @@
+/**
+ * @file payload_codec.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Table driven bit packing for the FieldTester uplink formats
+ *        One field table per payload format is the single description of the format.
+ *        The firmware encoder and the decoder are both generated from it.
+ *        No Arduino dependencies, the decoder can be used in host tools.
+ * @version 0.1
+ * @date 2024-12-27
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef PAYLOAD_CODEC_H
+#define PAYLOAD_CODEC_H
+
+#include <stdint.h>
+
+/** Field types */
+typedef enum codec_type_num
+{
+	CODEC_UINT = 0,		// Unsigned value
+	CODEC_SIGN_MAG = 1, // Magnitude, sign stored in a separate bit
+	CODEC_CONST = 2		// Constant value, no input
+} codec_type_num_t;
+
+/** Description of one field of a payload */
+struct codec_field_s
+{
+	uint8_t type;	   // codec_type_num_t
+	uint8_t bit_pos;   // Position of the MSB, counted from the first bit of the payload
+	uint8_t bits;	   // Width of the field
+	uint8_t sign_bit;  // Position of the sign bit (only CODEC_SIGN_MAG)
+	int32_t offset;	   // raw = (value - offset) / scale
+	uint32_t scale;	   // value = raw * scale + offset
+	uint32_t limit;	   // Values >= limit are clamped to max_raw (0 = no limit)
+	uint32_t max_raw;  // Raw value used for clamping, constant value for CODEC_CONST
+};
+
+/** Field index for the FieldTester formats */
+typedef enum ft_field_num
+{
+	FT_LAT = 0,
+	FT_LNG = 1,
+	FT_ALT = 2,
+	FT_HDOP = 3,
+	FT_SATS = 4,
+	FT_V2_SEQ = 2,
+} ft_field_num_t;
+
+/** FieldTester V1 (fPort 1), latitude/longitude in 1/10000000 degree, altitude in m, HDOP in 1/100 */
+static constexpr codec_field_s ft_v1_fields[] = {
+	{CODEC_SIGN_MAG, 2, 23, 1, 53, 108, 900000000UL, 8333333UL},	// Latitude
+	{CODEC_SIGN_MAG, 25, 23, 0, 107, 215, 1800000000UL, 8372093UL}, // Longitude
+	{CODEC_UINT, 48, 16, 0, -1000, 1, 0, 0},						// Altitude
+	{CODEC_UINT, 64, 8, 0, 0, 10, 0, 0},							// HDOP
+	{CODEC_UINT, 72, 8, 0, 0, 1, 0, 0},								// Number of satellites
+};
+
+/** FieldTester V2 (fPort 1), latitude/longitude in 1/10000000 degree */
+static constexpr codec_field_s ft_v2_fields[] = {
+	{CODEC_SIGN_MAG, 2, 23, 1, 53, 108, 900000000UL, 8333333UL},	// Latitude
+	{CODEC_SIGN_MAG, 25, 23, 0, 107, 215, 1800000000UL, 8372093UL}, // Longitude
+	{CODEC_UINT, 64, 16, 0, 0, 1, 0, 0},							// Sequence ID
+	{CODEC_CONST, 48, 16, 0, 0, 1, 0, 0x5632},						// Marker 'V' '2'
+};
+
+/** Field index for the batched formats */
+typedef enum batch_field_num
+{
+	BATCH_COUNT = 0,
+	BATCH_AGE = 1,
+	BATCH_RSSI = 2,
+	BATCH_SNR = 3,
+	BATCH_GW = 4,
+	BATCH_LAT = 0,
+	BATCH_LNG = 1,
+	BATCH_ALT = 2,
+	BATCH_TIME = 3,
+} batch_field_num_t;
+
+/** Batched uplink (fPort 3) header, the LinkCheck result is the last one before the uplink */
+static constexpr codec_field_s batch_head_fields[] = {
+	{CODEC_UINT, 0, 8, 0, 0, 1, 0, 0},		// Number of samples
+	{CODEC_UINT, 8, 16, 0, 0, 1, 0, 0},		// Age of the last sample in seconds
+	{CODEC_UINT, 24, 8, 0, -200, 1, 0, 0},	// RSSI in dBm
+	{CODEC_UINT, 32, 8, 0, -128, 1, 0, 0},	// SNR in dB
+	{CODEC_UINT, 40, 8, 0, 0, 1, 0, 0},		// Number of gateways
+};
+
+/** Batched uplink keyframe, first sample with absolute values, latitude/longitude in 1/10000000 degree */
+static constexpr codec_field_s batch_key_fields[] = {
+	{CODEC_UINT, 0, 32, 0, -900000000L, 1, 0, 0},	 // Latitude
+	{CODEC_UINT, 32, 32, 0, -1800000000L, 1, 0, 0}, // Longitude
+	{CODEC_UINT, 64, 16, 0, -1000, 1, 0, 0},		 // Altitude in m
+};
+
+/** Batched uplink delta, change to the previous sample, latitude/longitude in 1/100000 degree */
+static constexpr codec_field_s batch_delta_fields[] = {
+	{CODEC_UINT, 0, 16, 0, -3276800L, 100, 0, 0},  // Latitude change
+	{CODEC_UINT, 16, 16, 0, -3276800L, 100, 0, 0}, // Longitude change
+	{CODEC_UINT, 32, 8, 0, -128, 1, 0, 0},		   // Altitude change in m
+	{CODEC_UINT, 40, 16, 0, 0, 1, 0, 0},		   // Time since the previous sample in seconds
+};
+
+/** Field index for the fragment header */
+typedef enum frag_field_num
+{
+	FRAG_ID = 0,
+	FRAG_TOTAL = 1,
+	FRAG_OFFSET = 2,
+} frag_field_num_t;
+
+/** Fragment (fPort 4) header, followed by the fragment data */
+static constexpr codec_field_s frag_head_fields[] = {
+	{CODEC_UINT, 0, 8, 0, 0, 1, 0, 0},	// Packet id
+	{CODEC_UINT, 8, 8, 0, 0, 1, 0, 0},	// Length of the complete packet
+	{CODEC_UINT, 16, 8, 0, 0, 1, 0, 0}, // Offset of the fragment data in the packet
+};
+
+/** Largest latitude/longitude change a delta can carry */
+#define BATCH_DELTA_POS_MAX 3276800L
+/** Largest altitude change a delta can carry */
+#define BATCH_DELTA_ALT_MAX 127
+/** Largest time in seconds a delta or the header can carry */
+#define BATCH_TIME_MAX 65535
+
+/**
+ * @brief Write bits MSB first into a zeroed buffer
+ *
+ * @param buffer payload buffer
+ * @param bit_pos position of the MSB
+ * @param bits number of bits
+ * @param raw value to write
+ */
+static inline void codec_put_bits(uint8_t *buffer, uint8_t bit_pos, uint8_t bits, uint32_t raw)
+{
+	while (bits != 0)
+	{
+		uint8_t byte_idx = bit_pos >> 3;
+		uint8_t free_bits = 8 - (bit_pos & 0x07);
+		uint8_t chunk = bits < free_bits ? bits : free_bits;
+		uint8_t part = (raw >> (bits - chunk)) & ((1 << chunk) - 1);
+		buffer[byte_idx] |= part << (free_bits - chunk);
+		bits -= chunk;
+		bit_pos += chunk;
+	}
+}
+
+/**
+ * @brief Read bits MSB first from a buffer
+ *
+ * @param buffer payload buffer
+ * @param bit_pos position of the MSB
+ * @param bits number of bits
+ * @return uint32_t raw value
+ */
+static inline uint32_t codec_get_bits(const uint8_t *buffer, uint8_t bit_pos, uint8_t bits)
+{
+	uint32_t raw = 0;
+	while (bits != 0)
+	{
+		uint8_t byte_idx = bit_pos >> 3;
+		uint8_t free_bits = 8 - (bit_pos & 0x07);
+		uint8_t chunk = bits < free_bits ? bits : free_bits;
+		raw = (raw << chunk) | ((buffer[byte_idx] >> (free_bits - chunk)) & ((1 << chunk) - 1));
+		bits -= chunk;
+		bit_pos += chunk;
+	}
+	return raw;
+}
+
+/**
+ * @brief Encoder and decoder for one payload format
+ *
+ * @tparam FIELDS field table of the format
+ * @tparam NUM_FIELDS number of fields in the table
+ * @tparam SIZE payload size in bytes
+ */
+template <const codec_field_s *FIELDS, uint8_t NUM_FIELDS, uint8_t SIZE>
+struct codec_format
+{
+	/** Payload size in bytes */
+	static const uint8_t size = SIZE;
+
+	/**
+	 * @brief Encode values into a buffer
+	 *
+	 * @param buffer destination, at least SIZE bytes
+	 * @param values one value per field (ignored for CODEC_CONST)
+	 * @return uint8_t number of bytes written
+	 */
+	static uint8_t encode(uint8_t *buffer, const int32_t *values)
+	{
+		for (uint8_t idx = 0; idx < SIZE; idx++)
+		{
+			buffer[idx] = 0;
+		}
+		for (uint8_t idx = 0; idx < NUM_FIELDS; idx++)
+		{
+			const codec_field_s &field = FIELDS[idx];
+			uint32_t raw = 0;
+			if (field.type == CODEC_CONST)
+			{
+				raw = field.max_raw;
+			}
+			else
+			{
+				int64_t value = values[idx];
+				if (field.type == CODEC_SIGN_MAG)
+				{
+					if (value < 0)
+					{
+						codec_put_bits(buffer, field.sign_bit, 1, 1);
+						value = -value;
+					}
+				}
+				if ((field.limit != 0) && (value >= field.limit))
+				{
+					raw = field.max_raw;
+				}
+				else if (value < field.offset)
+				{
+					raw = 0;
+				}
+				else
+				{
+					raw = (uint32_t)((value - field.offset) / field.scale);
+				}
+			}
+			codec_put_bits(buffer, field.bit_pos, field.bits, raw);
+		}
+		return SIZE;
+	}
+
+	/**
+	 * @brief Decode a buffer into values
+	 *
+	 * @param buffer payload, at least SIZE bytes
+	 * @param values one value per field, same units as the encoder input
+	 * @return true payload is valid (size and constant fields match)
+	 * @return false payload does not match the format
+	 */
+	static bool decode(const uint8_t *buffer, uint8_t len, int32_t *values)
+	{
+		if (len < SIZE)
+		{
+			return false;
+		}
+		for (uint8_t idx = 0; idx < NUM_FIELDS; idx++)
+		{
+			const codec_field_s &field = FIELDS[idx];
+			uint32_t raw = codec_get_bits(buffer, field.bit_pos, field.bits);
+			if (field.type == CODEC_CONST)
+			{
+				if (raw != field.max_raw)
+				{
+					return false;
+				}
+				values[idx] = (int32_t)raw;
+				continue;
+			}
+			int64_t value = (int64_t)raw * field.scale + field.offset;
+			if ((field.type == CODEC_SIGN_MAG) && (codec_get_bits(buffer, field.sign_bit, 1) != 0))
+			{
+				value = -value;
+			}
+			values[idx] = (int32_t)value;
+		}
+		return true;
+	}
+};
+
+/** FieldTester V1 payload */
+typedef codec_format<ft_v1_fields, sizeof(ft_v1_fields) / sizeof(codec_field_s), 10> ft_v1_codec;
+/** FieldTester V2 payload */
+typedef codec_format<ft_v2_fields, sizeof(ft_v2_fields) / sizeof(codec_field_s), 10> ft_v2_codec;
+/** Batched uplink header */
+typedef codec_format<batch_head_fields, sizeof(batch_head_fields) / sizeof(codec_field_s), 6> batch_head_codec;
+/** Batched uplink keyframe */
+typedef codec_format<batch_key_fields, sizeof(batch_key_fields) / sizeof(codec_field_s), 10> batch_key_codec;
+/** Batched uplink delta */
+typedef codec_format<batch_delta_fields, sizeof(batch_delta_fields) / sizeof(codec_field_s), 7> batch_delta_codec;
+/** Fragment header */
+typedef codec_format<frag_head_fields, sizeof(frag_head_fields) / sizeof(codec_field_s), 3> frag_head_codec;
+
+/**
+ * @brief Encode the fragment of a packet that starts at offset
+ *        The fragment takes as much of the packet as fits into max_payload
+ *
+ * @param buffer destination, at least max_payload bytes
+ * @param max_payload max payload size of the current DR
+ * @param id packet id
+ * @param packet complete packet
+ * @param total length of the complete packet
+ * @param offset offset of the fragment data in the packet
+ * @return uint8_t number of packet bytes in the fragment, 0 if max_payload has no room for data
+ */
+static inline uint8_t frag_encode(uint8_t *buffer, uint8_t max_payload, uint8_t id, const uint8_t *packet, uint8_t total, uint8_t offset)
+{
+	if ((max_payload <= frag_head_codec::size) || (offset >= total))
+	{
+		return 0;
+	}
+	uint8_t chunk = max_payload - frag_head_codec::size;
+	if (chunk > (total - offset))
+	{
+		chunk = total - offset;
+	}
+	int32_t head[3];
+	head[FRAG_ID] = id;
+	head[FRAG_TOTAL] = total;
+	head[FRAG_OFFSET] = offset;
+	frag_head_codec::encode(buffer, head);
+	for (uint8_t idx = 0; idx < chunk; idx++)
+	{
+		buffer[frag_head_codec::size + idx] = packet[offset + idx];
+	}
+	return chunk;
+}
+
+#endif
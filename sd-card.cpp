@@ -32,7 +32,7 @@ volatile uint16_t lines_written = 0;
  */
 bool init_sd(void)
 {
-	digitalWrite(WB_IO2, HIGH);
+	rail_power(true);
 	delay(50);
 
 #if 0
@@ -126,7 +126,7 @@ bool init_sd(void)
  */
 void dir_sd(File dir)
 {
-	digitalWrite(WB_IO2, HIGH);
+	rail_power(true);
 	delay(50);
 	while (true)
 	{
@@ -154,71 +154,172 @@ void dir_sd(File dir)
 }
 #endif
 
+/** Steps of the SD card dump job */
+enum sd_dump_state
+{
+	DUMP_WAIT_TX = 0, // Wait until the current test cycle is finished
+	DUMP_OPEN = 1,	  // Open the next log file and send the file name
+	DUMP_DATA = 2,	  // Send one chunk of the file
+	DUMP_EOF = 3,	  // Send the EOF marker
+	DUMP_REBOOT = 4	  // All files sent
+};
+
+/** Number of the log file that is sent */
+static uint16_t dump_file_num = 0;
+
 /**
- * @brief Send content of all files to the Serial port
+ * @brief Reboot after the SD card job
  *
  */
-void dump_all_sd_files(void)
+static void sd_job_reboot(void)
 {
-	SD.begin(WB_SPI_CS);
-	uint16_t file_num = 0;
-	sprintf((char *)file_name, "%04d-log.csv", file_num);
-	while (true)
-	{
-		if (SD.exists((const char *)file_name))
-		{
-			// MYLOG("SD", "Content of %s:", file_name);
-			// Serial.println("=====================================================");
-			log_file = SD.open((const char *)file_name, FILE_READ); // re-open the file for reading.
-			if (log_file)
-			{
-				oled_clear();
-				oled_write_header("LOGGING", false);
-				oled_add_line((char *)"Dumping SD card");
-				oled_add_line((char *)"Do not power off");
-				sprintf(line_str, "%s", file_name);
-				oled_write_line(3, 0, line_str);
-				oled_display();
-				Serial.printf("%s\r\n", file_name);
-				Serial.write(0x02);
-				Serial.flush();
-				// Delay to give receiver time to get filename
-				delay(500);
-				while (log_file.available())
-				{
-					Serial.write(log_file.read()); // read from the file until there's nothing else in it.
-					delay(5);
-				}
-				log_file.close(); // close the file.
-				Serial.flush();
-
-				// Delay to give receiver time to get EOF marker
-				delay(500);
+	oled_clear();
+	oled_write_header("REBOOT", false);
+	oled_display();
+	api.system.reboot();
+}
 
-				Serial.write(0x03);
-				Serial.flush();
+/**
+ * @brief End an SD card job that could not start, the test cycle did not finish in time
+ *        Reports the failure and restarts testing instead of rebooting
+ *
+ * @param job SD card job
+ * @param name name of the job for the report
+ */
+static void sd_job_failed(job_s *job, const char *name)
+{
+	MYLOG("SD", "Timeout waiting for TX finished");
+	job->failed = true;
+	Serial.printf("%s failed, TX not finished\r\n", name);
+	oled_clear();
+	oled_write_header("LOGGING", false);
+	sprintf(line_str, "%s failed", name);
+	oled_add_line(line_str);
+	oled_add_line((char *)"TX not finished");
+	oled_display();
+	g_settings_ui = false;
+	if (get_send_period() != 0)
+	{
+		lat_timer_start(RAK_TIMER_0, get_send_period(), NULL);
+	}
+	lat_timer_start(RAK_TIMER_2, 60000, NULL);
+}
 
-				// Delay to give receiver time to get EOF marker
-				delay(500);
-			}
-			else
+/**
+ * @brief Step of the SD card dump job, sends the content of all files to the Serial port
+ *        The bytes are sent in chunks with the same average rate as the former 5 ms per byte
+ *
+ * @param job SD card dump job
+ * @return true dump finished
+ * @return false more steps to come
+ */
+static bool sd_dump_step(job_s *job)
+{
+	switch (job->state)
+	{
+	case DUMP_WAIT_TX:
+		if (!ready_to_dump)
+		{
+			if ((millis() - job->started) > SD_JOB_WAIT_TX)
 			{
-				MYLOG("SD", "Failed to open file for reading."); // if the file didn't open, print an error.
+				sd_job_failed(job, "Dump");
+				return true;
 			}
-
-			file_num++;
-			sprintf((char *)file_name, "%04d-log.csv", file_num);
-			MYLOG("SD", "Look for next file %s", file_name);
+			job_sleep(job, 100);
+			break;
 		}
-		else
+		SD.begin(WB_SPI_CS);
+		dump_file_num = 0;
+		sprintf((char *)file_name, "%04d-log.csv", dump_file_num);
+		job->state = DUMP_OPEN;
+		// Keep the AT command response apart from the first file name
+		job_sleep(job, 500);
+		break;
+	case DUMP_OPEN:
+		if (!SD.exists((const char *)file_name))
 		{
 			Serial.write(0x17);
 			Serial.flush();
+			SD.end();
+			Serial.printf("\r\n");
+			job->state = DUMP_REBOOT;
+			job_sleep(job, 100);
+			break;
+		}
+		log_file = SD.open((const char *)file_name, FILE_READ);
+		if (!log_file)
+		{
+			MYLOG("SD", "Failed to open file for reading.");
+			dump_file_num++;
+			sprintf((char *)file_name, "%04d-log.csv", dump_file_num);
+			break;
+		}
+		job->total += log_file.size();
+		oled_clear();
+		oled_write_header("LOGGING", false);
+		oled_add_line((char *)"Dumping SD card");
+		oled_add_line((char *)"Do not power off");
+		sprintf(line_str, "%s", file_name);
+		oled_write_line(3, 0, line_str);
+		oled_display();
+		Serial.printf("%s\r\n", file_name);
+		Serial.write(0x02);
+		Serial.flush();
+		job->state = DUMP_DATA;
+		// Give receiver time to get filename
+		job_sleep(job, 500);
+		break;
+	case DUMP_DATA:
+	{
+		uint8_t sent = 0;
+		while (log_file.available() && (sent < SD_DUMP_CHUNK))
+		{
+			Serial.write(log_file.read());
+			sent++;
+		}
+		job->progress += sent;
+		if (log_file.available())
+		{
+			job_sleep(job, sent * 5);
 			break;
 		}
+		log_file.close();
+		Serial.flush();
+		job->state = DUMP_EOF;
+		// Give receiver time to get the end of the file
+		job_sleep(job, 500);
+		break;
+	}
+	case DUMP_EOF:
+		Serial.write(0x03);
+		Serial.flush();
+		dump_file_num++;
+		sprintf((char *)file_name, "%04d-log.csv", dump_file_num);
+		MYLOG("SD", "Look for next file %s", file_name);
+		job->state = DUMP_OPEN;
+		// Give receiver time to get EOF marker
+		job_sleep(job, 500);
+		break;
+	default:
+		sd_job_reboot();
+		return true;
 	}
+	return false;
+}
 
-	SD.end();
+/** SD card dump job */
+static job_s sd_dump_job = {"sd_dump", sd_dump_step};
+
+/**
+ * @brief Start sending the content of all files to the Serial port, the device reboots when finished
+ *        Waits for the current test cycle to finish first
+ *
+ * @return true dump started
+ * @return false dump could not be started
+ */
+bool sd_dump_start(void)
+{
+	return job_start(&sd_dump_job);
 }
 
 /**
@@ -228,7 +329,7 @@ void dump_all_sd_files(void)
  */
 void dump_sd_file(const char *path)
 {
-	digitalWrite(WB_IO2, HIGH);
+	rail_power(true);
 	delay(50);
 	MYLOG("SD", "Reading file: %s", path);
 
@@ -251,46 +352,110 @@ void dump_sd_file(const char *path)
 	SD.end();
 }
 
+/** Steps of the SD card erase job */
+enum sd_erase_state
+{
+	ERASE_WAIT_TX = 0, // Wait until the current test cycle is finished
+	ERASE_OPEN = 1,	   // Start the SD card after its power up time and open the root folder
+	ERASE_FILE = 2,	   // Remove one file
+	ERASE_REBOOT = 3   // All files removed
+};
+
+/** Root folder while erasing the SD card */
+static File erase_dir;
+
 /**
- * @brief Erase all files on the SD card
+ * @brief Step of the SD card erase job, removes one file per step
  *
+ * @param job SD card erase job
+ * @return true erase finished
+ * @return false more steps to come
  */
-void clear_sd_file(void)
+static bool sd_erase_step(job_s *job)
 {
-	digitalWrite(WB_IO2, HIGH);
-	delay(50);
-
-	// Just to be sure
-	SD.end();
-
-	SD.begin(WB_SPI_CS);
-
-	File dir = SD.open("/", FILE_READ);
-	if (dir)
+	switch (job->state)
 	{
-		while (true)
+	case ERASE_WAIT_TX:
+		if (!ready_to_dump)
 		{
-			log_file = dir.openNextFile();
-			if (!log_file)
-			{
-				// no more files
-				MYLOG("SD", "No more files");
-				break;
-			}
-			if (!log_file.isDirectory())
+			if ((millis() - job->started) > (2 * SD_JOB_WAIT_TX))
 			{
-				char *last_file_name = log_file.name();
-				SD.remove((const char *)last_file_name);
+				sd_job_failed(job, "Erase");
+				return true;
 			}
-			log_file.close();
+			job_sleep(job, 100);
+			break;
 		}
-		dir.close();
-	}
-	else
-	{
-		MYLOG("SD", "Can't open root");
+		rail_power(true);
+		job->state = ERASE_OPEN;
+		// Power up time of the SD card
+		job_sleep(job, 50);
+		break;
+	case ERASE_OPEN:
+		// Just to be sure
+		SD.end();
+		SD.begin(WB_SPI_CS);
+		erase_dir = SD.open("/", FILE_READ);
+		if (!erase_dir)
+		{
+			MYLOG("SD", "Can't open root");
+			SD.end();
+			job->state = ERASE_REBOOT;
+			break;
+		}
+		job->state = ERASE_FILE;
+		break;
+	case ERASE_FILE:
+		log_file = erase_dir.openNextFile();
+		if (!log_file)
+		{
+			// no more files
+			MYLOG("SD", "No more files");
+			erase_dir.close();
+			SD.end();
+			job->state = ERASE_REBOOT;
+			break;
+		}
+		if (!log_file.isDirectory())
+		{
+			char *last_file_name = log_file.name();
+			SD.remove((const char *)last_file_name);
+			job->progress++;
+		}
+		log_file.close();
+		break;
+	default:
+		sd_job_reboot();
+		return true;
 	}
-	SD.end();
+	return false;
+}
+
+/** SD card erase job */
+static job_s sd_erase_job = {"sd_erase", sd_erase_step};
+
+/**
+ * @brief Start erasing all files on the SD card, the device reboots when finished
+ *        Waits for the current test cycle to finish first
+ *
+ * @return true erase started
+ * @return false erase could not be started
+ */
+bool sd_erase_start(void)
+{
+	return job_start(&sd_erase_job);
+}
+
+/**
+ * @brief Check if the SD card is used by the dump or erase job
+ *        Other SD card access would close the files of the job and change file_name
+ *
+ * @return true SD card job is running
+ * @return false SD card is free
+ */
+bool sd_busy(void)
+{
+	return sd_dump_job.active || sd_erase_job.active;
 }
 
 /**
@@ -302,7 +467,12 @@ void clear_sd_file(void)
  */
 bool create_sd_file(void)
 {
-	digitalWrite(WB_IO2, HIGH);
+	if (sd_busy())
+	{
+		MYLOG("SD", "SD card busy, no new file");
+		return false;
+	}
+	rail_power(true);
 	delay(50);
 
 	SD.begin(WB_SPI_CS);
@@ -418,8 +588,17 @@ bool create_sd_file(void)
  */
 void write_sd_entry(void)
 {
+	if (sd_busy())
+	{
+		MYLOG("SD", "SD card busy, entry skipped");
+		ready_to_dump = true;
+		cycle_event(CEV_LOGGED);
+		return;
+	}
+	trace_add(TEV_SD_BEGIN, lines_written);
+	energy_state(EN_SD, true);
 
-	digitalWrite(WB_IO2, HIGH);
+	rail_power(true);
 	delay(50);
 
 	SD.begin(WB_SPI_CS);
@@ -438,75 +617,7 @@ void write_sd_entry(void)
 	if (log_file)
 	{
 		sd_card_error = false;
-		size_t bytes_to_write = 0;
-		if (g_custom_parameters.test_mode == MODE_LINKCHECK)
-		{
-			if (g_custom_parameters.location_on)
-			{
-				// log_file.println("\"time\";\"Mode\";\"Gw\";\"Lat\";\"Lng\";\"RX RSSI\";\"RX SNR\";\"Demod\";\"TX DR\";\"Lost\"");
-				bytes_to_write = snprintf(line_entry, 511, "%04d-%02d-%02d %02d:%02d:%02d;%d;%d;%.6f;%.6f;%d;%d;%d;%d;%d",
-										  result.year, result.month, result.day, result.hour, result.min, result.sec,
-										  result.mode, result.gw,
-										  result.lat, result.lng,
-										  result.rx_rssi,
-										  result.rx_snr,
-										  result.demod, result.tx_dr, result.lost);
-			}
-			else
-			{
-				// log_file.println("\"time\";\"Mode\";\"Gw\";\"RX RSSI\";\"RX SNR\";\"Demod\";\"TX DR\";\"Lost\"");
-				bytes_to_write = snprintf(line_entry, 511, "%04d-%02d-%02d %02d:%02d:%02d;%d;%d;%d;%d;%d;%d;%d",
-										  result.year, result.month, result.day, result.hour, result.min, result.sec,
-										  result.mode, result.gw,
-										  result.rx_rssi,
-										  result.rx_snr,
-										  result.demod, result.tx_dr, result.lost);
-			}
-		}
-		else if (g_custom_parameters.test_mode == MODE_FIELDTESTER)
-		{
-			// log_file.println("\"time\";\"Mode\";\"Gw\";\"Lat\";\"Lng\";\"min RSSI\";\"max RSSI\";\"RX RSSI\";\"RX SNR\";\"min Dist\";\"max Dist\";\"TX DR\";\"Lost\"");
-			bytes_to_write = snprintf(line_entry, 511, "%04d-%02d-%02d %02d:%02d:%02d;%d;%d;%.6f;%.6f;%d;%d;%d;%d;%d;%d;%d;%d",
-									  result.year, result.month, result.day, result.hour, result.min, result.sec,
-									  result.mode, result.gw,
-									  result.lat, result.lng,
-									  result.min_rssi, result.max_rssi, result.rx_rssi,
-									  result.rx_snr,
-									  result.min_dst, result.max_dst, result.tx_dr, result.lost);
-		}
-		else if (g_custom_parameters.test_mode == MODE_FIELDTESTER_V2)
-		{
-			// log_file.println("\"time\";\"Mode\";\"Gw\";\"Lat\";\"Lng\";\"max RSSI\";\"max SNR\";\"RX RSSI\";\"RX SNR\";\"min Dist\";\"max Dist\";\"TX DR\";\"PLR\"");
-			bytes_to_write = snprintf(line_entry, 511, "%04d-%02d-%02d %02d:%02d:%02d;%d;%d;%.6f;%.6f;%d;%d;%d;%d;%d;%d;%d;%.1f",
-									  result.year, result.month, result.day, result.hour, result.min, result.sec,
-									  result.mode, result.gw,
-									  result.lat, result.lng,
-									  result.max_rssi, result.max_snr, result.rx_rssi,
-									  result.rx_snr,
-									  result.min_dst, result.max_dst, result.tx_dr, (float)result.lost / 10.0f);
-		}
-		else // LoRa P2P
-		{
-			if (g_custom_parameters.location_on)
-			{
-				// log_file.println("\"time\";\"Mode\";\"Lat\";\"Lng\";\"RX RSSI\";\"RX SNR\"");
-				bytes_to_write = snprintf(line_entry, 511, "%04d-%02d-%02d %02d:%02d:%02d;%d;%.6f;%.6f;%d;%d",
-										  result.year, result.month, result.day, result.hour, result.min, result.sec,
-										  result.mode,
-										  result.lat, result.lng,
-										  result.rx_rssi,
-										  result.rx_snr);
-			}
-			else
-			{
-				// log_file.println("\"time\";\"Mode\";\"RX RSSI\";\"RX SNR\"");
-				bytes_to_write = snprintf(line_entry, 511, "%04d-%02d-%02d %02d:%02d:%02d;%d;%d;%d",
-										  result.year, result.month, result.day, result.hour, result.min, result.sec,
-										  result.mode,
-										  result.rx_rssi,
-										  result.rx_snr);
-			}
-		}
+		size_t bytes_to_write = log_format_entry(line_entry, 511, result, g_custom_parameters.test_mode, g_custom_parameters.location_on);
 
 		MYLOG("SD", "Writing:\r\n%s", line_entry);
 		size_t written = log_file.println(line_entry);
@@ -533,6 +644,8 @@ void write_sd_entry(void)
 	}
 
 	SD.end();
+	trace_add(TEV_SD_END, !sd_card_error, lines_written);
+	energy_state(EN_SD, false);
 
 	if (lines_written == 300)
 	{
@@ -541,6 +654,89 @@ void write_sd_entry(void)
 	}
 
 	ready_to_dump = true;
+	cycle_event(CEV_LOGGED);
 
 	return;
-}
\ No newline at end of file
+}
+/**
+ * @brief Append a table to a file on the SD card
+ * 		The header is written if the file is new
+ *
+ * @param path file name
+ * @param header header line
+ * @param table table lines, each line terminated with \r\n
+ * @return true table written
+ * @return false file could not be written or SD card busy
+ */
+bool write_sd_table(const char *path, const char *header, const char *table)
+{
+	if (sd_busy())
+	{
+		MYLOG("SD", "SD card busy, %s not written", path);
+		return false;
+	}
+	rail_power(true);
+	delay(50);
+
+	SD.begin(WB_SPI_CS);
+
+	bool new_file = !SD.exists(path);
+	File table_file = SD.open(path, FILE_WRITE);
+	if (!table_file)
+	{
+		MYLOG("SD", "Error writing to %s", path);
+		SD.end();
+		return false;
+	}
+	if (new_file)
+	{
+		table_file.println(header);
+	}
+	size_t bytes_to_write = strlen(table);
+	bool result = table_file.write((const uint8_t *)table, bytes_to_write) == bytes_to_write;
+	table_file.flush();
+	table_file.close();
+	SD.end();
+	return result;
+}
+
+/**
+ * @brief Append lines to a file on the SD card
+ *
+ * @param path file name
+ * @param format line formatter, returns the length of line idx or -1 after the last line
+ * @return true lines written
+ * @return false file could not be opened or written or SD card busy
+ */
+bool write_sd_lines(const char *path, int (*format)(uint8_t idx, char *line, size_t size))
+{
+	if (sd_busy())
+	{
+		MYLOG("SD", "SD card busy, %s not written", path);
+		return false;
+	}
+	rail_power(true);
+	delay(50);
+
+	SD.begin(WB_SPI_CS);
+
+	File lines_file = SD.open(path, FILE_WRITE);
+	if (!lines_file)
+	{
+		MYLOG("SD", "Error writing to %s", path);
+		SD.end();
+		return false;
+	}
+	bool result = true;
+	char line[128];
+	int len;
+	for (uint8_t idx = 0; (len = format(idx, line, sizeof(line))) >= 0; idx++)
+	{
+		result &= lines_file.write((const uint8_t *)line, len) == (size_t)len;
+		result &= lines_file.println() == 2;
+	}
+	lines_file.flush();
+	lines_file.close();
+	SD.end();
+	return result;
+}
@@ -0,0 +1,51 @@
+/**
+ * @file settings.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Settings structure saved in flash and the test modes
+ *        No Arduino dependencies, the host benchmarks use the same structure for the settings CRC.
+ * @version 0.1
+ * @date 2025-01-20
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stdint.h>
+
+/** Custom flash parameters structure */
+struct custom_param_s
+{
+	uint32_t settings_crc = 0;
+	uint32_t send_interval = 30000;
+	uint8_t valid_flag = 0xAA;
+	uint8_t test_mode = 0;
+	bool display_saver = true;
+	bool location_on = false;
+	uint8_t custom_packet[129] = {0x01, 0x02, 0x03, 0x04};
+	uint16_t custom_packet_len = 4;
+	bool dr_sweep_on = false;
+	int8_t timezone = 8;
+	uint32_t mesh_check_node = 0;
+	uint8_t batch_samples = 1;
+	bool auto_interval = false;
+	uint16_t fair_use_s = 30;
+	uint8_t sweep_count = 1;
+	uint8_t sweep_fail_stop = 3;
+	bool fragment_on = false;
+};
+// Structure size without CRC
+#define custom_params_len sizeof(custom_param_s)
+
+typedef enum test_mode_num
+{
+	MODE_LINKCHECK = 0,
+	MODE_P2P = 1,
+	MODE_FIELDTESTER = 2,
+	MODE_FIELDTESTER_V2 = 3,
+	MODE_MESHTASTIC = 4,
+	INVALID_MODE = 5
+} test_mode_num_t;
+
+#endif // SETTINGS_H
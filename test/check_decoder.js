@@ -0,0 +1,91 @@
+// Compare the field tables and the decoder in chirpstack-decoder.js with payload_codec.h
+// The tables, random payloads with the values decoded by the firmware codec, a batched uplink and fragments come from ./test_codec --json
+// Usage: node check_decoder.js (in the test folder, after make test_codec)
+var fs = require('fs');
+var vm = require('vm');
+var path = require('path');
+var execFileSync = require('child_process').execFileSync;
+
+var decoder = {};
+vm.createContext(decoder);
+vm.runInContext(fs.readFileSync(path.join(__dirname, '..', 'chirpstack-decoder.js'), 'utf8'), decoder);
+
+var firmware = JSON.parse(execFileSync(path.join(__dirname, 'test_codec'), ['--json'], { encoding: 'utf8' }));
+
+// Firmware format and the matching table of the decoder
+var formats = {
+	ft_v1: 'ftV1Fields',
+	batch_head: 'batchHeadFields',
+	batch_key: 'batchKeyFields',
+	batch_delta: 'batchDeltaFields',
+	frag_head: 'fragHeadFields'
+};
+var keys = ['type', 'bitPos', 'bits', 'signBit', 'offset', 'scale'];
+
+var checks = 0;
+var failed = 0;
+function check(cond, text) {
+	checks++;
+	if (!cond) {
+		failed++;
+		console.log('check_decoder: ' + text);
+	}
+}
+
+for (var format in formats) {
+	var fields = firmware[format].fields;
+	var table = decoder[formats[format]];
+	check(table !== undefined, formats[format] + ' missing');
+	if (table === undefined) {
+		continue;
+	}
+	check(table.length === fields.length, formats[format] + ' has ' + table.length + ' fields, ' + format + ' has ' + fields.length);
+	for (var idx = 0; idx < Math.min(table.length, fields.length); idx++) {
+		for (var key = 0; key < keys.length; key++) {
+			check(table[idx][keys[key]] === fields[idx][keys[key]], formats[format] + '[' + idx + '].' + keys[key] + ' is ' +
+				table[idx][keys[key]] + ', ' + format + ' has ' + fields[idx][keys[key]]);
+		}
+	}
+	var vectors = firmware[format].vectors;
+	for (var vector = 0; vector < vectors.length; vector++) {
+		var values = decoder.decodeFields(table, vectors[vector].bytes);
+		for (idx = 0; idx < table.length; idx++) {
+			var value = Math.round(values[table[idx].name] * table[idx].divisor);
+			check(value === vectors[vector].values[idx], formats[format] + ' ' + table[idx].name + ' of [' + vectors[vector].bytes +
+				'] is ' + value + ', firmware decodes ' + vectors[vector].values[idx]);
+		}
+	}
+}
+
+// Batched uplink, positions and ages of the points
+var batch = firmware.batch;
+var decoded = decoder.Decode(3, batch.bytes, {});
+check(decoded.rssi === batch.rssi && decoded.snr === batch.snr && decoded.gateways === batch.gateways,
+	'batch LinkCheck result is ' + decoded.rssi + '/' + decoded.snr + '/' + decoded.gateways);
+check(decoded.points.length === batch.points.length, 'batch has ' + decoded.points.length + ' points, expected ' + batch.points.length);
+for (idx = 0; idx < Math.min(decoded.points.length, batch.points.length); idx++) {
+	var point = decoded.points[idx];
+	var expected = batch.points[idx];
+	check((Math.round(point.latitude * 10000000) === expected[0]) && (Math.round(point.longitude * 10000000) === expected[1]) &&
+		(point.altitude === expected[2]) && (point.age === expected[3]), 'batch point ' + idx + ' is ' + JSON.stringify(point) +
+		', expected ' + expected);
+}
+
+// Fragments in random order with a repeated fragment, decoded one by one and put together
+var fragments = firmware.fragments;
+var frames = [];
+for (idx = 0; idx < fragments.frames.length; idx++) {
+	frames.push(decoder.Decode(4, fragments.frames[idx], {}));
+}
+var packets = decoder.reassembleFragments(frames);
+check(packets.complete.length === 1, packets.complete.length + ' complete packets, expected 1');
+if (packets.complete.length === 1) {
+	check(packets.complete[0].id === fragments.complete.id, 'complete packet id ' + packets.complete[0].id + ', expected ' + fragments.complete.id);
+	check(packets.complete[0].payload === fragments.complete.payload, 'complete packet is ' + packets.complete[0].payload +
+		', expected ' + fragments.complete.payload);
+}
+check((packets.incomplete.length === 1) && (packets.incomplete[0] === fragments.incomplete),
+	'incomplete packets ' + packets.incomplete + ', expected ' + fragments.incomplete);
+
+console.log('check_decoder: ' + checks + ' checks, ' + failed + ' failed');
+process.exit(failed === 0 ? 0 : 1);
@@ -0,0 +1,110 @@
+/**
+ * @file host_bench.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Host benchmarks, same kernels and JSON format as ATC+BENCH
+ *        The kernels of bench_kernels.h run with 10 times the iterations of the device, then the scheduler
+ *        with task counts that do not fit on the device. The kernels and the order of the results do not change between runs.
+ * @version 0.1
+ * @date 2025-01-15
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <array>
+#include <chrono>
+#include <utility>
+#include "Arduino.h"
+#define BENCH_ITER_SCALE 10
+#include "bench_kernels.h"
+
+/** Max number of dummy tasks */
+#define BENCH_MAX_TASKS 512
+
+template <size_t... N>
+static constexpr std::array<MillisTaskManager::TaskFunction_t, sizeof...(N)> bench_task_table(std::index_sequence<N...>)
+{
+	return {bench_task<N>...};
+}
+
+/** Dummy task functions */
+static const auto bench_tasks = bench_task_table(std::make_index_sequence<BENCH_MAX_TASKS>());
+
+/** Static task nodes of the dummy tasks */
+static MillisTaskManager::Task_t bench_host_nodes[BENCH_MAX_TASKS];
+
+/** Task manager under test with more tasks */
+static MillisTaskManager *bench_host_mtm;
+
+static uint32_t bench_host_mtm_running(uint32_t iter)
+{
+	bench_host_mtm->Running(iter);
+	return 0;
+}
+
+static uint32_t bench_host_mtm_deadline(uint32_t iter)
+{
+	bench_sink += bench_host_mtm->NextDeadline(iter);
+	return 0;
+}
+
+/** Separator of the result list */
+static const char *bench_sep = "";
+
+/**
+ * @brief Run a kernel and print its result as JSON object
+ *
+ * @param kernel benchmark kernel
+ */
+static void bench_run(const bench_kernel_s *kernel)
+{
+	uint64_t bytes = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t iter = 0; iter < kernel->iterations; iter++)
+	{
+		bytes += kernel->run(iter);
+	}
+	auto time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	printf("%s\n{\"name\":\"%s\",\"iter\":%u,\"ns_op\":%u,\"bytes_op\":%u}", bench_sep, kernel->name, kernel->iterations,
+		   (uint32_t)(time_ns / kernel->iterations), (uint32_t)(bytes / kernel->iterations));
+	bench_sep = ",";
+}
+
+/**
+ * @brief Scheduler benchmarks with a number of tasks
+ *
+ * @param num_tasks number of registered tasks
+ */
+static void bench_mtm_tasks(int num_tasks)
+{
+	bench_host_mtm = new MillisTaskManager();
+	for (int idx = 0; idx < num_tasks; idx++)
+	{
+		bench_host_mtm->Register(&bench_host_nodes[idx], bench_tasks[idx], bench_intervals[idx % 8]);
+	}
+	char name[32];
+	bench_kernel_s kernel;
+	kernel.name = name;
+	kernel.iterations = 10000;
+	snprintf(name, sizeof(name), "mtm_running_%d", num_tasks);
+	kernel.run = bench_host_mtm_running;
+	bench_run(&kernel);
+	snprintf(name, sizeof(name), "mtm_next_deadline_%d", num_tasks);
+	kernel.run = bench_host_mtm_deadline;
+	bench_run(&kernel);
+	delete bench_host_mtm;
+}
+
+int main(void)
+{
+	printf("{\"bench\":1,\"fw\":\"host\",\"results\":[");
+	bench_setup();
+	for (size_t idx = 0; idx < BENCH_NUM; idx++)
+	{
+		bench_run(&bench_kernels[idx]);
+	}
+	bench_mtm_tasks(64);
+	bench_mtm_tasks(256);
+	bench_mtm_tasks(512);
+	printf("]}\n");
+	return 0;
+}
@@ -0,0 +1,58 @@
+/**
+ * @file host_test.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Check macros of the host tests
+ *        A failed check prints the location, main() returns the number of failed checks
+ * @version 0.1
+ * @date 2025-01-15
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+
+/** Number of failed checks */
+static int test_failed = 0;
+/** Number of checks */
+static int test_checks = 0;
+
+#define CHECK(cond)                                                           \
+	do                                                                        \
+	{                                                                         \
+		test_checks++;                                                        \
+		if (!(cond))                                                          \
+		{                                                                     \
+			test_failed++;                                                    \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		}                                                                     \
+	} while (0)
+
+#define CHECK_EQ(a, b)                                                                           \
+	do                                                                                           \
+	{                                                                                            \
+		test_checks++;                                                                           \
+		long long _a = (long long)(a);                                                           \
+		long long _b = (long long)(b);                                                           \
+		if (_a != _b)                                                                            \
+		{                                                                                        \
+			test_failed++;                                                                       \
+			printf("%s:%d: check failed: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+		}                                                                                        \
+	} while (0)
+
+/**
+ * @brief Print the result of a test program
+ *
+ * @param name name of the test program
+ * @return int number of failed checks, exit code of main()
+ */
+static inline int test_result(const char *name)
+{
+	printf("%s: %d checks, %d failed\n", name, test_checks, test_failed);
+	return test_failed;
+}
+
+#endif // HOST_TEST_H
@@ -0,0 +1,14 @@
+/**
+ * @file Arduino.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Virtual clock of the Arduino shim
+ * @version 0.1
+ * @date 2025-01-15
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "Arduino.h"
+
+/** Virtual time in microseconds */
+uint64_t host_time_us = 0;
@@ -0,0 +1,36 @@
+/**
+ * @file Arduino.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Minimal Arduino shim for the host tests and benchmarks
+ *        millis() and micros() follow a virtual clock that the tests set and advance
+ * @version 0.1
+ * @date 2025-01-15
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+/** Virtual time in microseconds */
+extern uint64_t host_time_us;
+
+static inline uint32_t millis(void) { return (uint32_t)(host_time_us / 1000); }
+static inline uint32_t micros(void) { return (uint32_t)host_time_us; }
+static inline void delay(uint32_t ms) { host_time_us += (uint64_t)ms * 1000; }
+static inline void noInterrupts(void) {}
+static inline void interrupts(void) {}
+
+/**
+ * @brief Set the virtual clock
+ *
+ * @param ms new millis() value
+ */
+static inline void host_set_millis(uint32_t ms) { host_time_us = (uint64_t)ms * 1000; }
+
+#endif // HOST_ARDUINO_H
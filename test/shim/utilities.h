@@ -0,0 +1,43 @@
+/**
+ * @file utilities.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Host version of the RUI3 utilities used by the firmware
+ *        Crc32 is the same CRC-32 (reflected polynomial 0xEDB88320) as the one of RUI3
+ * @version 0.1
+ * @date 2025-01-20
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef HOST_UTILITIES_H
+#define HOST_UTILITIES_H
+
+#include <stdint.h>
+
+/**
+ * @brief CRC-32 of a buffer
+ *
+ * @param buffer data
+ * @param length number of bytes
+ * @return uint32_t CRC
+ */
+static inline uint32_t Crc32(uint8_t *buffer, uint16_t length)
+{
+	const uint32_t reversed_polynom = 0xEDB88320;
+	uint32_t crc = 0xFFFFFFFF;
+	if (buffer == nullptr)
+	{
+		return 0;
+	}
+	for (uint16_t i = 0; i < length; ++i)
+	{
+		crc ^= (uint32_t)buffer[i];
+		for (uint16_t j = 0; j < 8; j++)
+		{
+			crc = (crc >> 1) ^ (reversed_polynom & ~((crc & 0x01) - 1));
+		}
+	}
+	return ~crc;
+}
+
+#endif // HOST_UTILITIES_H
@@ -0,0 +1,385 @@
+/**
+ * @file test_clock_sim.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Host test, virtual clock simulation of the task manager, periodic timers and the test cycle
+ *        The virtual clock starts before the uint32_t millis() wraparound and jumps from deadline to deadline,
+ *        months of operation run in seconds. Checks that periodic tasks and timers do not drift, starve or double-fire.
+ *        The virtual timers follow the semantics of the RAK timers, periodic timers reload from the expiry.
+ * @version 0.1
+ * @date 2025-01-10
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "Arduino.h"
+#include "MillisTaskManager.h"
+#include "test_cycle.h"
+#include "host_test.h"
+#include <string.h>
+
+/** Length of a day in ms */
+#define SIM_DAY_MS 86400000UL
+
+/** Number of simulated tasks */
+#define SIM_NUM_TASKS 4
+
+/** Timers of the simulation */
+typedef enum sim_timer_num
+{
+	SIM_SEND = 0,	 // Periodic send timer
+	SIM_TX_DONE = 1, // Fake radio TX done
+	SIM_RX = 2,		 // Fake radio LinkCheck answer
+	SIM_LOGGED = 3,	 // SD card entry written
+	SIM_SHOWN = 4,	 // Display updated
+	SIM_NUM_TIMERS = 5
+} sim_timer_num_t;
+
+/** Virtual timer, same semantics as the RAK timers, periodic timers reload from the expiry */
+struct sim_timer_s
+{
+	bool active;
+	bool periodic;
+	uint32_t due;
+	uint32_t period;
+};
+
+/** Run statistics of a task or timer */
+struct sim_stats_s
+{
+	uint32_t interval;
+	uint32_t runs;
+	uint32_t last;
+	uint32_t min_gap;
+	uint32_t max_gap;
+};
+
+/** Task intervals, send interval and fake radio delays in ms */
+static const uint32_t sim_intervals[SIM_NUM_TASKS] = {10000, 60000, 900000, 3600000};
+#define SIM_SEND_INTERVAL 120000
+#define SIM_TX_TIME 1500
+#define SIM_RX_TIME 2000
+#define SIM_LOG_TIME 250
+#define SIM_SHOW_TIME 100
+/** Every n-th LinkCheck answer is lost */
+#define SIM_LOST_EVERY 10
+/** Max delay of the main loop after a deadline */
+#define SIM_MAX_JITTER 50
+
+/** Virtual clock */
+static uint32_t sim_now = 0;
+
+/** Virtual timers */
+static sim_timer_s sim_timers[SIM_NUM_TIMERS];
+
+/** Statistics of the tasks, the last entry is the send timer */
+static sim_stats_s sim_stats[SIM_NUM_TASKS + 1];
+
+/** Task manager of the simulation */
+static MillisTaskManager sim_mtm;
+
+/** Static task nodes of the simulated tasks */
+static MillisTaskManager::Task_t sim_nodes[SIM_NUM_TASKS];
+
+/** Test cycle of the simulation */
+static cycle_sm_s sim_cycle;
+
+/** Number of sent packets and of lost LinkCheck answers */
+static uint32_t sim_sent = 0;
+static uint32_t sim_lost = 0;
+
+/** Random generator state, fixed seed for reproducible runs */
+static uint32_t sim_seed = 1;
+
+/** Simulated days */
+static uint16_t sim_days = 0;
+
+/**
+ * @brief Pseudo random number
+ *
+ * @return uint32_t random number
+ */
+static uint32_t sim_rand(void)
+{
+	sim_seed = sim_seed * 1103515245 + 12345;
+	return sim_seed >> 16;
+}
+
+/**
+ * @brief Record a run of a task or timer
+ *
+ * @param stats statistics of the task or timer
+ */
+static void sim_record(sim_stats_s *stats)
+{
+	if (stats->runs != 0)
+	{
+		uint32_t gap = sim_now - stats->last;
+		if (gap < stats->min_gap)
+		{
+			stats->min_gap = gap;
+		}
+		if (gap > stats->max_gap)
+		{
+			stats->max_gap = gap;
+		}
+	}
+	stats->last = sim_now;
+	stats->runs++;
+}
+
+/**
+ * @brief Simulated task
+ *
+ * @tparam N task number, each task needs its own function
+ */
+template <int N>
+static void sim_task(void)
+{
+	sim_record(&sim_stats[N]);
+}
+
+/**
+ * @brief Start a virtual timer
+ *
+ * @param id timer
+ * @param ms period
+ * @param periodic true for a periodic timer
+ */
+static void sim_timer_start(uint8_t id, uint32_t ms, bool periodic)
+{
+	sim_timers[id].active = true;
+	sim_timers[id].periodic = periodic;
+	sim_timers[id].due = sim_now + ms;
+	sim_timers[id].period = ms;
+}
+
+/**
+ * @brief Handle an expired virtual timer, the fake radio and display of one LinkCheck cycle
+ *
+ * @param id timer
+ */
+static void sim_timer_fired(uint8_t id)
+{
+	switch (id)
+	{
+	case SIM_SEND:
+		sim_record(&sim_stats[SIM_NUM_TASKS]);
+		cycle_sm_event(&sim_cycle, CEV_START, sim_now);
+		sim_sent++;
+		sim_timer_start(SIM_TX_DONE, SIM_TX_TIME, false);
+		break;
+	case SIM_TX_DONE:
+		cycle_sm_event(&sim_cycle, CEV_TX_DONE, sim_now);
+		if ((sim_sent % SIM_LOST_EVERY) == 0)
+		{
+			// No answer, the wait_rx stage times out
+			sim_lost++;
+			break;
+		}
+		sim_timer_start(SIM_RX, SIM_RX_TIME - SIM_TX_TIME, false);
+		break;
+	case SIM_RX:
+		cycle_sm_event(&sim_cycle, CEV_RX, sim_now);
+		sim_timer_start(SIM_LOGGED, SIM_LOG_TIME, false);
+		break;
+	case SIM_LOGGED:
+		cycle_sm_event(&sim_cycle, CEV_LOGGED, sim_now);
+		sim_timer_start(SIM_SHOWN, SIM_SHOW_TIME, false);
+		break;
+	case SIM_SHOWN:
+		cycle_sm_event(&sim_cycle, CEV_SHOWN, sim_now);
+		break;
+	}
+}
+
+/**
+ * @brief Time until the next virtual timer expires
+ *
+ * @return uint32_t time in ms, 0xFFFFFFFF if no timer is active
+ */
+static uint32_t sim_timer_next(void)
+{
+	uint32_t wait = 0xFFFFFFFF;
+	for (uint8_t idx = 0; idx < SIM_NUM_TIMERS; idx++)
+	{
+		if (!sim_timers[idx].active)
+		{
+			continue;
+		}
+		int32_t left = (int32_t)(sim_timers[idx].due - sim_now);
+		if (left <= 0)
+		{
+			return 0;
+		}
+		if ((uint32_t)left < wait)
+		{
+			wait = left;
+		}
+	}
+	return wait;
+}
+
+/**
+ * @brief Run the simulation
+ *        The virtual clock starts so that the millis() wraparound is in the middle of the simulated time.
+ *        After each deadline the main loop is delayed by a random time up to SIM_MAX_JITTER.
+ *
+ * @param days simulated time in days
+ * @param seed random seed
+ */
+static void clock_sim_run(uint16_t days, uint32_t seed)
+{
+	uint64_t total = (uint64_t)days * SIM_DAY_MS;
+	sim_days = days;
+	sim_seed = seed;
+	sim_sent = 0;
+	sim_lost = 0;
+	sim_now = (uint32_t)(0 - (total / 2));
+
+	memset(sim_timers, 0, sizeof(sim_timers));
+	for (uint8_t idx = 0; idx <= SIM_NUM_TASKS; idx++)
+	{
+		sim_stats[idx].interval = idx < SIM_NUM_TASKS ? sim_intervals[idx] : SIM_SEND_INTERVAL;
+		sim_stats[idx].runs = 0;
+		sim_stats[idx].min_gap = 0xFFFFFFFF;
+		sim_stats[idx].max_gap = 0;
+	}
+	sim_mtm.Register(&sim_nodes[0], sim_task<0>, sim_intervals[0]);
+	sim_mtm.Register(&sim_nodes[1], sim_task<1>, sim_intervals[1]);
+	sim_mtm.Register(&sim_nodes[2], sim_task<2>, sim_intervals[2]);
+	sim_mtm.Register(&sim_nodes[3], sim_task<3>, sim_intervals[3]);
+	cycle_sm_init(&sim_cycle, &cycle_linkcheck_table, sim_now);
+	sim_timer_start(SIM_SEND, SIM_SEND_INTERVAL, true);
+
+	uint64_t elapsed = 0;
+	while (elapsed < total)
+	{
+		// Sleep until the next deadline, the main loop is late by a random time
+		uint32_t wait = sim_mtm.NextDeadline(sim_now);
+		uint32_t timer_wait = sim_timer_next();
+		uint32_t cycle_wait = cycle_sm_next_timeout(&sim_cycle, sim_now);
+		if (timer_wait < wait)
+		{
+			wait = timer_wait;
+		}
+		if (cycle_wait < wait)
+		{
+			wait = cycle_wait;
+		}
+		if (wait != 0)
+		{
+			wait += sim_rand() % SIM_MAX_JITTER;
+		}
+		sim_now += wait;
+		elapsed += wait;
+
+		for (uint8_t idx = 0; idx < SIM_NUM_TIMERS; idx++)
+		{
+			if (sim_timers[idx].active && ((int32_t)(sim_timers[idx].due - sim_now) <= 0))
+			{
+				if (sim_timers[idx].periodic)
+				{
+					sim_timers[idx].due += sim_timers[idx].period;
+				}
+				else
+				{
+					sim_timers[idx].active = false;
+				}
+				sim_timer_fired(idx);
+			}
+		}
+		cycle_sm_check(&sim_cycle, sim_now);
+		sim_mtm.Running(sim_now);
+	}
+	for (uint8_t idx = 0; idx < SIM_NUM_TASKS; idx++)
+	{
+		sim_mtm.Logout(sim_nodes[idx].Function);
+	}
+}
+
+/**
+ * @brief Format the result of the simulation
+ *        Tasks and send timer <name>:<interval ms>:<runs>:<expected runs>:<min gap ms>:<max gap ms>:<OK|FAIL>
+ *        Test cycle cycle:<sent>:<lost>:<wait_rx timeouts>:<other timeouts>:<OK|FAIL>
+ *
+ * @param idx line index
+ * @param line output buffer
+ * @param size size of the output buffer
+ * @return int length of the line, -1 after the last line
+ */
+static int clock_sim_format(uint8_t idx, char *line, size_t size)
+{
+	uint64_t total = (uint64_t)sim_days * SIM_DAY_MS;
+	if (idx <= SIM_NUM_TASKS)
+	{
+		sim_stats_s *stats = &sim_stats[idx];
+		uint32_t expected = (uint32_t)(total / stats->interval);
+		bool ok = stats->max_gap <= (stats->interval + SIM_MAX_JITTER);
+		if (idx < SIM_NUM_TASKS)
+		{
+			// Tasks restart the interval when they run, the delay of the main loop adds up
+			ok = ok && (stats->min_gap >= stats->interval);
+			ok = ok && (stats->runs >= (uint32_t)(total / (stats->interval + SIM_MAX_JITTER))) && (stats->runs <= (expected + 1));
+		}
+		else
+		{
+			// Periodic timers reload from the expiry, no drift
+			ok = ok && (stats->min_gap >= (stats->interval - SIM_MAX_JITTER));
+			ok = ok && (stats->runs >= expected - 1) && (stats->runs <= expected);
+		}
+		return snprintf(line, size, "%s%d:%u:%u:%u:%u:%u:%s", idx < SIM_NUM_TASKS ? "task" : "timer", idx,
+						stats->interval, stats->runs, expected, stats->min_gap, stats->max_gap, ok ? "OK" : "FAIL");
+	}
+	if (idx == (SIM_NUM_TASKS + 1))
+	{
+		uint32_t other = 0;
+		for (uint8_t state = 0; state < CYCLE_NUM_STATES; state++)
+		{
+			if (state != CYCLE_WAIT_RX)
+			{
+				other += sim_cycle.timeouts[state];
+			}
+		}
+		// Each lost answer times out once, except a cycle that is still waiting at the end
+		uint32_t lost_timeouts = sim_cycle.timeouts[CYCLE_WAIT_RX];
+		bool ok = (other == 0) && (lost_timeouts <= sim_lost) && ((lost_timeouts + 1) >= sim_lost);
+		return snprintf(line, size, "cycle:%u:%u:%u:%u:%s", sim_sent, sim_lost, lost_timeouts, other, ok ? "OK" : "FAIL");
+	}
+	return -1;
+}
+
+/**
+ * @brief Run the simulation and check the result lines
+ *
+ * @param days simulated time in days
+ * @param seed random seed
+ */
+static void test_sim(uint16_t days, uint32_t seed)
+{
+	char line[80];
+	clock_sim_run(days, seed);
+	for (uint8_t idx = 0; clock_sim_format(idx, line, sizeof(line)) >= 0; idx++)
+	{
+		size_t len = strlen(line);
+		bool ok = (len > 3) && (strcmp(&line[len - 3], ":OK") == 0);
+		CHECK(ok);
+		if (!ok)
+		{
+			printf("%d days, seed %u: %s\n", days, seed, line);
+		}
+	}
+}
+
+int main(void)
+{
+	// Short runs around the wraparound, then more than 8 wraparounds of millis()
+	static const uint16_t days[] = {1, 7, 60, 400};
+	for (uint8_t idx = 0; idx < sizeof(days) / sizeof(days[0]); idx++)
+	{
+		for (uint32_t seed = 1; seed <= 3; seed++)
+		{
+			test_sim(days[idx], seed);
+		}
+	}
+	return test_result("test_clock_sim");
+}
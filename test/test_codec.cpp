@@ -0,0 +1,482 @@
+/**
+ * @file test_codec.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Host test of the payload codecs
+ *        Randomized round trips of all formats, values in range, clamped values and random payloads.
+ *        Fragment round trips with DR changes and fragments refused by the stack.
+ *        With the argument --json the field tables, random payloads with the decoded values, a batched uplink
+ *        and fragments of two packets are printed as JSON, check_decoder.js compares them with the tables and the decoder in chirpstack-decoder.js.
+ * @version 0.1
+ * @date 2025-01-16
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "payload_codec.h"
+#include "host_test.h"
+
+/** Number of random round trips per format */
+#define CODEC_ROUNDS 20000
+/** Number of random payloads per format in the JSON output */
+#define CODEC_VECTORS 200
+
+/**
+ * @brief Random 32 bit value
+ *
+ * @return uint32_t random value
+ */
+static uint32_t codec_rand(void)
+{
+	return ((uint32_t)(rand() & 0xFFFF) << 16) | (uint32_t)(rand() & 0xFFFF);
+}
+
+/**
+ * @brief Largest raw value of a field
+ *
+ * @param field field description
+ * @return uint32_t max raw value
+ */
+static uint32_t codec_field_max(const codec_field_s &field)
+{
+	return field.bits == 32 ? 0xFFFFFFFF : (1UL << field.bits) - 1;
+}
+
+/**
+ * @brief Random payload that decodes, constant fields are set
+ *
+ * @param fields field table of the format
+ * @param num number of fields
+ * @param buffer payload
+ * @param size payload size
+ */
+static void codec_rand_payload(const codec_field_s *fields, uint8_t num, uint8_t *buffer, uint8_t size)
+{
+	for (uint8_t idx = 0; idx < size; idx++)
+	{
+		buffer[idx] = rand() & 0xFF;
+	}
+	for (uint8_t idx = 0; idx < num; idx++)
+	{
+		if (fields[idx].type == CODEC_CONST)
+		{
+			// codec_put_bits() only sets bits, clear the field first
+			for (uint8_t bit = 0; bit < fields[idx].bits; bit++)
+			{
+				uint8_t pos = fields[idx].bit_pos + bit;
+				buffer[pos >> 3] &= ~(0x80 >> (pos & 0x07));
+			}
+			codec_put_bits(buffer, fields[idx].bit_pos, fields[idx].bits, fields[idx].max_raw);
+		}
+	}
+}
+
+/**
+ * @brief Check that all decoded values of a payload fit into int32_t
+ *
+ * @param fields field table of the format
+ * @param num number of fields
+ * @param buffer payload
+ * @return true all values fit
+ * @return false a value is too large and wraps in the decoder
+ */
+static bool codec_fits(const codec_field_s *fields, uint8_t num, const uint8_t *buffer)
+{
+	for (uint8_t idx = 0; idx < num; idx++)
+	{
+		uint32_t raw = codec_get_bits(buffer, fields[idx].bit_pos, fields[idx].bits);
+		if (((int64_t)raw * fields[idx].scale + fields[idx].offset) > INT32_MAX)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Random round trips of one format
+ *        Values in range decode to the value rounded down to the scale, values at or above the limit
+ *        decode to the clamp value, random payloads decode and encode to the same payload after one round
+ *
+ * @tparam CODEC codec of the format
+ * @param fields field table of the format
+ * @param num number of fields
+ */
+template <typename CODEC>
+static void test_format(const codec_field_s *fields, uint8_t num)
+{
+	uint8_t buffer[CODEC::size];
+	uint8_t again[CODEC::size];
+	int32_t values[8];
+	int32_t decoded[8];
+
+	// Too short payloads are rejected
+	memset(buffer, 0, sizeof(buffer));
+	CHECK(!CODEC::decode(buffer, CODEC::size - 1, decoded));
+
+	for (uint32_t round = 0; round < CODEC_ROUNDS; round++)
+	{
+		// Values in range
+		for (uint8_t idx = 0; idx < num; idx++)
+		{
+			const codec_field_s &field = fields[idx];
+			int64_t span = (int64_t)codec_field_max(field) * field.scale;
+			if (field.limit != 0)
+			{
+				span = field.limit - 1 - field.offset;
+			}
+			if (span > ((int64_t)INT32_MAX - field.offset))
+			{
+				// The values are int32_t
+				span = (int64_t)INT32_MAX - field.offset;
+			}
+			int64_t value = field.offset + (int64_t)((((uint64_t)codec_rand() << 32) | codec_rand()) % (uint64_t)(span + 1));
+			if ((field.type == CODEC_SIGN_MAG) && (rand() & 0x01))
+			{
+				value = -value;
+			}
+			values[idx] = (int32_t)value;
+		}
+		CHECK_EQ(CODEC::encode(buffer, values), CODEC::size);
+		CHECK(CODEC::decode(buffer, CODEC::size, decoded));
+		for (uint8_t idx = 0; idx < num; idx++)
+		{
+			const codec_field_s &field = fields[idx];
+			if (field.type == CODEC_CONST)
+			{
+				CHECK_EQ(decoded[idx], field.max_raw);
+				continue;
+			}
+			int64_t value = values[idx];
+			int64_t result = decoded[idx];
+			if (field.type == CODEC_SIGN_MAG)
+			{
+				CHECK((value < 0) == (result < 0));
+				value = value < 0 ? -value : value;
+				result = result < 0 ? -result : result;
+			}
+			CHECK((result <= value) && (result > (value - field.scale)));
+		}
+
+		// Clamped values
+		for (uint8_t idx = 0; idx < num; idx++)
+		{
+			const codec_field_s &field = fields[idx];
+			values[idx] = field.limit != 0 ? (int32_t)(field.limit + (codec_rand() % 1000)) : field.offset - 1 - (rand() % 1000);
+		}
+		CODEC::encode(buffer, values);
+		CHECK(CODEC::decode(buffer, CODEC::size, decoded));
+		for (uint8_t idx = 0; idx < num; idx++)
+		{
+			const codec_field_s &field = fields[idx];
+			if (field.type == CODEC_CONST)
+			{
+				continue;
+			}
+			int64_t clamp = field.limit != 0 ? (int64_t)field.max_raw * field.scale + field.offset : field.offset;
+			CHECK_EQ(decoded[idx], clamp);
+		}
+
+		// Random payloads
+		codec_rand_payload(fields, num, buffer, CODEC::size);
+		CHECK(CODEC::decode(buffer, CODEC::size, decoded));
+		CODEC::encode(again, decoded);
+		bool clamped = !codec_fits(fields, num, buffer);
+		for (uint8_t idx = 0; idx < num; idx++)
+		{
+			const codec_field_s &field = fields[idx];
+			clamped = clamped || ((field.limit != 0) && (codec_get_bits(buffer, field.bit_pos, field.bits) >= field.max_raw));
+		}
+		if (!clamped)
+		{
+			CHECK(memcmp(buffer, again, CODEC::size) == 0);
+		}
+		CHECK(CODEC::decode(again, CODEC::size, values));
+		CODEC::encode(buffer, values);
+		CHECK(memcmp(buffer, again, CODEC::size) == 0);
+	}
+}
+
+/**
+ * @brief Constant fields must match
+ */
+static void test_marker(void)
+{
+	uint8_t buffer[ft_v2_codec::size];
+	int32_t values[4] = {475000000, 85000000, 1234, 0};
+	int32_t decoded[4];
+	ft_v2_codec::encode(buffer, values);
+	CHECK_EQ(buffer[6], 'V');
+	CHECK_EQ(buffer[7], '2');
+	CHECK(ft_v2_codec::decode(buffer, sizeof(buffer), decoded));
+	CHECK_EQ(decoded[FT_V2_SEQ], 1234);
+	buffer[7] = '1';
+	CHECK(!ft_v2_codec::decode(buffer, sizeof(buffer), decoded));
+}
+
+/**
+ * @brief Print the field table and random payloads of one format as JSON
+ *
+ * @tparam CODEC codec of the format
+ * @param name name of the format
+ * @param fields field table of the format
+ * @param num number of fields
+ * @param last true for the last format
+ */
+template <typename CODEC>
+static void json_format(const char *name, const codec_field_s *fields, uint8_t num, bool last)
+{
+	uint8_t buffer[CODEC::size];
+	int32_t decoded[8];
+	printf("\"%s\":{\"fields\":[", name);
+	for (uint8_t idx = 0; idx < num; idx++)
+	{
+		const codec_field_s &field = fields[idx];
+		printf("%s{\"type\":%d,\"bitPos\":%d,\"bits\":%d,\"signBit\":%d,\"offset\":%d,\"scale\":%u}", idx == 0 ? "" : ",",
+			   field.type, field.bit_pos, field.bits, field.sign_bit, field.offset, field.scale);
+	}
+	printf("],\"vectors\":[");
+	for (uint16_t vector = 0; vector < CODEC_VECTORS; vector++)
+	{
+		do
+		{
+			codec_rand_payload(fields, num, buffer, CODEC::size);
+		} while (!codec_fits(fields, num, buffer));
+		CODEC::decode(buffer, CODEC::size, decoded);
+		printf("%s{\"bytes\":[", vector == 0 ? "" : ",");
+		for (uint8_t idx = 0; idx < CODEC::size; idx++)
+		{
+			printf("%s%d", idx == 0 ? "" : ",", buffer[idx]);
+		}
+		printf("],\"values\":[");
+		for (uint8_t idx = 0; idx < num; idx++)
+		{
+			printf("%s%d", idx == 0 ? "" : ",", decoded[idx]);
+		}
+		printf("]}");
+	}
+	printf("]}%s\n", last ? "" : ",");
+}
+
+/**
+ * @brief Print a batched uplink with the expected points as JSON
+ *        The points are <latitude>, <longitude>, <altitude>, <age s>, latitude/longitude in 1/10000000 degree
+ */
+static void json_batch(void)
+{
+	static const int32_t samples[][4] = {
+		{475000000, 85000000, 500, 0},
+		{475012300, 84995400, 503, 60},
+		{474998700, 85003100, 498, 125},
+		{474998700, 85003100, 498, 185},
+		{475100000, 84900000, 560, 250},
+	};
+	const uint8_t count = sizeof(samples) / sizeof(samples[0]);
+	const int32_t age = 3;
+	uint8_t buffer[batch_head_codec::size + batch_key_codec::size + (count - 1) * batch_delta_codec::size];
+	int32_t head[5] = {count, age, -95, 7, 2};
+	uint8_t len = batch_head_codec::encode(buffer, head);
+	len += batch_key_codec::encode(&buffer[len], samples[0]);
+	for (uint8_t idx = 1; idx < count; idx++)
+	{
+		int32_t delta[4];
+		delta[BATCH_LAT] = samples[idx][BATCH_LAT] - samples[idx - 1][BATCH_LAT];
+		delta[BATCH_LNG] = samples[idx][BATCH_LNG] - samples[idx - 1][BATCH_LNG];
+		delta[BATCH_ALT] = samples[idx][BATCH_ALT] - samples[idx - 1][BATCH_ALT];
+		delta[BATCH_TIME] = samples[idx][3] - samples[idx - 1][3];
+		len += batch_delta_codec::encode(&buffer[len], delta);
+	}
+	printf("\"batch\":{\"rssi\":-95,\"snr\":7,\"gateways\":2,\"bytes\":[");
+	for (uint8_t idx = 0; idx < len; idx++)
+	{
+		printf("%s%d", idx == 0 ? "" : ",", buffer[idx]);
+	}
+	printf("],\"points\":[");
+	for (uint8_t idx = 0; idx < count; idx++)
+	{
+		printf("%s[%d,%d,%d,%d]", idx == 0 ? "" : ",", samples[idx][BATCH_LAT], samples[idx][BATCH_LNG], samples[idx][BATCH_ALT],
+			   age + samples[count - 1][3] - samples[idx][3]);
+	}
+	printf("]},\n");
+}
+
+/** Max payload sizes of the DRs of the regions, from DR0 in US915 to the largest payload */
+static const uint8_t frag_max_payloads[] = {11, 12, 51, 53, 115, 125, 222, 242};
+/** Max number of fragments of a packet */
+#define FRAG_MAX 64
+
+/** Fragments of a packet */
+struct frag_list_s
+{
+	uint8_t data[FRAG_MAX][242];
+	uint8_t len[FRAG_MAX];
+	uint8_t num;
+};
+
+/**
+ * @brief Split a packet like frag_send(), the DR changes at random and some fragments are refused by the stack
+ *        A refused fragment does not move the offset and is encoded again with the next DR
+ *
+ * @param packet complete packet
+ * @param total length of the packet
+ * @param id packet id
+ * @param list sent fragments
+ */
+static void frag_split(const uint8_t *packet, uint8_t total, uint8_t id, frag_list_s *list)
+{
+	uint8_t offset = 0;
+	list->num = 0;
+	while ((offset < total) && (list->num < FRAG_MAX))
+	{
+		uint8_t max_payload = frag_max_payloads[rand() % sizeof(frag_max_payloads)];
+		uint8_t *buffer = list->data[list->num];
+		uint8_t chunk = frag_encode(buffer, max_payload, id, packet, total, offset);
+		CHECK(chunk != 0);
+		CHECK(frag_head_codec::size + chunk <= max_payload);
+		if ((rand() % 4) == 0)
+		{
+			// Refused by the stack, sent again
+			continue;
+		}
+		list->len[list->num++] = frag_head_codec::size + chunk;
+		offset += chunk;
+	}
+}
+
+/**
+ * @brief Fragment round trips, random packets are split and put together again from the fragment headers
+ */
+static void test_fragments(void)
+{
+	static frag_list_s list;
+	uint8_t packet[242];
+	uint8_t rebuilt[242];
+	uint8_t buffer[242];
+
+	// No room for data, or nothing left
+	CHECK_EQ(frag_encode(buffer, frag_head_codec::size, 1, packet, 10, 0), 0);
+	CHECK_EQ(frag_encode(buffer, 51, 1, packet, 10, 10), 0);
+
+	for (uint16_t round = 0; round < 2000; round++)
+	{
+		uint8_t total = 1 + (rand() % 242);
+		uint8_t id = rand() & 0xFF;
+		for (uint8_t idx = 0; idx < total; idx++)
+		{
+			packet[idx] = rand() & 0xFF;
+		}
+		frag_split(packet, total, id, &list);
+		memset(rebuilt, 0, sizeof(rebuilt));
+		uint16_t received = 0;
+		uint8_t next = 0;
+		for (uint8_t frag = 0; frag < list.num; frag++)
+		{
+			int32_t head[3];
+			CHECK(frag_head_codec::decode(list.data[frag], list.len[frag], head));
+			CHECK_EQ(head[FRAG_ID], id);
+			CHECK_EQ(head[FRAG_TOTAL], total);
+			// The fragments follow each other without gap or overlap
+			CHECK_EQ(head[FRAG_OFFSET], next);
+			uint8_t chunk = list.len[frag] - frag_head_codec::size;
+			memcpy(&rebuilt[head[FRAG_OFFSET]], &list.data[frag][frag_head_codec::size], chunk);
+			next = head[FRAG_OFFSET] + chunk;
+			received += chunk;
+		}
+		CHECK_EQ(received, total);
+		CHECK(memcmp(packet, rebuilt, total) == 0);
+	}
+}
+
+/**
+ * @brief Print fragments of two packets as JSON, in random order with a repeated fragment
+ *        The first packet is complete, the last fragment of the second packet is missing
+ */
+static void json_fragments(void)
+{
+	static frag_list_s lists[2];
+	uint8_t packets[2][242];
+	uint8_t totals[2] = {200, 60};
+	uint8_t ids[2] = {7, 8};
+	uint8_t order[2 * FRAG_MAX + 1][2];
+	uint8_t num = 0;
+	for (uint8_t pkt = 0; pkt < 2; pkt++)
+	{
+		for (uint8_t idx = 0; idx < totals[pkt]; idx++)
+		{
+			packets[pkt][idx] = rand() & 0xFF;
+		}
+		do
+		{
+			frag_split(packets[pkt], totals[pkt], ids[pkt], &lists[pkt]);
+		} while (lists[pkt].num < 3);
+		uint8_t frags = pkt == 0 ? lists[pkt].num : lists[pkt].num - 1;
+		for (uint8_t frag = 0; frag < frags; frag++)
+		{
+			order[num][0] = pkt;
+			order[num++][1] = frag;
+		}
+	}
+	// Repeated fragment
+	order[num][0] = 0;
+	order[num++][1] = 1;
+	for (uint8_t idx = num - 1; idx > 0; idx--)
+	{
+		uint8_t other = rand() % (idx + 1);
+		uint8_t pkt = order[idx][0];
+		uint8_t frag = order[idx][1];
+		order[idx][0] = order[other][0];
+		order[idx][1] = order[other][1];
+		order[other][0] = pkt;
+		order[other][1] = frag;
+	}
+	printf("\"fragments\":{\"complete\":{\"id\":%d,\"payload\":\"", ids[0]);
+	for (uint8_t idx = 0; idx < totals[0]; idx++)
+	{
+		printf("%02x", packets[0][idx]);
+	}
+	printf("\"},\"incomplete\":%d,\"frames\":[", ids[1]);
+	for (uint8_t idx = 0; idx < num; idx++)
+	{
+		frag_list_s *list = &lists[order[idx][0]];
+		uint8_t frag = order[idx][1];
+		printf("%s[", idx == 0 ? "" : ",");
+		for (uint8_t pos = 0; pos < list->len[frag]; pos++)
+		{
+			printf("%s%d", pos == 0 ? "" : ",", list->data[frag][pos]);
+		}
+		printf("]");
+	}
+	printf("]},\n");
+}
+
+/** Number of fields of a table */
+#define CODEC_NUM(table) (uint8_t)(sizeof(table) / sizeof(codec_field_s))
+
+int main(int argc, char **argv)
+{
+	srand(1);
+	if ((argc == 2) && (strcmp(argv[1], "--json") == 0))
+	{
+		printf("{\n");
+		json_format<ft_v1_codec>("ft_v1", ft_v1_fields, CODEC_NUM(ft_v1_fields), false);
+		json_format<batch_head_codec>("batch_head", batch_head_fields, CODEC_NUM(batch_head_fields), false);
+		json_format<batch_key_codec>("batch_key", batch_key_fields, CODEC_NUM(batch_key_fields), false);
+		json_format<batch_delta_codec>("batch_delta", batch_delta_fields, CODEC_NUM(batch_delta_fields), false);
+		json_batch();
+		json_fragments();
+		json_format<frag_head_codec>("frag_head", frag_head_fields, CODEC_NUM(frag_head_fields), true);
+		printf("}\n");
+		return 0;
+	}
+	test_format<ft_v1_codec>(ft_v1_fields, CODEC_NUM(ft_v1_fields));
+	test_format<ft_v2_codec>(ft_v2_fields, CODEC_NUM(ft_v2_fields));
+	test_format<batch_head_codec>(batch_head_fields, CODEC_NUM(batch_head_fields));
+	test_format<batch_key_codec>(batch_key_fields, CODEC_NUM(batch_key_fields));
+	test_format<batch_delta_codec>(batch_delta_fields, CODEC_NUM(batch_delta_fields));
+	test_format<frag_head_codec>(frag_head_fields, CODEC_NUM(frag_head_fields));
+	test_marker();
+	test_fragments();
+	return test_result("test_codec");
+}
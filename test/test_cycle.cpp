@@ -0,0 +1,374 @@
+/**
+ * @file test_cycle.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Host test of the test cycle state machine
+ *        A fake radio produces the callback events of random test cycles, with failed TX,
+ *        missing answers, missing location, stuck stages and late callbacks. The fake application
+ *        runs the actions of the transitions like test_cycle.cpp, the actions, timeouts and statistics
+ *        are checked against the fake radio.
+ * @version 0.1
+ * @date 2025-01-15
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "Arduino.h"
+#include "test_cycle.h"
+#include "host_test.h"
+
+/** Outcomes of a test cycle of the fake radio */
+enum fake_outcome_num
+{
+	FAKE_OK = 0,	  // TX done, answer received
+	FAKE_SKIP,		  // No TX, e.g. duty cycle
+	FAKE_TX_FAIL,	  // TX failed
+	FAKE_NO_ANSWER,	  // No LinkCheck answer, the FieldTester wait for the downlink times out
+	FAKE_TX_STUCK,	  // TX done never comes, it comes late after the timeout
+	FAKE_NO_FIX,	  // FieldTester without location, the acquisition times out
+	FAKE_P2P_RX,	  // P2P packet received without TX
+	FAKE_NUM_OUTCOMES // Number of outcomes
+};
+
+/** Fake radio and application, keeps the expected statistics */
+struct fake_radio_s
+{
+	cycle_sm_s sm;
+	uint32_t now;
+	uint32_t start;
+	uint32_t acquire_ms;				 // Location acquisition time set by the CACT_ACQUIRE action
+	uint32_t actions[CYCLE_NUM_ACTIONS]; // Actions run by the fake application
+	uint32_t tx_entries;
+	uint32_t timeouts;
+	uint32_t aborts;
+	uint32_t no_fix;
+	uint32_t no_dl;
+	uint32_t ignored;
+};
+
+/**
+ * @brief Run the action of the last transition like cycle_run_action() does
+ *
+ * @param radio fake radio
+ */
+static void fake_action(fake_radio_s *radio)
+{
+	uint8_t action = radio->sm.action;
+	CHECK(action < CYCLE_NUM_ACTIONS);
+	if (action >= CYCLE_NUM_ACTIONS)
+	{
+		return;
+	}
+	radio->actions[action]++;
+	if (action == CACT_ACQUIRE)
+	{
+		cycle_sm_set_timeout(&radio->sm, CYCLE_ACQUIRE, radio->acquire_ms);
+	}
+}
+
+/**
+ * @brief Let time pass, check the timeouts like the loop does
+ *
+ * @param radio fake radio
+ * @param delay_ms time to pass
+ */
+static void fake_wait(fake_radio_s *radio, uint32_t delay_ms)
+{
+	// The loop checks the timeout at least every second
+	for (uint32_t step = 0; step < delay_ms; step += 1000)
+	{
+		radio->now += delay_ms - step > 1000 ? 1000 : delay_ms - step;
+		if (cycle_sm_check(&radio->sm, radio->now))
+		{
+			fake_action(radio);
+		}
+	}
+}
+
+/**
+ * @brief Send an event to the state machine at a later time, the timeouts are checked before
+ *
+ * @param radio fake radio
+ * @param event cycle_event_num_t
+ * @param delay_ms time since the last event
+ * @return true transition found
+ * @return false event ignored
+ */
+static bool fake_event(fake_radio_s *radio, uint8_t event, uint32_t delay_ms)
+{
+	fake_wait(radio, delay_ms);
+	if (!cycle_sm_event(&radio->sm, event, radio->now))
+	{
+		return false;
+	}
+	fake_action(radio);
+	return true;
+}
+
+/**
+ * @brief Run one test cycle of the fake radio
+ *
+ * @param radio fake radio
+ * @param outcome fake_outcome_num
+ */
+static void fake_cycle(fake_radio_s *radio, uint8_t outcome)
+{
+	bool fieldtester = radio->sm.table == &cycle_fieldtester_table;
+	bool p2p = radio->sm.table == &cycle_p2p_table;
+	uint32_t toa = 50 + rand() % 2000;
+
+	// P2P has no failed TX
+	if (p2p && (outcome == FAKE_TX_FAIL))
+	{
+		outcome = FAKE_OK;
+	}
+
+	if (outcome == FAKE_P2P_RX)
+	{
+		// P2P receive, LinkCheck and FieldTester ignore an answer without uplink
+		if (!fake_event(radio, CEV_RX, 100))
+			radio->ignored++;
+		if (p2p)
+		{
+			CHECK_EQ(radio->sm.action, CACT_SHOW);
+			CHECK(fake_event(radio, CEV_LOGGED, 20));
+			CHECK(fake_event(radio, CEV_SHOWN, 250));
+		}
+		return;
+	}
+
+	// The test cycle sends the packet
+	CHECK(fake_event(radio, CEV_START, 0));
+	CHECK_EQ(radio->sm.action, CACT_SEND);
+	radio->tx_entries++;
+	if (fieldtester && (outcome != FAKE_SKIP))
+	{
+		// The send action starts the acquisition, the acquisition time is half of the send interval
+		radio->acquire_ms = 5000 + 1000 * (rand() % 30);
+		CHECK(fake_event(radio, CEV_ACQUIRE, 10));
+		CHECK_EQ(radio->sm.action, CACT_ACQUIRE);
+		if (outcome == FAKE_NO_FIX)
+		{
+			// The state machine ends the acquisition after the acquisition time
+			fake_wait(radio, radio->acquire_ms - 1);
+			CHECK_EQ(radio->sm.state, CYCLE_ACQUIRE);
+			fake_wait(radio, 1);
+			CHECK_EQ(radio->sm.state, CYCLE_IDLE);
+			CHECK_EQ(radio->sm.action, CACT_STOP_GNSS);
+			radio->timeouts++;
+			radio->no_fix++;
+			return;
+		}
+		CHECK(fake_event(radio, CEV_FIX, 1000 + rand() % 4000));
+		CHECK_EQ(radio->sm.action, CACT_SEND_FIX);
+		radio->tx_entries++;
+	}
+	// A new test while the test cycle runs is skipped
+	CHECK(!fake_event(radio, CEV_START, 1));
+	radio->ignored++;
+	switch (outcome)
+	{
+	case FAKE_SKIP:
+	case FAKE_NO_FIX:
+		CHECK(fake_event(radio, CEV_SKIP, 5));
+		return;
+	case FAKE_TX_FAIL:
+		CHECK(fake_event(radio, CEV_TX_FAIL, toa));
+		break;
+	case FAKE_TX_STUCK:
+		// TX done after the 30 s timeout of the TX stage, the state machine is idle already
+		CHECK(!fake_event(radio, CEV_TX_DONE, 31000));
+		CHECK_EQ(radio->sm.action, CACT_ABORT);
+		radio->timeouts++;
+		radio->aborts++;
+		radio->ignored++;
+		return;
+	case FAKE_NO_ANSWER:
+		CHECK(fake_event(radio, CEV_TX_DONE, toa));
+		if (p2p)
+			break;
+		if (fieldtester)
+		{
+			// The state machine ends the wait for the downlink after 10 s and shows the result
+			fake_wait(radio, 9999);
+			CHECK_EQ(radio->sm.state, CYCLE_WAIT_RX);
+			fake_wait(radio, 1);
+			CHECK_EQ(radio->sm.state, CYCLE_LOG);
+			CHECK_EQ(radio->sm.action, CACT_NO_DL);
+			radio->timeouts++;
+			radio->no_dl++;
+			break;
+		}
+		// LinkCheck without answer, the wait for RX stage times out, the late answer is ignored
+		CHECK(!fake_event(radio, CEV_RX, 21000));
+		CHECK_EQ(radio->sm.action, CACT_ABORT);
+		radio->timeouts++;
+		radio->aborts++;
+		radio->ignored++;
+		return;
+	default:
+		CHECK(fake_event(radio, CEV_TX_DONE, toa));
+		if (!p2p)
+			CHECK(fake_event(radio, CEV_RX, 1000 + rand() % 1000));
+		break;
+	}
+	CHECK_EQ(radio->sm.state, CYCLE_LOG);
+	CHECK(fake_event(radio, CEV_LOGGED, 20 + rand() % 100));
+	CHECK(fake_event(radio, CEV_SHOWN, 250));
+}
+
+/**
+ * @brief Random test cycles of one test mode
+ *
+ * @param table transition table of the test mode
+ * @param start time of the first cycle
+ */
+static void test_mode(const cycle_table_s *table, uint32_t start)
+{
+	fake_radio_s radio;
+	memset(&radio, 0, sizeof(radio));
+	radio.now = start;
+	radio.start = start;
+	cycle_sm_init(&radio.sm, table, start);
+	for (int cycle = 0; cycle < 2000; cycle++)
+	{
+		fake_cycle(&radio, rand() % FAKE_NUM_OUTCOMES);
+		// Every cycle ends in idle
+		CHECK_EQ(radio.sm.state, CYCLE_IDLE);
+		// Send interval
+		fake_event(&radio, CYCLE_NUM_EVENTS, rand() % 60000);
+		radio.ignored++;
+	}
+	uint32_t total = 0;
+	uint32_t timeouts = 0;
+	for (uint8_t state = 0; state < CYCLE_NUM_STATES; state++)
+	{
+		total += cycle_sm_time(&radio.sm, state, radio.now);
+		timeouts += radio.sm.timeouts[state];
+	}
+	// All time is accounted, also across the millis() wrap
+	CHECK_EQ(total, radio.now - radio.start);
+	CHECK_EQ(timeouts, radio.timeouts);
+	CHECK_EQ(radio.sm.entries[CYCLE_TX], radio.tx_entries);
+	CHECK_EQ(radio.sm.ignored, radio.ignored);
+	// Every TX stage was started by a send action, every result was shown
+	CHECK_EQ(radio.actions[CACT_SEND] + radio.actions[CACT_SEND_FIX], radio.tx_entries);
+	CHECK_EQ(radio.actions[CACT_SHOW] + radio.actions[CACT_NO_DL], radio.sm.entries[CYCLE_LOG]);
+	CHECK_EQ(radio.actions[CACT_ACQUIRE], radio.sm.entries[CYCLE_ACQUIRE]);
+	CHECK_EQ(radio.actions[CACT_STOP_GNSS], radio.no_fix);
+	CHECK_EQ(radio.actions[CACT_NO_DL], radio.no_dl);
+	CHECK_EQ(radio.actions[CACT_ABORT], radio.aborts);
+}
+
+/**
+ * @brief Timeouts of the single stages
+ *
+ */
+static void test_timeouts(void)
+{
+	cycle_sm_s sm;
+	cycle_sm_init(&sm, &cycle_linkcheck_table, 0);
+	CHECK_EQ(cycle_sm_next_timeout(&sm, 1000), 0xFFFFFFFF);
+	CHECK(cycle_sm_event(&sm, CEV_START, 1000));
+	CHECK_EQ(sm.action, CACT_SEND);
+	CHECK_EQ(cycle_sm_next_timeout(&sm, 2000), 29000);
+	CHECK(!cycle_sm_check(&sm, 30999));
+	CHECK(cycle_sm_check(&sm, 31000));
+	CHECK_EQ(sm.state, CYCLE_IDLE);
+	CHECK_EQ(sm.action, CACT_ABORT);
+	CHECK_EQ(sm.timeouts[CYCLE_TX], 1);
+
+	// Timeout across the millis() wrap
+	cycle_sm_init(&sm, &cycle_p2p_table, 0xFFFFF000);
+	CHECK(cycle_sm_event(&sm, CEV_RX, 0xFFFFFF00));
+	CHECK_EQ(cycle_sm_next_timeout(&sm, 0x100), 5000 - 0x200);
+	CHECK(cycle_sm_check(&sm, 0xFFFFFF00 + 5000));
+
+	// Acquisition time set by the application, also for the running stage, the timeout raises CEV_NO_FIX
+	cycle_sm_init(&sm, &cycle_fieldtester_table, 0xFFFFFFFF - 500);
+	CHECK(cycle_sm_event(&sm, CEV_START, 0xFFFFFFFF - 500));
+	CHECK(cycle_sm_event(&sm, CEV_ACQUIRE, 0xFFFFFFFF - 400));
+	CHECK_EQ(sm.action, CACT_ACQUIRE);
+	cycle_sm_set_timeout(&sm, CYCLE_ACQUIRE, 60000);
+	CHECK(!cycle_sm_check(&sm, 60000 - 402));
+	CHECK(cycle_sm_check(&sm, 60000 - 401));
+	CHECK_EQ(sm.state, CYCLE_IDLE);
+	CHECK_EQ(sm.action, CACT_STOP_GNSS);
+	CHECK_EQ(sm.timeouts[CYCLE_ACQUIRE], 1);
+
+	// Clearing the statistics keeps the running stage and the acquisition time
+	CHECK(cycle_sm_event(&sm, CEV_START, 70000));
+	CHECK(cycle_sm_event(&sm, CEV_ACQUIRE, 70000));
+	cycle_sm_clear(&sm, 80000);
+	CHECK_EQ(sm.state, CYCLE_ACQUIRE);
+	CHECK_EQ(sm.timeouts[CYCLE_ACQUIRE], 0);
+	CHECK_EQ(cycle_sm_next_timeout(&sm, 80000), 60000);
+	// A new table starts with its own timeouts
+	cycle_sm_init(&sm, &cycle_fieldtester_table, 0);
+	CHECK_EQ(sm.timeout_ms[CYCLE_ACQUIRE], 30000);
+}
+
+/**
+ * @brief Consistency of the transition tables
+ *        The test starts with a send action, each result is shown, each timeout event has a transition
+ *
+ */
+static void test_tables(void)
+{
+	static const cycle_table_s *tables[] = {&cycle_linkcheck_table, &cycle_fieldtester_table, &cycle_p2p_table};
+	for (uint8_t idx = 0; idx < sizeof(tables) / sizeof(tables[0]); idx++)
+	{
+		const cycle_table_s *table = tables[idx];
+		for (uint8_t trans = 0; trans < table->num; trans++)
+		{
+			const cycle_transition_s *transition = &table->transitions[trans];
+			CHECK(transition->state < CYCLE_NUM_STATES);
+			CHECK(transition->event < CYCLE_NUM_EVENTS);
+			CHECK(transition->next < CYCLE_NUM_STATES);
+			CHECK(transition->action < CACT_ABORT);
+			if ((transition->state == CYCLE_IDLE) && (transition->event == CEV_START))
+			{
+				CHECK_EQ(transition->action, CACT_SEND);
+			}
+			if ((transition->next == CYCLE_LOG) && (transition->state != CYCLE_LOG))
+			{
+				CHECK((transition->action == CACT_SHOW) || (transition->action == CACT_NO_DL));
+			}
+			if (transition->next == CYCLE_ACQUIRE)
+			{
+				CHECK_EQ(transition->action, CACT_ACQUIRE);
+			}
+			// Only one transition per state and event
+			for (uint8_t other = trans + 1; other < table->num; other++)
+			{
+				CHECK((table->transitions[other].state != transition->state) || (table->transitions[other].event != transition->event));
+			}
+		}
+		cycle_sm_s sm;
+		cycle_sm_init(&sm, table, 0);
+		for (uint8_t state = 0; state < CYCLE_NUM_STATES; state++)
+		{
+			uint8_t event = table->timeout_event[state];
+			if (event == CYCLE_NUM_EVENTS)
+			{
+				continue;
+			}
+			// A timeout event needs a timeout and a transition
+			CHECK(table->timeout_ms[state] != 0);
+			sm.state = state;
+			CHECK(cycle_sm_find(&sm, event) != NULL);
+		}
+	}
+}
+
+int main(void)
+{
+	srand(1);
+	test_tables();
+	test_timeouts();
+	test_mode(&cycle_linkcheck_table, 0);
+	test_mode(&cycle_fieldtester_table, 0);
+	test_mode(&cycle_p2p_table, 0);
+	test_mode(&cycle_fieldtester_table, 0xFF000000);
+	test_mode(&cycle_linkcheck_table, 0xFF000000);
+	return test_result("test_cycle");
+}
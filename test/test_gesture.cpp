@@ -0,0 +1,304 @@
+/**
+ * @file test_gesture.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Host test of the button gesture recognizer
+ *        Edge sequences of 1 to 7 clicks, long presses, contact bounces and too many clicks are fed
+ *        the same way as button.cpp does, with a 100 ms button task and with a blocked main loop,
+ *        also across the millis() wraparound.
+ * @version 0.1
+ * @date 2025-01-16
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <stdint.h>
+#include "gesture.h"
+#include "host_test.h"
+
+/** Max number of edges of a sequence */
+#define MAX_EDGES 64
+/** Max number of recognized gestures of a sequence */
+#define MAX_GESTURES 8
+/** Period of the button task */
+#define TASK_PERIOD 100
+/** Bounce edges come this many ms after the edge */
+#define BOUNCE_MS 4
+
+/** Button edge, time relative to the start of the sequence */
+struct test_edge_s
+{
+	uint32_t time;
+	bool pressed;
+};
+
+/** Edge sequence */
+struct test_seq_s
+{
+	test_edge_s edges[MAX_EDGES];
+	uint8_t num;
+	uint32_t end; // Button released after the last edge until this time
+};
+
+/** Recognized gesture */
+struct test_gesture_s
+{
+	uint8_t gesture;
+	uint32_t time;
+};
+
+/** Result of a sequence */
+struct test_result_s
+{
+	test_gesture_s gestures[MAX_GESTURES];
+	uint8_t num;
+	uint32_t bounces;
+	uint32_t dropped;
+};
+
+/**
+ * @brief Add an edge, optionally with contact bounces
+ *
+ * @param seq sequence
+ * @param time time of the edge
+ * @param pressed level after the edge
+ * @param bounce true to add two bounce edges after the edge
+ */
+static void seq_edge(test_seq_s *seq, uint32_t time, bool pressed, bool bounce)
+{
+	seq->edges[seq->num++] = {time, pressed};
+	if (bounce)
+	{
+		seq->edges[seq->num++] = {time + BOUNCE_MS, !pressed};
+		seq->edges[seq->num++] = {time + 2 * BOUNCE_MS, pressed};
+	}
+}
+
+/**
+ * @brief Build a sequence of clicks
+ *
+ * @param seq sequence
+ * @param clicks number of clicks
+ * @param hold time the button is pressed per click
+ * @param gap time the button is released between clicks
+ * @param bounce true for contact bounces on every edge
+ */
+static void seq_clicks(test_seq_s *seq, uint8_t clicks, uint32_t hold, uint32_t gap, bool bounce)
+{
+	seq->num = 0;
+	uint32_t time = 0;
+	for (uint8_t idx = 0; idx < clicks; idx++)
+	{
+		seq_edge(seq, time, true, bounce);
+		seq_edge(seq, time + hold, false, bounce);
+		time += hold + gap;
+	}
+	seq->end = time + GESTURE_LONG_MS + 1000;
+}
+
+/**
+ * @brief Level of the button at a time
+ *
+ * @param seq sequence
+ * @param time time relative to the start
+ * @return true button pressed
+ */
+static bool seq_level(const test_seq_s *seq, uint32_t time)
+{
+	bool pressed = false;
+	for (uint8_t idx = 0; (idx < seq->num) && (seq->edges[idx].time <= time); idx++)
+	{
+		pressed = seq->edges[idx].pressed;
+	}
+	return pressed;
+}
+
+/**
+ * @brief Store a recognized gesture
+ *
+ * @param result result of the sequence
+ * @param gesture gesture_num_t
+ * @param time time relative to the start
+ */
+static void result_add(test_result_s *result, uint8_t gesture, uint32_t time)
+{
+	if ((gesture != GESTURE_NONE) && (result->num < MAX_GESTURES))
+	{
+		result->gestures[result->num++] = {gesture, time};
+	}
+}
+
+/**
+ * @brief Run a sequence like button.cpp, the edges are buffered by the interrupt and decoded by the button task
+ *
+ * @param seq sequence
+ * @param base millis() at the start of the sequence
+ * @param blocked the main loop is blocked until this time, all edges before it are decoded late
+ * @param result recognized gestures, times relative to the start
+ */
+static void seq_run(const test_seq_s *seq, uint32_t base, uint32_t blocked, test_result_s *result)
+{
+	gesture_sm_s sm;
+	gesture_init(&sm);
+	sm.edge_ms = base - GESTURE_DEBOUNCE_MS;
+	result->num = 0;
+
+	uint8_t next = 0;
+	for (uint32_t now = 0; now <= seq->end; now += TASK_PERIOD)
+	{
+		if (now < blocked)
+		{
+			continue;
+		}
+		// Buffered edges with their own time stamps, the gesture time is the decode time
+		while ((next < seq->num) && (seq->edges[next].time <= now))
+		{
+			uint32_t time = base + seq->edges[next].time;
+			result_add(result, gesture_timeout(&sm, time), now);
+			result_add(result, gesture_edge(&sm, seq->edges[next].pressed, time), now);
+			next++;
+		}
+		result_add(result, gesture_poll(&sm, seq_level(seq, now), base + now), now);
+	}
+	CHECK(!gesture_pending(&sm));
+	result->bounces = sm.bounces;
+	result->dropped = sm.dropped;
+}
+
+/**
+ * @brief Run a sequence at several start times and with a blocked main loop, the result must be one gesture
+ *
+ * @param seq sequence
+ * @param gesture expected gesture_num_t, GESTURE_NONE for a dropped sequence
+ * @param earliest the gesture is not reported before this time
+ * @param bounces expected number of dropped bounce edges
+ */
+static void check_seq(const test_seq_s *seq, uint8_t gesture, uint32_t earliest, uint32_t bounces)
+{
+	// Start times before, at and after the millis() wraparound
+	static const uint32_t bases[] = {0, 1000, 0xFFFFFFFF - 700, 0xFFFFFFFF - 50, 0xFFFFFFFF};
+	for (uint8_t idx = 0; idx < sizeof(bases) / sizeof(bases[0]); idx++)
+	{
+		for (uint8_t block = 0; block < 2; block++)
+		{
+			test_result_s result;
+			seq_run(seq, bases[idx], block ? seq->end - GESTURE_LONG_MS : 0, &result);
+			CHECK_EQ(result.bounces, bounces);
+			if (gesture == GESTURE_NONE)
+			{
+				CHECK_EQ(result.num, 0);
+				CHECK_EQ(result.dropped, 1);
+				continue;
+			}
+			CHECK_EQ(result.num, 1);
+			CHECK_EQ(result.dropped, 0);
+			if (result.num == 1)
+			{
+				CHECK_EQ(result.gestures[0].gesture, gesture);
+				CHECK(result.gestures[0].time >= earliest);
+				if (block == 0)
+				{
+					// The button task reports the gesture in the first run after the deadline
+					CHECK(result.gestures[0].time < (earliest + TASK_PERIOD));
+				}
+			}
+		}
+	}
+}
+
+/**
+ * @brief 1 to 7 clicks, with and without bounces, more than 7 clicks are dropped
+ */
+static void test_clicks(void)
+{
+	test_seq_s seq;
+	for (uint8_t clicks = 1; clicks <= GESTURE_MAX_CLICKS + 2; clicks++)
+	{
+		for (uint8_t bounce = 0; bounce < 2; bounce++)
+		{
+			seq_clicks(&seq, clicks, 80, 120, bounce);
+			uint32_t last_press = (clicks - 1) * 200;
+			uint8_t gesture = clicks <= GESTURE_MAX_CLICKS ? GESTURE_CLICK_1 + clicks - 1 : GESTURE_NONE;
+			uint32_t earliest = 0;
+			if (clicks <= GESTURE_MAX_CLICKS)
+			{
+				earliest = last_press + gesture_click_ms[clicks - 1];
+				if (earliest < (last_press + 80 + GESTURE_SETTLE_MS))
+				{
+					earliest = last_press + 80 + GESTURE_SETTLE_MS;
+				}
+			}
+			check_seq(&seq, gesture, earliest, bounce ? clicks * 4 : 0);
+		}
+	}
+}
+
+/**
+ * @brief Long press, with bounces and after a click
+ */
+static void test_long(void)
+{
+	test_seq_s seq;
+	seq.num = 0;
+	seq_edge(&seq, 0, true, false);
+	seq_edge(&seq, 4000, false, false);
+	seq.end = 8000;
+	check_seq(&seq, GESTURE_LONG, GESTURE_LONG_MS, 0);
+
+	seq.num = 0;
+	seq_edge(&seq, 0, true, true);
+	seq_edge(&seq, 3500, false, true);
+	seq.end = 8000;
+	check_seq(&seq, GESTURE_LONG, GESTURE_LONG_MS, 4);
+
+	// Released just before the long press time is a click
+	seq.num = 0;
+	seq_edge(&seq, 0, true, false);
+	seq_edge(&seq, GESTURE_LONG_MS - 200, false, false);
+	seq.end = 8000;
+	check_seq(&seq, GESTURE_CLICK_1, GESTURE_LONG_MS - 200 + GESTURE_SETTLE_MS, 0);
+}
+
+/**
+ * @brief A release edge taken as bounce is caught from the level of the button
+ */
+static void test_lost_edge(void)
+{
+	test_seq_s seq;
+	seq.num = 0;
+	seq_edge(&seq, 0, true, false);
+	seq_edge(&seq, GESTURE_DEBOUNCE_MS - 10, false, false);
+	seq.end = 8000;
+
+	gesture_sm_s sm;
+	gesture_init(&sm);
+	sm.edge_ms = 0xFFFFFFFF - 1000;
+	uint32_t base = 0xFFFFFFFF - 10;
+	uint8_t gestures[2] = {GESTURE_NONE, GESTURE_NONE};
+	uint8_t num = 0;
+	for (uint32_t now = 0; now <= seq.end; now += 10)
+	{
+		for (uint8_t idx = 0; idx < seq.num; idx++)
+		{
+			if (seq.edges[idx].time == now)
+			{
+				gesture_edge(&sm, seq.edges[idx].pressed, base + now);
+			}
+		}
+		uint8_t gesture = gesture_poll(&sm, seq_level(&seq, now), base + now);
+		if ((gesture != GESTURE_NONE) && (num < 2))
+		{
+			gestures[num++] = gesture;
+		}
+	}
+	CHECK_EQ(sm.bounces, 1);
+	CHECK_EQ(num, 1);
+	CHECK_EQ(gestures[0], GESTURE_CLICK_1);
+}
+
+int main(void)
+{
+	test_clicks();
+	test_long();
+	test_lost_edge();
+	return test_result("test_gesture");
+}
@@ -0,0 +1,302 @@
+/**
+ * @file test_mtm.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Host test of the MillisTaskManager scheduler
+ *        Tasks that disable, enable, register or logout other tasks during a Running call,
+ *        and a random sequence that is checked against a model of the task states
+ * @version 0.1
+ * @date 2025-01-15
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "Arduino.h"
+#include "MillisTaskManager.h"
+#include "host_test.h"
+
+/** Scheduler under test */
+static MillisTaskManager *mtm;
+
+/** Number of runs of each task */
+static uint32_t runs[MTM_MAX_TASKS];
+
+/** Action of task A in the current test */
+static void (*task_a_action)(uint32_t pass) = NULL;
+
+/** Number of runs of task A */
+static uint32_t pass_a = 0;
+
+static void task_b(void) { runs[1]++; }
+static void task_c(void) { runs[2]++; }
+
+static void task_a(void)
+{
+	runs[0]++;
+	pass_a++;
+	if (task_a_action != NULL)
+	{
+		task_a_action(pass_a);
+	}
+}
+
+/**
+ * @brief Run the scheduler for a time with 1 ms steps
+ *
+ * @param ms time to run
+ */
+static void run_ms(uint32_t ms)
+{
+	for (uint32_t step = 0; step < ms; step++)
+	{
+		mtm->Running(millis());
+		delay(1);
+	}
+}
+
+/**
+ * @brief Start a test with a new scheduler, A and B every 10 ms, A registered first
+ *
+ * @param action action of task A
+ */
+static void start(void (*action)(uint32_t pass))
+{
+	delete mtm;
+	mtm = new MillisTaskManager();
+	memset(runs, 0, sizeof(runs));
+	pass_a = 0;
+	task_a_action = action;
+	mtm->Register(task_a, 10);
+	mtm->Register(task_b, 10);
+}
+
+static void disable_b(uint32_t pass)
+{
+	if (pass == 2)
+		mtm->SetState(task_b, false);
+}
+
+static void toggle_b(uint32_t pass)
+{
+	if (pass == 2)
+	{
+		mtm->SetState(task_b, false);
+		mtm->SetState(task_b, true);
+	}
+}
+
+static void toggle_logout_b(uint32_t pass)
+{
+	toggle_b(pass);
+	if (pass == 3)
+		mtm->Logout(task_b);
+}
+
+static void logout_b(uint32_t pass)
+{
+	if (pass == 2)
+		mtm->Logout(task_b);
+}
+
+static void register_c(uint32_t pass)
+{
+	if (pass == 2)
+		mtm->Register(task_c, 10);
+}
+
+/**
+ * @brief Disable, enable and logout a task that is due in the same Running call
+ *
+ */
+static void test_same_pass(void)
+{
+	// A disables B while B waits in the same pass, B only ran in the first pass
+	start(disable_b);
+	run_ms(100);
+	CHECK_EQ(runs[0], 10);
+	CHECK_EQ(runs[1], 1);
+	CHECK_EQ(mtm->NextDeadline(millis()) <= 10, 1);
+
+	// Disable and enable again in the same pass, B keeps its 10 ms period, no duplicate heap entry
+	start(toggle_b);
+	run_ms(100);
+	CHECK_EQ(runs[0], 10);
+	CHECK_EQ(runs[1], 10);
+
+	// Logout after the toggle, B is gone and does not come back from a stale heap entry
+	start(toggle_logout_b);
+	run_ms(100);
+	CHECK_EQ(runs[1], 2);
+	CHECK(mtm->Find(task_b) == NULL);
+
+	// Logout of a due task with a heap allocated node, the node is not used after delete
+	start(logout_b);
+	run_ms(100);
+	CHECK_EQ(runs[1], 1);
+	CHECK(mtm->Find(task_b) == NULL);
+
+	// A task registered during a pass runs from the next pass on
+	start(register_c);
+	run_ms(100);
+	CHECK_EQ(runs[2], 9);
+}
+
+/** Job runner pattern, the task disables itself when idle */
+static bool self_busy = true;
+static void task_self(void)
+{
+	runs[3]++;
+	if (!self_busy)
+		mtm->SetState(task_self, false);
+}
+
+/**
+ * @brief A task that disables itself and is registered again later, as the job runner does
+ *
+ */
+static void test_self_disable(void)
+{
+	delete mtm;
+	mtm = new MillisTaskManager();
+	memset(runs, 0, sizeof(runs));
+	static MillisTaskManager::Task_t node;
+	self_busy = false;
+	mtm->Register(&node, task_self, 0);
+	run_ms(20);
+	CHECK_EQ(runs[3], 1);
+	CHECK_EQ(mtm->NextDeadline(millis()), 0xFFFFFFFF);
+	// Registered again, runs again
+	self_busy = true;
+	CHECK(mtm->Register(&node, task_self, 5) == &node);
+	run_ms(20);
+	CHECK_EQ(runs[3], 5);
+}
+
+/** Number of tasks of the random test */
+#define RND_TASKS 12
+
+/** Model of the task states of the random test */
+static bool model_registered[RND_TASKS];
+static bool model_enabled[RND_TASKS];
+/** Task that was executed while it was disabled or logged out */
+static int wrong_runs = 0;
+
+template <int N>
+void rnd_task(void);
+
+/** Task functions of the random test */
+static MillisTaskManager::TaskFunction_t rnd_funcs[RND_TASKS] = {
+	rnd_task<0>, rnd_task<1>, rnd_task<2>, rnd_task<3>, rnd_task<4>, rnd_task<5>,
+	rnd_task<6>, rnd_task<7>, rnd_task<8>, rnd_task<9>, rnd_task<10>, rnd_task<11>};
+
+/**
+ * @brief Apply a random change to a random task, to the scheduler and the model
+ *
+ */
+static void rnd_change(void)
+{
+	int idx = rand() % RND_TASKS;
+	switch (rand() % 4)
+	{
+	case 0:
+	{
+		bool state = rand() % 2;
+		if (mtm->Register(rnd_funcs[idx], rand() % 20, state) != NULL)
+		{
+			model_registered[idx] = true;
+			model_enabled[idx] = state;
+		}
+		break;
+	}
+	case 1:
+		if (mtm->Logout(rnd_funcs[idx]))
+		{
+			model_registered[idx] = false;
+			model_enabled[idx] = false;
+		}
+		break;
+	case 2:
+	{
+		bool state = rand() % 2;
+		if (mtm->SetState(rnd_funcs[idx], state))
+			model_enabled[idx] = state;
+		break;
+	}
+	default:
+		mtm->SetIntervalTime(rnd_funcs[idx], rand() % 20);
+		break;
+	}
+}
+
+template <int N>
+void rnd_task(void)
+{
+	if (!model_registered[N] || !model_enabled[N])
+		wrong_runs++;
+	// Change other tasks while the scheduler runs
+	if (rand() % 3 == 0)
+		rnd_change();
+}
+
+/**
+ * @brief Random changes inside and outside of the tasks, checked against the model
+ *        Every enabled task must keep running, no disabled or logged out task may run
+ *
+ */
+static void test_random(void)
+{
+	for (int seed = 0; seed < 200; seed++)
+	{
+		srand(seed);
+		delete mtm;
+		mtm = new MillisTaskManager(seed % 4 == 0);
+		memset(model_registered, 0, sizeof(model_registered));
+		memset(model_enabled, 0, sizeof(model_enabled));
+		host_set_millis(seed % 2 ? 0xFFFFF000 : 0);
+		for (int step = 0; step < 2000; step++)
+		{
+			if (rand() % 10 == 0)
+				rnd_change();
+			mtm->Running(millis());
+			delay(rand() % 5);
+		}
+		// All enabled tasks are scheduled, with priority only the first due task runs per pass
+		for (int idx = 0; idx < RND_TASKS; idx++)
+		{
+			MillisTaskManager::Task_t *task = mtm->Find(rnd_funcs[idx]);
+			CHECK_EQ(task != NULL, model_registered[idx]);
+			if (task != NULL)
+			{
+				CHECK_EQ(task->State, model_enabled[idx]);
+				CHECK_EQ(task->HeapIndex >= 0, model_enabled[idx]);
+			}
+		}
+	}
+	CHECK_EQ(wrong_runs, 0);
+}
+
+/**
+ * @brief The heap holds at most MTM_MAX_TASKS enabled tasks, disabled tasks do not count
+ *
+ */
+static void test_capacity(void)
+{
+	delete mtm;
+	mtm = new MillisTaskManager();
+	static MillisTaskManager::Task_t nodes[MTM_MAX_TASKS + 1];
+	for (int idx = 0; idx < RND_TASKS; idx++)
+	{
+		CHECK(mtm->Register(&nodes[idx], rnd_funcs[idx], 10) != NULL);
+	}
+	CHECK(mtm->Register(&nodes[RND_TASKS], task_b, 10, false) != NULL);
+	CHECK(mtm->SetState(task_b, true) == (RND_TASKS < MTM_MAX_TASKS));
+}
+
+int main(void)
+{
+	test_same_pass();
+	test_self_disable();
+	test_random();
+	test_capacity();
+	delete mtm;
+	return test_result("test_mtm");
+}
@@ -0,0 +1,327 @@
+/**
+ * @file test_regions.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Host test of the regional parameters in lorawan_regions.h
+ *        The datarate tables of RP002-1.0.x are written out here a second time, every combination of
+ *        region, DR, dwell time, FOpts length and repeater limit is checked against them.
+ *        lpw_min_dr() is checked against a plain search for every payload length, the time on air against
+ *        the Semtech formula (AN1200.13) computed in floating point.
+ * @version 0.1
+ * @date 2025-01-20
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <stdint.h>
+#include <math.h>
+#include "lorawan_regions.h"
+#include "host_test.h"
+
+/** Datarate of the RP002 tables, N is the max application payload */
+struct ref_dr_s
+{
+	uint8_t sf;
+	uint16_t bw;
+	uint8_t n;
+	uint8_t n_dwell;
+};
+
+/** Region of the RP002 tables */
+struct ref_region_s
+{
+	const char *name;
+	ref_dr_s dr[LPW_NUM_DR];
+	uint8_t max_ul_dr;
+	bool dwell_default;
+};
+
+/** Not defined or not used by RUI3 */
+#define REF_RFU {0, 0, 0, 0}
+/** FSK 50 kbps */
+#define REF_FSK {LPW_SF_FSK, 0, 242, 242}
+
+/** RP002-1.0.x EU863-870, EU433 and RU864 use the same datarates */
+#define REF_EU                                                                                           \
+	{                                                                                                    \
+		{12, 125, 51, 51}, {11, 125, 51, 51}, {10, 125, 51, 51}, {9, 125, 115, 115}, {8, 125, 242, 242}, \
+			{7, 125, 242, 242}, {7, 250, 242, 242}, REF_FSK, REF_RFU, REF_RFU, REF_RFU, REF_RFU,         \
+			REF_RFU, REF_RFU, REF_RFU, REF_RFU                                                           \
+	}
+
+/** RP002-1.0.x US902-928, DR5 and DR6 are RFU, DR8 to DR13 are downlink only */
+#define REF_US                                                                                                \
+	{                                                                                                         \
+		{10, 125, 11, 11}, {9, 125, 53, 53}, {8, 125, 125, 125}, {7, 125, 242, 242}, {8, 500, 242, 242},      \
+			REF_RFU, REF_RFU, REF_RFU, {12, 500, 53, 53}, {11, 500, 129, 129}, {10, 500, 242, 242},           \
+			{9, 500, 242, 242}, {8, 500, 242, 242}, {7, 500, 242, 242}, REF_RFU, REF_RFU                      \
+	}
+
+/** RP002-1.0.x AU915-928, LA915 uses the same plan, DR8 to DR13 are downlink only */
+#define REF_AU                                                                                             \
+	{                                                                                                      \
+		{12, 125, 51, 0}, {11, 125, 51, 0}, {10, 125, 51, 11}, {9, 125, 115, 53}, {8, 125, 242, 125},      \
+			{7, 125, 242, 242}, {8, 500, 242, 242}, REF_RFU, {12, 500, 53, 53}, {11, 500, 129, 129},       \
+			{10, 500, 242, 242}, {9, 500, 242, 242}, {8, 500, 242, 242}, {7, 500, 242, 242}, REF_RFU, REF_RFU \
+	}
+
+/** RP002-1.0.x AS923, the same for all four frequency plans */
+#define REF_AS                                                                                              \
+	{                                                                                                       \
+		{12, 125, 51, 0}, {11, 125, 51, 0}, {10, 125, 51, 11}, {9, 125, 115, 53}, {8, 125, 242, 125},       \
+			{7, 125, 242, 242}, {7, 250, 242, 242}, REF_FSK, REF_RFU, REF_RFU, REF_RFU, REF_RFU,            \
+			REF_RFU, REF_RFU, REF_RFU, REF_RFU                                                              \
+	}
+
+/** RP002-1.0.x CN470-510 and KR920-923, DR0 to DR5 */
+#define REF_CN_KR                                                                                        \
+	{                                                                                                    \
+		{12, 125, 51, 51}, {11, 125, 51, 51}, {10, 125, 51, 51}, {9, 125, 115, 115}, {8, 125, 242, 242}, \
+			{7, 125, 242, 242}, REF_RFU, REF_RFU, REF_RFU, REF_RFU, REF_RFU, REF_RFU,                    \
+			REF_RFU, REF_RFU, REF_RFU, REF_RFU                                                           \
+	}
+
+/** RP002-1.0.x IN865-867, DR6 is RFU */
+#define REF_IN                                                                                           \
+	{                                                                                                    \
+		{12, 125, 51, 51}, {11, 125, 51, 51}, {10, 125, 51, 51}, {9, 125, 115, 115}, {8, 125, 242, 242}, \
+			{7, 125, 242, 242}, REF_RFU, REF_FSK, REF_RFU, REF_RFU, REF_RFU, REF_RFU,                    \
+			REF_RFU, REF_RFU, REF_RFU, REF_RFU                                                           \
+	}
+
+/** Reference tables, indexed by RUI3 band number */
+static const ref_region_s ref_regions[LPW_NUM_REGIONS] = {
+	{"EU433", REF_EU, 7, false},
+	{"CN470", REF_CN_KR, 5, false},
+	{"RU864", REF_EU, 7, false},
+	{"IN865", REF_IN, 7, false},
+	{"EU868", REF_EU, 7, false},
+	{"US915", REF_US, 4, false},
+	{"AU915", REF_AU, 6, false},
+	{"KR920", REF_CN_KR, 5, false},
+	{"AS923-1", REF_AS, 7, true},
+	{"AS923-2", REF_AS, 7, true},
+	{"AS923-3", REF_AS, 7, true},
+	{"AS923-4", REF_AS, 7, true},
+	{"LA915", REF_AU, 6, false},
+};
+
+/** Largest FOpts length, 15 bytes */
+#define REF_MAX_FOPTS 15
+
+/**
+ * @brief Max application payload from the reference tables
+ *
+ * @param region RUI3 band number
+ * @param dr datarate
+ * @param dwell true if 400 ms dwell time limit is active
+ * @param fopts FOpts length
+ * @param repeater true if repeater compatible size is required
+ * @return uint8_t max payload, 0 if nothing fits
+ */
+static uint8_t ref_max_payload(uint8_t region, uint8_t dr, bool dwell, uint8_t fopts, bool repeater)
+{
+	if ((region >= LPW_NUM_REGIONS) || (dr >= LPW_NUM_DR))
+	{
+		return 0;
+	}
+	const ref_dr_s *ref = &ref_regions[region].dr[dr];
+	int16_t size = dwell ? ref->n_dwell : ref->n;
+	if (repeater && (size > LPW_REPEATER_MAX_PAYLOAD))
+	{
+		size = LPW_REPEATER_MAX_PAYLOAD;
+	}
+	size -= fopts;
+	return size > 0 ? size : 0;
+}
+
+/**
+ * @brief Lowest uplink datarate for a payload, plain search over the reference tables
+ *
+ * @param region RUI3 band number
+ * @param len payload size
+ * @param dwell true if 400 ms dwell time limit is active
+ * @param fopts FOpts length
+ * @param repeater true if repeater compatible size is required
+ * @return uint8_t datarate or LPW_DR_NONE
+ */
+static uint8_t ref_min_dr(uint8_t region, uint16_t len, bool dwell, uint8_t fopts, bool repeater)
+{
+	for (uint8_t dr = 0; dr <= ref_regions[region].max_ul_dr; dr++)
+	{
+		uint8_t max_payload = ref_max_payload(region, dr, dwell, fopts, repeater);
+		if ((max_payload != 0) && (len <= max_payload))
+		{
+			return dr;
+		}
+	}
+	return LPW_DR_NONE;
+}
+
+/**
+ * @brief LoRa time on air, Semtech AN1200.13 in floating point
+ *
+ * @param sf spreading factor
+ * @param bw bandwidth in kHz
+ * @param cr coding rate 1 = 4/5 to 4 = 4/8
+ * @param preamble preamble length in symbols
+ * @param explicit_header true if explicit header is used
+ * @param crc true if payload CRC is used
+ * @param len PHY payload size
+ * @return double time on air in us
+ */
+static double ref_lora_toa_us(uint8_t sf, uint16_t bw, uint8_t cr, uint16_t preamble, bool explicit_header, bool crc, uint16_t len)
+{
+	double t_sym = pow(2.0, sf) / (bw * 1000.0) * 1e6;
+	// Low data rate optimization for symbols longer than 16 ms
+	int de = t_sym > 16000.0 ? 1 : 0;
+	double t_preamble = (preamble + 4.25) * t_sym;
+	double num = 8.0 * len - 4.0 * sf + 28 + 16 * (crc ? 1 : 0) - 20 * (explicit_header ? 0 : 1);
+	double symbols = 8 + fmax(ceil(num / (4.0 * (sf - 2 * de))) * (cr + 4), 0.0);
+	return t_preamble + symbols * t_sym;
+}
+
+/**
+ * @brief FSK time on air at 50 kbps, 5 bytes preamble, 3 bytes sync word, length byte and CRC
+ *
+ * @param len PHY payload size
+ * @return double time on air in us
+ */
+static double ref_fsk_toa_us(uint16_t len)
+{
+	return (5 + 3 + 1 + len + 2) * 8 / 50000.0 * 1e6;
+}
+
+/**
+ * @brief Datarate parameters and the region data against the reference tables
+ */
+static void test_tables(void)
+{
+	for (uint8_t region = 0; region < LPW_NUM_REGIONS; region++)
+	{
+		const ref_region_s *ref = &ref_regions[region];
+		CHECK_EQ(lpw_regions[region].min_ul_dr, 0);
+		CHECK_EQ(lpw_regions[region].max_ul_dr, ref->max_ul_dr);
+		CHECK_EQ(lpw_regions[region].dwell_default, ref->dwell_default);
+		for (uint8_t dr = 0; dr < LPW_NUM_DR; dr++)
+		{
+			CHECK_EQ(lpw_sf(region, dr), ref->dr[dr].sf);
+			CHECK_EQ(lpw_bw(region, dr), ref->dr[dr].bw);
+		}
+		// Out of range datarates
+		CHECK_EQ(lpw_sf(region, LPW_NUM_DR), 0);
+		CHECK_EQ(lpw_bw(region, LPW_NUM_DR), 0);
+		CHECK_EQ(lpw_max_payload(region, LPW_NUM_DR, false), 0);
+	}
+	// Out of range region
+	CHECK_EQ(lpw_sf(LPW_NUM_REGIONS, 0), 0);
+	CHECK_EQ(lpw_max_payload(LPW_NUM_REGIONS, 0, false), 0);
+	CHECK_EQ(lpw_min_dr(LPW_NUM_REGIONS, 1, false), LPW_DR_NONE);
+	CHECK_EQ(lpw_toa_us(LPW_NUM_REGIONS, 0, 10), 0);
+}
+
+/**
+ * @brief Max payload of every region, DR, dwell time, FOpts length and repeater limit
+ */
+static void test_max_payload(void)
+{
+	for (uint8_t region = 0; region < LPW_NUM_REGIONS; region++)
+	{
+		for (uint8_t dr = 0; dr < LPW_NUM_DR; dr++)
+		{
+			for (uint8_t dwell = 0; dwell < 2; dwell++)
+			{
+				for (uint8_t fopts = 0; fopts <= REF_MAX_FOPTS; fopts++)
+				{
+					for (uint8_t repeater = 0; repeater < 2; repeater++)
+					{
+						CHECK_EQ(lpw_max_payload(region, dr, dwell, fopts, repeater), ref_max_payload(region, dr, dwell, fopts, repeater));
+					}
+				}
+			}
+		}
+	}
+}
+
+/**
+ * @brief Lowest datarate for every payload length 0 to 243
+ */
+static void test_min_dr(void)
+{
+	for (uint8_t region = 0; region < LPW_NUM_REGIONS; region++)
+	{
+		for (uint16_t len = 0; len <= 243; len++)
+		{
+			for (uint8_t dwell = 0; dwell < 2; dwell++)
+			{
+				for (uint8_t fopts = 0; fopts <= REF_MAX_FOPTS; fopts++)
+				{
+					for (uint8_t repeater = 0; repeater < 2; repeater++)
+					{
+						CHECK_EQ(lpw_min_dr(region, len, dwell, fopts, repeater), ref_min_dr(region, len, dwell, fopts, repeater));
+					}
+				}
+			}
+		}
+	}
+}
+
+/**
+ * @brief Time on air of all SF, BW and lengths, and of every uplink datarate of every region
+ */
+static void test_toa(void)
+{
+	static const uint16_t bws[] = {125, 250, 500};
+	for (uint8_t sf = 7; sf <= 12; sf++)
+	{
+		for (uint8_t bw = 0; bw < sizeof(bws) / sizeof(bws[0]); bw++)
+		{
+			for (uint16_t len = 0; len <= 255; len++)
+			{
+				for (uint8_t cr = 1; cr <= 4; cr++)
+				{
+					for (uint8_t header = 0; header < 2; header++)
+					{
+						double ref = ref_lora_toa_us(sf, bws[bw], cr, 8, header, true, len);
+						CHECK(fabs(lora_toa_us(sf, bws[bw], cr, 8, header, true, len) - ref) < 0.5);
+					}
+				}
+				double ref = ref_lora_toa_us(sf, bws[bw], 1, 8, true, false, len);
+				CHECK(fabs(lora_toa_us(sf, bws[bw], 1, 8, true, false, len) - ref) < 0.5);
+			}
+		}
+	}
+
+	for (uint8_t region = 0; region < LPW_NUM_REGIONS; region++)
+	{
+		for (uint8_t dr = 0; dr < LPW_NUM_DR; dr++)
+		{
+			const ref_dr_s *ref = &ref_regions[region].dr[dr];
+			for (uint16_t len = 0; len <= 242; len++)
+			{
+				for (uint8_t fopts = 0; fopts <= REF_MAX_FOPTS; fopts += 5)
+				{
+					uint16_t phy_len = len + LPW_PHY_OVERHEAD + fopts;
+					double toa = 0;
+					if (ref->sf == LPW_SF_FSK)
+					{
+						toa = ref_fsk_toa_us(phy_len);
+					}
+					else if (ref->sf != 0)
+					{
+						toa = ref_lora_toa_us(ref->sf, ref->bw, 1, 8, true, true, phy_len);
+					}
+					CHECK(fabs(lpw_toa_us(region, dr, len, fopts) - toa) < 0.5);
+				}
+			}
+		}
+	}
+}
+
+int main(void)
+{
+	test_tables();
+	test_max_payload();
+	test_min_dr();
+	test_toa();
+	return test_result("test_regions");
+}
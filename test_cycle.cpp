@@ -0,0 +1,225 @@
+/**
+ * @file test_cycle.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Test cycle state machine of the application
+ *        The send timer and the LoRa, GNSS, SD card and display callbacks report their events.
+ *        The state machine owns the cycle, the actions of its transitions send the packet, start and stop
+ *        the location acquisition and start the display, its timeouts end the acquisition without location,
+ *        the wait for the FieldTester downlink and stuck stages. It measures the time spent in each stage.
+ * @version 0.1
+ * @date 2025-01-09
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "app.h"
+
+/** Test cycle of the current test mode */
+static cycle_sm_s g_cycle = {NULL};
+
+/**
+ * @brief Get the transition table for the current test mode
+ *
+ * @return const cycle_table_s* transition table
+ */
+static const cycle_table_s *cycle_get_table(void)
+{
+	if (!api.lorawan.nwm.get())
+	{
+		return &cycle_p2p_table;
+	}
+	if ((g_custom_parameters.test_mode == MODE_FIELDTESTER) || (g_custom_parameters.test_mode == MODE_FIELDTESTER_V2))
+	{
+		return &cycle_fieldtester_table;
+	}
+	return &cycle_linkcheck_table;
+}
+
+/**
+ * @brief Run the action of a transition
+ *        The state has changed already, an action can report the next event
+ *
+ * @param action cycle_action_num_t
+ */
+static void cycle_run_action(uint8_t action)
+{
+	switch (action)
+	{
+	case CACT_SEND:
+		send_test_packet();
+		break;
+	case CACT_ACQUIRE:
+		cycle_sm_set_timeout(&g_cycle, CYCLE_ACQUIRE, gnss_start_acquisition());
+		return;
+	case CACT_SEND_FIX:
+		gnss_send_fix();
+		break;
+	case CACT_STOP_GNSS:
+		gnss_stop_acquisition();
+		return;
+	case CACT_NO_DL:
+		no_dl_handler();
+		return;
+	case CACT_SHOW:
+		lat_timer_start(RAK_TIMER_1, 250, NULL);
+		return;
+	default:
+		return;
+	}
+	// Nothing was handed to the stack
+	if ((g_cycle.state == CYCLE_TX) && !tx_active)
+	{
+		cycle_event(CEV_SKIP);
+	}
+}
+
+/**
+ * @brief Report an event of the test cycle and run the action of the transition
+ *        The statistics start new if the test mode was changed
+ *
+ * @param event cycle_event_num_t
+ * @return true state changed
+ * @return false event ignored in the current state
+ */
+bool cycle_event(uint8_t event)
+{
+	const cycle_table_s *table = cycle_get_table();
+	if (g_cycle.table != table)
+	{
+		cycle_sm_init(&g_cycle, table, millis());
+	}
+	uint8_t old_state = g_cycle.state;
+	if (!cycle_sm_event(&g_cycle, event, millis()))
+	{
+		return false;
+	}
+	uint8_t action = g_cycle.action;
+	MYLOG("CYCLE", "%s -> %s %s", cycle_state_names[old_state], cycle_state_names[g_cycle.state], cycle_action_names[action]);
+	cycle_run_action(action);
+	return true;
+}
+
+/**
+ * @brief Get the current stage of the test cycle
+ *
+ * @return uint8_t cycle_state_num_t
+ */
+uint8_t cycle_get_state(void)
+{
+	return g_cycle.state;
+}
+
+/**
+ * @brief Get the test cycle event of a display reason
+ *
+ * @param reason display reason, see display_event
+ * @return uint8_t cycle_event_num_t, CYCLE_NUM_EVENTS if the display reason is not part of a test cycle
+ */
+uint8_t cycle_reason_event(uint8_t reason)
+{
+	switch (reason)
+	{
+	case 1:	 // P2P packet
+	case 4:	 // LinkCheck result
+	case 6:	 // FieldTester downlink
+	case 10: // Meshtastic packet
+		return CEV_RX;
+	case 2: // TX failed
+		return CEV_TX_FAIL;
+	case 7: // FieldTester no downlink
+		return CEV_RX_TIMEOUT;
+	case 8: // TX finished
+		return CEV_TX_DONE;
+	default: // Join result
+		return CYCLE_NUM_EVENTS;
+	}
+}
+
+/**
+ * @brief Time until the current stage of the test cycle times out
+ *
+ * @return uint32_t time in ms, 0xFFFFFFFF if the stage has no timeout
+ */
+uint32_t cycle_next_timeout(void)
+{
+	if (g_cycle.table == NULL)
+	{
+		return 0xFFFFFFFF;
+	}
+	return cycle_sm_next_timeout(&g_cycle, millis());
+}
+
+/**
+ * @brief Check the timeout of the current stage
+ *        The timeout of the location acquisition and of the FieldTester downlink run their actions.
+ *        A stuck cycle is counted and the state machine waits for the next cycle,
+ *        tx_active and ready_to_dump stay with the callbacks, a late TX done still gets its display event.
+ *
+ */
+void cycle_check(void)
+{
+	if (g_cycle.table == NULL)
+	{
+		return;
+	}
+	uint8_t old_state = g_cycle.state;
+	if (!cycle_sm_check(&g_cycle, millis()))
+	{
+		return;
+	}
+	uint8_t action = g_cycle.action;
+	MYLOG("CYCLE", "Timeout in %s %s", cycle_state_names[old_state], cycle_action_names[action]);
+	if (action == CACT_ABORT)
+	{
+		// Keep the history of the stuck cycle
+		trace_fault(TEV_CYCLE_TIMEOUT, old_state);
+		return;
+	}
+	cycle_run_action(action);
+}
+
+/**
+ * @brief Format the statistics of one stage of the test cycle
+ *        Format <state>:<entries>:<time s>:<average ms>:<timeouts>
+ *        The last line is <mode>:<current state>:<ignored events>
+ *
+ * @param idx line index
+ * @param line output buffer
+ * @param size size of the output buffer
+ * @return int length of the line, -1 after the last line
+ */
+int cycle_format(uint8_t idx, char *line, size_t size)
+{
+	if (g_cycle.table == NULL)
+	{
+		cycle_sm_init(&g_cycle, cycle_get_table(), millis());
+	}
+	if (idx < CYCLE_NUM_STATES)
+	{
+		uint32_t time_ms = cycle_sm_time(&g_cycle, idx, millis());
+		uint32_t entries = g_cycle.entries[idx];
+		return snprintf(line, size, "%s:%ld:%ld:%ld:%ld", cycle_state_names[idx], entries, time_ms / 1000,
+						entries == 0 ? 0 : time_ms / entries, g_cycle.timeouts[idx]);
+	}
+	if (idx == CYCLE_NUM_STATES)
+	{
+		return snprintf(line, size, "%s:%s:%ld", g_cycle.table->name, cycle_state_names[g_cycle.state], g_cycle.ignored);
+	}
+	return -1;
+}
+
+/**
+ * @brief Start new test cycle statistics
+ *
+ */
+void cycle_reset(void)
+{
+	const cycle_table_s *table = cycle_get_table();
+	if (g_cycle.table != table)
+	{
+		cycle_sm_init(&g_cycle, table, millis());
+		return;
+	}
+	// Keep the running cycle
+	cycle_sm_clear(&g_cycle, millis());
+}
@@ -0,0 +1,339 @@
+/**
+ * @file test_cycle.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Table driven state machine of one test cycle
+ *        One transition table per test mode describes the stages of a test cycle
+ *        (acquire location, TX, wait for RX, log, display), the action of each transition
+ *        and the timeout of each stage. A stage that times out raises its timeout event,
+ *        a stage without timeout event ends the cycle.
+ *        No Arduino dependencies, the time is passed in, the actions are run by the caller,
+ *        the state machine can be run on a host.
+ * @version 0.1
+ * @date 2025-01-09
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef TEST_CYCLE_H
+#define TEST_CYCLE_H
+
+#include <stdint.h>
+
+/** States of a test cycle */
+typedef enum cycle_state_num
+{
+	CYCLE_IDLE = 0,	   // Waiting for the next test
+	CYCLE_ACQUIRE = 1, // Waiting for a location fix
+	CYCLE_TX = 2,	   // Packet handed to the stack, waiting for TX done
+	CYCLE_WAIT_RX = 3, // Waiting for LinkCheck answer or downlink
+	CYCLE_LOG = 4,	   // Result known, waiting for the SD card entry
+	CYCLE_DISPLAY = 5, // Waiting for the display update
+	CYCLE_NUM_STATES = 6
+} cycle_state_num_t;
+
+/** Events of a test cycle */
+typedef enum cycle_event_num
+{
+	CEV_START = 0,		// Send timer fired or forced TX
+	CEV_ACQUIRE = 1,	// Location acquisition started
+	CEV_FIX = 2,		// Location found
+	CEV_NO_FIX = 3,		// Location acquisition timeout, raised by the state machine
+	CEV_SKIP = 4,		// No TX in this cycle (duty cycle, not joined, send error, batch sample)
+	CEV_TX_DONE = 5,	// TX finished
+	CEV_TX_FAIL = 6,	// TX failed
+	CEV_RX = 7,			// LinkCheck answer, downlink or P2P packet received
+	CEV_RX_TIMEOUT = 8, // No downlink received, TX failed in FieldTester mode or raised by the state machine
+	CEV_LOGGED = 9,		// SD card entry written
+	CEV_SHOWN = 10,		// Display updated
+	CYCLE_NUM_EVENTS = 11
+} cycle_event_num_t;
+
+/** Actions of the transitions, run by the application after the state changed */
+typedef enum cycle_action_num
+{
+	CACT_NONE = 0,		// Nothing to do
+	CACT_SEND = 1,		// Prepare and send the packet of the test mode
+	CACT_ACQUIRE = 2,	// Start the location acquisition
+	CACT_SEND_FIX = 3,	// Send the packet with the location found
+	CACT_STOP_GNSS = 4, // Stop the location acquisition without location
+	CACT_NO_DL = 5,		// Show the result without downlink
+	CACT_SHOW = 6,		// Show the result
+	CACT_ABORT = 7,		// Stage timed out without timeout event, the cycle ended
+	CYCLE_NUM_ACTIONS = 8
+} cycle_action_num_t;
+
+/** One transition */
+struct cycle_transition_s
+{
+	uint8_t state;	// cycle_state_num_t
+	uint8_t event;	// cycle_event_num_t
+	uint8_t next;	// cycle_state_num_t
+	uint8_t action; // cycle_action_num_t
+};
+
+/** Transition table of a test mode */
+struct cycle_table_s
+{
+	const char *name;
+	const cycle_transition_s *transitions;
+	uint8_t num;
+	uint32_t timeout_ms[CYCLE_NUM_STATES];	 // 0 = no timeout
+	uint8_t timeout_event[CYCLE_NUM_STATES]; // Event raised on timeout, CYCLE_NUM_EVENTS ends the cycle
+};
+
+/** State machine with time statistics */
+struct cycle_sm_s
+{
+	const cycle_table_s *table;
+	uint8_t state;
+	uint8_t action;						  // cycle_action_num_t of the last transition
+	uint32_t entered;					  // Time the state was entered
+	uint32_t timeout_ms[CYCLE_NUM_STATES]; // Timeouts of the stages, the table values or set by the application
+	uint32_t time_ms[CYCLE_NUM_STATES];	  // Time spent in each state
+	uint32_t entries[CYCLE_NUM_STATES];	  // Number of times each state was entered
+	uint32_t timeouts[CYCLE_NUM_STATES];  // Number of timeouts of each state
+	uint32_t ignored;					  // Events without transition in the current state
+};
+
+/** Timeouts of LinkCheck and P2P, IDLE waits for the send timer */
+#define CYCLE_TIMEOUTS {0, 0, 30000, 20000, 5000, 5000}
+/** Timeouts of FieldTester, the acquisition time is set for each cycle, the downlink is expected within 10 s */
+#define CYCLE_FT_TIMEOUTS {0, 30000, 30000, 10000, 5000, 5000}
+/** All stages end the cycle on timeout */
+#define CYCLE_NO_TIMEOUT_EVENTS {CYCLE_NUM_EVENTS, CYCLE_NUM_EVENTS, CYCLE_NUM_EVENTS, CYCLE_NUM_EVENTS, CYCLE_NUM_EVENTS, CYCLE_NUM_EVENTS}
+/** FieldTester, no location and no downlink are results of the cycle */
+#define CYCLE_FT_TIMEOUT_EVENTS {CYCLE_NUM_EVENTS, CEV_NO_FIX, CYCLE_NUM_EVENTS, CEV_RX_TIMEOUT, CYCLE_NUM_EVENTS, CYCLE_NUM_EVENTS}
+
+/** LoRaWAN LinkCheck */
+static const cycle_transition_s cycle_linkcheck_transitions[] = {
+	{CYCLE_IDLE, CEV_START, CYCLE_TX, CACT_SEND},
+	{CYCLE_TX, CEV_SKIP, CYCLE_IDLE, CACT_NONE},
+	{CYCLE_TX, CEV_TX_DONE, CYCLE_WAIT_RX, CACT_NONE},
+	{CYCLE_TX, CEV_TX_FAIL, CYCLE_LOG, CACT_SHOW},
+	{CYCLE_TX, CEV_RX, CYCLE_LOG, CACT_SHOW},
+	{CYCLE_WAIT_RX, CEV_RX, CYCLE_LOG, CACT_SHOW},
+	{CYCLE_WAIT_RX, CEV_TX_FAIL, CYCLE_LOG, CACT_SHOW},
+	{CYCLE_LOG, CEV_LOGGED, CYCLE_DISPLAY, CACT_NONE},
+	{CYCLE_LOG, CEV_SHOWN, CYCLE_IDLE, CACT_NONE},
+	{CYCLE_DISPLAY, CEV_SHOWN, CYCLE_IDLE, CACT_NONE},
+};
+
+/** FieldTester V1 and V2, the result comes with a downlink from the backend */
+static const cycle_transition_s cycle_fieldtester_transitions[] = {
+	{CYCLE_IDLE, CEV_START, CYCLE_TX, CACT_SEND},
+	{CYCLE_TX, CEV_ACQUIRE, CYCLE_ACQUIRE, CACT_ACQUIRE},
+	{CYCLE_ACQUIRE, CEV_FIX, CYCLE_TX, CACT_SEND_FIX},
+	{CYCLE_ACQUIRE, CEV_NO_FIX, CYCLE_IDLE, CACT_STOP_GNSS},
+	{CYCLE_TX, CEV_SKIP, CYCLE_IDLE, CACT_NONE},
+	{CYCLE_TX, CEV_TX_DONE, CYCLE_WAIT_RX, CACT_NONE},
+	{CYCLE_TX, CEV_TX_FAIL, CYCLE_LOG, CACT_SHOW},
+	{CYCLE_TX, CEV_RX, CYCLE_LOG, CACT_SHOW},
+	{CYCLE_TX, CEV_RX_TIMEOUT, CYCLE_LOG, CACT_SHOW},
+	{CYCLE_WAIT_RX, CEV_RX, CYCLE_LOG, CACT_SHOW},
+	{CYCLE_WAIT_RX, CEV_RX_TIMEOUT, CYCLE_LOG, CACT_NO_DL},
+	{CYCLE_LOG, CEV_LOGGED, CYCLE_DISPLAY, CACT_NONE},
+	{CYCLE_LOG, CEV_SHOWN, CYCLE_IDLE, CACT_NONE},
+	{CYCLE_DISPLAY, CEV_SHOWN, CYCLE_IDLE, CACT_NONE},
+};
+
+/** LoRa P2P and Meshtastic, received packets are a test cycle of their own */
+static const cycle_transition_s cycle_p2p_transitions[] = {
+	{CYCLE_IDLE, CEV_START, CYCLE_TX, CACT_SEND},
+	{CYCLE_IDLE, CEV_RX, CYCLE_LOG, CACT_SHOW},
+	{CYCLE_TX, CEV_SKIP, CYCLE_IDLE, CACT_NONE},
+	{CYCLE_TX, CEV_TX_DONE, CYCLE_LOG, CACT_SHOW},
+	{CYCLE_TX, CEV_RX, CYCLE_LOG, CACT_SHOW},
+	{CYCLE_LOG, CEV_LOGGED, CYCLE_DISPLAY, CACT_NONE},
+	{CYCLE_LOG, CEV_SHOWN, CYCLE_IDLE, CACT_NONE},
+	{CYCLE_DISPLAY, CEV_SHOWN, CYCLE_IDLE, CACT_NONE},
+};
+
+static const cycle_table_s cycle_linkcheck_table = {"LinkCheck", cycle_linkcheck_transitions,
+													sizeof(cycle_linkcheck_transitions) / sizeof(cycle_transition_s),
+													CYCLE_TIMEOUTS, CYCLE_NO_TIMEOUT_EVENTS};
+static const cycle_table_s cycle_fieldtester_table = {"FieldTester", cycle_fieldtester_transitions,
+													  sizeof(cycle_fieldtester_transitions) / sizeof(cycle_transition_s),
+													  CYCLE_FT_TIMEOUTS, CYCLE_FT_TIMEOUT_EVENTS};
+static const cycle_table_s cycle_p2p_table = {"P2P", cycle_p2p_transitions,
+											  sizeof(cycle_p2p_transitions) / sizeof(cycle_transition_s),
+											  CYCLE_TIMEOUTS, CYCLE_NO_TIMEOUT_EVENTS};
+
+/** Names of the states */
+static const char *const cycle_state_names[CYCLE_NUM_STATES] = {"idle", "acquire", "tx", "wait_rx", "log", "display"};
+
+/** Names of the actions */
+static const char *const cycle_action_names[CYCLE_NUM_ACTIONS] = {"none", "send", "acquire", "send_fix", "stop_gnss", "no_dl", "show", "abort"};
+
+/**
+ * @brief Change the state and account the time spent in the old state
+ *
+ * @param sm state machine
+ * @param next new state
+ * @param action cycle_action_num_t of the transition
+ * @param now current time in ms
+ */
+static inline void cycle_sm_enter(cycle_sm_s *sm, uint8_t next, uint8_t action, uint32_t now)
+{
+	sm->time_ms[sm->state] += now - sm->entered;
+	sm->state = next;
+	sm->action = action;
+	sm->entered = now;
+	sm->entries[next]++;
+}
+
+/**
+ * @brief Clear the statistics, the current state and the timeouts are kept
+ *
+ * @param sm state machine
+ * @param now current time in ms
+ */
+static inline void cycle_sm_clear(cycle_sm_s *sm, uint32_t now)
+{
+	sm->entered = now;
+	for (uint8_t idx = 0; idx < CYCLE_NUM_STATES; idx++)
+	{
+		sm->time_ms[idx] = 0;
+		sm->entries[idx] = 0;
+		sm->timeouts[idx] = 0;
+	}
+	sm->ignored = 0;
+}
+
+/**
+ * @brief Start a state machine in idle state with the timeouts of the table and cleared statistics
+ *
+ * @param sm state machine
+ * @param table transition table of the test mode
+ * @param now current time in ms
+ */
+static inline void cycle_sm_init(cycle_sm_s *sm, const cycle_table_s *table, uint32_t now)
+{
+	sm->table = table;
+	sm->state = CYCLE_IDLE;
+	sm->action = CACT_NONE;
+	for (uint8_t idx = 0; idx < CYCLE_NUM_STATES; idx++)
+	{
+		sm->timeout_ms[idx] = table->timeout_ms[idx];
+	}
+	cycle_sm_clear(sm, now);
+}
+
+/**
+ * @brief Set the timeout of a stage, e.g. the location acquisition time
+ *        A running stage uses the new timeout, counted from the time it was entered
+ *
+ * @param sm state machine
+ * @param state cycle_state_num_t
+ * @param timeout_ms timeout in ms, 0 = no timeout
+ */
+static inline void cycle_sm_set_timeout(cycle_sm_s *sm, uint8_t state, uint32_t timeout_ms)
+{
+	if (state < CYCLE_NUM_STATES)
+	{
+		sm->timeout_ms[state] = timeout_ms;
+	}
+}
+
+/**
+ * @brief Find the transition of an event in the current state
+ *
+ * @param sm state machine
+ * @param event cycle_event_num_t
+ * @return const cycle_transition_s* transition, NULL if the event has no transition in the current state
+ */
+static inline const cycle_transition_s *cycle_sm_find(cycle_sm_s *sm, uint8_t event)
+{
+	for (uint8_t idx = 0; idx < sm->table->num; idx++)
+	{
+		const cycle_transition_s *transition = &sm->table->transitions[idx];
+		if ((transition->state == sm->state) && (transition->event == event))
+		{
+			return transition;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Handle an event, the action of the transition is in sm->action
+ *
+ * @param sm state machine
+ * @param event cycle_event_num_t
+ * @param now current time in ms
+ * @return true transition found, state changed
+ * @return false no transition for the event in the current state, event ignored
+ */
+static inline bool cycle_sm_event(cycle_sm_s *sm, uint8_t event, uint32_t now)
+{
+	const cycle_transition_s *transition = cycle_sm_find(sm, event);
+	if (transition == NULL)
+	{
+		sm->ignored++;
+		return false;
+	}
+	cycle_sm_enter(sm, transition->next, transition->action, now);
+	return true;
+}
+
+/**
+ * @brief Time until the current state times out
+ *
+ * @param sm state machine
+ * @param now current time in ms
+ * @return uint32_t time in ms, 0 if timed out, 0xFFFFFFFF if the state has no timeout
+ */
+static inline uint32_t cycle_sm_next_timeout(cycle_sm_s *sm, uint32_t now)
+{
+	uint32_t timeout = sm->timeout_ms[sm->state];
+	if (timeout == 0)
+	{
+		return 0xFFFFFFFF;
+	}
+	uint32_t elapsed = now - sm->entered;
+	return elapsed >= timeout ? 0 : timeout - elapsed;
+}
+
+/**
+ * @brief Check the timeout of the current state
+ *        A timed out state takes the transition of its timeout event,
+ *        without timeout event the cycle goes back to idle with the action CACT_ABORT.
+ *        The action of the transition is in sm->action.
+ *
+ * @param sm state machine
+ * @param now current time in ms
+ * @return true state timed out
+ * @return false no timeout
+ */
+static inline bool cycle_sm_check(cycle_sm_s *sm, uint32_t now)
+{
+	if (cycle_sm_next_timeout(sm, now) != 0)
+	{
+		return false;
+	}
+	sm->timeouts[sm->state]++;
+	const cycle_transition_s *transition = cycle_sm_find(sm, sm->table->timeout_event[sm->state]);
+	if (transition == NULL)
+	{
+		cycle_sm_enter(sm, CYCLE_IDLE, CACT_ABORT, now);
+	}
+	else
+	{
+		cycle_sm_enter(sm, transition->next, transition->action, now);
+	}
+	return true;
+}
+
+/**
+ * @brief Time spent in a state, including the time in the current state
+ *
+ * @param sm state machine
+ * @param state cycle_state_num_t
+ * @param now current time in ms
+ * @return uint32_t time in ms
+ */
+static inline uint32_t cycle_sm_time(cycle_sm_s *sm, uint8_t state, uint32_t now)
+{
+	return sm->time_ms[state] + (state == sm->state ? now - sm->entered : 0);
+}
+
+#endif
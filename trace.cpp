@@ -0,0 +1,151 @@
+/**
+ * @file trace.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Binary trace of radio, GNSS, SD card, display and button events
+ *        Fixed size RAM ring, the oldest events are overwritten. Each event has a microsecond timestamp,
+ *        an event id and two arguments. Recording only copies 12 bytes, it works in release builds without MYLOG.
+ *        The ring is dumped as hex lines over AT command or to the SD card, trace_decoder.py turns it into a timeline.
+ * @version 0.1
+ * @date 2025-01-12
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "app.h"
+
+/** Event ring */
+static trace_event_s trace_ring[TRACE_SIZE];
+
+/** Number of recorded events since the start, the ring holds the last TRACE_SIZE */
+static volatile uint32_t trace_count = 0;
+
+/** millis() of the last event, a sync event is added after long pauses */
+static uint32_t trace_last_ms = 0;
+
+/** millis() of the last trace saved to the SD card */
+static uint32_t trace_saved_ms = 0;
+
+/** Flag if the trace was saved to the SD card */
+static bool trace_saved = false;
+
+/**
+ * @brief Record one event
+ *        Can be called from interrupts and callbacks
+ *
+ * @param id trace_event_num_t
+ * @param arg0 first argument, meaning depends on the event
+ * @param arg1 second argument, meaning depends on the event
+ */
+void trace_add(uint8_t id, uint16_t arg0, uint32_t arg1)
+{
+	noInterrupts();
+	// Read inside the critical section, an interrupt between the read and the update of trace_last_ms would make the pause negative
+	uint32_t now_ms = millis();
+	// The microsecond timestamp wraps after 71 minutes, sync events let the decoder follow long pauses
+	uint32_t pause_ms = now_ms - trace_last_ms;
+	if (pause_ms > TRACE_SYNC_MS)
+	{
+		trace_event_s *sync = &trace_ring[trace_count % TRACE_SIZE];
+		sync->time_us = micros();
+		sync->id = TEV_SYNC;
+		sync->reserved = 0;
+		sync->arg0 = pause_ms / 1000 > 0xFFFF ? 0xFFFF : pause_ms / 1000;
+		sync->arg1 = now_ms;
+		trace_count++;
+	}
+	trace_last_ms = now_ms;
+	trace_event_s *event = &trace_ring[trace_count % TRACE_SIZE];
+	event->time_us = micros();
+	event->id = id;
+	event->reserved = 0;
+	event->arg0 = arg0;
+	event->arg1 = arg1;
+	trace_count++;
+	interrupts();
+}
+
+/**
+ * @brief Start the trace with a sync event and the boot event with the reset reason
+ *
+ */
+void trace_init(void)
+{
+	trace_count = 0;
+	trace_last_ms = millis();
+	trace_add(TEV_SYNC, 0, millis());
+	trace_add(TEV_BOOT, 0, NRF_POWER->RESETREAS);
+}
+
+/**
+ * @brief Clear the trace
+ *
+ */
+void trace_reset(void)
+{
+	noInterrupts();
+	trace_count = 0;
+	interrupts();
+	trace_add(TEV_SYNC, 0, millis());
+}
+
+/**
+ * @brief Format the trace as hex lines
+ *        First line TRACE:<recorded events>:<events in the dump>:<millis>:<micros>:<millis of the last event>
+ *        Then TRACE_PER_LINE events per line, each 24 hex characters, little endian as in RAM, oldest event first
+ *
+ * @param idx line index
+ * @param line output buffer, at least TRACE_PER_LINE * 24 + 1 bytes
+ * @param size size of the output buffer
+ * @return int length of the line, -1 after the last line
+ */
+int trace_format(uint8_t idx, char *line, size_t size)
+{
+	// Snapshot of the ring position, events recorded during the dump can overwrite the oldest lines
+	static uint32_t count = 0;
+	static uint32_t first = 0;
+	if (idx == 0)
+	{
+		count = trace_count;
+		first = count > TRACE_SIZE ? count - TRACE_SIZE : 0;
+		return snprintf(line, size, "TRACE:%ld:%ld:%ld:%ld:%ld", count, count - first, millis(), micros(), trace_last_ms);
+	}
+	uint32_t start = first + (uint32_t)(idx - 1) * TRACE_PER_LINE;
+	if (start >= count)
+	{
+		return -1;
+	}
+	int len = 0;
+	for (uint32_t num = start; (num < count) && (num < start + TRACE_PER_LINE); num++)
+	{
+		const uint8_t *bytes = (const uint8_t *)&trace_ring[num % TRACE_SIZE];
+		for (uint8_t byte = 0; (byte < sizeof(trace_event_s)) && ((size_t)len + 3 <= size); byte++)
+		{
+			len += snprintf(&line[len], size - len, "%02X", bytes[byte]);
+		}
+	}
+	return len;
+}
+
+/**
+ * @brief Save the trace to the SD card after a fault
+ *        At most once per TRACE_SAVE_INTERVAL, repeated faults do not fill the card
+ *
+ * @param reason trace_event_num_t of the fault, recorded before the trace is saved
+ * @param arg argument of the fault
+ */
+void trace_fault(uint8_t reason, uint16_t arg)
+{
+	trace_add(reason, arg, 0);
+	if (!has_sd || g_settings_ui)
+	{
+		return;
+	}
+	if (trace_saved && ((millis() - trace_saved_ms) < TRACE_SAVE_INTERVAL))
+	{
+		return;
+	}
+	trace_saved = true;
+	trace_saved_ms = millis();
+	bool result = write_sd_lines(TRACE_FILE_NAME, trace_format);
+	trace_add(TEV_TRACE_SAVED, result, 0);
+}
@@ -0,0 +1,165 @@
+import sys
+import struct
+
+# Decoder for the event trace of the Signal Meter
+# Input is the output of ATC+TRACE=? or the trace.txt file from the SD card
+# Usage: python trace_decoder.py <file>
+# Prints one line per event: time since boot, time since the previous event, event and arguments
+
+# Event names, must match trace_event_num_t in app.h
+EVENTS = [
+	"SYNC",
+	"BOOT",
+	"TX_START",
+	"TX_ERROR",
+	"TX_DONE",
+	"RX",
+	"RX_TIMEOUT",
+	"JOIN",
+	"LINKCHECK",
+	"GNSS_POLL",
+	"SD_BEGIN",
+	"SD_END",
+	"DISPLAY",
+	"BUTTON",
+	"GESTURE",
+	"CYCLE_TIMEOUT",
+	"TRACE_SAVED",
+]
+
+# Names of the test cycle states, must match cycle_state_names in test_cycle.h
+CYCLE_STATES = ["idle", "acquire", "tx", "wait_rx", "log", "display"]
+
+# Size of one event in hex characters
+EVENT_HEX = 24
+
+
+def s16(value):
+	return value - 0x10000 if value & 0x8000 else value
+
+
+def s32(value):
+	return value - 0x100000000 if value & 0x80000000 else value
+
+
+def describe(event_id, arg0, arg1):
+	if event_id == 0:
+		return "millis %d pause %d s" % (arg1, arg0)
+	if event_id == 1:
+		return "reset reason 0x%08X" % arg1
+	if event_id == 2:
+		return ("P2P" if arg0 == 0 else "fPort %d" % arg0) + " len %d" % arg1
+	if event_id == 3:
+		return "fPort %d" % arg0
+	if event_id in (4, 7):
+		return "status %d" % s16(arg0)
+	if event_id == 5:
+		return "RSSI %d SNR %d" % (s16(arg0), s32(arg1))
+	if event_id == 8:
+		return "state %d gateways %d RSSI %d" % (arg0 >> 8, arg0 & 0xFF, s32(arg1))
+	if event_id == 9:
+		return ("location" if arg0 else "no location") + " sat %d" % arg1
+	if event_id == 10:
+		return "lines %d" % arg0
+	if event_id == 11:
+		return ("OK" if arg0 else "ERROR") + " lines %d" % arg1
+	if event_id == 12:
+		return "reason %d age %d ms" % (arg0, arg1)
+	if event_id == 13:
+		return ("pressed" if arg1 else "released") + " buffered %d" % arg0
+	if event_id == 14:
+		return "status %d" % arg0
+	if event_id == 15:
+		return "in " + (CYCLE_STATES[arg0] if arg0 < len(CYCLE_STATES) else str(arg0))
+	if event_id == 16:
+		return "OK" if arg0 else "ERROR"
+	return "0x%04X 0x%08X" % (arg0, arg1)
+
+
+def decode(header, hex_lines):
+	# Header TRACE:<recorded events>:<events in the dump>:<millis>:<micros>:<millis of the last event>
+	fields = header.split(":")
+	last_ms = int(fields[5])
+
+	events = []
+	for line in hex_lines:
+		raw = bytes.fromhex(line)
+		for pos in range(0, len(raw), EVENT_HEX // 2):
+			events.append(struct.unpack_from("<IBxHI", raw, pos))
+	if len(events) == 0:
+		print("Trace is empty")
+		return
+
+	# The microsecond timestamp wraps after 71 minutes. Two events are never more than 30 minutes apart
+	# without a sync event in between, the sync event has the exact millis() and the length of the pause.
+	times = [0.0] * len(events)
+	first_sync = None
+	for idx, (time_us, event_id, arg0, arg1) in enumerate(events):
+		if event_id == 0:
+			times[idx] = float(arg1)
+			if first_sync is None:
+				first_sync = idx
+		elif idx > 0:
+			times[idx] = times[idx - 1] + ((time_us - events[idx - 1][0]) & 0xFFFFFFFF) / 1000.0
+
+	# Events before the first sync event, the oldest part of the ring, are counted back from its end
+	end = len(events) if first_sync is None else first_sync
+	if end > 0:
+		if first_sync is None:
+			end_ms = float(last_ms)
+		elif events[first_sync][2] != 0:
+			# Pause known with 1 s resolution
+			end_ms = events[first_sync][3] - events[first_sync][2] * 1000.0
+		else:
+			end_ms = events[first_sync][3] - ((events[first_sync][0] - events[end - 1][0]) & 0xFFFFFFFF) / 1000.0
+		shift = end_ms - times[end - 1]
+		for idx in range(end):
+			times[idx] += shift
+
+	print("%d events recorded, %d in the trace" % (int(fields[1]), len(events)))
+	print("%12s %10s  %-14s %s" % ("time ms", "delta ms", "event", "arguments"))
+	sd_begin = None
+	for idx, (time_us, event_id, arg0, arg1) in enumerate(events):
+		delta = times[idx] - times[idx - 1] if idx > 0 else 0
+		name = EVENTS[event_id] if event_id < len(EVENTS) else "EVENT_%d" % event_id
+		text = describe(event_id, arg0, arg1)
+		if event_id == 10:
+			sd_begin = times[idx]
+		elif (event_id == 11) and (sd_begin is not None):
+			text += " took %.1f ms" % (times[idx] - sd_begin)
+			sd_begin = None
+		print("%12.1f %10.1f  %-14s %s" % (times[idx], delta, name, text))
+
+
+def main():
+	if len(sys.argv) != 2:
+		print("Usage: python trace_decoder.py <file>")
+		sys.exit(1)
+
+	with open(sys.argv[1]) as f:
+		lines = [line.strip() for line in f]
+
+	# A file can contain more than one trace, e.g. trace.txt after several faults
+	header = None
+	hex_lines = []
+	for line in lines:
+		if line.startswith("TRACE:"):
+			if header is not None:
+				decode(header, hex_lines)
+				print()
+			header = line
+			hex_lines = []
+		elif (header is not None) and (len(line) > 0) and (len(line) % EVENT_HEX == 0):
+			try:
+				bytes.fromhex(line)
+			except ValueError:
+				continue
+			hex_lines.append(line)
+	if header is None:
+		print("No trace found")
+		sys.exit(1)
+	decode(header, hex_lines)
+
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,559 @@
+/**
+ * @file uplink.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief TX buffer pool for LoRaWAN uplinks
+ *        Payloads are encoded in place into the buffer that is handed to api.lorawan.send
+ *        The required DR is calculated when the payload is encoded and again only if the region or the FOpts length changed
+ * @version 0.1
+ * @date 2024-12-28
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "app.h"
+
+/** Storage of the TX buffers */
+static uint8_t tx_storage[TX_BUFFER_NUM][TX_BUFFER_SIZE];
+
+/** TX buffer pool */
+static tx_buffer_s tx_pool[TX_BUFFER_NUM];
+
+/** Payload for FieldTester and LinkCheck with location */
+tx_buffer_s *g_tx_payload = NULL;
+
+/** Custom packet payload, points directly to the packet in the settings */
+tx_buffer_s g_custom_payload = {g_custom_parameters.custom_packet, 0, 0, 0xFF, 0, true};
+
+/**
+ * @brief Get a free buffer from the pool
+ *
+ * @return tx_buffer_s* pointer to the buffer or NULL if the pool is exhausted
+ */
+tx_buffer_s *tx_buffer_alloc(void)
+{
+	for (uint8_t idx = 0; idx < TX_BUFFER_NUM; idx++)
+	{
+		if (!tx_pool[idx].in_use)
+		{
+			tx_pool[idx].data = tx_storage[idx];
+			tx_pool[idx].len = 0;
+			tx_pool[idx].min_dr = 0;
+			tx_pool[idx].band = 0xFF;
+			tx_pool[idx].fopts = 0;
+			tx_pool[idx].in_use = true;
+			return &tx_pool[idx];
+		}
+	}
+	MYLOG("UPLINK", "TX buffer pool exhausted");
+	return NULL;
+}
+
+/**
+ * @brief Return a buffer to the pool
+ *
+ * @param buffer buffer to release, NULL is ignored
+ */
+void tx_buffer_free(tx_buffer_s *buffer)
+{
+	if ((buffer != NULL) && (buffer != &g_custom_payload))
+	{
+		buffer->len = 0;
+		buffer->in_use = false;
+	}
+}
+
+/**
+ * @brief Get an empty payload buffer for FieldTester and LinkCheck with location
+ *        The pool has a buffer for each fixed user (TX_BUFFER_FIXED), the allocation cannot fail
+ *
+ * @return tx_buffer_s* pointer to the empty buffer
+ */
+tx_buffer_s *tx_payload_reset(void)
+{
+	if (g_tx_payload == NULL)
+	{
+		g_tx_payload = tx_buffer_alloc();
+	}
+	g_tx_payload->len = 0;
+	g_tx_payload->min_dr = 0;
+	g_tx_payload->band = 0xFF;
+	g_tx_payload->fopts = 0;
+	return g_tx_payload;
+}
+
+/**
+ * @brief Calculate the minimum DR for the current payload size
+ *        Called after the payload is encoded
+ *
+ * @param buffer payload buffer
+ */
+void tx_buffer_set_dr(tx_buffer_s *buffer)
+{
+	buffer->band = api.lorawan.band.get();
+	buffer->fopts = get_fopts_len();
+	buffer->min_dr = get_min_dr(buffer->band, buffer->len);
+	MYLOG("UPLINK", "Payload len %d requires DR%d", buffer->len, buffer->min_dr);
+}
+
+/**
+ * @brief Check if the minimum DR of a payload is still valid
+ *        It depends on the region and on the FOpts length, which changes after the time sync
+ *
+ * @param buffer payload buffer
+ * @return true min_dr can be used
+ * @return false min_dr must be calculated again
+ */
+bool tx_buffer_dr_valid(tx_buffer_s *buffer)
+{
+	return (buffer->band == api.lorawan.band.get()) && (buffer->fopts == get_fopts_len());
+}
+
+/**
+ * @brief Get the custom packet payload without copying it
+ *        The DR is recalculated only if the packet length, the region or the FOpts length changed
+ *
+ * @return tx_buffer_s* custom packet payload
+ */
+tx_buffer_s *tx_custom_payload(void)
+{
+	if ((g_custom_payload.len != g_custom_parameters.custom_packet_len) || !tx_buffer_dr_valid(&g_custom_payload))
+	{
+		g_custom_payload.len = g_custom_parameters.custom_packet_len;
+		tx_buffer_set_dr(&g_custom_payload);
+	}
+	return &g_custom_payload;
+}
+
+/**
+ * @brief Encode the location in the FieldTester format of the current test mode
+ *        V1 format for FieldTester and LinkCheck, V2 format for FieldTester V2
+ *
+ * @param buffer payload buffer
+ * @param latitude Latitude as read from the GNSS receiver
+ * @param longitude Longitude as read from the GNSS receiver
+ * @param altitude Altitude in meter
+ * @param accuracy HDOP as read from the GNSS receiver
+ * @param sats Number of satellites
+ * @return true payload encoded
+ * @return false payload does not fit into the buffer
+ */
+bool tx_buffer_add_gnss(tx_buffer_s *buffer, int32_t latitude, int32_t longitude, int16_t altitude, float accuracy, int8_t sats)
+{
+	int32_t values[5];
+	values[FT_LAT] = latitude;
+	values[FT_LNG] = longitude;
+
+	if (g_custom_parameters.test_mode == MODE_FIELDTESTER_V2)
+	{
+		if ((buffer->len + ft_v2_codec::size) > TX_BUFFER_SIZE)
+		{
+			return false;
+		}
+		values[FT_V2_SEQ] = (uint16_t)packet_num;
+		buffer->len += ft_v2_codec::encode(&buffer->data[buffer->len], values);
+	}
+	else
+	{
+		if ((buffer->len + ft_v1_codec::size) > TX_BUFFER_SIZE)
+		{
+			return false;
+		}
+		values[FT_ALT] = altitude;
+		values[FT_HDOP] = (int32_t)accuracy;
+		values[FT_SATS] = (uint8_t)sats;
+		buffer->len += ft_v1_codec::encode(&buffer->data[buffer->len], values);
+	}
+	tx_buffer_set_dr(buffer);
+	return true;
+}
+
+/**
+ * @brief Check if payload fits with current DR
+ *        Uses the DR calculated at encode time, recalculated only if the region or the FOpts length changed
+ *
+ * @param buffer payload buffer
+ * @return true Packet size ok
+ * @return false Packet is too large
+ */
+bool tx_buffer_check_dr(tx_buffer_s *buffer)
+{
+	if (!tx_buffer_dr_valid(buffer))
+	{
+		tx_buffer_set_dr(buffer);
+	}
+	if (buffer->min_dr <= api.lorawan.dr.get())
+	{
+		return true;
+	}
+
+	MYLOG("UPLINK", "Datarate DR%d doesn't allow packet size %d", api.lorawan.dr.get(), buffer->len);
+	if (has_oled && !g_settings_ui)
+	{
+		oled_add_line((char *)"Packet too large!");
+		sprintf(line_str, "Requires DR%d", buffer->min_dr);
+		oled_add_line(line_str);
+	}
+	tx_active = false;
+	// Do not send packet
+	return false;
+}
+
+/** Batched uplink payload */
+tx_buffer_s *g_batch_payload = NULL;
+
+/** Number of samples in the batched uplink */
+uint8_t g_batch_count = 0;
+
+/** Position of the last sample as the decoder sees it, deltas are relative to it */
+static int32_t batch_last[3];
+
+/** Time of the last sample as the decoder sees it, the time changes are relative to it */
+static uint32_t batch_last_ms = 0;
+
+/** Number of gateways, RSSI and SNR of the last LinkCheck, sent once per batch in the header */
+static int32_t batch_link[5];
+
+/** Sample that could not be added to the last batch, starts the next batch */
+static int32_t batch_pending[3];
+
+/** Time of the pending sample */
+static uint32_t batch_pending_ms = 0;
+
+/** Flag if a sample is pending */
+static bool batch_has_pending = false;
+
+/**
+ * @brief Write the batch header with the current number of samples, the age of the last sample and the last LinkCheck result
+ *
+ */
+static void batch_write_header(void)
+{
+	uint32_t age = (millis() - batch_last_ms) / 1000;
+	batch_link[BATCH_COUNT] = g_batch_count;
+	batch_link[BATCH_AGE] = age > BATCH_TIME_MAX ? BATCH_TIME_MAX : age;
+	batch_head_codec::encode(g_batch_payload->data, batch_link);
+}
+
+/**
+ * @brief Start a new batch with a keyframe
+ *
+ * @param values sample position, indexed by batch_field_num_t
+ * @param sample_ms time of the sample
+ */
+static void batch_start(const int32_t *values, uint32_t sample_ms)
+{
+	if (g_batch_payload == NULL)
+	{
+		g_batch_payload = tx_buffer_alloc();
+	}
+	g_batch_count = 1;
+	batch_last[BATCH_LAT] = values[BATCH_LAT];
+	batch_last[BATCH_LNG] = values[BATCH_LNG];
+	batch_last[BATCH_ALT] = values[BATCH_ALT];
+	batch_last_ms = sample_ms;
+	batch_write_header();
+	g_batch_payload->len = batch_head_codec::size;
+	g_batch_payload->len += batch_key_codec::encode(&g_batch_payload->data[g_batch_payload->len], values);
+}
+
+/**
+ * @brief Check if a payload of this size can be sent with the current DR
+ *
+ * @param len payload size
+ * @return true payload fits
+ * @return false payload is too large
+ */
+static bool batch_fits(uint16_t len)
+{
+	return (len <= TX_BUFFER_SIZE) && (len <= get_max_payload(api.lorawan.band.get(), api.lorawan.dr.get()));
+}
+
+/**
+ * @brief Add a sample to the batched uplink
+ *        First sample is a keyframe, following samples are stored as position and time changes
+ *        A sample that cannot be stored as a change is kept as keyframe for the next batch
+ *        The LinkCheck result is stored once in the header, the samples are taken before its answer
+ *
+ * @param latitude Latitude as read from the GNSS receiver
+ * @param longitude Longitude as read from the GNSS receiver
+ * @param altitude Altitude in meter
+ * @param rssi RSSI of the last downlink
+ * @param snr SNR of the last downlink
+ * @param gateways Number of gateways from the last LinkCheck
+ * @return true batch is complete and should be sent
+ * @return false batch has room for more samples
+ */
+bool batch_add_sample(int32_t latitude, int32_t longitude, int16_t altitude, int16_t rssi, int8_t snr, uint8_t gateways)
+{
+	uint32_t sample_ms = millis();
+	int32_t values[3];
+	values[BATCH_LAT] = latitude;
+	values[BATCH_LNG] = longitude;
+	values[BATCH_ALT] = altitude;
+	batch_link[BATCH_RSSI] = rssi < -200 ? -200 : (rssi > 55 ? 55 : rssi);
+	batch_link[BATCH_SNR] = snr;
+	batch_link[BATCH_GW] = gateways;
+
+	if (g_batch_count == 0)
+	{
+		batch_start(values, sample_ms);
+	}
+	else
+	{
+		int32_t delta[4];
+		delta[BATCH_LAT] = latitude - batch_last[BATCH_LAT];
+		delta[BATCH_LNG] = longitude - batch_last[BATCH_LNG];
+		delta[BATCH_ALT] = altitude - batch_last[BATCH_ALT];
+		uint32_t time = (sample_ms - batch_last_ms) / 1000;
+
+		if ((delta[BATCH_LAT] >= BATCH_DELTA_POS_MAX) || (delta[BATCH_LAT] < -BATCH_DELTA_POS_MAX) ||
+			(delta[BATCH_LNG] >= BATCH_DELTA_POS_MAX) || (delta[BATCH_LNG] < -BATCH_DELTA_POS_MAX) ||
+			(delta[BATCH_ALT] > BATCH_DELTA_ALT_MAX) || (delta[BATCH_ALT] < -BATCH_DELTA_ALT_MAX) ||
+			(time > BATCH_TIME_MAX) || !batch_fits(g_batch_payload->len + batch_delta_codec::size))
+		{
+			MYLOG("UPLINK", "Sample doesn't fit, keep it for next batch");
+			memcpy(batch_pending, values, sizeof(batch_pending));
+			batch_pending_ms = sample_ms;
+			batch_has_pending = true;
+			batch_write_header();
+			tx_buffer_set_dr(g_batch_payload);
+			return true;
+		}
+		delta[BATCH_TIME] = time;
+
+		uint8_t *delta_buffer = &g_batch_payload->data[g_batch_payload->len];
+		g_batch_payload->len += batch_delta_codec::encode(delta_buffer, delta);
+
+		// Continue from the position and time the decoder will calculate to avoid adding up rounding errors
+		batch_delta_codec::decode(delta_buffer, batch_delta_codec::size, delta);
+		batch_last[BATCH_LAT] += delta[BATCH_LAT];
+		batch_last[BATCH_LNG] += delta[BATCH_LNG];
+		batch_last[BATCH_ALT] += delta[BATCH_ALT];
+		batch_last_ms += delta[BATCH_TIME] * 1000;
+
+		g_batch_count++;
+		batch_write_header();
+	}
+	tx_buffer_set_dr(g_batch_payload);
+	MYLOG("UPLINK", "Batch has %d samples, %d bytes", g_batch_count, g_batch_payload->len);
+
+	// Complete if all samples are collected or the next sample would not fit the current DR
+	return (g_batch_count >= g_custom_parameters.batch_samples) || !batch_fits(g_batch_payload->len + batch_delta_codec::size);
+}
+
+/**
+ * @brief Clear the batch after it was sent
+ *        A pending sample becomes the keyframe of the next batch
+ *
+ */
+void batch_reset(void)
+{
+	g_batch_count = 0;
+	if (g_batch_payload != NULL)
+	{
+		g_batch_payload->len = 0;
+	}
+	if (batch_has_pending)
+	{
+		batch_has_pending = false;
+		batch_start(batch_pending, batch_pending_ms);
+		tx_buffer_set_dr(g_batch_payload);
+	}
+}
+
+/**
+ * @brief Send a payload as confirmed uplink and record its time on air
+ *
+ * @param buffer payload buffer
+ * @param port fPort
+ * @return true uplink was started
+ * @return false LoRaWAN send returned an error
+ */
+bool tx_send(tx_buffer_s *buffer, uint8_t port)
+{
+	trace_add(TEV_TX_START, port, buffer->len);
+	if (!api.lorawan.send(buffer->len, buffer->data, port, true, 0))
+	{
+		trace_add(TEV_TX_ERROR, port);
+		return false;
+	}
+	dc_add_tx(buffer->len);
+	dc_update_auto_interval();
+
+	int32_t budget = dc_get_budget_left();
+	if ((budget >= 0) && has_oled && !g_settings_ui)
+	{
+		sprintf(line_str, "Airtime left %ld.%ld s", budget / 1000, (budget % 1000) / 100);
+		oled_add_line(line_str);
+	}
+	return true;
+}
+
+/** Fragment id of the current custom packet */
+static uint8_t frag_id = 0;
+
+/** Offset of the next fragment in the custom packet */
+static uint8_t frag_offset = 0;
+
+/** Flag if a fragmented packet is in progress */
+static bool frag_active = false;
+
+/** Flag if the last sent fragment completes the packet */
+static bool frag_last = false;
+
+/** Flag if all fragments of the current packet were acknowledged */
+static bool frag_all_ok = true;
+
+/** Flag if the result of a fragment is expected */
+static volatile bool frag_pending = false;
+
+/** Flag if the send timer was shortened for the next fragment */
+static bool frag_timer_shifted = false;
+
+/** Fragment delivery statistics */
+frag_stats_s g_frag_stats = {0, 0, 0, 0};
+
+/**
+ * @brief Check if the custom packet is sent in fragments
+ *
+ * @return true fragmentation is enabled and the packet does not fit the current DR, or a packet is in progress
+ */
+bool frag_needed(void)
+{
+	if (frag_active)
+	{
+		return true;
+	}
+	return g_custom_parameters.fragment_on && (tx_custom_payload()->min_dr > api.lorawan.dr.get());
+}
+
+/**
+ * @brief Encode the next fragment of the custom packet
+ *        The fragment size follows the max payload of the current DR, DR changes between fragments are possible
+ *        The offset is only moved by frag_send() after the stack accepted the fragment
+ *
+ * @param chunk number of packet bytes in the fragment
+ * @return tx_buffer_s* fragment payload or NULL if the DR does not allow a fragment
+ */
+static tx_buffer_s *frag_next(uint8_t *chunk)
+{
+	uint8_t max_payload = get_max_payload(api.lorawan.band.get(), api.lorawan.dr.get());
+	if (max_payload <= frag_head_codec::size)
+	{
+		return NULL;
+	}
+	if (frag_active && (frag_offset >= g_custom_parameters.custom_packet_len))
+	{
+		// Custom packet was changed, start again
+		frag_active = false;
+	}
+	if (!frag_active)
+	{
+		// Start a new packet
+		frag_id++;
+		frag_offset = 0;
+		frag_all_ok = true;
+		frag_active = true;
+		g_frag_stats.packets++;
+	}
+
+	tx_buffer_s *buffer = tx_payload_reset();
+	*chunk = frag_encode(buffer->data, max_payload, frag_id, g_custom_parameters.custom_packet,
+						 g_custom_parameters.custom_packet_len, frag_offset);
+	buffer->len = frag_head_codec::size + *chunk;
+	tx_buffer_set_dr(buffer);
+	return buffer;
+}
+
+/**
+ * @brief Send the next fragment of the custom packet
+ *        If more fragments follow, the send timer is shortened to FRAG_INTERVAL_MS
+ *        A fragment refused by the stack (busy, duty cycle) is sent again with the next timer
+ *
+ * @return true uplink was started
+ * @return false fragment could not be sent
+ */
+bool frag_send(void)
+{
+	uint8_t chunk = 0;
+	tx_buffer_s *buffer = frag_next(&chunk);
+	if (buffer == NULL)
+	{
+		MYLOG("UPLINK", "DR%d too small for fragments", api.lorawan.dr.get());
+		if (has_oled && !g_settings_ui)
+		{
+			oled_add_line((char *)"Packet too large!");
+		}
+		return false;
+	}
+
+	MYLOG("UPLINK", "Fragment %d bytes %d-%d of %d", frag_id, frag_offset, frag_offset + chunk - 1, g_custom_parameters.custom_packet_len);
+	if (has_oled && !g_settings_ui)
+	{
+		sprintf(line_str, "Fragment %d-%d of %d", frag_offset, frag_offset + chunk - 1, g_custom_parameters.custom_packet_len);
+		oled_add_line(line_str);
+	}
+
+	bool result = tx_send(buffer, FRAG_FPORT);
+	if (result)
+	{
+		g_frag_stats.sent++;
+		frag_pending = true;
+		frag_offset += chunk;
+		frag_last = frag_offset >= g_custom_parameters.custom_packet_len;
+		frag_active = !frag_last;
+	}
+	else
+	{
+		MYLOG("UPLINK", "Fragment refused, send it again");
+	}
+
+	// Shorten the send interval until the packet is complete
+	if (!dr_sweep_active)
+	{
+		if (frag_active)
+		{
+			api.system.timer.stop(RAK_TIMER_0);
+			lat_timer_start(RAK_TIMER_0, FRAG_INTERVAL_MS, NULL);
+			frag_timer_shifted = true;
+		}
+		else if (frag_timer_shifted)
+		{
+			frag_timer_shifted = false;
+			api.system.timer.stop(RAK_TIMER_0);
+			if (get_send_period() != 0)
+			{
+				lat_timer_start(RAK_TIMER_0, get_send_period(), NULL);
+			}
+		}
+	}
+	return result;
+}
+
+/**
+ * @brief Add the result of a fragment to the statistics
+ *        Called from the LoRaWAN callbacks, only the first result of a fragment is counted
+ *
+ * @param success true if the LinkCheck answer was received
+ */
+void frag_add_result(bool success)
+{
+	if (!frag_pending)
+	{
+		return;
+	}
+	frag_pending = false;
+	if (success)
+	{
+		g_frag_stats.ok++;
+	}
+	else
+	{
+		frag_all_ok = false;
+	}
+	if (frag_last && frag_all_ok)
+	{
+		g_frag_stats.complete++;
+	}
+	MYLOG("UPLINK", "Fragments %d/%d delivered, packets %d/%d complete", g_frag_stats.ok, g_frag_stats.sent, g_frag_stats.complete, g_frag_stats.packets);
+}
@@ -14,6 +14,7 @@
 // #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <CayenneLPP.h>
+#include "payload_codec.h"
 
 #define LPP_GPS4 136 // 3 byte lon/lat 0.0001 °, 3 bytes alt 0.01 meter (Cayenne LPP default)
 #define LPP_GPS6 137 // 4 byte lon/lat 0.000001 °, 3 bytes alt 0.01 meter (Customized Cayenne LPP, higher precision)